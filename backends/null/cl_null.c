@@ -21,7 +21,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // cl_null.c -- this file can stub out the entire client system
 // for pure dedicated servers
 
-#include "../qcommon/qcommon.h"
+#include "../../qcommon/qcommon.h"
+
+// set by the client, pmove falls back to the defaults without one
+struct image_s	*load_saveshot;
+player_state_t	*clientstate;
 
 void Key_Bind_Null_f(void)
 {
@@ -35,11 +39,15 @@ void CL_Drop (void)
 {
 }
 
+void CL_BenchAbort (const char *error)
+{
+}
+
 void CL_Shutdown (void)
 {
 }
 
-void CL_Frame (int msec)
+void CL_Frame (int32_t msec)
 {
 }
 
@@ -55,7 +63,7 @@ void Cmd_ForwardToServer (void)
 	Com_Printf ("Unknown command \"%s\"\n", cmd);
 }
 
-void SCR_DebugGraph (float value, int color)
+void SCR_DebugGraph (float value, int32_t color)
 {
 }
 
@@ -72,3 +80,24 @@ void Key_Init (void)
 	Cmd_AddCommand ("bind", Key_Bind_Null_f);
 }
 
+void R_GrabScreen (void)
+{
+}
+
+void R_ScaledScreenshot (char *name)
+{
+}
+
+void R_FreePic (char *name)
+{
+}
+
+struct image_s *R_DrawFindPic (char *name)
+{
+	return NULL;
+}
+
+qboolean LegacyProtocol (void)
+{
+	return false;	// the server always uses the new protocol
+}
@@ -8,7 +8,7 @@ of the License, or (at your option) any later version.
 
 This program is distributed in the hope that it will be useful,
 but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
 
 See the GNU General Public License for more details.
 
@@ -17,37 +17,62 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
-#include "../ref_gl/gl_local.h"
+/*
+** GLIMP_NULL.C
+**
+** Window system glue for the headless build.  There is no window and no
+** context, the mode is whatever vid_width and vid_height ask for and the
+** GL calls land in qgl_null.c.
+*/
+#include "../../client/renderer/include/r_local.h"
 
-void		GLimp_BeginFrame( float camera_separation )
+void GLimp_SetFullscreen (qboolean enable)
 {
 }
 
-void		GLimp_EndFrame( void )
+rserr_t GLimp_SetMode (int32_t *pwidth, int32_t *pheight)
 {
-}
+	int32_t width = Cvar_VariableInteger("vid_width");
+	int32_t height = Cvar_VariableInteger("vid_height");
 
-int 		GLimp_Init( void *hinstance, void *hWnd )
-{
+	if (width <= 0 || height <= 0)
+	{
+		width = 640;
+		height = 480;
+	}
+
+	VID_Printf (PRINT_ALL, "Initializing null display at %ix%i\n", width, height);
+
+	glConfig.have_stencil = true;
+	glConfig.refresh_rate = 60;
+	glConfig.srgb_framebuffer = 0;
+	Cvar_SetInteger ("vid_srgb", 0);
+	glConfig.window_width = width;
+	glConfig.window_height = height;
+
+	VID_NewWindow (width, height);
+	*pwidth = width;
+	*pheight = height;
+	return rserr_ok;
 }
 
-void		GLimp_Shutdown( void )
+void GLimp_Shutdown (void)
 {
 }
 
-int     	GLimp_SetMode( int *pwidth, int *pheight, int mode, qboolean fullscreen )
+qboolean GLimp_Init (void)
 {
+	return true;
 }
 
-void		GLimp_AppActivate( qboolean active )
+void GLimp_BeginFrame (void)
 {
 }
 
-void		GLimp_EnableLogging( qboolean enable )
+void GLimp_EndFrame (void)
 {
 }
 
-void		GLimp_LogNewFrame( void )
+void GLimp_AppActivate (qboolean active)
 {
 }
-
@@ -0,0 +1,345 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// qgl_null.c -- GL entry points that do nothing
+//
+// Stands in for libGL and GLEW in the headless build, so the renderer runs
+// all of its CPU side (vis, world traversal, lightmaps, sorting) without a
+// context.  Queries answer like a minimal GL 2.1 driver that has every
+// extension R_Init asks for, object names are handed out in sequence and
+// shaders always compile.
+
+#include "../../client/renderer/include/r_local.h"
+
+static GLuint	null_names;
+
+/*
+==============================================================
+
+CORE 1.1
+
+==============================================================
+*/
+
+void GLAPIENTRY glAlphaFunc (GLenum func, GLclampf ref) {}
+void GLAPIENTRY glBegin (GLenum mode) {}
+void GLAPIENTRY glBindTexture (GLenum target, GLuint texture) {}
+void GLAPIENTRY glBlendFunc (GLenum sfactor, GLenum dfactor) {}
+void GLAPIENTRY glClear (GLbitfield mask) {}
+void GLAPIENTRY glClearColor (GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {}
+void GLAPIENTRY glClearDepth (GLclampd depth) {}
+void GLAPIENTRY glClearStencil (GLint s) {}
+void GLAPIENTRY glColor3f (GLfloat red, GLfloat green, GLfloat blue) {}
+void GLAPIENTRY glColor4f (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {}
+void GLAPIENTRY glColor4fv (const GLfloat *v) {}
+void GLAPIENTRY glColor4ub (GLubyte red, GLubyte green, GLubyte blue, GLubyte alpha) {}
+void GLAPIENTRY glColorMask (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) {}
+void GLAPIENTRY glColorPointer (GLint size, GLenum type, GLsizei stride, const void *pointer) {}
+void GLAPIENTRY glCullFace (GLenum mode) {}
+void GLAPIENTRY glDeleteTextures (GLsizei n, const GLuint *textures) {}
+void GLAPIENTRY glDepthFunc (GLenum func) {}
+void GLAPIENTRY glDepthMask (GLboolean flag) {}
+void GLAPIENTRY glDepthRange (GLclampd zNear, GLclampd zFar) {}
+void GLAPIENTRY glDisable (GLenum cap) {}
+void GLAPIENTRY glDisableClientState (GLenum array) {}
+void GLAPIENTRY glDrawArrays (GLenum mode, GLint first, GLsizei count) {}
+void GLAPIENTRY glDrawElements (GLenum mode, GLsizei count, GLenum type, const void *indices) {}
+void GLAPIENTRY glEnable (GLenum cap) {}
+void GLAPIENTRY glEnableClientState (GLenum array) {}
+void GLAPIENTRY glEnd (void) {}
+void GLAPIENTRY glFinish (void) {}
+void GLAPIENTRY glFogf (GLenum pname, GLfloat param) {}
+void GLAPIENTRY glFogfv (GLenum pname, const GLfloat *params) {}
+void GLAPIENTRY glFogi (GLenum pname, GLint param) {}
+void GLAPIENTRY glGetTexImage (GLenum target, GLint level, GLenum format, GLenum type, void *pixels) {}
+void GLAPIENTRY glHint (GLenum target, GLenum mode) {}
+void GLAPIENTRY glLineWidth (GLfloat width) {}
+void GLAPIENTRY glLoadIdentity (void) {}
+void GLAPIENTRY glLoadMatrixf (const GLfloat *m) {}
+void GLAPIENTRY glMatrixMode (GLenum mode) {}
+void GLAPIENTRY glMultMatrixf (const GLfloat *m) {}
+void GLAPIENTRY glOrtho (GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble zNear, GLdouble zFar) {}
+void GLAPIENTRY glPixelStorei (GLenum pname, GLint param) {}
+void GLAPIENTRY glPolygonMode (GLenum face, GLenum mode) {}
+void GLAPIENTRY glPolygonOffset (GLfloat factor, GLfloat units) {}
+void GLAPIENTRY glPopMatrix (void) {}
+void GLAPIENTRY glPushMatrix (void) {}
+void GLAPIENTRY glScalef (GLfloat x, GLfloat y, GLfloat z) {}
+void GLAPIENTRY glShadeModel (GLenum mode) {}
+void GLAPIENTRY glStencilFunc (GLenum func, GLint ref, GLuint mask) {}
+void GLAPIENTRY glStencilOp (GLenum fail, GLenum zfail, GLenum zpass) {}
+void GLAPIENTRY glTexCoord2f (GLfloat s, GLfloat t) {}
+void GLAPIENTRY glTexCoordPointer (GLint size, GLenum type, GLsizei stride, const void *pointer) {}
+void GLAPIENTRY glTexEnvf (GLenum target, GLenum pname, GLfloat param) {}
+void GLAPIENTRY glTexEnvi (GLenum target, GLenum pname, GLint param) {}
+void GLAPIENTRY glTexGenf (GLenum coord, GLenum pname, GLfloat param) {}
+void GLAPIENTRY glTexGeni (GLenum coord, GLenum pname, GLint param) {}
+void GLAPIENTRY glTexImage2D (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels) {}
+void GLAPIENTRY glTexParameterf (GLenum target, GLenum pname, GLfloat param) {}
+void GLAPIENTRY glTexParameteri (GLenum target, GLenum pname, GLint param) {}
+void GLAPIENTRY glTexSubImage2D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels) {}
+void GLAPIENTRY glVertex2f (GLfloat x, GLfloat y) {}
+void GLAPIENTRY glVertex3f (GLfloat x, GLfloat y, GLfloat z) {}
+void GLAPIENTRY glVertex3fv (const GLfloat *v) {}
+void GLAPIENTRY glVertexPointer (GLint size, GLenum type, GLsizei stride, const void *pointer) {}
+void GLAPIENTRY glViewport (GLint x, GLint y, GLsizei width, GLsizei height) {}
+
+GLenum GLAPIENTRY glGetError (void)
+{
+	return GL_NO_ERROR;
+}
+
+const GLubyte * GLAPIENTRY glGetString (GLenum name)
+{
+	switch (name)
+	{
+	case GL_VENDOR:
+	case GL_RENDERER:
+		return (const GLubyte *)"null";
+	case GL_VERSION:
+		return (const GLubyte *)"2.1 null";
+	case GL_SHADING_LANGUAGE_VERSION:
+		return (const GLubyte *)"1.20";
+	default:
+		return (const GLubyte *)"";
+	}
+}
+
+void GLAPIENTRY glGetIntegerv (GLenum pname, GLint *params)
+{
+	switch (pname)
+	{
+	case GL_MAX_TEXTURE_SIZE:
+		*params = 4096;
+		break;
+	case GL_MAX_TEXTURE_UNITS:
+		*params = 4;
+		break;
+	default:
+		*params = 0;
+		break;
+	}
+}
+
+void GLAPIENTRY glGetFloatv (GLenum pname, GLfloat *params)
+{
+	if (pname == GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT)
+		*params = 1.0f;
+	else
+		*params = 0.0f;
+}
+
+void GLAPIENTRY glGenTextures (GLsizei n, GLuint *textures)
+{
+	while (n-- > 0)
+		*textures++ = ++null_names;
+}
+
+/*
+==============================================================
+
+EXTENSIONS
+
+==============================================================
+*/
+
+static void GLAPIENTRY null_ActiveTexture (GLenum texture) {}
+static void GLAPIENTRY null_AttachShader (GLuint program, GLuint shader) {}
+static void GLAPIENTRY null_BindAttribLocation (GLuint program, GLuint index, const GLchar* name) {}
+static void GLAPIENTRY null_BindBuffer (GLenum target, GLuint buffer) {}
+static void GLAPIENTRY null_BindFramebufferEXT (GLenum target, GLuint framebuffer) {}
+static void GLAPIENTRY null_BindRenderbufferEXT (GLenum target, GLuint renderbuffer) {}
+static void GLAPIENTRY null_BufferData (GLenum target, GLsizeiptr size, const void* data, GLenum usage) {}
+static void GLAPIENTRY null_BufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {}
+static void GLAPIENTRY null_ClientActiveTexture (GLenum texture) {}
+static void GLAPIENTRY null_ColorTableEXT (GLenum target, GLenum internalFormat, GLsizei width, GLenum format, GLenum type, const void *data) {}
+static void GLAPIENTRY null_CompileShader (GLuint shader) {}
+static void GLAPIENTRY null_DeleteBuffers (GLsizei n, const GLuint* buffers) {}
+static void GLAPIENTRY null_DeleteFramebuffersEXT (GLsizei n, const GLuint* framebuffers) {}
+static void GLAPIENTRY null_DeleteProgram (GLuint program) {}
+static void GLAPIENTRY null_DeleteRenderbuffersEXT (GLsizei n, const GLuint* renderbuffers) {}
+static void GLAPIENTRY null_DeleteShader (GLuint shader) {}
+static void GLAPIENTRY null_DeleteSync (GLsync sync) {}
+static void GLAPIENTRY null_DisableVertexAttribArray (GLuint index) {}
+static void GLAPIENTRY null_DrawRangeElements (GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const void *indices) {}
+static void GLAPIENTRY null_EnableVertexAttribArray (GLuint index) {}
+static void GLAPIENTRY null_FramebufferRenderbufferEXT (GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer) {}
+static void GLAPIENTRY null_FramebufferTexture2DEXT (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) {}
+static void GLAPIENTRY null_GenerateMipmap (GLenum target) {}
+static void GLAPIENTRY null_LinkProgram (GLuint program) {}
+static void GLAPIENTRY null_LockArraysEXT (GLint first, GLsizei count) {}
+static void GLAPIENTRY null_MatrixLoadIdentityEXT (GLenum matrixMode) {}
+static void GLAPIENTRY null_MatrixLoadfEXT (GLenum matrixMode, const GLfloat* m) {}
+static void GLAPIENTRY null_MatrixMultfEXT (GLenum matrixMode, const GLfloat* m) {}
+static void GLAPIENTRY null_MatrixOrthoEXT (GLenum matrixMode, GLdouble l, GLdouble r, GLdouble b, GLdouble t, GLdouble n, GLdouble f) {}
+static void GLAPIENTRY null_MatrixPopEXT (GLenum matrixMode) {}
+static void GLAPIENTRY null_MatrixPushEXT (GLenum matrixMode) {}
+static void GLAPIENTRY null_RenderbufferStorageEXT (GLenum target, GLenum internalformat, GLsizei width, GLsizei height) {}
+static void GLAPIENTRY null_ShaderSource (GLuint shader, GLsizei count, const GLchar *const* string, const GLint* length) {}
+static void GLAPIENTRY null_StencilOpSeparate (GLenum face, GLenum sfail, GLenum dpfail, GLenum dppass) {}
+static void GLAPIENTRY null_Uniform1f (GLint location, GLfloat v0) {}
+static void GLAPIENTRY null_Uniform1fv (GLint location, GLsizei count, const GLfloat* value) {}
+static void GLAPIENTRY null_Uniform1i (GLint location, GLint v0) {}
+static void GLAPIENTRY null_Uniform2f (GLint location, GLfloat v0, GLfloat v1) {}
+static void GLAPIENTRY null_Uniform2fv (GLint location, GLsizei count, const GLfloat* value) {}
+static void GLAPIENTRY null_Uniform3f (GLint location, GLfloat v0, GLfloat v1, GLfloat v2) {}
+static void GLAPIENTRY null_Uniform4fv (GLint location, GLsizei count, const GLfloat* value) {}
+static void GLAPIENTRY null_UniformMatrix4fv (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {}
+static void GLAPIENTRY null_UnlockArraysEXT (void) {}
+static void GLAPIENTRY null_UseProgram (GLuint program) {}
+static void GLAPIENTRY null_VertexAttribPointer (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer) {}
+
+static void GLAPIENTRY null_GenNames (GLsizei n, GLuint *names)
+{
+	while (n-- > 0)
+		*names++ = ++null_names;
+}
+
+static GLuint GLAPIENTRY null_CreateProgram (void)
+{
+	return ++null_names;
+}
+
+static GLuint GLAPIENTRY null_CreateShader (GLenum type)
+{
+	return ++null_names;
+}
+
+static void GLAPIENTRY null_GetObjectiv (GLuint object, GLenum pname, GLint *param)
+{
+	if (pname == GL_COMPILE_STATUS || pname == GL_LINK_STATUS)
+		*param = GL_TRUE;
+	else
+		*param = 0;
+}
+
+static void GLAPIENTRY null_GetInfoLog (GLuint object, GLsizei bufSize, GLsizei *length, GLchar *infoLog)
+{
+	if (length)
+		*length = 0;
+	if (bufSize > 0)
+		infoLog[0] = 0;
+}
+
+static GLint GLAPIENTRY null_GetUniformLocation (GLuint program, const GLchar *name)
+{
+	return 0;
+}
+
+static GLenum GLAPIENTRY null_CheckFramebufferStatusEXT (GLenum target)
+{
+	return GL_FRAMEBUFFER_COMPLETE_EXT;
+}
+
+static GLsync GLAPIENTRY null_FenceSync (GLenum condition, GLbitfield flags)
+{
+	return (GLsync)&null_names;
+}
+
+static GLenum GLAPIENTRY null_ClientWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	return GL_ALREADY_SIGNALED;
+}
+
+#define	null_GenBuffers				null_GenNames
+#define	null_GenFramebuffersEXT		null_GenNames
+#define	null_GenRenderbuffersEXT	null_GenNames
+#define	null_GetProgramiv			null_GetObjectiv
+#define	null_GetShaderiv			null_GetObjectiv
+#define	null_GetProgramInfoLog		null_GetInfoLog
+#define	null_GetShaderInfoLog		null_GetInfoLog
+
+PFNGLACTIVETEXTUREPROC __glewActiveTexture = null_ActiveTexture;
+PFNGLATTACHSHADERPROC __glewAttachShader = null_AttachShader;
+PFNGLBINDATTRIBLOCATIONPROC __glewBindAttribLocation = null_BindAttribLocation;
+PFNGLBINDBUFFERPROC __glewBindBuffer = null_BindBuffer;
+PFNGLBINDFRAMEBUFFEREXTPROC __glewBindFramebufferEXT = null_BindFramebufferEXT;
+PFNGLBINDRENDERBUFFEREXTPROC __glewBindRenderbufferEXT = null_BindRenderbufferEXT;
+PFNGLBUFFERDATAPROC __glewBufferData = null_BufferData;
+PFNGLBUFFERSUBDATAPROC __glewBufferSubData = null_BufferSubData;
+PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC __glewCheckFramebufferStatusEXT = null_CheckFramebufferStatusEXT;
+PFNGLCLIENTACTIVETEXTUREPROC __glewClientActiveTexture = null_ClientActiveTexture;
+PFNGLCLIENTWAITSYNCPROC __glewClientWaitSync = null_ClientWaitSync;
+PFNGLCOLORTABLEEXTPROC __glewColorTableEXT = null_ColorTableEXT;
+PFNGLCOMPILESHADERPROC __glewCompileShader = null_CompileShader;
+PFNGLCREATEPROGRAMPROC __glewCreateProgram = null_CreateProgram;
+PFNGLCREATESHADERPROC __glewCreateShader = null_CreateShader;
+PFNGLDELETEBUFFERSPROC __glewDeleteBuffers = null_DeleteBuffers;
+PFNGLDELETEFRAMEBUFFERSEXTPROC __glewDeleteFramebuffersEXT = null_DeleteFramebuffersEXT;
+PFNGLDELETEPROGRAMPROC __glewDeleteProgram = null_DeleteProgram;
+PFNGLDELETERENDERBUFFERSEXTPROC __glewDeleteRenderbuffersEXT = null_DeleteRenderbuffersEXT;
+PFNGLDELETESHADERPROC __glewDeleteShader = null_DeleteShader;
+PFNGLDELETESYNCPROC __glewDeleteSync = null_DeleteSync;
+PFNGLDISABLEVERTEXATTRIBARRAYPROC __glewDisableVertexAttribArray = null_DisableVertexAttribArray;
+PFNGLDRAWRANGEELEMENTSPROC __glewDrawRangeElements = null_DrawRangeElements;
+PFNGLENABLEVERTEXATTRIBARRAYPROC __glewEnableVertexAttribArray = null_EnableVertexAttribArray;
+PFNGLFENCESYNCPROC __glewFenceSync = null_FenceSync;
+PFNGLFRAMEBUFFERRENDERBUFFEREXTPROC __glewFramebufferRenderbufferEXT = null_FramebufferRenderbufferEXT;
+PFNGLFRAMEBUFFERTEXTURE2DEXTPROC __glewFramebufferTexture2DEXT = null_FramebufferTexture2DEXT;
+PFNGLGENBUFFERSPROC __glewGenBuffers = null_GenBuffers;
+PFNGLGENFRAMEBUFFERSEXTPROC __glewGenFramebuffersEXT = null_GenFramebuffersEXT;
+PFNGLGENRENDERBUFFERSEXTPROC __glewGenRenderbuffersEXT = null_GenRenderbuffersEXT;
+PFNGLGENERATEMIPMAPPROC __glewGenerateMipmap = null_GenerateMipmap;
+PFNGLGETPROGRAMINFOLOGPROC __glewGetProgramInfoLog = null_GetProgramInfoLog;
+PFNGLGETPROGRAMIVPROC __glewGetProgramiv = null_GetProgramiv;
+PFNGLGETSHADERINFOLOGPROC __glewGetShaderInfoLog = null_GetShaderInfoLog;
+PFNGLGETSHADERIVPROC __glewGetShaderiv = null_GetShaderiv;
+PFNGLGETUNIFORMLOCATIONPROC __glewGetUniformLocation = null_GetUniformLocation;
+PFNGLLINKPROGRAMPROC __glewLinkProgram = null_LinkProgram;
+PFNGLLOCKARRAYSEXTPROC __glewLockArraysEXT = null_LockArraysEXT;
+PFNGLMATRIXLOADIDENTITYEXTPROC __glewMatrixLoadIdentityEXT = null_MatrixLoadIdentityEXT;
+PFNGLMATRIXLOADFEXTPROC __glewMatrixLoadfEXT = null_MatrixLoadfEXT;
+PFNGLMATRIXMULTFEXTPROC __glewMatrixMultfEXT = null_MatrixMultfEXT;
+PFNGLMATRIXORTHOEXTPROC __glewMatrixOrthoEXT = null_MatrixOrthoEXT;
+PFNGLMATRIXPOPEXTPROC __glewMatrixPopEXT = null_MatrixPopEXT;
+PFNGLMATRIXPUSHEXTPROC __glewMatrixPushEXT = null_MatrixPushEXT;
+PFNGLRENDERBUFFERSTORAGEEXTPROC __glewRenderbufferStorageEXT = null_RenderbufferStorageEXT;
+PFNGLSHADERSOURCEPROC __glewShaderSource = null_ShaderSource;
+PFNGLSTENCILOPSEPARATEPROC __glewStencilOpSeparate = null_StencilOpSeparate;
+PFNGLUNIFORM1FPROC __glewUniform1f = null_Uniform1f;
+PFNGLUNIFORM1FVPROC __glewUniform1fv = null_Uniform1fv;
+PFNGLUNIFORM1IPROC __glewUniform1i = null_Uniform1i;
+PFNGLUNIFORM2FPROC __glewUniform2f = null_Uniform2f;
+PFNGLUNIFORM2FVPROC __glewUniform2fv = null_Uniform2fv;
+PFNGLUNIFORM3FPROC __glewUniform3f = null_Uniform3f;
+PFNGLUNIFORM4FVPROC __glewUniform4fv = null_Uniform4fv;
+PFNGLUNIFORMMATRIX4FVPROC __glewUniformMatrix4fv = null_UniformMatrix4fv;
+PFNGLUNLOCKARRAYSEXTPROC __glewUnlockArraysEXT = null_UnlockArraysEXT;
+PFNGLUSEPROGRAMPROC __glewUseProgram = null_UseProgram;
+PFNGLVERTEXATTRIBPOINTERPROC __glewVertexAttribPointer = null_VertexAttribPointer;
+
+GLboolean __GLEW_ARB_sync = GL_TRUE;
+GLboolean __GLEW_ARB_texture_compression_bptc = GL_TRUE;
+GLboolean __GLEW_ARB_texture_float = GL_TRUE;
+GLboolean __GLEW_ARB_texture_rg = GL_TRUE;
+GLboolean __GLEW_ARB_vertex_array_object = GL_TRUE;
+GLboolean __GLEW_ARB_vertex_buffer_object = GL_TRUE;
+GLboolean __GLEW_EXT_compiled_vertex_array = GL_TRUE;
+GLboolean __GLEW_EXT_direct_state_access = GL_TRUE;
+GLboolean __GLEW_EXT_framebuffer_object = GL_TRUE;
+GLboolean __GLEW_EXT_framebuffer_sRGB = GL_TRUE;
+GLboolean __GLEW_EXT_packed_depth_stencil = GL_TRUE;
+GLboolean __GLEW_EXT_texture_compression_s3tc = GL_TRUE;
+GLboolean __GLEW_EXT_texture_filter_anisotropic = GL_TRUE;
+GLboolean __GLEW_EXT_texture_sRGB = GL_TRUE;
+
+#ifdef __linux__
+GLboolean __GLXEW_EXT_swap_control = GL_FALSE;
+GLboolean __GLXEW_EXT_swap_control_tear = GL_FALSE;
+#endif
@@ -108,6 +108,62 @@ int		Sys_Milliseconds (void)
 	return 0;
 }
 
+int		Sys_CPUCount (void)
+{
+	return 1;
+}
+
+void	*Sys_CreateThread (int (*func)(void *), void *data, const char *name)
+{
+	return NULL;
+}
+
+void	Sys_WaitThread (void *thread)
+{
+}
+
+void	*Sys_CreateSemaphore (int value)
+{
+	return NULL;
+}
+
+void	Sys_DestroySemaphore (void *sem)
+{
+}
+
+void	Sys_SemaphoreWait (void *sem)
+{
+}
+
+void	Sys_SemaphorePost (void *sem)
+{
+}
+
+int		Sys_AtomicAdd (volatile int *value, int add)
+{
+	int		old;
+
+	old = *value;
+	*value += add;
+	return old;
+}
+
+void	*Sys_MapFile (const char *path, int *length)
+{
+	return NULL;
+}
+
+void	Sys_UnmapFile (void *base, int length)
+{
+}
+
+int		Sys_ReadFileAt (FILE *f, int offset, void *buffer, int length)
+{
+	if (fseek(f, offset, SEEK_SET))
+		return -1;
+	return fread(buffer, 1, length, f);
+}
+
 void	Sys_Mkdir (char *path)
 {
 }
@@ -84,6 +84,113 @@ int32_t Sys_Milliseconds (void)
 	return curtime;
 }
 
+/*
+================
+Sys_Nanoseconds
+
+The first call must come from the main thread
+================
+*/
+uint64_t Sys_Nanoseconds (void)
+{
+	static uint64_t	base, freq;
+	uint64_t		count;
+
+	if (!freq)
+	{
+		freq = SDL_GetPerformanceFrequency();
+		base = SDL_GetPerformanceCounter();
+	}
+	count = SDL_GetPerformanceCounter() - base;
+	return (count / freq) * 1000000000 + (count % freq) * 1000000000 / freq;
+}
+
+/*
+================
+Sys_Microseconds
+================
+*/
+uint64_t Sys_Microseconds (void)
+{
+	return Sys_Nanoseconds () / 1000;
+}
+
+
+/*
+===============================================================================
+
+THREADS
+
+===============================================================================
+*/
+
+/*
+================
+Sys_CPUCount
+================
+*/
+int32_t Sys_CPUCount (void)
+{
+	return SDL_GetCPUCount();
+}
+
+/*
+================
+Sys_CreateThread
+================
+*/
+void *Sys_CreateThread (int32_t (*func)(void *), void *data, const char *name)
+{
+	return SDL_CreateThread (func, name, data);
+}
+
+/*
+================
+Sys_WaitThread
+================
+*/
+void Sys_WaitThread (void *thread)
+{
+	SDL_WaitThread ((SDL_Thread *)thread, NULL);
+}
+
+/*
+================
+Sys_CreateSemaphore
+================
+*/
+void *Sys_CreateSemaphore (int32_t value)
+{
+	return SDL_CreateSemaphore (value);
+}
+
+void Sys_DestroySemaphore (void *sem)
+{
+	SDL_DestroySemaphore ((SDL_sem *)sem);
+}
+
+void Sys_SemaphoreWait (void *sem)
+{
+	SDL_SemWait ((SDL_sem *)sem);
+}
+
+void Sys_SemaphorePost (void *sem)
+{
+	SDL_SemPost ((SDL_sem *)sem);
+}
+
+/*
+================
+Sys_AtomicAdd
+
+Returns the value before the add
+================
+*/
+int32_t Sys_AtomicAdd (volatile int32_t *value, int32_t add)
+{
+	return SDL_AtomicAdd ((SDL_atomic_t *)value, add);
+}
+
 
 #ifdef _WIN32
 /*
@@ -475,6 +582,12 @@ void Sys_Init (void)
 	SDL_version compiled;
 	SDL_version linked;
 
+#ifdef HEADLESS
+	// no display or sound card on build machines
+	SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+	SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+#endif
+
 	if (SDL_Init(SDL_INIT_EVENTS | SDL_INIT_VIDEO) != 0){
 		Sys_Error("SDL_Init failed!");
 	}
@@ -19,6 +19,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 // net_wins.c
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE		// recvmmsg / sendmmsg
+#endif
+
 #include "../../qcommon/qcommon.h"
 
 #include <unistd.h>
@@ -36,6 +40,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <libc.h>
 #endif
 
+// batched datagram calls, where the c library has them
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define	NET_MMSG
+#endif
+
 netadr_t	net_local_adr;
 
 #define	LOOPBACK	0x7f000001
@@ -61,6 +70,40 @@ int			ipx_sockets[2];
 int NET_Socket (const char *net_interface, int port);
 char *NET_ErrorString (void);
 
+#ifdef NET_MMSG
+#define	NET_RECV_BATCH	16
+#define	NET_SEND_BATCH	64
+#define	NET_SEND_POOL	(MAX_MSGLEN*4)
+
+// datagrams drained from a socket by one recvmmsg, handed out one
+// NET_GetPacket at a time
+typedef struct
+{
+	sizebuf_t	msgs[NET_RECV_BATCH];
+	struct sockaddr_in	from[NET_RECV_BATCH];
+	byte		data[NET_RECV_BATCH][MAX_MSGLEN];
+	int			get, count;
+} recvring_t;
+
+// datagrams held between NET_BeginBatch and NET_FlushPackets
+typedef struct
+{
+	qboolean	active;
+	int			socket;
+	int			count;
+	int			used;		// bytes of data in use
+	struct sockaddr_in	to[NET_SEND_BATCH];
+	struct iovec	iov[NET_SEND_BATCH];
+	byte		data[NET_SEND_POOL];
+} sendqueue_t;
+
+static recvring_t	recvrings[2];
+static sendqueue_t	sendqueues[2];
+static qboolean		net_nommsg;		// the kernel turned the calls down
+#endif
+
+cvar_t		*net_batch;
+
 //=============================================================================
 
 void NetadrToSockadr (netadr_t *a, struct sockaddr_in *s)
@@ -275,6 +318,114 @@ void NET_SendLoopPacket (netsrc_t sock, int length, void *data, netadr_t to)
 
 //=============================================================================
 
+#ifdef NET_MMSG
+/*
+==================
+NET_BatchUsable
+==================
+*/
+static qboolean NET_BatchUsable (void)
+{
+	return !net_nommsg && net_batch && net_batch->value;
+}
+
+/*
+==================
+NET_FillRecvRing
+
+Pulls every datagram waiting on the socket, up to NET_RECV_BATCH,
+with a single call.  Returns -1 with errno set on failure.
+==================
+*/
+static int NET_FillRecvRing (recvring_t *ring, int net_socket)
+{
+	struct mmsghdr	msgs[NET_RECV_BATCH];
+	struct iovec	iov[NET_RECV_BATCH];
+	int		i, ret;
+
+	memset (msgs, 0, sizeof(msgs));
+	for (i=0 ; i<NET_RECV_BATCH ; i++)
+	{
+		iov[i].iov_base = ring->data[i];
+		iov[i].iov_len = MAX_MSGLEN;
+		msgs[i].msg_hdr.msg_name = &ring->from[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(ring->from[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	ring->get = ring->count = 0;
+
+	ret = recvmmsg (net_socket, msgs, NET_RECV_BATCH, MSG_DONTWAIT, NULL);
+	if (ret == -1)
+	{
+		if (errno == ENOSYS)
+			net_nommsg = true;
+		return -1;
+	}
+
+	for (i=0 ; i<ret ; i++)
+	{
+		ring->msgs[i].data = ring->data[i];
+		ring->msgs[i].maxsize = MAX_MSGLEN;
+		ring->msgs[i].cursize = msgs[i].msg_len;
+		if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+			ring->msgs[i].cursize = MAX_MSGLEN;
+	}
+	ring->count = ret;
+
+	return ret;
+}
+
+/*
+==================
+NET_GetBatchedPacket
+
+Returns the next datagram from the receive ring, refilling it from the
+socket once it runs dry.
+==================
+*/
+static qboolean NET_GetBatchedPacket (netsrc_t sock, int net_socket, netadr_t *net_from, sizebuf_t *net_message)
+{
+	recvring_t	*ring;
+	sizebuf_t	*msg;
+	int		err;
+
+	ring = &recvrings[sock];
+
+	while (1)
+	{
+		if (ring->get == ring->count)
+		{
+			if (NET_FillRecvRing (ring, net_socket) == -1)
+			{
+				err = errno;
+				if (err == EWOULDBLOCK || err == ECONNREFUSED || err == ENOSYS)
+					return false;
+				Com_Printf ("NET_GetPacket: %s\n", NET_ErrorString());
+				return false;
+			}
+			if (!ring->count)
+				return false;
+		}
+
+		msg = &ring->msgs[ring->get];
+		SockadrToNetadr (&ring->from[ring->get], net_from);
+		ring->get++;
+
+		if (msg->cursize >= MAX_MSGLEN || msg->cursize >= net_message->maxsize)
+		{
+			Com_Printf ("Oversize packet from %s\n", NET_AdrToString (*net_from));
+			continue;
+		}
+
+		memcpy (net_message->data, msg->data, msg->cursize);
+		net_message->cursize = msg->cursize;
+		return true;
+	}
+}
+#endif
+
 qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 {
 	int 	ret;
@@ -297,6 +448,16 @@ qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_messag
 		if (!net_socket)
 			continue;
 
+#ifdef NET_MMSG
+		if (protocol == 0 && NET_BatchUsable ())
+		{
+			if (NET_GetBatchedPacket (sock, net_socket, net_from, net_message))
+				return true;
+			if (!net_nommsg)
+				continue;
+		}
+#endif
+
 		fromlen = sizeof(from);
 		ret = recvfrom (net_socket, net_message->data, net_message->maxsize
 			, 0, (struct sockaddr *)&from, &fromlen);
@@ -329,6 +490,126 @@ qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_messag
 
 //=============================================================================
 
+#ifdef NET_MMSG
+/*
+==================
+NET_SendQueued
+
+Hands the send queue to the kernel, one sendmmsg for as many datagrams
+as it will take at a time.  A datagram that fails is reported and skipped.
+==================
+*/
+static void NET_SendQueued (sendqueue_t *q)
+{
+	struct mmsghdr	msgs[NET_SEND_BATCH];
+	netadr_t	to;
+	int		i, ret;
+
+	memset (msgs, 0, sizeof(msgs));
+	for (i=0 ; i<q->count ; i++)
+	{
+		msgs[i].msg_hdr.msg_name = &q->to[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(q->to[i]);
+		msgs[i].msg_hdr.msg_iov = &q->iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	i = 0;
+	while (i < q->count)
+	{
+		if (net_nommsg)
+			ret = -1;
+		else
+			ret = sendmmsg (q->socket, &msgs[i], q->count - i, 0);
+
+		if (ret == -1 && (net_nommsg || errno == ENOSYS))
+		{	// fall back to one call per datagram
+			net_nommsg = true;
+			ret = sendto (q->socket, q->iov[i].iov_base, q->iov[i].iov_len, 0,
+				(struct sockaddr *)&q->to[i], sizeof(q->to[i]));
+			if (ret != -1)
+			{
+				i++;
+				continue;
+			}
+		}
+
+		if (ret == -1)
+		{
+			SockadrToNetadr (&q->to[i], &to);
+			Com_Printf ("NET_SendPacket ERROR: %s to %s\n", NET_ErrorString(),
+					NET_AdrToString (to));
+			i++;
+			continue;
+		}
+
+		i += ret;
+	}
+
+	q->count = 0;
+	q->used = 0;
+}
+
+/*
+==================
+NET_QueuePacket
+==================
+*/
+static void NET_QueuePacket (netsrc_t sock, int net_socket, int length, void *data, struct sockaddr_in *addr)
+{
+	sendqueue_t	*q;
+
+	q = &sendqueues[sock];
+
+	if (q->count && (q->count == NET_SEND_BATCH || q->used + length > NET_SEND_POOL
+		|| q->socket != net_socket))
+		NET_SendQueued (q);
+
+	q->socket = net_socket;
+	q->to[q->count] = *addr;
+	q->iov[q->count].iov_base = q->data + q->used;
+	q->iov[q->count].iov_len = length;
+	memcpy (q->data + q->used, data, length);
+	q->used += length;
+	q->count++;
+}
+#endif
+
+/*
+==================
+NET_BeginBatch
+
+Holds back datagrams sent on sock until NET_FlushPackets, so a frame's
+worth of packets go out together
+==================
+*/
+void NET_BeginBatch (netsrc_t sock)
+{
+#ifdef NET_MMSG
+	if (NET_BatchUsable ())
+		sendqueues[sock].active = true;
+#endif
+}
+
+/*
+==================
+NET_FlushPackets
+==================
+*/
+void NET_FlushPackets (netsrc_t sock)
+{
+#ifdef NET_MMSG
+	sendqueue_t	*q;
+
+	q = &sendqueues[sock];
+	if (q->count)
+		NET_SendQueued (q);
+	q->active = false;
+#endif
+}
+
+//=============================================================================
+
 void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 {
 	int		ret;
@@ -372,6 +653,14 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
     
 	NetadrToSockadr (&to, &addr);
 
+#ifdef NET_MMSG
+	if (sendqueues[sock].active && net_socket == ip_sockets[sock])
+	{
+		NET_QueuePacket (sock, net_socket, length, data, &addr);
+		return;
+	}
+#endif
+
 	ret = sendto (net_socket, data, length, 0, (struct sockaddr *)&addr, sizeof(addr) );
 	if (ret == -1)
 	{
@@ -429,6 +718,10 @@ void	NET_Config (qboolean multiplayer)
 	{	// shut down any existing sockets
 		for (i=0 ; i<2 ; i++)
 		{
+#ifdef NET_MMSG
+			NET_FlushPackets (i);
+			recvrings[i].get = recvrings[i].count = 0;
+#endif
 			if (ip_sockets[i])
 			{
 				close (ip_sockets[i]);
@@ -459,6 +752,7 @@ NET_Init
 */
 void NET_Init (void)
 {
+	net_batch = Cvar_Get ("net_batch", "1", 0);
 }
 
 
@@ -552,6 +846,11 @@ void NET_Sleep(int msec)
 	if (!ip_sockets[NS_SERVER] || (dedicated && !dedicated->value))
 		return; // we're not a server, just run full speed
 
+#ifdef NET_MMSG
+	if (recvrings[NS_SERVER].get < recvrings[NS_SERVER].count)
+		return; // packets already waiting in the receive ring
+#endif
+
 	FD_ZERO(&fdset);
 	if (stdin_active)
 		FD_SET(0, &fdset); // stdin is processed too
@@ -29,6 +29,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <dirent.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <fcntl.h>
 #include <sys/time.h>
 #include <ctype.h>
 
@@ -132,6 +133,60 @@ void Hunk_Free (void *base)
 
 //===============================================================================
 
+/*
+=================
+Sys_MapFile
+=================
+*/
+void *Sys_MapFile (const char *path, int32_t *length)
+{
+	struct stat	st;
+	void		*base;
+	int			fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+
+	if (fstat(fd, &st) == -1 || st.st_size <= 0 || st.st_size > 0x7fffffff)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	base = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);	// the mapping keeps the file referenced
+	if (base == MAP_FAILED)
+		return NULL;
+
+	*length = (int32_t)st.st_size;
+	return base;
+}
+
+void Sys_UnmapFile (void *base, int32_t length)
+{
+	if (base)
+		munmap(base, length);
+}
+
+/*
+=================
+Sys_ReadFileAt
+=================
+*/
+int32_t Sys_ReadFileAt (FILE *f, int32_t offset, void *buffer, int32_t length)
+{
+	ssize_t		r;
+
+	do {
+		r = pread(fileno(f), buffer, length, offset);
+	} while (r == -1 && errno == EINTR);
+
+	return (int32_t)r;
+}
+
+//===============================================================================
+
 void Sys_Mkdir (char *path)
 {
     mkdir (path, 0777);
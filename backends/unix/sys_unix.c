@@ -8,7 +8,7 @@ of the License, or (at your option) any later version.
 
 This program is distributed in the hope that it will be useful,
 but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
 
 See the GNU General Public License for more details.
 
@@ -17,155 +17,224 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
+// sys_unix.c -- system services for q2vr-ded
+//
+// The dedicated server counterpart of sys_sdl2.c, built on plain POSIX so
+// the server links nothing but libc, pthreads and the dynamic loader.
+
+#ifdef __linux__
+#define _GNU_SOURCE		// pthread_setname_np
+#endif
+
 #include <unistd.h>
-#include <signal.h>
 #include <stdlib.h>
-#include <limits.h>
-#include <sys/time.h>
-#include <sys/types.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <stdarg.h>
 #include <stdio.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
-#include <sys/stat.h>
 #include <string.h>
-#include <ctype.h>
-#include <sys/wait.h>
-#include <sys/mman.h>
 #include <errno.h>
-
-#ifdef __linux__
-#include <mntent.h>
-#endif
-
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <dlfcn.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/utsname.h>
 
-#include "../qcommon/qcommon.h"
-
-cvar_t *nostdout;
+#include "../../qcommon/qcommon.h"
+#include "../../qcommon/shared/game.h"
 
-unsigned	sys_frame_time;
+uint32_t	sys_frame_time;
+uint32_t	sys_cacheline;
 
-uid_t saved_euid;
-qboolean stdin_active = true;
-int			ActiveApp;
+qboolean	stdin_active = true;
+static cvar_t	*nostdout;
 
-// =======================================================================
-// General routines
-// =======================================================================
 
-void Sys_ConsoleOutput (char *string)
+/*
+================
+Sys_Milliseconds
+================
+*/
+int32_t	curtime;
+int32_t Sys_Milliseconds (void)
 {
-	if (nostdout && nostdout->value)
-		return;
+	curtime = (int32_t)(Sys_Nanoseconds () / 1000000);
+	return curtime;
+}
 
-	fputs(string, stdout);
+/*
+================
+Sys_Nanoseconds
+
+The first call must come from the main thread
+================
+*/
+uint64_t Sys_Nanoseconds (void)
+{
+	static uint64_t	base;
+	struct timespec	ts;
+	uint64_t		now;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	if (!base)
+		base = now;
+	return now - base;
 }
 
-void Sys_Printf (char *fmt, ...)
+/*
+================
+Sys_Microseconds
+================
+*/
+uint64_t Sys_Microseconds (void)
 {
-	va_list		argptr;
-	char		text[1024];
-	unsigned char		*p;
+	return Sys_Nanoseconds () / 1000;
+}
 
-	va_start (argptr, fmt);
-//	vsprintf (text, fmt, argptr);
-	Q_vsnprintf (text, sizeof(text), fmt, argptr);
-	va_end (argptr);
 
-	if (strlen(text) > sizeof(text))
-		Sys_Error("memory overwrite in Sys_Printf");
+/*
+===============================================================================
 
-    if (nostdout && nostdout->value)
-        return;
+THREADS
 
-	for (p = (unsigned char *)text; *p; p++) {
-		*p &= 0x7f;
-		if ((*p > 128 || *p < 32) && *p != 10 && *p != 13 && *p != 9)
-			printf("[%02x]", *p);
-		else
-			putc(*p, stdout);
-	}
-}
+===============================================================================
+*/
 
-void Sys_Quit (void)
+typedef struct
 {
-	CL_Shutdown ();
-	Qcommon_Shutdown ();
-    fcntl (0, F_SETFL, fcntl (0, F_GETFL, 0) & ~FNDELAY);
-	_exit(0);
+	pthread_t	handle;
+	int32_t		(*func)(void *);
+	void		*data;
+	char		name[16];	// the limit of pthread_setname_np
+} systhread_t;
+
+/*
+================
+Sys_CPUCount
+================
+*/
+int32_t Sys_CPUCount (void)
+{
+	long	count = sysconf (_SC_NPROCESSORS_ONLN);
+
+	return count > 0 ? (int32_t)count : 1;
 }
 
-void Sys_Init(void)
+static void *Sys_ThreadMain (void *arg)
 {
-#if id386
-//	Sys_SetFPCW();
+	systhread_t	*thread = (systhread_t *)arg;
+
+#ifdef __linux__
+	pthread_setname_np (pthread_self (), thread->name);
 #endif
+	thread->func (thread->data);
+	return NULL;
 }
 
-void Sys_Error (char *error, ...)
-{ 
-	va_list     argptr;
-	char        string[1024];
+/*
+================
+Sys_CreateThread
+================
+*/
+void *Sys_CreateThread (int32_t (*func)(void *), void *data, const char *name)
+{
+	systhread_t	*thread;
 
-// change stdin to non blocking
-	fcntl (0, F_SETFL, fcntl (0, F_GETFL, 0) & ~FNDELAY);
+	thread = malloc (sizeof(systhread_t));
+	if (!thread)
+		return NULL;
 
-	CL_Shutdown ();
-	Qcommon_Shutdown ();
+	thread->func = func;
+	thread->data = data;
+	Q_strncpyz (thread->name, name ? name : "", sizeof(thread->name));
+	if (pthread_create (&thread->handle, NULL, Sys_ThreadMain, thread))
+	{
+		free (thread);
+		return NULL;
+	}
+	return thread;
+}
 
-	va_start (argptr, error);
-//	vsprintf (string, error, argptr);
-	Q_vsnprintf (string, sizeof(string), error, argptr);
-	va_end (argptr);
-	fprintf(stderr, "Error: %s\n", string);
+/*
+================
+Sys_WaitThread
+================
+*/
+void Sys_WaitThread (void *thread)
+{
+	if (!thread)
+		return;
 
-	_exit (1);
-} 
+	pthread_join (((systhread_t *)thread)->handle, NULL);
+	free (thread);
+}
 
-void Sys_Warn (char *warning, ...)
-{ 
-	va_list     argptr;
-	char        string[1024];
+/*
+================
+Sys_CreateSemaphore
+================
+*/
+void *Sys_CreateSemaphore (int32_t value)
+{
+	sem_t	*sem;
 
-	va_start (argptr, warning);
-//	vsprintf (string, warning, argptr);
-	Q_vsnprintf (string, sizeof(string), warning, argptr);
-	va_end (argptr);
-	fprintf(stderr, "Warning: %s", string);
-} 
+	sem = malloc (sizeof(sem_t));
+	if (sem && sem_init (sem, 0, value))
+	{
+		free (sem);
+		return NULL;
+	}
+	return sem;
+}
 
-/*
-============
-Sys_FileTime
+void Sys_DestroySemaphore (void *sem)
+{
+	if (!sem)
+		return;
 
-returns -1 if not present
-============
-*/
-int	Sys_FileTime (char *path)
+	sem_destroy ((sem_t *)sem);
+	free (sem);
+}
+
+void Sys_SemaphoreWait (void *sem)
+{
+	while (sem_wait ((sem_t *)sem) && errno == EINTR)
+		;
+}
+
+void Sys_SemaphorePost (void *sem)
 {
-	struct	stat	buf;
-	
-	if (stat (path,&buf) == -1)
-		return -1;
-	
-	return buf.st_mtime;
+	sem_post ((sem_t *)sem);
 }
 
-void floating_point_exception_handler(int whatever)
+/*
+================
+Sys_AtomicAdd
+
+Returns the value before the add
+================
+*/
+int32_t Sys_AtomicAdd (volatile int32_t *value, int32_t add)
 {
-//	Sys_Warn("floating point exception\n");
-	signal(SIGFPE, floating_point_exception_handler);
+	return __sync_fetch_and_add (value, add);
 }
 
-char *Sys_ConsoleInput(void)
+
+/*
+===============================================================================
+
+CONSOLE
+
+===============================================================================
+*/
+
+char *Sys_ConsoleInput (void)
 {
-    static char text[256];
-    int     len;
-	fd_set	fdset;
-    struct timeval timeout;
+	static char	text[256];
+	int32_t		len;
+	fd_set		fdset;
+	struct timeval	timeout;
 
 	if (!dedicated || !dedicated->value)
 		return NULL;
@@ -180,7 +249,7 @@ char *Sys_ConsoleInput(void)
 	if (select (1, &fdset, NULL, NULL, &timeout) == -1 || !FD_ISSET(0, &fdset))
 		return NULL;
 
-	len = read (0, text, sizeof(text));
+	len = (int32_t)read (0, text, sizeof(text));
 	if (len == 0) { // eof!
 		stdin_active = false;
 		return NULL;
@@ -193,143 +262,401 @@ char *Sys_ConsoleInput(void)
 	return text;
 }
 
-/*****************************************************************************/
+void Sys_ConsoleOutput (char *string)
+{
+	if (nostdout && nostdout->value)
+		return;
 
-static void *game_library;
+	fputs (string, stdout);
+	fflush (stdout);
+}
 
 /*
-=================
-Sys_UnloadGame
-=================
+================
+Sys_SendKeyEvents
+
+No window, just grab the frame time
+================
 */
-void Sys_UnloadGame (void)
+void Sys_SendKeyEvents (void)
+{
+	sys_frame_time = Sys_Milliseconds ();
+}
+
+char *Sys_GetClipboardData (void)
+{
+	return NULL;
+}
+
+void Sys_FreeClipboardData (char *cliptext)
 {
-	if (game_library) 
-		dlclose (game_library);
-	game_library = NULL;
 }
 
+
 /*
-=================
-Sys_GetGameAPI
+===============================================================================
 
-Loads the game dll
-=================
+SYSTEM IO
+
+===============================================================================
 */
-void *Sys_GetGameAPI (void *parms)
+
+void Sys_Error (char *error, ...)
 {
-	void	*(*GetGameAPI) (void *);
-
-	char	name[MAX_OSPATH];
-	char	curpath[MAX_OSPATH];
-	char	*path;
-
-	// Knightmare- changed game library name for better cohabitation
-#ifdef __i386__
-	const char *gamename = "kmq2gamei386.so";
-#elif defined __alpha__
-	const char *gamename = "kmq2gameaxp.so";
-#elif defined __x86_64__
-	const char *gamename = "kmq2gamex86_64.so";
-#elif defined __powerpc__
-	const char *gamename = "kmq2gameppc.so";
-#elif defined __sparc__
-	const char *gamename = "kmq2gamesparc.so";
-#else
-#error Unknown arch
-#endif
+	va_list		argptr;
+	char		text[1024];
 
-	setreuid(getuid(), getuid());
-	setegid(getgid());
+	// restore blocking stdin for the shell
+	fcntl (0, F_SETFL, fcntl (0, F_GETFL, 0) & ~FNDELAY);
 
-	if (game_library)
-		Com_Error (ERR_FATAL, "Sys_GetGameAPI without Sys_UnloadingGame");
+	CL_Shutdown ();
+	Qcommon_Shutdown ();
+
+	va_start (argptr, error);
+	Q_vsnprintf (text, sizeof(text), error, argptr);
+	va_end (argptr);
+	fprintf (stderr, "Error: %s\n", text);
 
-	getcwd(curpath, sizeof(curpath));
+	exit (1);
+}
 
-	Com_Printf("------- Loading %s -------\n", gamename);
+void Sys_Quit (void)
+{
+	CL_Shutdown ();
+	Qcommon_Shutdown ();
 
-	// now run through the search paths
-	path = NULL;
-	while (1)
+	fcntl (0, F_SETFL, fcntl (0, F_GETFL, 0) & ~FNDELAY);
+	exit (0);
+}
+
+//================================================================
+
+static char	*basepath = NULL;
+
+/*
+================
+Sys_GetBaseDir
+
+The directory holding the executable, or the current one if that
+can't be found
+================
+*/
+char *Sys_GetBaseDir (void)
+{
+	char	path[MAX_OSPATH];
+	char	*slash;
+	ssize_t	len;
+
+	if (basepath)
+		return basepath;
+
+	len = readlink ("/proc/self/exe", path, sizeof(path)-1);
+	if (len > 0)
 	{
-		path = FS_NextPath (path);
-		if (!path)
-			return NULL;		// couldn't find one anywhere
-		sprintf (name, "%s/%s/%s", curpath, path, gamename);
-		game_library = dlopen (name, RTLD_LAZY );
-		if (game_library)
+		path[len] = 0;
+		slash = strrchr (path, '/');
+		if (slash && slash != path)
 		{
-			Com_Printf ("LoadLibrary (%s)\n",name);
-			break;
+			*slash = 0;
+			basepath = Z_TagStrdup (path, TAG_SYSTEM);
 		}
 	}
+	if (!basepath)
+		basepath = Z_TagStrdup (".", TAG_SYSTEM);
+
+	Com_Printf ("Using base path %s\n", basepath);
+	return basepath;
+}
+
+/*
+================
+Sys_Init
+================
+*/
+void Sys_Init (void)
+{
+	char			string[64];
+	struct utsname	name;
+	long			pages, pagesize, line;
 
-	GetGameAPI = (void *)dlsym (game_library, "GetGameAPI");
-	if (!GetGameAPI)
+	if (uname (&name))
 	{
-		Sys_UnloadGame ();		
-		return NULL;
+		Q_strncpyz (string, "Unix", sizeof(string));
+		Cvar_Get ("sys_os", string, CVAR_NOSET|CVAR_LATCH);
+		Com_sprintf (string, sizeof(string), "Unknown %i-core CPU", Sys_CPUCount());
+	}
+	else
+	{
+		Cvar_Get ("sys_os", name.sysname, CVAR_NOSET|CVAR_LATCH);
+		Com_sprintf (string, sizeof(string), "%s %i-core CPU", name.machine, Sys_CPUCount());
 	}
+	Cvar_Get ("sys_cpu", string, CVAR_NOSET|CVAR_LATCH);
 
-	return GetGameAPI (parms);
+	line = 0;
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+	line = sysconf (_SC_LEVEL1_DCACHE_LINESIZE);
+#endif
+	sys_cacheline = (line > 0) ? (uint32_t)line : 64;
+
+	// physical memory in megabytes, like SDL_GetSystemRAM
+	pages = sysconf (_SC_PHYS_PAGES);
+	pagesize = sysconf (_SC_PAGESIZE);
+	Com_sprintf (string, sizeof(string), "%u", (pages > 0 && pagesize > 0) ?
+		(uint32_t)((uint64_t)pages * pagesize / (1024*1024)) : 0);
+	Cvar_Get ("sys_ram", string, CVAR_NOSET|CVAR_LATCH);
 }
 
-/*****************************************************************************/
-
+/*
+=================
+Sys_AppActivate
+=================
+*/
 void Sys_AppActivate (void)
 {
 }
 
-void HandleEvents(void);
-void Sys_SendKeyEvents (void)
+
+/*
+========================================================================
+
+GAME DLL
+
+========================================================================
+*/
+
+static void	*game_library;
+
+/*
+=================
+Sys_UnloadGame
+=================
+*/
+void Sys_UnloadGame (void)
+{
+	if (game_library)
+		dlclose (game_library);
+	game_library = NULL;
+}
+
+void *Sys_LoadGameAPI (const char *name, void *parms, qboolean setGameLibrary)
 {
-#ifndef DEDICATED_ONLY
-	HandleEvents();
+	game_export_t	*ge = NULL;
+	void			*library;
+	void			*(*GetGameAPI) (void *);
+
+	Com_DPrintf ("dlopen (%s)\n", name);
+	library = dlopen (name, RTLD_NOW);
+	if (!library)
+	{
+		Com_DPrintf ("failed to load %s: %s\n", name, dlerror());
+		return NULL;
+	}
+
+	GetGameAPI = (void *(*)(void *))dlsym (library, "GetGameAPI");
+	if (GetGameAPI)
+	{
+		ge = GetGameAPI (parms);
+		if (ge->apiversion & GAME_API_VERSION_MASK)
+		{
+			if (ge->apiversion != GAME_API_VERSION)
+			{
+				Com_DPrintf ("game is version %i, not %i\n", ge->apiversion, GAME_API_VERSION);
+				ge = NULL;
+			}
+		}
+		else if (sv_legacy_libraries->value)
+		{
+			if (ge->apiversion != LEGACY_API_VERSION)
+			{
+				Com_DPrintf ("game is version %i, not %i\n", ge->apiversion, LEGACY_API_VERSION);
+				ge = NULL;
+			}
+		}
+		else
+		{
+			Com_DPrintf ("game is version %i, not %i\n", ge->apiversion, GAME_API_VERSION);
+			ge = NULL;
+		}
+	}
+
+	if (ge && setGameLibrary)
+		game_library = library;
+	else
+	{
+		Com_DPrintf ("dlclose (%s)\n", name);
+		dlclose (library);
+	}
+	return ge;
+}
+
+game_import_t SV_GetGameImport (void);
+
+// prefer loading Q2VR, then KMQ2, then try to fallback to legacy
+static const char *dllnames[] = {
+#ifdef Q2VR_ENGINE_MOD
+	"vrgame" CPUSTRING,
+	"mpgame" CPUSTRING,
+#endif
+#ifdef KMQUAKE2_ENGINE_MOD
+	"kmq2game" CPUSTRING,
 #endif
+	"game" CPUSTRING,
+	"game",
+	0};
+
+/*
+=================
+Sys_SkipGameLibrary
 
-	// grab frame time 
-	sys_frame_time = Sys_Milliseconds();
+The q2vr game library doesn't run the mission packs, those get their own
+=================
+*/
+static qboolean Sys_SkipGameLibrary (const char *dllname)
+{
+	qboolean	missionPack = (!Q_strcasecmp(fs_gamedirvar->string, "rogue")
+							|| !Q_strcasecmp(fs_gamedirvar->string, "xatrix"));
+
+	if (missionPack && !strncmp(dllname, "vrgame", 6))
+		return true;
+	if (!missionPack && !strncmp(dllname, "mpgame", 6))
+		return true;
+	if (!sv_legacy_libraries->value && !strncmp(dllname, "game", 4))
+		return true;
+	return false;
 }
 
-/*****************************************************************************/
+void *Sys_LoadGameLibrariesInPath (const char *path, qboolean setGameLibrary)
+{
+	char			name[MAX_OSPATH];
+	game_import_t	import = SV_GetGameImport();
+	void			*ge;
+	int32_t			i;
+
+	if (!path)
+		return NULL;
+
+	for (i = 0; dllnames[i] != 0; i++)
+	{
+		if (Sys_SkipGameLibrary (dllnames[i]))
+			continue;
+
+		Com_sprintf (name, sizeof(name), "%s/%s.so", path, dllnames[i]);
+		ge = Sys_LoadGameAPI (name, &import, setGameLibrary);
+		if (ge)
+			return ge;
+	}
+	return NULL;
+}
 
-int main (int argc, char **argv)
+void *Sys_LoadGameLibraryInBasePaths (const char *dllname, qboolean setGameLibrary)
 {
-	int 	time, oldtime, newtime;
+	char			name[MAX_OSPATH];
+	game_import_t	import = SV_GetGameImport();
+	const char		*path = NULL;
+	void			*ge;
 
-	// go back to real user for config loads
-	saved_euid = geteuid();
-	seteuid(getuid());
+	if (!dllname)
+		return NULL;
+	if (setGameLibrary && Sys_SkipGameLibrary (dllname))
+		return NULL;
 
-	printf ("\n");	
-	printf ("========= Initialization =================\n");
-	printf ("KMQuake2 -- Version 0.20\n");
-	printf ("Linux Port by QuDos\n");
-	printf ("http://qudos.quakedev.com/\n");
-	printf ("Compiled: "__DATE__" -- "__TIME__"\n");
-	printf ("==========================================\n\n");	
+	while ((path = FS_NextBasePath(path)) != NULL)
+	{
+		Com_sprintf (name, sizeof(name), "%s/%s.so", path, dllname);
+		ge = Sys_LoadGameAPI (name, &import, setGameLibrary);
+		if (ge)
+			return ge;
+	}
+	return NULL;
+}
 
-	Qcommon_Init(argc, argv);
+/*
+=================
+Sys_GetGameAPI
 
-	fcntl(0, F_SETFL, fcntl (0, F_GETFL, 0) | FNDELAY);
+Loads the game library, searching the same places as sys_sdl2.c
+=================
+*/
+void *Sys_GetGameAPI ()
+{
+	char		name[MAX_OSPATH];
+	char		cwd[MAX_OSPATH];
+	const char	*path = NULL;
+	void		*ge = NULL;
+	int32_t		i;
+#ifndef _DEBUG
+	const char	*debugdir = "release";
+#else
+	const char	*debugdir = "debug";
+#endif
+
+	if (game_library)
+		Com_Error (ERR_FATAL, "Sys_GetGameAPI without Sys_UnloadingGame");
 
-	nostdout = Cvar_Get("nostdout", "0", 0);
-	if (!nostdout->value) {
-		fcntl(0, F_SETFL, fcntl (0, F_GETFL, 0) | FNDELAY);
-//		printf ("Linux Quake II -- Version %0.3f\n", KMQUAKE2_VERSION);
+	// check the current debug directory first for development purposes
+	if (!getcwd (cwd, sizeof(cwd)))
+		Q_strncpyz (cwd, ".", sizeof(cwd));
+
+	Com_sprintf (name, sizeof(name), "%s/%s", cwd, debugdir);
+	ge = Sys_LoadGameLibrariesInPath (name, true);
+#ifdef _DEBUG
+	if (!ge)
+		ge = Sys_LoadGameLibrariesInPath (cwd, true);
+#endif
+
+	while (!ge && (path = FS_NextGamePath(path)) != NULL)
+	{
+		Com_DPrintf ("Checking path: %s\n", path);
+		ge = Sys_LoadGameLibrariesInPath (path, true);
 	}
 
-    oldtime = Sys_Milliseconds ();
-    while (1)
-    {
-// find time spent rendering last frame
-		do {
+	for (i = 0; !ge && dllnames[i]; i++)
+	{
+		Com_DPrintf ("Checking library: %s\n", dllnames[i]);
+		ge = Sys_LoadGameLibraryInBasePaths (dllnames[i], true);
+	}
+
+	if (!ge)
+		Com_Printf ("Could not find suitable library\n");
+
+	return ge;
+}
+
+//=======================================================================
+
+/*
+==================
+main
+
+SV_Frame does the long waits between server frames in NET_Sleep, this
+only keeps an idle server without a socket from spinning
+==================
+*/
+int32_t main (int32_t argc, char *argv[])
+{
+	int32_t		time, oldtime, newtime;
+
+	Qcommon_Init (argc, argv);
+
+	nostdout = Cvar_Get ("nostdout", "0", 0);
+	if (!nostdout->value)
+		fcntl (0, F_SETFL, fcntl (0, F_GETFL, 0) | FNDELAY);
+
+	oldtime = Sys_Milliseconds ();
+	while (1)
+	{
+		do
+		{
 			newtime = Sys_Milliseconds ();
 			time = newtime - oldtime;
+			if (time < 1)
+				usleep (1000);
 		} while (time < 1);
-        Qcommon_Frame (time);
+
+		Qcommon_Frame (time);
 		oldtime = newtime;
-    }
+	}
 
+	// never gets here
+	return 0;
 }
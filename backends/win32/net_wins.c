@@ -445,6 +445,28 @@ qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_messag
 
 //=============================================================================
 
+/*
+==================
+NET_BeginBatch
+
+Winsock has no batched send, so packets always go out immediately
+==================
+*/
+void NET_BeginBatch (netsrc_t sock)
+{
+}
+
+/*
+==================
+NET_FlushPackets
+==================
+*/
+void NET_FlushPackets (netsrc_t sock)
+{
+}
+
+//=============================================================================
+
 void NET_SendPacket (netsrc_t sock, int32_t length, void *data, netadr_t to)
 {
 	int32_t		ret;
@@ -115,6 +115,73 @@ void Hunk_Free (void *base)
 
 //===============================================================================
 
+/*
+=================
+Sys_MapFile
+=================
+*/
+void *Sys_MapFile (const char *path, int32_t *length)
+{
+	HANDLE	file, mapping;
+	DWORD	size, high;
+	void	*base;
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	size = GetFileSize(file, &high);
+	if (size == INVALID_FILE_SIZE || high || !size || size > 0x7fffffff)
+	{
+		CloseHandle(file);
+		return NULL;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping)
+		return NULL;
+
+	base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);	// the view keeps the mapping alive
+	if (!base)
+		return NULL;
+
+	*length = (int32_t)size;
+	return base;
+}
+
+void Sys_UnmapFile (void *base, int32_t length)
+{
+	if (base)
+		UnmapViewOfFile(base);
+}
+
+/*
+=================
+Sys_ReadFileAt
+
+The handle isn't opened for overlapped io, so ReadFile still moves the
+file pointer and the FILE's buffer doesn't see it.  Pack files are only
+read through here once they are open, which keeps that harmless.
+=================
+*/
+int32_t Sys_ReadFileAt (FILE *f, int32_t offset, void *buffer, int32_t length)
+{
+	OVERLAPPED	ov;
+	DWORD		read;
+
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = offset;
+
+	if (!ReadFile((HANDLE)_get_osfhandle(_fileno(f)), buffer, length, &read, &ov))
+		return (GetLastError() == ERROR_HANDLE_EOF) ? 0 : -1;
+
+	return (int32_t)read;
+}
+
+//===============================================================================
+
 void Sys_Mkdir (char *path)
 {
 	_mkdir (path);
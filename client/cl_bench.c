@@ -0,0 +1,358 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+// cl_bench.c -- per stage frame timing for the benchmark command
+//
+// "benchmark <demo> [name]" plays a demo as a timedemo and times every
+// client frame along with the stages listed in ref.h.  Stages nest, so a
+// stage includes the time of any stage timed inside it.  When the demo
+// ends the percentiles are written to <gamedir>/benchmarks/<name>.csv and
+// the histograms they came from to <name>_hist.csv.
+
+#include "client.h"
+
+// 1 usec buckets up to 1 msec, 10 usec up to 10 msec, 100 usec up to a
+// second, anything slower lands in the last one
+#define	BENCH_BUCKETS	(1000 + 900 + 9900)
+
+typedef struct
+{
+	uint64_t	start;
+	uint64_t	time;		// accumulated this frame
+	uint64_t	total;
+	uint32_t	max;
+	uint32_t	hist[BENCH_BUCKETS];
+} benchtimer_t;
+
+static const char *bench_names[BENCH_NUMSTAGES] =
+{
+	"frame",
+	"parse",
+	"entities",
+	"particles",
+	"sound",
+	"refresh",
+	"markleaves",
+	"worldnode",
+	"lightmaps",
+	"particlesort"
+};
+
+// the stages are profiler zones as well, except the ones that run
+// too often to keep in the ring
+static const char *bench_zones[BENCH_NUMSTAGES] =
+{
+	NULL,
+	"CL_ReadPackets",
+	"CL_AddEntities",
+	"CL_AddParticles",
+	"S_Update",
+	"SCR_UpdateScreen",
+	"R_MarkLeaves",
+	"R_RecursiveWorldNode",
+	NULL,
+	"R_SortParticlesOnList"
+};
+
+static struct
+{
+	qboolean		active;
+	qboolean		inframe;
+	int32_t			frames;
+	char			name[MAX_QPATH];
+	char			oldtimedemo[16];
+	benchtimer_t	timers[BENCH_NUMSTAGES];
+} bench;
+
+
+static int32_t CL_BenchBucket (uint32_t usec)
+{
+	if (usec < 1000)
+		return usec;
+	if (usec < 10000)
+		return 1000 + (usec - 1000) / 10;
+	if (usec < 1000000)
+		return 1900 + (usec - 10000) / 100;
+	return BENCH_BUCKETS - 1;
+}
+
+static uint32_t CL_BenchBucketTime (int32_t bucket)
+{
+	if (bucket < 1000)
+		return bucket;
+	if (bucket < 1900)
+		return 1000 + (bucket - 1000) * 10;
+	return 10000 + (bucket - 1900) * 100;
+}
+
+static uint32_t CL_BenchPercentile (benchtimer_t *t, int32_t percent)
+{
+	int32_t		i;
+	uint32_t	target, count;
+
+	target = ((uint32_t)bench.frames * percent + 99) / 100;
+	if (!target)
+		target = 1;
+
+	for (i=0, count=0 ; i<BENCH_BUCKETS ; i++)
+	{
+		count += t->hist[i];
+		if (count >= target)
+			return CL_BenchBucketTime (i);
+	}
+	return t->max;
+}
+
+
+/*
+=================
+CL_BenchBegin / CL_BenchEnd
+
+Only count inside a benchmark frame, anywhere else they cost a
+single test
+=================
+*/
+void CL_BenchBegin (benchstage_t stage)
+{
+	if (bench_zones[stage])
+		Prof_Begin (bench_zones[stage]);
+	if (bench.inframe)
+		bench.timers[stage].start = Sys_Microseconds ();
+}
+
+void CL_BenchEnd (benchstage_t stage)
+{
+	if (bench.inframe)
+		bench.timers[stage].time += Sys_Microseconds () - bench.timers[stage].start;
+	if (bench_zones[stage])
+		Prof_End ();
+}
+
+/*
+=================
+CL_BenchBeginFrame
+=================
+*/
+void CL_BenchBeginFrame (void)
+{
+	int32_t		i;
+
+	if (!bench.active)
+		return;
+
+	for (i=0 ; i<BENCH_NUMSTAGES ; i++)
+		bench.timers[i].time = 0;
+	bench.inframe = true;
+	CL_BenchBegin (BENCH_FRAME);
+}
+
+/*
+=================
+CL_BenchEndFrame
+
+Frames where the demo isn't playing yet are thrown away
+=================
+*/
+void CL_BenchEndFrame (void)
+{
+	int32_t			i;
+	uint32_t		usec;
+	benchtimer_t	*t;
+
+	if (!bench.inframe)
+		return;
+
+	CL_BenchEnd (BENCH_FRAME);
+	bench.inframe = false;
+
+	if (cls.state != ca_active || !cl.refresh_prepped)
+		return;
+
+	bench.frames++;
+	for (i=0, t=bench.timers ; i<BENCH_NUMSTAGES ; i++, t++)
+	{
+		usec = (uint32_t)min(t->time, 0xffffffffu);
+		t->total += usec;
+		if (usec > t->max)
+			t->max = usec;
+		t->hist[CL_BenchBucket(usec)]++;
+	}
+}
+
+/*
+=================
+CL_BenchWrite
+=================
+*/
+static void CL_BenchWrite (void)
+{
+	char			path[MAX_OSPATH];
+	FILE			*f;
+	int32_t			i, j;
+	qboolean		used;
+	benchtimer_t	*t;
+
+	Com_sprintf (path, sizeof(path), "%s/benchmarks/%s.csv", FS_Gamedir(), bench.name);
+	FS_CreatePath (path);
+	f = fopen (path, "w");
+	if (!f)
+	{
+		Com_Printf ("CL_BenchWrite: couldn't open %s\n", path);
+		return;
+	}
+
+	Com_Printf ("%i frames, times in usec\n", bench.frames);
+	Com_Printf ("%-14s %8s %8s %8s %8s %8s\n", "stage", "mean", "p50", "p95", "p99", "max");
+	fprintf (f, "stage,frames,mean_us,p50_us,p95_us,p99_us,max_us\n");
+	for (i=0, t=bench.timers ; i<BENCH_NUMSTAGES ; i++, t++)
+	{
+		double	mean = (double)t->total / bench.frames;
+		uint32_t	p50 = CL_BenchPercentile (t, 50);
+		uint32_t	p95 = CL_BenchPercentile (t, 95);
+		uint32_t	p99 = CL_BenchPercentile (t, 99);
+
+		Com_Printf ("%-14s %8.1f %8u %8u %8u %8u\n", bench_names[i], mean, p50, p95, p99, t->max);
+		fprintf (f, "%s,%i,%.1f,%u,%u,%u,%u\n", bench_names[i], bench.frames, mean, p50, p95, p99, t->max);
+	}
+	fclose (f);
+	Com_Printf ("Wrote %s\n", path);
+
+	Com_sprintf (path, sizeof(path), "%s/benchmarks/%s_hist.csv", FS_Gamedir(), bench.name);
+	f = fopen (path, "w");
+	if (!f)
+	{
+		Com_Printf ("CL_BenchWrite: couldn't open %s\n", path);
+		return;
+	}
+
+	fprintf (f, "bucket_us");
+	for (i=0 ; i<BENCH_NUMSTAGES ; i++)
+		fprintf (f, ",%s", bench_names[i]);
+	fprintf (f, "\n");
+	for (j=0 ; j<BENCH_BUCKETS ; j++)
+	{
+		for (i=0, used=false ; i<BENCH_NUMSTAGES ; i++)
+			used |= bench.timers[i].hist[j] != 0;
+		if (!used)
+			continue;
+
+		fprintf (f, "%u", CL_BenchBucketTime(j));
+		for (i=0 ; i<BENCH_NUMSTAGES ; i++)
+			fprintf (f, ",%u", bench.timers[i].hist[j]);
+		fprintf (f, "\n");
+	}
+	fclose (f);
+	Com_Printf ("Wrote %s\n", path);
+}
+
+/*
+=================
+CL_BenchAbort
+
+Called from Com_Error on a drop.  A benchmark that drops before its
+first frame, like one whose demo won't load, leaves a csv saying so,
+and the headless build exits with an error instead of idling at the
+console.  Drops after that end the demo like any disconnect.
+=================
+*/
+void CL_BenchAbort (const char *error)
+{
+	char	path[MAX_OSPATH];
+	FILE	*f;
+
+	if (!bench.active || bench.frames)
+		return;
+
+	Com_sprintf (path, sizeof(path), "%s/benchmarks/%s.csv", FS_Gamedir(), bench.name);
+	FS_CreatePath (path);
+	f = fopen (path, "w");
+	if (f)
+	{
+		fprintf (f, "error\n\"%s\"\n", error);
+		fclose (f);
+	}
+
+	bench.active = false;
+	bench.inframe = false;
+	Cvar_ForceSet ("timedemo", bench.oldtimedemo);
+
+#ifdef HEADLESS
+	Sys_Error ("benchmark %s failed: %s", bench.name, error);
+#endif
+}
+
+/*
+=================
+CL_BenchFinish
+
+Called from CL_Disconnect when the demo ends
+=================
+*/
+void CL_BenchFinish (void)
+{
+	if (!bench.active || !bench.frames)
+		return;		// still loading the demo
+
+	CL_BenchWrite ();
+	bench.active = false;
+	bench.inframe = false;
+	Cvar_ForceSet ("timedemo", bench.oldtimedemo);
+
+#ifdef HEADLESS
+	Cbuf_AddText ("quit\n");
+#endif
+}
+
+/*
+=================
+CL_Benchmark_f
+
+benchmark <demo> [name]
+=================
+*/
+void CL_Benchmark_f (void)
+{
+	char	*demo;
+
+	if (Cmd_Argc() < 2 || Cmd_Argc() > 3)
+	{
+		Com_Printf ("usage: benchmark <demo> [name]\n");
+		return;
+	}
+
+	demo = Cmd_Argv(1);
+	if (Cmd_Argc() == 3)
+		Q_strncpyz (bench.name, Cmd_Argv(2), sizeof(bench.name));
+	else
+	{
+		Q_strncpyz (bench.name, COM_SkipPath(demo), sizeof(bench.name));
+		COM_StripExtension (bench.name, bench.name);
+	}
+
+	if (!bench.active)
+		Q_strncpyz (bench.oldtimedemo, Cvar_VariableString("timedemo"), sizeof(bench.oldtimedemo));
+	memset (bench.timers, 0, sizeof(bench.timers));
+	bench.frames = 0;
+	bench.inframe = false;
+	bench.active = true;
+
+	Cvar_ForceSet ("timedemo", "1");
+	Cbuf_AddText (va("demomap %s\n", demo));
+}
@@ -55,6 +55,120 @@ static const char *env_suf[6] = {"rt", "bk", "lf", "ft", "up", "dn"};
 void CL_InitFailedDownloadList (void);
 
 
+/*
+=================
+CL_PrefetchImage
+
+Queues the same substitute the renderer would pick for an image
+=================
+*/
+static void CL_PrefetchImage (const char *name)
+{
+	static const char *subst[3] = {"png", "jpg", "tga"};
+	char	fn[MAX_QPATH];
+	char	*ext;
+	int32_t	i, count;
+
+	Q_strncpyz (fn, name, sizeof(fn));
+	ext = strrchr (fn, '.');
+	if (!ext || strlen(ext) != 4)
+		return;
+
+	if (!Q_strcasecmp (ext, ".tga"))
+		count = 2;
+	else if (!Q_strcasecmp (ext, ".pcx") || !Q_strcasecmp (ext, ".wal"))
+		count = 3;
+	else
+		count = 0;
+
+	for (i=0 ; i<count ; i++)
+	{
+		strcpy (ext+1, subst[i]);
+		if (FS_PrefetchFile (fn))
+			return;
+	}
+
+	FS_PrefetchFile (name);
+}
+
+/*
+=================
+CL_PrefetchLevel
+
+Starts reading everything registration is about to ask for, in the
+order it will ask.  Call once the map is known to be on disk.
+=================
+*/
+void CL_PrefetchLevel (void)
+{
+	extern int32_t		numtexinfo;
+	extern mapsurface_t	map_surfaces[];
+	char		fn[MAX_QPATH];
+	const char	*name;
+	int32_t		i, cs_sounds, cs_images, max_models, max_sounds, max_images;
+
+	FS_ClearPrefetch ();
+
+	if ( LegacyProtocol() )
+	{
+		cs_sounds = OLD_CS_SOUNDS;
+		cs_images = OLD_CS_IMAGES;
+		max_models = OLD_MAX_MODELS;
+		max_sounds = OLD_MAX_SOUNDS;
+		max_images = OLD_MAX_IMAGES;
+	}
+	else
+	{
+		cs_sounds = CS_SOUNDS;
+		cs_images = CS_IMAGES;
+		max_models = MAX_MODELS;
+		max_sounds = MAX_SOUNDS;
+		max_images = MAX_IMAGES;
+	}
+
+	for (i=1 ; i<max_sounds && cl.configstrings[cs_sounds+i][0] ; i++)
+	{
+		name = cl.configstrings[cs_sounds+i];
+		if (name[0] == '*')
+			continue;	// sexed sounds depend on the player model
+		if (name[0] == '#')
+			FS_PrefetchFile (name+1);
+		else
+		{
+			Com_sprintf (fn, sizeof(fn), "sound/%s", name);
+			FS_PrefetchFile (fn);
+		}
+	}
+
+	FS_PrefetchFile (cl.configstrings[CS_MODELS+1]);
+
+	for (i=0 ; i<numtexinfo ; i++)
+	{
+		Com_sprintf (fn, sizeof(fn), "textures/%s.wal", map_surfaces[i].rname);
+		CL_PrefetchImage (fn);
+	}
+
+	for (i=2 ; i<max_models && cl.configstrings[CS_MODELS+i][0] ; i++)
+	{
+		name = cl.configstrings[CS_MODELS+i];
+		if (name[0] != '*' && name[0] != '#')
+			FS_PrefetchFile (name);
+	}
+
+	for (i=1 ; i<max_images && cl.configstrings[cs_images+i][0] ; i++)
+	{
+		name = cl.configstrings[cs_images+i];
+		if (name[0] == '/' || name[0] == '\\')
+			CL_PrefetchImage (name+1);
+		else
+		{
+			Com_sprintf (fn, sizeof(fn), "pics/%s.pcx", name);
+			CL_PrefetchImage (fn);
+		}
+	}
+}
+
+
 /*
 =================
 CL_RequestNextDownload
@@ -273,6 +387,8 @@ void CL_RequestNextDownload (void)
 					map_checksum, cl.configstrings[CS_MAPCHECKSUM]);
 				return;
 			}
+
+			CL_PrefetchLevel ();
 		}
 
 		if (precache_check > OLD_ENV_CNT && precache_check < OLD_TEXTURE_CNT) {
@@ -604,6 +720,8 @@ void CL_RequestNextDownload (void)
 					map_checksum, cl.configstrings[CS_MAPCHECKSUM]);
 				return;
 			}
+
+			CL_PrefetchLevel ();
 		}
 
 		if (precache_check > ENV_CNT && precache_check < TEXTURE_CNT) {
@@ -717,6 +835,7 @@ void CL_RequestNextDownload (void)
 
 	CL_RegisterSounds ();
 	CL_PrepRefresh ();
+	FS_ClearPrefetch ();
 
 	MSG_WriteByte (&cls.netchan.message, clc_stringcmd);
 	MSG_WriteString (&cls.netchan.message, va("begin %i\n", precache_spawncount) );
@@ -987,6 +1106,7 @@ void CL_ParseDownload (void)
 		r = rename (oldn, newn);
 		if (r)
 			Com_Printf ("failed to rename.\n");
+		FS_FlushLookupCache ();
 
 		cls.download = NULL;
 		cls.downloadpercent = 0;
@@ -978,6 +978,7 @@ void CL_ParseFrame (void)
 		cl.frame.valid = true;		// uncompressed frame
 		old = NULL;
 		cls.demowaiting = false;	// we can start recording now
+		cls.demokeyframe = cls.demorecording;
 	}
 	else
 	{
@@ -2341,6 +2342,8 @@ void CL_AddEntities (void)
 	if (cls.state != ca_active)
 		return;
 
+	CL_BenchBegin (BENCH_ENTITIES);
+
 	if (cl.time > cl.frame.servertime)
 	{
 		if (cl_showclamp->value)
@@ -2378,9 +2381,13 @@ void CL_AddEntities (void)
 
 	//CL_AddProjectiles ();
 	CL_AddTEnts ();
+	CL_BenchBegin (BENCH_PARTICLES);
 	CL_AddParticles ();
+	CL_BenchEnd (BENCH_PARTICLES);
 	CL_AddDLights ();
 	CL_AddLightStyles ();
+
+	CL_BenchEnd (BENCH_ENTITIES);
 }
 
 
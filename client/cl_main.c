@@ -48,6 +48,7 @@ cvar_t	*cl_autoskins;
 cvar_t	*cl_footsteps;
 cvar_t	*cl_timeout;
 cvar_t	*cl_predict;
+cvar_t	*cl_demokeyframes;
 //cvar_t	*cl_minfps;
 cvar_t	*cl_maxfps;
 cvar_t	*cl_sleep; 
@@ -178,6 +179,15 @@ void CL_WriteDemoMessage (void)
 {
 	int32_t		len, swlen;
 
+	// index the messages that hold a full frame, and keep asking
+	// the server for one every cl_demokeyframes seconds
+	if (cls.demokeyframe && cls.demonextkey >= 0)
+	{
+		Demo_AddKeyframe (&cls.demoindex, cl.frame.servertime, ftell(cls.demofile));
+		cls.demonextkey = cl.frame.servertime + cl_demokeyframes->value*1000;
+	}
+	cls.demokeyframe = false;
+
 	// the first eight bytes are just packet sequencing stuff
 	len = net_message.cursize-8;
 	swlen = LittleLong(len);
@@ -206,6 +216,7 @@ void CL_Stop_f (void)
 // finish up
 	len = -1;
 	fwrite (&len, 4, 1, cls.demofile);
+	Demo_WriteIndex (&cls.demoindex, cls.demofile);
 	fclose (cls.demofile);
 	cls.demofile = NULL;
 	cls.demorecording = false;
@@ -266,6 +277,9 @@ void CL_Record_f (void)
 
 	// don't start saving messages until a non-delta compressed message is received
 	cls.demowaiting = true;
+	cls.demokeyframe = false;
+	cls.demonextkey = 0;
+	Demo_BeginIndex (&cls.demoindex);
 
 	//
 	// write out messages to hold the startup information
@@ -506,8 +520,10 @@ void CL_SendConnectPacket (void)
 		Netchan_OutOfBandPrint (NS_CLIENT, adr, "connect %i %i %i \"%s\"\n",
 			OLD_PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo() );
 	else
-		Netchan_OutOfBandPrint (NS_CLIENT, adr, "connect %i %i %i \"%s\"\n",
-			PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo() );
+		Netchan_OutOfBandPrint (NS_CLIENT, adr, "connect %i %i %i \"%s\"%s%s\n",
+			PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo(),
+			net_compress->value ? " " NETCHAN_ZLIB : "",
+			net_fragment->value ? " " NETCHAN_FRAG : "" );
 }
 
 /*
@@ -706,6 +722,7 @@ void CL_Disconnect (void)
 			Com_Printf ("%i frames, %3.1f seconds: %3.1f fps\n", cl.timedemo_frames,
 			time/1000.0, cl.timedemo_frames*1000.0 / time);
 	}
+	CL_BenchFinish ();
 
 	VectorClear (cl.refdef.blend);
 	//R_SetPalette(NULL);
@@ -725,9 +742,13 @@ void CL_Disconnect (void)
 	Netchan_Transmit (&cls.netchan, strlen(final), (byte *)final);
 	Netchan_Transmit (&cls.netchan, strlen(final), (byte *)final);
 	Netchan_Transmit (&cls.netchan, strlen(final), (byte *)final);
+	Netchan_Free (&cls.netchan);
 
 	CL_ClearState ();
 
+	// don't hold on to a level that was never finished loading
+	FS_ClearPrefetch ();
+
 	// stop download
 	if (cls.download) {
 		fclose(cls.download);
@@ -1107,6 +1128,9 @@ void CL_ConnectionlessPacket (void)
                 return;
             }
             Netchan_Setup (NS_CLIENT, &cls.netchan, net_from, cls.quakePort);
+            cls.netchan.compress = Netchan_HasExtension (NETCHAN_ZLIB, 1);
+            if (Netchan_HasExtension (NETCHAN_FRAG, 1))
+                Netchan_EnableFragments (&cls.netchan);
             MSG_WriteChar (&cls.netchan.message, clc_stringcmd);
             MSG_WriteString (&cls.netchan.message, "new");
             cls.state = ca_connected;
@@ -1333,8 +1357,10 @@ void CL_Precache_f (void)
 		uint32_t	map_checksum;		// for detecting cheater maps
 
 		CM_LoadMap (cl.configstrings[CS_MODELS+1], true, &map_checksum);
+		CL_PrefetchLevel ();
 		CL_RegisterSounds ();
 		CL_PrepRefresh ();
+		FS_ClearPrefetch ();
 		return;
 	}
 
@@ -1473,6 +1499,7 @@ void CL_InitLocal (void)
 	cl_timeout = Cvar_Get ("cl_timeout", "120", 0);
 	cl_paused = Cvar_Get ("paused", "0", CVAR_CHEAT);
 	cl_timedemo = Cvar_Get ("timedemo", "0", CVAR_CHEAT);
+	cl_demokeyframes = Cvar_Get ("cl_demokeyframes", "10", CVAR_ARCHIVE);
 
 	rcon_client_password = Cvar_Get ("rcon_password", "", 0);
 	rcon_address = Cvar_Get ("rcon_address", "", 0);
@@ -1515,6 +1542,7 @@ void CL_InitLocal (void)
 	Cmd_AddCommand ("disconnect", CL_Disconnect_f);
 	Cmd_AddCommand ("record", CL_Record_f);
 	Cmd_AddCommand ("stop", CL_Stop_f);
+	Cmd_AddCommand ("benchmark", CL_Benchmark_f);
 
 	Cmd_AddCommand ("quit", CL_Quit_f);
 
@@ -1788,6 +1816,8 @@ void CL_Frame (int32_t msec)
 	else 
 		averageFrameTime = 0.0f;
 
+	CL_BenchBeginFrame ();
+
 	Sys_SendKeyEvents();
 
 	// let the mouse activate or deactivate
@@ -1829,13 +1859,19 @@ void CL_Frame (int32_t msec)
 
 
 	// fetch results from server
+	CL_BenchBegin (BENCH_PARSE);
 	CL_ReadPackets ();
+	CL_BenchEnd (BENCH_PARSE);
 
 	// send a new command message to the server
+	Prof_Begin ("CL_SendCommand");
 	CL_SendCommand ();
+	Prof_End ();
 
 	// predict all unacknowledged movements
+	Prof_Begin ("CL_PredictMovement");
 	CL_PredictMovement ();
+	Prof_End ();
 
 	// allow rendering DLL change
 	VID_CheckChanges ();
@@ -1845,12 +1881,16 @@ void CL_Frame (int32_t msec)
 	// update the screen
 	if (host_speeds->value)
 		time_before_ref = Sys_Milliseconds ();
+	CL_BenchBegin (BENCH_REFRESH);
 	SCR_UpdateScreen ();
+	CL_BenchEnd (BENCH_REFRESH);
 	if (host_speeds->value)
 		time_after_ref = Sys_Milliseconds ();
 
 	// update audio
+	CL_BenchBegin (BENCH_SOUND);
 	S_Update (cl.refdef.vieworg, cl.v_forward, cl.v_right, cl.v_up);
+	CL_BenchEnd (BENCH_SOUND);
 	
 	// advance local effects for next frame
 	CL_RunDLights ();
@@ -1861,6 +1901,8 @@ void CL_Frame (int32_t msec)
 
 	cls.framecount++;
 
+	CL_BenchEndFrame ();
+
 	if ( log_stats->value )
 	{
 		if ( cls.state == ca_active )
@@ -151,6 +151,13 @@ void CL_ParseServerData (void)
 	CL_ClearState ();
 	cls.state = ca_connected;
 
+	// server times start over, so the demo index stays with the first level
+	if (cls.demorecording)
+	{
+		cls.demonextkey = -1;
+		Demo_CloseIndex (&cls.demoindex);
+	}
+
 // parse protocol version number
 	i = MSG_ReadLong (&net_message);
 	cls.serverProtocol = i;
@@ -467,6 +474,9 @@ void CL_ParseConfigString (void)
 	strncpy (olds, cl.configstrings[i], sizeof(olds));
 	olds[sizeof(olds) - 1] = 0;
 
+	if (cls.demorecording && !cls.demowaiting)
+		Demo_LogConfigstring (&cls.demoindex, cl.frame.servertime, i, cl.configstrings[i], s);
+
 	strcpy (cl.configstrings[i], s);
 
 	// do something apropriate 
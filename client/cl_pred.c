@@ -20,6 +20,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "client.h"
 
+// prediction traces have their own context so they don't share
+// trace state with the server
+static cmtrace_t	cl_tracectx;
+
 
 /*
 ===================
@@ -110,14 +114,14 @@ void CL_ClipMoveToEntities (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
 			bmins[2] = -zd;
 			bmaxs[2] = zu;
 
-			headnode = CM_HeadnodeForBox (bmins, bmaxs);
+			headnode = CM_HeadnodeForBoxCtx (&cl_tracectx, bmins, bmaxs);
 			angles = vec3_origin;	// boxes don't rotate
 		}
 
 		if (tr->allsolid)
 			return;
 
-		trace = CM_TransformedBoxTrace (start, end,
+		trace = CM_TransformedBoxTraceCtx (&cl_tracectx, start, end,
 			mins, maxs, headnode,  MASK_PLAYERSOLID,
 			ent->origin, angles);
 
@@ -186,14 +190,14 @@ void CL_ClipMoveToEntities2 (int32_t entnum, vec3_t start, vec3_t mins, vec3_t m
 			bmins[2] = -zd;
 			bmaxs[2] = zu;
 
-			headnode = CM_HeadnodeForBox (bmins, bmaxs);
+			headnode = CM_HeadnodeForBoxCtx (&cl_tracectx, bmins, bmaxs);
 			angles = vec3_origin;	// boxes don't rotate
 		}
 
 		if (tr->allsolid)
 			return;
 
-		trace = CM_TransformedBoxTrace (start, end,
+		trace = CM_TransformedBoxTraceCtx (&cl_tracectx, start, end,
 			mins, maxs, headnode,  MASK_PLAYERSOLID,
 			ent->origin, angles);
 
@@ -249,7 +253,7 @@ void CL_ClipMoveToBrushEntities ( vec3_t start, vec3_t mins, vec3_t maxs, vec3_t
 		if (tr->allsolid)
 			return;
 
-		trace = CM_TransformedBoxTrace (start, end,
+		trace = CM_TransformedBoxTraceCtx (&cl_tracectx, start, end,
 			mins, maxs, headnode,  MASK_PLAYERSOLID,
 			ent->origin, angles);
 
@@ -281,7 +285,7 @@ trace_t CL_Trace (vec3_t start, vec3_t end, float size,  int32_t contentmask)
     const vec3_t maxs = {size, size, size};
     const vec3_t mins = {-size, -size, -size};
 
-	return CM_BoxTrace (start, end, mins, maxs, 0, contentmask);
+	return CM_BoxTraceCtx (&cl_tracectx, start, end, mins, maxs, 0, contentmask);
 }
 
 
@@ -298,7 +302,7 @@ trace_t CL_BrushTrace (vec3_t start, vec3_t end, float size,  int32_t contentmas
     vec3_t mins = {-size, -size, -size};
 	trace_t	t;
 
-	t = CM_BoxTrace (start, end, mins, maxs, 0, contentmask);
+	t = CM_BoxTraceCtx (&cl_tracectx, start, end, mins, maxs, 0, contentmask);
 	if (t.fraction < 1.0)
 		t.ent = (struct edict_s *)1;
 
@@ -323,7 +327,7 @@ trace_t CL_PMTrace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
 		maxs = vec3_origin;
 
 	// check against world
-	t = CM_BoxTrace (start, end, mins, maxs, 0, MASK_PLAYERSOLID);
+	t = CM_BoxTraceCtx (&cl_tracectx, start, end, mins, maxs, 0, MASK_PLAYERSOLID);
 	if (t.fraction < 1.0)
 		t.ent = (struct edict_s *)1;
 
@@ -350,7 +354,7 @@ trace_t CL_PMSurfaceTrace (int32_t playernum, vec3_t start, vec3_t mins, vec3_t
 		maxs = vec3_origin;
 
 	// check against world
-	t = CM_BoxTrace (start, end, mins, maxs, 0, contentmask);
+	t = CM_BoxTraceCtx (&cl_tracectx, start, end, mins, maxs, 0, contentmask);
 	if (t.fraction < 1.0)
 		t.ent = (struct edict_s *)1;
 
@@ -678,10 +678,27 @@ void R_SetLightLevel ();
 void R_SetGL2D ();
 void R_RenderCommon (refdef_t *fd);
 void R_Clear(void);
+/*
+==================
+VR_EyeOffset
+==================
+*/
+static void VR_EyeOffset (int index, vec3_t out)
+{
+	if (vr_autoipd->value)
+	{
+		VectorScale(vrState.renderParams[index].viewOffset,PLAYER_HEIGHT_UNITS / PLAYER_HEIGHT_M, out);
+	} else {
+		float viewOffset = (vr_ipd->value / 2000.0) * PLAYER_HEIGHT_UNITS / PLAYER_HEIGHT_M;
+		VectorSet(out,(-1 + index * 2) * viewOffset ,0,0);
+	}
+}
+
 void VR_RenderStereo ()
 {
 	extern int32_t entitycmpfnc( const entity_t *, const entity_t * );
 	vec3_t view,viewOrig, offset;
+	float viewSpread;
 	int index;
 
 	if (cls.state != ca_active)
@@ -846,11 +863,21 @@ void VR_RenderStereo ()
 	}
 
 	VectorCopy(view,cl.refdef.vieworg);
+
+	// the eyes share the world lists, which have to reach the farther
+	// one, the hmd offsets needn't be symmetric or just sideways
+	viewSpread = 0;
+	for (index = 0; index < NUM_EYES; index++)
+	{
+		vec3_t eyeOffset;
+		VR_EyeOffset(index, eyeOffset);
+		viewSpread = max(viewSpread, VectorLength(eyeOffset));
+	}
+
 	// left eye rendering
 	for (index = 0; index < NUM_EYES; index++)
 	{
 		eye_param_t params;
-		int eyeSign = (-1 + index * 2);
 
 		if (vr_autofov->value)
 		{
@@ -868,13 +895,8 @@ void VR_RenderStereo ()
 		
 		if (cl.refdef.rdflags & RDF_UNDERWATER)
 			params.projection = R_ApplyWarpToProjection(params.projection);
-		if (vr_autoipd->value)
-		{
-			VectorScale(vrState.renderParams[index].viewOffset,PLAYER_HEIGHT_UNITS / PLAYER_HEIGHT_M, params.viewOffset);
-		} else {
-			float viewOffset = (vr_ipd->value / 2000.0) * PLAYER_HEIGHT_UNITS / PLAYER_HEIGHT_M;
-			VectorSet(params.viewOffset,eyeSign * viewOffset ,0,0);
-		}
+		VR_EyeOffset(index, params.viewOffset);
+		params.viewSpread = viewSpread;
 
 		R_RenderViewIntoFBO( &cl.refdef, params,vrState.eyeFBO[index],NULL);	
 	}
@@ -1027,6 +1049,7 @@ void R_RenderStereo ()
 		int eyeSign = (-1 + index * 2);
 		float viewOffset = (r_stereo_separation->value / 2000.0) * PLAYER_HEIGHT_UNITS / PLAYER_HEIGHT_M;
 		VectorSet(params.viewOffset,eyeSign * viewOffset ,0,0);
+		params.viewSpread = viewOffset;
 		params.projection.x.offset = eyeSign * r_stereo_separation->value / 2000.0;
 
 		R_RenderViewIntoFBO( &cl.refdef, params,&stereo_fbo[index],NULL);	
@@ -1289,6 +1312,7 @@ void V_RenderViewIntoFBO (fbo_t *fbo)
 
 	params.projection.x.offset = 0.0;
 	VectorSet(params.viewOffset,0,0,0);
+	params.viewSpread = 0;
 
 	R_RenderCommon(&cl.refdef);
 
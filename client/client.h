@@ -271,6 +271,9 @@ typedef struct
 	qboolean	demorecording;
 	qboolean	demowaiting;	// don't record until a non-delta message is received
 	FILE		*demofile;
+	demoindex_t	demoindex;		// keyframes and configstring changes so far
+	qboolean	demokeyframe;	// the message being parsed holds a non-delta frame
+	int32_t		demonextkey;	// servertime to ask for the next non-delta frame at
 
 #ifdef	ROQ_SUPPORT
 	// Cinematic information
@@ -383,6 +386,7 @@ extern	cvar_t	*cl_lightlevel;	// FIXME HACK
 
 extern	cvar_t	*cl_paused;
 extern	cvar_t	*cl_timedemo;
+extern	cvar_t	*cl_demokeyframes;	// seconds between demo keyframes, 0 for none
 
 // Knighthare added
 extern	cvar_t	*info_password;
@@ -736,6 +740,14 @@ void IN_CenterView (void);
 float CL_KeyState (kbutton_t *key);
 char *Key_KeynumToString (int32_t keynum);
 
+//
+// cl_bench.c
+//
+void CL_BenchBeginFrame (void);
+void CL_BenchEndFrame (void);
+void CL_BenchFinish (void);
+void CL_Benchmark_f (void);
+
 //
 // cl_demo.c
 //
@@ -757,6 +769,7 @@ void CL_ParseClientinfo (int32_t player);
 // cl_download.c
 //
 void CL_RequestNextDownload (void);
+void CL_PrefetchLevel (void);
 qboolean CL_CheckOrDownloadFile (char *filename);
 void CL_Download_f (void);
 void CL_ParseDownload (void);
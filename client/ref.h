@@ -256,4 +256,26 @@ typedef struct
 	particle_t	*decals;
 } refdef_t;
 
+//
+// cl_bench.c, stages timed by the benchmark command, most of them are
+// also profiler zones
+//
+typedef enum
+{
+	BENCH_FRAME,
+	BENCH_PARSE,
+	BENCH_ENTITIES,
+	BENCH_PARTICLES,
+	BENCH_SOUND,
+	BENCH_REFRESH,
+	BENCH_MARKLEAVES,
+	BENCH_WORLDNODE,
+	BENCH_LIGHTMAPS,
+	BENCH_PARTICLESORT,
+	BENCH_NUMSTAGES
+} benchstage_t;
+
+void	CL_BenchBegin (benchstage_t stage);
+void	CL_BenchEnd (benchstage_t stage);
+
 #endif // __REF_H
@@ -214,6 +214,11 @@ extern	vec3_t	vpn;
 extern	vec3_t	vright;
 extern	vec3_t	r_origin;
 
+extern	int32_t		r_viewcount;
+extern	qboolean	r_sharedview;
+extern	vec3_t		r_listorigin;
+extern	float		r_listspread;
+
 //
 // screen size info
 //
@@ -288,6 +293,8 @@ extern	cvar_t	*r_picmip;
 extern	cvar_t	*r_skymip;
 extern	cvar_t	*r_playermip;
 extern	cvar_t	*r_showtris;
+extern	cvar_t	*r_worldvbo;
+extern	cvar_t	*r_sharedworld;
 extern	cvar_t	*r_showbbox;	// Knightmare- show model bounding box
 extern	cvar_t	*r_finish;
 extern	cvar_t	*r_cull;
@@ -359,7 +366,6 @@ void R_TranslatePlayerSkin (int32_t playernum);
 
 // Knightmare- added some of Psychospaz's shortcuts
 void ElementAddNode (sortedelement_t *base, sortedelement_t *thisElement);
-int32_t transCompare (const void *arg1, const void *arg2);
 
 void R_MaxColorVec (vec3_t color);
 
@@ -387,6 +393,24 @@ void R_DrawDecals (void);
 void R_DrawAllDecals (void);
 void R_ParticleStencil (int32_t passnum);
 
+//
+// r_sort.c
+//
+typedef struct
+{
+	uint32_t	key;
+	int32_t		index;
+} sortkey_t;
+
+uint32_t R_FloatSortKey (float f);
+qboolean R_KeysSorted (const sortkey_t *keys, int32_t count);
+sortkey_t *R_SortKeys (sortkey_t *keys, sortkey_t *temp, int32_t count);
+
+//
+// r_worldindex.c
+//
+int32_t R_WriteSurfaceIndexes (msurface_t *surf, uint32_t *out);
+
 //
 // r_light.c
 //
@@ -398,6 +422,8 @@ void R_ParticleStencil (int32_t passnum);
 #define	LM_BLOCK_WIDTH	128
 #define	LM_BLOCK_HEIGHT	128
 
+#define	MAX_BLOCKLIGHTS	(128*128*4)	// floats of scratch for building one lightmap
+
 //#define	MAX_LIGHTMAPS	128	// moved this up above to keeep TEXNUM_* values aligned
 
 #define GL_LIGHTMAP_FORMAT	GL_RGBA
@@ -442,6 +468,9 @@ extern gllightmapstate_t gl_lms;
 void R_LightPoint (vec3_t p, vec3_t color, qboolean isEnt);
 void R_LightPointDynamics (vec3_t p, vec3_t color, m_dlight_t *list, int32_t *amount, int32_t max);
 void R_PushDlights (void);
+void R_BuildLightMapBlock (msurface_t *surf, entity_t *ent, float *blocklights, byte *dest, int32_t stride);
+void R_LightmapBench_f (void);
+extern	int32_t	r_dlightchanged[(MAX_DLIGHTS+31)>>5];	// set for dlights that differ from the last frame
 void R_ShadowLight (vec3_t pos, vec3_t lightAdd);
 void R_MarkLights (dlight_t *light, int32_t bit, mnode_t *node);
 
@@ -497,6 +526,7 @@ typedef struct {
 typedef struct {
 	vec3_t viewOffset;
 	eyeScaleOffset_t projection;
+	float viewSpread;	// farthest any view of the frame is offset, for the shared world lists
 } eye_param_t;
 
 //
@@ -527,6 +557,7 @@ void R_DrawBrushModel (entity_t *e);
 void R_DrawSpriteModel (entity_t *e);
 void R_DrawBeam( entity_t *e );
 void R_DrawWorld (void);
+void R_FreeWorldVBO (model_t *mod);
 void R_RenderDlights (void);
 void R_DrawAlphaSurfaces (void);
 void R_RenderBrushPoly (msurface_t *fa);
@@ -137,6 +137,8 @@ typedef struct msurface_s
 	Sint32			dlight_s, dlight_t; // gl lightmap coordinates for dynamic lightmaps
 
 	glpoly_t	*polys;				// multiple if warped
+	Sint32			vbo_firstvert;		// in the world vertex buffer, -1 if not in it
+	Sint32			vbo_numindexes;
 	struct	msurface_s	*texturechain;
 	struct  msurface_s	*lightmapchain;
 
@@ -146,6 +148,8 @@ typedef struct msurface_s
 	Sint32			dlightframe;
 	Sint32			dlightbits[(MAX_DLIGHTS+31)>>5];	// derived from MAX_DLIGHTS
 	qboolean	cached_dlight;
+	Sint32			cached_dlightbits[(MAX_DLIGHTS+31)>>5];	// dlightbits the lightmap was built with
+	Sint32			cached_dlightframe;	// last frame the lightmap was built or found current
 
 	Sint32			lightmaptexturenum;
 	byte		styles[MAXLIGHTMAPS];
@@ -290,6 +294,7 @@ typedef struct model_s
 
 	Sint32			extradatasize;
 	void		*extradata;
+	const void	*bspfile;		// mapped bsp that lumps point into, or NULL
 
 	qboolean	hasAlpha; // if model has scripted transparency
 
@@ -309,34 +309,18 @@ PCX LOADING
 
 /*
 ==============
-LoadPCX
+R_ParsePCX
+
+Swaps the header in place, returns NULL if the file can't be used
 ==============
 */
-void LoadPCX (char *filename, byte **pic, byte **palette, int32_t *width, int32_t *height)
+static pcx_t *R_ParsePCX (byte *raw, int32_t len)
 {
-	byte	*raw;
 	pcx_t	*pcx;
-	int32_t		x, y;
-	int32_t		len;
-	int32_t		dataByte, runLength;
-	byte	*out, *pix;
-
-	*pic = NULL;
-	*palette = NULL;
 
-	//
-	// load the file
-	//
-	len = FS_LoadFile (filename, (void **)&raw);
-	if (!raw)
-	{
-		VID_Printf (PRINT_DEVELOPER, "Bad pcx file %s\n", filename);
-		return;
-	}
+	if (len < sizeof(pcx_t))
+		return NULL;
 
-	//
-	// parse the PCX file
-	//
 	pcx = (pcx_t *)raw;
 
     pcx->xmin = LittleShort(pcx->xmin);
@@ -348,35 +332,32 @@ void LoadPCX (char *filename, byte **pic, byte **palette, int32_t *width, int32_
     pcx->bytes_per_line = LittleShort(pcx->bytes_per_line);
     pcx->palette_type = LittleShort(pcx->palette_type);
 
-	raw = &pcx->data;
-
 	if (pcx->manufacturer != 0x0a
 		|| pcx->version != 5
 		|| pcx->encoding != 1
 		|| pcx->bits_per_pixel != 8
 		|| pcx->xmax >= 640
 		|| pcx->ymax >= 480)
-	{
-		VID_Printf (PRINT_ALL, "Bad pcx file %s\n", filename);
-		return;
-	}
-
-	out = (byte*)Z_TagMalloc ( (pcx->ymax+1) * (pcx->xmax+1) , TAG_RENDERER);
+		return NULL;
 
-	*pic = out;
+	return pcx;
+}
 
-	pix = out;
+/*
+==============
+R_UnpackPCX
 
-	if (palette)
-	{
-		*palette = (byte*)Z_TagMalloc(768, TAG_RENDERER);
-		memcpy (*palette, (byte *)pcx + len - 768, 768);
-	}
+Expands the run length coded pixels, returns false if the file was malformed
+==============
+*/
+static qboolean R_UnpackPCX (pcx_t *pcx, int32_t len, byte *out)
+{
+	int32_t		x, y;
+	int32_t		dataByte, runLength;
+	byte	*raw, *pix;
 
-	if (width)
-		*width = pcx->xmax+1;
-	if (height)
-		*height = pcx->ymax+1;
+	raw = &pcx->data;
+	pix = out;
 
 	for (y=0 ; y<=pcx->ymax ; y++, pix += pcx->xmax+1)
 	{
@@ -398,7 +379,58 @@ void LoadPCX (char *filename, byte **pic, byte **palette, int32_t *width, int32_
 
 	}
 
-	if ( raw - (byte *)pcx > len)
+	return raw - (byte *)pcx <= len;
+}
+
+/*
+==============
+LoadPCX
+==============
+*/
+void LoadPCX (char *filename, byte **pic, byte **palette, int32_t *width, int32_t *height)
+{
+	byte	*raw;
+	pcx_t	*pcx;
+	int32_t		len;
+
+	*pic = NULL;
+	*palette = NULL;
+
+	//
+	// load the file
+	//
+	len = FS_LoadFile (filename, (void **)&raw);
+	if (!raw)
+	{
+		VID_Printf (PRINT_DEVELOPER, "Bad pcx file %s\n", filename);
+		return;
+	}
+
+	//
+	// parse the PCX file
+	//
+	pcx = R_ParsePCX (raw, len);
+	if (!pcx)
+	{
+		VID_Printf (PRINT_ALL, "Bad pcx file %s\n", filename);
+		FS_FreeFile (raw);
+		return;
+	}
+
+	*pic = (byte*)Z_TagMalloc ( (pcx->ymax+1) * (pcx->xmax+1) , TAG_RENDERER);
+
+	if (palette)
+	{
+		*palette = (byte*)Z_TagMalloc(768, TAG_RENDERER);
+		memcpy (*palette, (byte *)pcx + len - 768, 768);
+	}
+
+	if (width)
+		*width = pcx->xmax+1;
+	if (height)
+		*height = pcx->ymax+1;
+
+	if (!R_UnpackPCX (pcx, len, *pic))
 	{
 		VID_Printf (PRINT_DEVELOPER, "PCX file %s was malformed", filename);
 		Z_Free (*pic);
@@ -409,6 +441,98 @@ void LoadPCX (char *filename, byte **pic, byte **palette, int32_t *width, int32_
 }
 
 
+/*
+=========================================================
+
+PREFETCHED IMAGES
+
+=========================================================
+*/
+
+typedef struct
+{
+	int32_t		width, height;
+	int32_t		bits;				// 8 or 32
+	byte		pic[4];				// variable sized
+} decodedimage_t;
+
+/*
+==============
+R_DecodePrefetchedImage
+
+Runs on the filesystem's prefetch thread: decodes pcx, tga, png
+and jpg files into a malloc'd decodedimage_t, so registration only
+has to upload.  Must not print or touch the zone.
+==============
+*/
+static void *R_DecodePrefetchedImage (const char *name, const byte *data, int32_t length, int32_t *decodedLength)
+{
+	decodedimage_t	*decoded;
+	const char	*ext;
+	byte		*copy;
+	pcx_t		*pcx;
+	stbi_uc		*rgbadata;
+	int			w, h, c;
+	int32_t		size;
+
+	ext = strrchr (name, '.');
+	if (!ext)
+		return NULL;
+
+	if (!Q_strcasecmp (ext, ".pcx"))
+	{
+		// the header gets swapped in place
+		copy = (byte*)malloc (length);
+		if (!copy)
+			return NULL;
+		memcpy (copy, data, length);
+
+		decoded = NULL;
+		pcx = R_ParsePCX (copy, length);
+		if (pcx)
+		{
+			size = (pcx->xmax+1) * (pcx->ymax+1);
+			decoded = (decodedimage_t*)malloc (sizeof(decodedimage_t) + size);
+		}
+		if (decoded)
+		{
+			decoded->width = pcx->xmax+1;
+			decoded->height = pcx->ymax+1;
+			decoded->bits = 8;
+			if (!R_UnpackPCX (pcx, length, decoded->pic))
+			{
+				free (decoded);
+				decoded = NULL;
+			}
+		}
+		free (copy);
+	}
+	else if (!Q_strcasecmp (ext, ".tga") || !Q_strcasecmp (ext, ".png") || !Q_strcasecmp (ext, ".jpg"))
+	{
+		rgbadata = stbi_load_from_memory (data, length, &w, &h, &c, 4);
+		if (!rgbadata)
+			return NULL;
+
+		size = w * h * 4;
+		decoded = (decodedimage_t*)malloc (sizeof(decodedimage_t) + size);
+		if (decoded)
+		{
+			decoded->width = w;
+			decoded->height = h;
+			decoded->bits = 32;
+			memcpy (decoded->pic, rgbadata, size);
+		}
+		STBI_FREE (rgbadata);
+	}
+	else	// wal files are uploaded straight from the file
+		return NULL;
+
+	if (decoded)
+		*decodedLength = sizeof(decodedimage_t) + size;
+	return decoded;
+}
+
+
 /*
 =========================================================
 
@@ -1065,7 +1189,16 @@ image_t *R_LoadImage(char *name, imagetype_t type) {
     int32_t len = strlen(name);
     char *ext = name + len - 4;
     int token = Q_STLookup(&supported_image_types, ext);
-    
+    decodedimage_t *decoded;
+
+    decoded = (decodedimage_t *)FS_TakeDecoded (name);
+    if (decoded)
+    {
+        image = R_LoadPic (name, decoded->pic, decoded->width, decoded->height, type, decoded->bits);
+        free (decoded);
+        return image;
+    }
+
     if (token == s_pcx)
     {
         byte	*pic = NULL;
@@ -1358,6 +1491,8 @@ void R_InitImages (void)
     s_png = Q_STAutoRegister(&supported_image_types, ".png");
     
     Q_STAutoPack(&supported_image_types);
+
+    FS_SetPrefetchDecoder (R_DecodePrefetchedImage);
     
 	// Knightmare- reinitialize these after a vid_restart
 	// this is needed because the renderer is no longer a DLL
@@ -1499,5 +1634,7 @@ void R_ShutdownImages (void)
 		memset (image, 0, sizeof(*image));
 	}
     Q_STFree(&failed_images);
+
+    FS_SetPrefetchDecoder (NULL);
 }
 
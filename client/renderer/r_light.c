@@ -22,6 +22,28 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "include/r_local.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define	LM_AVX2
+#define	LM_SSE2
+#define	LM_KERNEL	"avx2"
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define	LM_SSE2
+#define	LM_KERNEL	"sse2"
+#else
+#define	LM_KERNEL	"scalar"
+#endif
+
+#if defined(LM_SSE2)
+// Q_ftol is fistp on x86 msvc, which rounds to nearest like cvtps
+#if defined(_M_IX86) && !defined(C_ONLY)
+#define	LM_FTOL(v)	_mm_cvtps_epi32 (v)
+#else
+#define	LM_FTOL(v)	_mm_cvttps_epi32 (v)
+#endif
+#endif
+
 int32_t	r_dlightframecount;
 
 void vectoangles (vec3_t value1, vec3_t angles);
@@ -196,6 +218,34 @@ void R_MarkLights (dlight_t *light, int32_t num, mnode_t *node)
 }
 
 
+int32_t			r_dlightchanged[(MAX_DLIGHTS+31)>>5];
+static dlight_t	r_olddlights[MAX_DLIGHTS];
+static int32_t	r_numolddlights;
+
+/*
+=============
+R_CheckDlightChanges
+
+Flags every dlight that isn't the same as the one in its slot last
+frame, so surfaces lit by the same lights as before can keep their
+lightmap
+=============
+*/
+static void R_CheckDlightChanges (void)
+{
+	int32_t		i, num;
+
+	num = min(r_newrefdef.num_dlights, MAX_DLIGHTS);
+	memset (r_dlightchanged, 0, sizeof(r_dlightchanged));
+	for (i=0; i<num; i++)
+	{
+		if (i >= r_numolddlights || memcmp(&r_newrefdef.dlights[i], &r_olddlights[i], sizeof(dlight_t)))
+			r_dlightchanged[i >> 5] |= 1 << (i & 31);
+	}
+	memcpy (r_olddlights, r_newrefdef.dlights, num * sizeof(dlight_t));
+	r_numolddlights = num;
+}
+
 /*
 =============
 R_PushDlights
@@ -206,6 +256,8 @@ void R_PushDlights (void)
 	int32_t		i;
 	dlight_t	*l;
 
+	R_CheckDlightChanges ();
+
 	if (r_flashblend->value)
 		return;
 
@@ -706,13 +758,16 @@ void R_ShadowLight (vec3_t pos, vec3_t lightAdd)
 
 //===================================================================
 
-static float s_blocklights[128*128*4]; //Knightmare-  was [34*34*3], supports max chop size of 2048?
+static float s_blocklights[MAX_BLOCKLIGHTS]; //Knightmare-  was [34*34*3], supports max chop size of 2048?
 /*
 ===============
 R_AddDynamicLights
+
+Reads only the surface, ent and the refdef, so the lightmap jobs can
+run it on the workers
 ===============
 */
-void R_AddDynamicLights (msurface_t *surf)
+static void R_AddDynamicLights (msurface_t *surf, entity_t *ent, float *blocklights)
 {
 	int32_t			lnum;
 	int32_t			sd, td;
@@ -744,8 +799,8 @@ void R_AddDynamicLights (msurface_t *surf)
 		}
 	}
 	else {
-		VectorCopy (currententity->origin, entOrigin);
-		VectorCopy (currententity->angles, entAngles);
+		VectorCopy (ent->origin, entOrigin);
+		VectorCopy (ent->angles, entAngles);
 	}
 
 //	if (currententity->angles[0] || currententity->angles[1] || currententity->angles[2])
@@ -800,7 +855,7 @@ void R_AddDynamicLights (msurface_t *surf)
 		local[0] = DotProduct (impact, tex->vecs[0]) + tex->vecs[0][3] - surf->texturemins[0];
 		local[1] = DotProduct (impact, tex->vecs[1]) + tex->vecs[1][3] - surf->texturemins[1];
 
-		pfBL = s_blocklights;
+		pfBL = blocklights;
 		for (t = 0, ftacc = 0; t<tmax; t++, ftacc += 16)
 		{
 			td = local[1] - ftacc;
@@ -848,7 +903,250 @@ void R_SetCacheState (msurface_t *surf)
 #ifdef BATCH_LM_UPDATES
 	// mark if dynamicly lit
 	surf->cached_dlight = (surf->dlightframe == r_framecount);
+	if (surf->cached_dlight)
+		memcpy (surf->cached_dlightbits, surf->dlightbits, sizeof(surf->cached_dlightbits));
+	surf->cached_dlightframe = r_framecount;
+#endif
+}
+
+
+/*
+===============
+R_AccumulateLightmap_C
+
+bl[i] = lightmap[i] * scale[i%3] over count floats, or += when add
+is set.  count is a multiple of 3.
+===============
+*/
+static void R_AccumulateLightmap_C (float *bl, const byte *lightmap, const float *scale, int32_t count, qboolean add)
+{
+	int32_t		i;
+
+	if (add)
+	{
+		for (i=0 ; i<count ; i+=3)
+		{
+			bl[i+0] += lightmap[i+0] * scale[0];
+			bl[i+1] += lightmap[i+1] * scale[1];
+			bl[i+2] += lightmap[i+2] * scale[2];
+		}
+	}
+	else
+	{
+		for (i=0 ; i<count ; i+=3)
+		{
+			bl[i+0] = lightmap[i+0] * scale[0];
+			bl[i+1] = lightmap[i+1] * scale[1];
+			bl[i+2] = lightmap[i+2] * scale[2];
+		}
+	}
+}
+
+/*
+===============
+R_AccumulateLightmap
+
+R_AccumulateLightmap_C a whole number of rgb triples at a time, the
+scale is rotated across the lanes so the samples never need splitting
+into channels
+===============
+*/
+static void R_AccumulateLightmap (float *bl, const byte *lightmap, const float *scale, int32_t count, qboolean add)
+{
+	int32_t		i = 0;
+
+#if defined(LM_AVX2)
+	__m256	s0 = _mm256_setr_ps (scale[0], scale[1], scale[2], scale[0], scale[1], scale[2], scale[0], scale[1]);
+	__m256	s1 = _mm256_setr_ps (scale[2], scale[0], scale[1], scale[2], scale[0], scale[1], scale[2], scale[0]);
+	__m256	s2 = _mm256_setr_ps (scale[1], scale[2], scale[0], scale[1], scale[2], scale[0], scale[1], scale[2]);
+	__m256	f0, f1, f2;
+
+	for ( ; i + 24 <= count ; i += 24)
+	{
+		f0 = _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)(lightmap + i)))), s0);
+		f1 = _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)(lightmap + i + 8)))), s1);
+		f2 = _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)(lightmap + i + 16)))), s2);
+		if (add)
+		{
+			f0 = _mm256_add_ps (f0, _mm256_loadu_ps (bl + i));
+			f1 = _mm256_add_ps (f1, _mm256_loadu_ps (bl + i + 8));
+			f2 = _mm256_add_ps (f2, _mm256_loadu_ps (bl + i + 16));
+		}
+		_mm256_storeu_ps (bl + i, f0);
+		_mm256_storeu_ps (bl + i + 8, f1);
+		_mm256_storeu_ps (bl + i + 16, f2);
+	}
+#elif defined(LM_SSE2)
+	__m128	s0 = _mm_setr_ps (scale[0], scale[1], scale[2], scale[0]);
+	__m128	s1 = _mm_setr_ps (scale[1], scale[2], scale[0], scale[1]);
+	__m128	s2 = _mm_setr_ps (scale[2], scale[0], scale[1], scale[2]);
+	__m128	f0, f1, f2;
+	__m128i	zero = _mm_setzero_si128 ();
+	__m128i	x, lo, hi;
+
+	// loads 16 bytes for 12 samples, so stop before reading past count
+	for ( ; i + 16 <= count ; i += 12)
+	{
+		x = _mm_loadu_si128 ((const __m128i *)(lightmap + i));
+		lo = _mm_unpacklo_epi8 (x, zero);
+		hi = _mm_unpackhi_epi8 (x, zero);
+		f0 = _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpacklo_epi16 (lo, zero)), s0);
+		f1 = _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpackhi_epi16 (lo, zero)), s1);
+		f2 = _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpacklo_epi16 (hi, zero)), s2);
+		if (add)
+		{
+			f0 = _mm_add_ps (f0, _mm_loadu_ps (bl + i));
+			f1 = _mm_add_ps (f1, _mm_loadu_ps (bl + i + 4));
+			f2 = _mm_add_ps (f2, _mm_loadu_ps (bl + i + 8));
+		}
+		_mm_storeu_ps (bl + i, f0);
+		_mm_storeu_ps (bl + i + 4, f1);
+		_mm_storeu_ps (bl + i + 8, f2);
+	}
+#endif
+
+	R_AccumulateLightmap_C (bl + i, lightmap + i, scale, count - i, add);
+}
+
+
+/*
+===============
+R_StoreLightmapRow_C
+
+Packs count pixels of blocklights into dest
+===============
+*/
+static void R_StoreLightmapRow_C (const float *bl, byte *dest, int32_t count, qboolean bgra)
+{
+	int32_t			r, g, b, a, max;
+	int32_t			j;
+
+	for (j=0 ; j<count ; j++)
+	{
+
+		r = Q_ftol( bl[0] );
+		g = Q_ftol( bl[1] );
+		b = Q_ftol( bl[2] );
+
+		// catch negative lights
+		if (r < 0)
+			r = 0;
+		if (g < 0)
+			g = 0;
+		if (b < 0)
+			b = 0;
+
+		//
+		// determine the brightest of the three color components
+		//
+		if (r > g)
+			max = r;
+		else
+			max = g;
+		if (b > max)
+			max = b;
+
+		//
+		// alpha is ONLY used for the mono lightmap case.  For this reason
+		// we set it to the brightest of the color components so that 
+		// things don't get too dim.
+		//
+		a = max;
+
+		//
+		// rescale all the color components if the intensity of the greatest
+		// channel exceeds 1.0
+		//
+		if (max > 255)
+		{
+			float t = 255.0F / max;
+
+			r = r*t;
+			g = g*t;
+			b = b*t;
+			a = a*t;
+		}
+		a = 255;	// fix for alpha test
+
+		if (bgra)
+		{
+			dest[0] = b;
+			dest[1] = g;
+			dest[2] = r;
+			dest[3] = a;
+		}
+		else
+		{
+			dest[0] = r;
+			dest[1] = g;
+			dest[2] = b;
+			dest[3] = a;
+		}
+
+		bl += 3;
+		dest += 4;
+	}
+}
+
+/*
+===============
+R_StoreLightmapRow
+
+R_StoreLightmapRow_C four pixels at a time, with the channels split
+out so the clamp and rescale are selects instead of branches.  AVX2
+builds use this too, splitting eight pixels across the 128 bit halves
+costs more than it saves.
+===============
+*/
+static void R_StoreLightmapRow (const float *bl, byte *dest, int32_t count, qboolean bgra)
+{
+	int32_t		i = 0;
+
+#if defined(LM_SSE2)
+	__m128	zero = _mm_setzero_ps ();
+	__m128	full = _mm_set1_ps (255.0F);
+	__m128i	alpha = _mm_set1_epi32 (255 << 24);
+	__m128	v0, v1, v2, t0, t1, r, g, b, max, over, t;
+	__m128i	ri, gi, bi, px;
+
+	for ( ; i + 4 <= count ; i += 4, bl += 12)
+	{
+		v0 = _mm_loadu_ps (bl);			// r0 g0 b0 r1
+		v1 = _mm_loadu_ps (bl + 4);		// g1 b1 r2 g2
+		v2 = _mm_loadu_ps (bl + 8);		// b2 r3 g3 b3
+
+		t0 = _mm_shuffle_ps (v1, v2, _MM_SHUFFLE(1,1,2,2));
+		r = _mm_shuffle_ps (v0, t0, _MM_SHUFFLE(2,0,3,0));
+		t0 = _mm_shuffle_ps (v0, v1, _MM_SHUFFLE(0,0,1,1));
+		t1 = _mm_shuffle_ps (v1, v2, _MM_SHUFFLE(2,2,3,3));
+		g = _mm_shuffle_ps (t0, t1, _MM_SHUFFLE(2,0,2,0));
+		t0 = _mm_shuffle_ps (v0, v1, _MM_SHUFFLE(1,1,2,2));
+		t1 = _mm_shuffle_ps (v2, v2, _MM_SHUFFLE(3,3,0,0));
+		b = _mm_shuffle_ps (t0, t1, _MM_SHUFFLE(2,0,2,0));
+
+		// convert like Q_ftol and catch negative lights
+		r = _mm_max_ps (_mm_cvtepi32_ps (LM_FTOL (r)), zero);
+		g = _mm_max_ps (_mm_cvtepi32_ps (LM_FTOL (g)), zero);
+		b = _mm_max_ps (_mm_cvtepi32_ps (LM_FTOL (b)), zero);
+
+		// rescale the pixels whose brightest channel exceeds 1.0
+		max = _mm_max_ps (r, _mm_max_ps (g, b));
+		over = _mm_cmpgt_ps (max, full);
+		t = _mm_div_ps (full, max);
+		r = _mm_or_ps (_mm_and_ps (over, _mm_mul_ps (r, t)), _mm_andnot_ps (over, r));
+		g = _mm_or_ps (_mm_and_ps (over, _mm_mul_ps (g, t)), _mm_andnot_ps (over, g));
+		b = _mm_or_ps (_mm_and_ps (over, _mm_mul_ps (b, t)), _mm_andnot_ps (over, b));
+
+		ri = _mm_cvttps_epi32 (bgra ? b : r);
+		gi = _mm_cvttps_epi32 (g);
+		bi = _mm_cvttps_epi32 (bgra ? r : b);
+		px = _mm_or_si128 (_mm_or_si128 (ri, _mm_slli_epi32 (gi, 8)),
+			_mm_or_si128 (_mm_slli_epi32 (bi, 16), alpha));
+		_mm_storeu_si128 ((__m128i *)(dest + i*4), px);
+	}
 #endif
+
+	R_StoreLightmapRow_C (bl, dest + i*4, count - i, bgra);
 }
 
 
@@ -860,15 +1158,27 @@ Combine and scale multiple lightmaps into the floating format in blocklights
 ===============
 */
 void R_BuildLightMap (msurface_t *surf, byte *dest, int32_t stride)
+{
+	R_BuildLightMapBlock (surf, currententity, s_blocklights, dest, stride);
+}
+
+
+/*
+===============
+R_BuildLightMapKernel
+
+simd picks the vector kernels over the scalar ones, they give the
+same bytes and lightmap_bench compares the two
+===============
+*/
+static void R_BuildLightMapKernel (msurface_t *surf, entity_t *ent, float *blocklights, byte *dest, int32_t stride, qboolean simd)
 {
 	int32_t			smax, tmax;
-	int32_t			r, g, b, a, max;
-	int32_t			i, j, size;
+	int32_t			i, size;
+	int32_t			maps, nummaps;
 	byte		*lightmap;
-	float		scale[4];
-	int32_t			nummaps;
-	float		*bl;
-	lightstyle_t	*style;
+	float		scale[3];
+	qboolean	bgra;
 
 	// if ( surf->texinfo->flags & (SURF_SKY|SURF_TRANS33|SURF_TRANS66|SURF_WARP) )
 	if ( surf->texinfo->flags & (SURF_SKY|SURF_WARP) )
@@ -878,21 +1188,14 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int32_t stride)
 	tmax = (surf->extents[1]>>4)+1;
 	size = smax*tmax;
 	// FIXME- can this limit be directly increased?		Yep - Knightmare
-	if (size > (sizeof(s_blocklights)>>4) )
+	if (size > (MAX_BLOCKLIGHTS>>2) )
 		VID_Error (ERR_DROP, "Bad s_blocklights size: %d", size);
 
 	// set to full bright if no light data
 	if (!surf->samples)
 	{
-		int32_t maps;
-
 		for (i=0 ; i<size*3 ; i++)
-			s_blocklights[i] = 255;
-		for (maps = 0 ; maps < MAXLIGHTMAPS && surf->styles[maps] != 255 ;
-			 maps++)
-		{
-			style = &r_newrefdef.lightstyles[surf->styles[maps]];
-		}
+			blocklights[i] = 255;
 		goto store;
 	}
 
@@ -901,159 +1204,135 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int32_t stride)
 		 nummaps++)
 		;
 
+	if (!nummaps)
+		memset( blocklights, 0, sizeof( blocklights[0] ) * size * 3 );
+
 	lightmap = surf->samples;
 
-	// add all the lightmaps
-	if ( nummaps == 1 )
+	// add all the lightmaps, the first one overwrites blocklights
+	for (maps = 0 ; maps < nummaps ; maps++)
 	{
-		int32_t maps;
+		for (i=0 ; i<3 ; i++)
+			scale[i] = r_modulate->value*r_newrefdef.lightstyles[surf->styles[maps]].rgb[i];
 
-		for (maps = 0 ; maps < MAXLIGHTMAPS && surf->styles[maps] != 255 ;
-			 maps++)
-		{
-			bl = s_blocklights;
+		if (simd)
+			R_AccumulateLightmap (blocklights, lightmap, scale, size*3, maps > 0);
+		else
+			R_AccumulateLightmap_C (blocklights, lightmap, scale, size*3, maps > 0);
+		lightmap += size*3;		// skip to next lightmap
+	}
 
-			for (i=0 ; i<3 ; i++)
-				scale[i] = r_modulate->value*r_newrefdef.lightstyles[surf->styles[maps]].rgb[i];
+	// add all the dynamic lights
+	if (surf->dlightframe == r_framecount)
+		R_AddDynamicLights (surf, ent, blocklights);
 
-			if ( scale[0] == 1.0F &&
-				 scale[1] == 1.0F &&
-				 scale[2] == 1.0F )
-			{
-				for (i=0 ; i<size ; i++, bl+=3)
-				{
-					bl[0] = lightmap[i*3+0];
-					bl[1] = lightmap[i*3+1];
-					bl[2] = lightmap[i*3+2];
-				}
-			}
-			else
-			{
-				for (i=0 ; i<size ; i++, bl+=3)
-				{
-					bl[0] = lightmap[i*3+0] * scale[0];
-					bl[1] = lightmap[i*3+1] * scale[1];
-					bl[2] = lightmap[i*3+2] * scale[2];
-				}
-			}
-			lightmap += size*3;		// skip to next lightmap
-		}
-	}
-	else
+	// put into texture format
+store:
+	bgra = (gl_lms.format == GL_BGRA);
+	for (i=0 ; i<tmax ; i++, dest += stride)
 	{
-		int32_t maps;
+		if (simd)
+			R_StoreLightmapRow (blocklights + i*smax*3, dest, smax, bgra);
+		else
+			R_StoreLightmapRow_C (blocklights + i*smax*3, dest, smax, bgra);
+	}
+}
 
-		memset( s_blocklights, 0, sizeof( s_blocklights[0] ) * size * 3 );
 
-		for (maps = 0 ; maps < MAXLIGHTMAPS && surf->styles[maps] != 255 ;
-			 maps++)
-		{
-			bl = s_blocklights;
+/*
+===============
+R_BuildLightMapBlock
 
-			for (i=0 ; i<3 ; i++)
-				scale[i] = r_modulate->value*r_newrefdef.lightstyles[surf->styles[maps]].rgb[i];
+R_BuildLightMap with the entity and the MAX_BLOCKLIGHTS floats of
+scratch passed in.  Surfaces that pass the checks here once at load
+never fail them later, so the lightmap jobs can call this from a worker.
+===============
+*/
+void R_BuildLightMapBlock (msurface_t *surf, entity_t *ent, float *blocklights, byte *dest, int32_t stride)
+{
+	R_BuildLightMapKernel (surf, ent, blocklights, dest, stride, true);
+}
 
-			if ( scale[0] == 1.0F &&
-				 scale[1] == 1.0F &&
-				 scale[2] == 1.0F )
-			{
-				for (i=0 ; i<size ; i++, bl+=3 )
-				{
-					bl[0] += lightmap[i*3+0];
-					bl[1] += lightmap[i*3+1];
-					bl[2] += lightmap[i*3+2];
-				}
-			}
-			else
-			{
-				for (i=0 ; i<size ; i++, bl+=3)
-				{
-					bl[0] += lightmap[i*3+0] * scale[0];
-					bl[1] += lightmap[i*3+1] * scale[1];
-					bl[2] += lightmap[i*3+2] * scale[2];
-				}
-			}
-			lightmap += size*3;		// skip to next lightmap
-		}
-	}
 
-	// add all the dynamic lights
-	if (surf->dlightframe == r_framecount)
-		R_AddDynamicLights (surf);
+/*
+===============
+R_LightmapBench_f
 
-	// put into texture format
-store:
-	stride -= (smax<<2);
-	bl = s_blocklights;
+lightmap_bench [passes]
 
+Builds the lightmap of every lit surface in the map with the scalar
+kernels and then the vector ones, checks they agree and prints the
+time of each.  Nothing here touches GL, so it runs headless as well.
+===============
+*/
+void R_LightmapBench_f (void)
+{
+	int32_t		i, k, pass, passes;
+	int32_t		numsurfs, mismatched, smax, tmax;
+	uint64_t	start, time[2];
+	msurface_t	*surf;
+	entity_t	ent;
+	float		*bl;
+	byte		*dest[2];
 
-	for (i=0 ; i<tmax ; i++, dest += stride)
+	if (Cmd_Argc() > 2)
 	{
-		for (j=0 ; j<smax ; j++)
-		{
+		VID_Printf (PRINT_ALL, "usage: lightmap_bench [passes]\n");
+		return;
+	}
+	if (!r_worldmodel || !r_newrefdef.lightstyles)
+	{
+		VID_Printf (PRINT_ALL, "No map loaded.\n");
+		return;
+	}
+	passes = (Cmd_Argc() == 2) ? max(atoi(Cmd_Argv(1)), 1) : 20;
 
-			r = Q_ftol( bl[0] );
-			g = Q_ftol( bl[1] );
-			b = Q_ftol( bl[2] );
-
-			// catch negative lights
-			if (r < 0)
-				r = 0;
-			if (g < 0)
-				g = 0;
-			if (b < 0)
-				b = 0;
-
-			//
-			// determine the brightest of the three color components
-			//
-			if (r > g)
-				max = r;
-			else
-				max = g;
-			if (b > max)
-				max = b;
-
-			//
-			// alpha is ONLY used for the mono lightmap case.  For this reason
-			// we set it to the brightest of the color components so that 
-			// things don't get too dim.
-			//
-			a = max;
-
-			//
-			// rescale all the color components if the intensity of the greatest
-			// channel exceeds 1.0
-			//
-			if (max > 255)
-			{
-				float t = 255.0F / max;
+	bl = Z_TagMalloc (MAX_BLOCKLIGHTS * sizeof(float), TAG_RENDERER);
+	dest[0] = Z_TagMalloc ((MAX_BLOCKLIGHTS>>2) * LIGHTMAP_BYTES, TAG_RENDERER);
+	dest[1] = Z_TagMalloc ((MAX_BLOCKLIGHTS>>2) * LIGHTMAP_BYTES, TAG_RENDERER);
+	memset (&ent, 0, sizeof(ent));
 
-				r = r*t;
-				g = g*t;
-				b = b*t;
-				a = a*t;
-			}
-			a = 255;	// fix for alpha test
+	// check the kernels agree first, this also warms the caches
+	numsurfs = mismatched = 0;
+	for (i=0, surf=r_worldmodel->surfaces ; i<r_worldmodel->numsurfaces ; i++, surf++)
+	{
+		if (surf->texinfo->flags & (SURF_SKY|SURF_WARP))
+			continue;
 
-			if (gl_lms.format == GL_BGRA)
-			{
-				dest[0] = b;
-				dest[1] = g;
-				dest[2] = r;
-				dest[3] = a;
-			}
-			else
+		smax = (surf->extents[0]>>4)+1;
+		tmax = (surf->extents[1]>>4)+1;
+		R_BuildLightMapKernel (surf, &ent, bl, dest[0], smax*LIGHTMAP_BYTES, false);
+		R_BuildLightMapKernel (surf, &ent, bl, dest[1], smax*LIGHTMAP_BYTES, true);
+		if (memcmp(dest[0], dest[1], smax*tmax*LIGHTMAP_BYTES))
+			mismatched++;
+		numsurfs++;
+	}
+
+	for (k=0 ; k<2 ; k++)
+	{
+		start = Sys_Microseconds ();
+		for (pass=0 ; pass<passes ; pass++)
+		{
+			for (i=0, surf=r_worldmodel->surfaces ; i<r_worldmodel->numsurfaces ; i++, surf++)
 			{
-				dest[0] = r;
-				dest[1] = g;
-				dest[2] = b;
-				dest[3] = a;
-			}
+				if (surf->texinfo->flags & (SURF_SKY|SURF_WARP))
+					continue;
 
-			bl += 3;
-			dest += 4;
+				smax = (surf->extents[0]>>4)+1;
+				R_BuildLightMapKernel (surf, &ent, bl, dest[k], smax*LIGHTMAP_BYTES, k);
+			}
 		}
+		time[k] = Sys_Microseconds () - start;
 	}
 
+	Z_Free (bl);
+	Z_Free (dest[0]);
+	Z_Free (dest[1]);
+
+	VID_Printf (PRINT_ALL, "%i surfaces, %i passes\n", numsurfs, passes);
+	VID_Printf (PRINT_ALL, "scalar: %.3f ms a pass\n", time[0] / (passes * 1000.0));
+	VID_Printf (PRINT_ALL, "%s: %.3f ms a pass, %.2fx\n", LM_KERNEL, time[1] / (passes * 1000.0),
+		time[1] ? (double)time[0] / time[1] : 0.0);
+	if (mismatched)
+		VID_Printf (PRINT_ALL, "%i surfaces differ between the kernels\n", mismatched);
 }
@@ -62,6 +62,14 @@ vec3_t	vpn;
 vec3_t	vright;
 vec3_t	r_origin;
 
+//
+// views sharing the world lists
+//
+int32_t		r_viewcount;		// views drawn since R_RenderCommon
+qboolean	r_sharedview;		// replaying the lists an earlier view built
+vec3_t		r_listorigin;		// the world lists are built from here
+float		r_listspread;		// for views up to this far from r_listorigin
+
 //float	r_world_matrix[16];
 float	r_base_world_matrix[16];
 
@@ -144,6 +152,8 @@ cvar_t	*r_picmip;
 cvar_t	*r_skymip;
 cvar_t	*r_playermip;
 cvar_t	*r_showtris;
+cvar_t	*r_worldvbo;
+cvar_t	*r_sharedworld;
 cvar_t	*r_showbbox;	// show model bounding box
 cvar_t	*r_finish;
 cvar_t	*r_cull;
@@ -661,7 +671,46 @@ void R_RenderCommon (refdef_t *fd)
 
 	R_SetFrustum ();
 
+	CL_BenchBegin (BENCH_MARKLEAVES);
 	R_MarkLeaves ();	// done here so we know if we're in water
+	CL_BenchEnd (BENCH_MARKLEAVES);
+
+	r_viewcount = 0;
+}
+
+/*
+================
+R_BeginSharedView
+
+The first view after R_RenderCommon builds the world lists and sorts
+the particles.  With r_sharedworld set the other views of the frame,
+the second eye, replay them, so the lists are culled against a frustum
+pulled back far enough to hold every view within spread of center.
+================
+*/
+static void R_BeginSharedView (vec3_t center, float spread)
+{
+	int32_t		i;
+
+	r_sharedview = (r_viewcount++ > 0) && r_sharedworld->value;
+	if (r_sharedview)
+		return;
+
+	if (!r_sharedworld->value)
+	{	// each view builds its own lists from where it is
+		VectorCopy (r_newrefdef.vieworg, r_listorigin);
+		r_listspread = 0;
+		return;
+	}
+
+	VectorCopy (center, r_listorigin);
+	r_listspread = spread;
+
+	VectorCopy (center, r_origin);
+	R_SetFrustum ();
+	for (i=0 ; i<4 ; i++)
+		frustum[i].dist -= spread;
+	VectorCopy (r_newrefdef.vieworg, r_origin);
 }
 
 /*
@@ -687,6 +736,9 @@ void R_RenderView (refdef_t *fd)
 
 	AngleVectors (r_newrefdef.viewangles, vpn, vright, vup);
 
+	if (!( r_newrefdef.rdflags & RDF_NOWORLDMODEL ))
+		R_BeginSharedView (r_newrefdef.vieworg, 0);
+
 	//
 	// set up viewport
 	//
@@ -736,7 +788,8 @@ void R_RenderView (refdef_t *fd)
 
 		if (r_transrendersort->value) {
 			//R_BuildParticleList();
-			R_SortParticlesOnList();
+			if (!r_sharedview)
+				R_SortParticlesOnList();
 			R_DrawAllDecals();
 			//R_DrawAllEntityShadows();
 			R_DrawSolidEntities();
@@ -790,6 +843,8 @@ void R_RenderViewIntoFBO (refdef_t *fd, eye_param_t parameters, fbo_t *destinati
 	if (r_norefresh->value)
 		return;
 
+	Prof_Begin ("R_RenderViewIntoFBO");
+
 	r_newrefdef = *fd;
 
 	if (!r_worldmodel && !( r_newrefdef.rdflags & RDF_NOWORLDMODEL ) )
@@ -813,6 +868,8 @@ void R_RenderViewIntoFBO (refdef_t *fd, eye_param_t parameters, fbo_t *destinati
 
 	VectorCopy (r_newrefdef.vieworg, r_origin);
 
+	if (!( r_newrefdef.rdflags & RDF_NOWORLDMODEL ))
+		R_BeginSharedView (fd->vieworg, max (parameters.viewSpread, VectorLength (parameters.viewOffset)));
 
 	oldWidth = vid.width;
 	oldHeight = vid.height;
@@ -872,7 +929,8 @@ void R_RenderViewIntoFBO (refdef_t *fd, eye_param_t parameters, fbo_t *destinati
 
 		if (r_transrendersort->value) {
 			//R_BuildParticleList();
-			R_SortParticlesOnList();
+			if (!r_sharedview)
+				R_SortParticlesOnList();
 			R_DrawAllDecals();
 			//R_DrawAllEntityShadows();
 			R_DrawSolidEntities();
@@ -921,6 +979,8 @@ void R_RenderViewIntoFBO (refdef_t *fd, eye_param_t parameters, fbo_t *destinati
 		R_DrawCameraEffect ();
 	vid.width = oldWidth;
 	vid.height = oldHeight;
+
+	Prof_End ();
 }
 
 
@@ -1032,6 +1092,8 @@ void R_RenderFrame (refdef_t *fd)
 {
 	eye_param_t params;
 	vrect_t rect;
+
+	Prof_Begin ("R_RenderFrame");
 	memset(&params,0,sizeof(eye_param_t));
 	params.projection.y.scale = 1.0f / tanf((fd->fov_y / 2.0f) * M_PI / 180);
 	params.projection.y.offset = 0.0;
@@ -1044,9 +1106,11 @@ void R_RenderFrame (refdef_t *fd)
 	rect.y = fd->y;
 	rect.width = fd->width;
 	rect.height = fd->height;
+	r_viewcount = 0;	// nothing to share with
 	R_RenderViewIntoFBO(fd,params,glState.currentFBO,&rect);
 //	V_RenderViewIntoFBO(hud);
 	R_SetGL2D ();
+	Prof_End ();
 }
 
 
@@ -1112,6 +1176,8 @@ void R_Register (void)
 	r_picmip = Cvar_Get ("r_picmip", "0", 0);
 	r_skymip = Cvar_Get ("r_skymip", "0", 0);
 	r_showtris = Cvar_Get ("r_showtris", "0", CVAR_CHEAT);
+	r_worldvbo = Cvar_Get ("r_worldvbo", "1", CVAR_ARCHIVE);
+	r_sharedworld = Cvar_Get ("r_sharedworld", "1", CVAR_ARCHIVE);
 	r_showbbox = Cvar_Get ("r_showbbox", "0", CVAR_CHEAT); // show model bounding box
 	r_finish = Cvar_Get ("r_finish", "0", CVAR_ARCHIVE);
 	r_cull = Cvar_Get ("r_cull", "1", 0);
@@ -1168,6 +1234,7 @@ void R_Register (void)
 	Cmd_AddCommand ("screenshot_silent", R_ScreenShot_Silent_f);
 	Cmd_AddCommand ("modellist", Mod_Modellist_f);
 	Cmd_AddCommand ("gl_strings", GL_Strings_f);
+	Cmd_AddCommand ("lightmap_bench", R_LightmapBench_f);
 //	Cmd_AddCommand ("resetvertexlights", R_ResetVertextLights_f);
 }
 
@@ -1746,6 +1813,7 @@ void R_Shutdown (void)
 	Cmd_RemoveCommand ("screenshot_silent");
 	Cmd_RemoveCommand ("imagelist");
 	Cmd_RemoveCommand ("gl_strings");
+	Cmd_RemoveCommand ("lightmap_bench");
 //	Cmd_RemoveCommand ("resetvertexlights");
 
 	// Knightmare- Free saveshot buffer
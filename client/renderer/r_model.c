@@ -38,6 +38,9 @@ void Mod_LoadAliasMD3Model (model_t *mod, void *buffer);
 model_t *Mod_LoadModel (model_t *mod, qboolean crash);
 
 byte	mod_novis[MAX_MAP_LEAFS/8];
+qboolean	mod_mapped;		// the buffer being loaded lives as long as the model, lumps can be used in place
+static model_t		*mod_mapping;		// model whose mapped file is being loaded
+static const void	*mod_mapbuf;
 
 #define	MAX_MOD_KNOWN	512
 model_t	mod_known[MAX_MOD_KNOWN];
@@ -132,8 +135,19 @@ Mod_ClusterPVS
 */
 byte *Mod_ClusterPVS (int32_t cluster, model_t *model)
 {
+	byte	*row;
+
 	if (cluster == -1 || !model->vis)
 		return mod_novis;
+
+	// the collision map is usually the same bsp, and has the rows expanded
+	if (model == r_worldmodel)
+	{
+		row = CM_SharedClusterPVS (model->name, cluster, model->vis->numclusters);
+		if (row)
+			return row;
+	}
+
 	return Mod_DecompressVis ( (byte *)model->vis + model->vis->bitofs[cluster][DVIS_PVS],
 		model);
 }
@@ -178,6 +192,27 @@ void Mod_Init (void)
 
 
 
+/*
+==================
+Mod_ReleaseMapping
+
+A load that errored out never got to unmap its file, release it
+before the next load so the mapping slots don't run out
+==================
+*/
+static void Mod_ReleaseMapping (void)
+{
+	if (!mod_mapbuf)
+		return;
+
+	if (mod_mapping->bspfile == mod_mapbuf)
+		mod_mapping->bspfile = NULL;
+	memset (mod_mapping->name, 0, sizeof(mod_mapping->name));	// don't hand out the half loaded model
+	FS_UnmapFile (mod_mapbuf);
+	mod_mapping = NULL;
+	mod_mapbuf = NULL;
+}
+
 /*
 ==================
 Mod_ForName
@@ -189,6 +224,7 @@ model_t *Mod_ForName (char *name, qboolean crash)
 {
 	model_t	*mod;
 	void *buf;
+	qboolean mapped = false;
 	int32_t		i;
     hash32_t nameHash;
     int32_t len = strlen(name);
@@ -207,6 +243,8 @@ model_t *Mod_ForName (char *name, qboolean crash)
 		return &mod_inline[i];
 	}
 
+	Mod_ReleaseMapping ();
+
     nameHash = Hash32(name, len);
 	//
 	// search the currently loaded models
@@ -249,6 +287,9 @@ model_t *Mod_ForName (char *name, qboolean crash)
             s[len-1] = '2';
             modfilelen = FS_LoadFile (name, &buf);
         }
+    } else if (len > 4 && !strcmp(name+len-4, ".bsp")) {
+        buf = (void *)FS_MapFile (name, &modfilelen);
+        mapped = true;
     } else {
         modfilelen = FS_LoadFile (name, &buf);
     }
@@ -261,6 +302,12 @@ model_t *Mod_ForName (char *name, qboolean crash)
 	}
 	
 	loadmodel = mod;
+	mod_mapped = mapped;
+	if (mapped)
+	{
+		mod_mapping = mod;
+		mod_mapbuf = buf;
+	}
 
 	//
 	// fill it in
@@ -303,7 +350,13 @@ model_t *Mod_ForName (char *name, qboolean crash)
 
 	loadmodel->extradatasize = Hunk_End ();
 
-	FS_FreeFile (buf);
+	// a bsp used in place stays mapped until the model is freed
+	if (!mapped)
+		FS_FreeFile (buf);
+	else if (mod->bspfile != buf)
+		FS_UnmapFile (buf);
+	mod_mapping = NULL;
+	mod_mapbuf = NULL;
 
 	return mod;
 }
@@ -318,6 +371,24 @@ model_t *Mod_ForName (char *name, qboolean crash)
 
 byte	*mod_base;
 
+/*
+=================
+Mod_InPlace
+
+Lumps that are already in memory order can point straight into
+a mapped bsp on little endian hosts, if they are aligned for the
+ints read through them
+=================
+*/
+static qboolean Mod_InPlace (lump_t *l)
+{
+	if (!mod_mapped || bigendien || ((uintptr_t)(mod_base + l->fileofs) & 3))
+		return false;
+
+	loadmodel->bspfile = mod_base;
+	return true;
+}
+
 
 /*
 =================
@@ -331,6 +402,11 @@ void Mod_LoadLighting (lump_t *l)
 		loadmodel->lightdata = NULL;
 		return;
 	}
+	if (Mod_InPlace (l))
+	{
+		loadmodel->lightdata = mod_base + l->fileofs;
+		return;
+	}
 	loadmodel->lightdata = (byte*)Hunk_Alloc ( l->filelen);	
 	memcpy (loadmodel->lightdata, mod_base + l->fileofs, l->filelen);
 }
@@ -350,6 +426,11 @@ void Mod_LoadVisibility (lump_t *l)
 		loadmodel->vis = NULL;
 		return;
 	}
+	if (Mod_InPlace (l))
+	{
+		loadmodel->vis = (dvis_t *)(mod_base + l->fileofs);
+		return;
+	}
 	loadmodel->vis = (dvis_t*)Hunk_Alloc ( l->filelen);	
 	memcpy (loadmodel->vis, mod_base + l->fileofs, l->filelen);
 
@@ -769,7 +850,7 @@ void CalcSurfaceExtents (msurface_t *s)
 
 void R_BuildPolygonFromSurface (msurface_t *fa);
 void R_CreateSurfaceLightmap (msurface_t *surf);
-void R_EndBuildingLightmaps (void);
+void R_EndBuildingLightmaps (model_t *m);
 void R_BeginBuildingLightmaps (model_t *m);
 
 /*
@@ -860,7 +941,7 @@ void Mod_LoadFaces (lump_t *l)
 			R_BuildPolygonFromSurface (out);
 	}
 
-	R_EndBuildingLightmaps ();
+	R_EndBuildingLightmaps (loadmodel);
 }
 
 
@@ -1032,10 +1113,16 @@ void Mod_LoadSurfedges (lump_t *l)
 		VID_Error (ERR_DROP, "MOD_LoadBmodel: bad surfedges count in %s: %i",
 		loadmodel->name, count);
 
+	loadmodel->numsurfedges = count;
+	if (Mod_InPlace (l))
+	{
+		loadmodel->surfedges = in;
+		return;
+	}
+
 	out = (int32_t *)Hunk_Alloc(count*sizeof(*out));
 
 	loadmodel->surfedges = out;
-	loadmodel->numsurfedges = count;
 
 	for ( i=0 ; i<count ; i++)
 		out[i] = LittleLong (in[i]);
@@ -1091,7 +1178,7 @@ Mod_LoadBrushModel
 void Mod_LoadBrushModel (model_t *mod, void *buffer)
 {
 	int32_t			i;
-	dheader_t	*header;
+	dheader_t	*header, swapped;
 	mmodel_t 	*bm;
 	
 	loadmodel->type = mod_brush;
@@ -1104,11 +1191,12 @@ void Mod_LoadBrushModel (model_t *mod, void *buffer)
 	if (i != BSPVERSION)
 		VID_Error (ERR_DROP, "Mod_LoadBrushModel: %s has wrong version number (%i should be %i)", mod->name, i, BSPVERSION);
 
-	// swap all the lumps
+	// swap all the lumps, the file itself may be a read only mapping
 	mod_base = (byte *)header;
 
 	for (i=0 ; i<sizeof(dheader_t)/4 ; i++)
-		((int32_t *)header)[i] = LittleLong ( ((int32_t *)header)[i]);
+		((int32_t *)&swapped)[i] = LittleLong ( ((int32_t *)header)[i]);
+	header = &swapped;
 
 	// load into heap	
 	Mod_LoadVertexes (&header->lumps[LUMP_VERTEXES]);
@@ -2544,8 +2632,12 @@ Mod_Free
 */
 void Mod_Free (model_t *mod)
 {
+	R_FreeWorldVBO (mod);
 	Hunk_Free (mod->extradata);
 
+	if (mod->bspfile)
+		FS_UnmapFile (mod->bspfile);
+
 #ifdef PROJECTION_SHADOWS // projection shadows from BeefQuake R6
 	if (mod->edge_tri)
 		Hunk_Free (mod->edge_tri);
@@ -2563,6 +2655,7 @@ void Mod_FreeAll (void)
 {
 	int32_t		i;
 
+	Mod_ReleaseMapping ();
 	for (i=0 ; i<mod_numknown ; i++)
 	{
 		if (mod_known[i].extradatasize)
@@ -143,58 +143,80 @@ typedef struct sortedpart_s
 
 sortedpart_t sorted_parts[MAX_PARTICLES];
 
-int32_t transCompare (const void *arg1, const void *arg2 ) 
-{
-	const sortedpart_t *a1, *a2;
-	a1 = (sortedpart_t *) arg1;
-	a2 = (sortedpart_t *) arg2;
-    return (a2->len - a1->len);
-}
+static sortkey_t	part_keys[MAX_PARTICLES];
+static sortkey_t	part_temp[MAX_PARTICLES];
+static vec_t		part_len[MAX_PARTICLES];
+static int32_t		part_order[MAX_PARTICLES];	// last sort, where the next one starts from
+static int32_t		part_numorder;
 
-int32_t transRenderCompare (const void *arg1, const void *arg2 )
-{
-    const sortedpart_t *a1, *a2;
-    int32_t image1, image2;
-    
-    a1 = (sortedpart_t *) arg1;
-    a2 = (sortedpart_t *) arg2;
-    
-    // FIXME: use hash of imagenum, blendfuncs, & critical flags
-    //	image1 = (a1->p->flags & PART_SPARK) ? 0 : a1->p->image;
-    //	image2 = (a2->p->flags & PART_SPARK) ? 0 : a2->p->image;
-    image1 = a1->p->image;
-    image2 = a2->p->image;
-    return (image2 - image1)*10000 + (a2->len - a1->len);
-}
+/*
+===============
+R_ParticleSortKey
 
-sortedpart_t NewSortedPart (particle_t *p)
+Farthest first, by the squared distance cut to 16 bits: its exponent and
+8 bits of mantissa.  That resolves about 1/512 of the depth, around 2
+units at 1000, much coarser than the old int compare; particles closer
+than that in depth tie and keep last frame's order.  r_transrendersort 1
+groups by image first.
+===============
+*/
+static uint32_t R_ParticleSortKey (particle_t *p, vec_t len)
 {
-	vec3_t result;
-	sortedpart_t s_part;
-
-    assert(p != NULL);
-
-	s_part.p = p;
-	VectorSubtract(p->origin, r_origin, result);
-	s_part.len = (result[0] * result[0]) + (result[1] * result[1]) + (result[2] * result[2]);
+	uint32_t	key;
 
-	return s_part;
+	key = ~(R_FloatSortKey (len) >> 15) & 0xffff;	// len is never negative
+	if (r_transrendersort->value == 1)
+		key |= (~(uint32_t)p->image & 0xffff) << 16;
+	return key;
 }
 
 
+/*
+===============
+R_SortParticlesOnList
+
+The keys go in last frame's order, which usually still holds for the
+other eye and for particles that didn't come or go
+===============
+*/
 void R_SortParticlesOnList (void)
 {
-	int32_t i;
+	int32_t		i, j, num;
+	vec3_t		dist;
+	particle_t	*p;
+	sortkey_t	*sorted;
 
-	for (i=0; i<r_newrefdef.num_particles; i++)
-		sorted_parts[i] = NewSortedPart(&r_newrefdef.particles[i]);
+	CL_BenchBegin (BENCH_PARTICLESORT);
 
-    if (r_transrendersort->value == 1) {
-        qsort((void *)sorted_parts, r_newrefdef.num_particles, sizeof(sortedpart_t), transRenderCompare);
-    } else {
-        qsort((void *)sorted_parts, r_newrefdef.num_particles, sizeof(sortedpart_t), transCompare);
-        
-    }
+	num = r_newrefdef.num_particles;
+	if (num != part_numorder)
+	{	// a different list, start from its own order
+		for (i=0; i<num; i++)
+			part_order[i] = i;
+		part_numorder = num;
+	}
+
+	for (i=0; i<num; i++)
+	{
+		j = part_order[i];
+		p = &r_newrefdef.particles[j];
+		VectorSubtract (p->origin, r_origin, dist);
+		part_len[j] = DotProduct (dist, dist);
+		part_keys[i].key = R_ParticleSortKey (p, part_len[j]);
+		part_keys[i].index = j;
+	}
+
+	sorted = R_SortKeys (part_keys, part_temp, num);
+
+	for (i=0; i<num; i++)
+	{
+		j = sorted[i].index;
+		sorted_parts[i].p = &r_newrefdef.particles[j];
+		sorted_parts[i].len = part_len[j];
+		part_order[i] = j;
+	}
+
+	CL_BenchEnd (BENCH_PARTICLESORT);
 }
 
 
@@ -951,6 +973,7 @@ void R_DrawAllParticles (void)
 	int32_t		i;
 	particle_t	*p;
 
+	Prof_Begin ("R_DrawAllParticles");
 	R_BeginParticles (false);
 
 	for ( i=0; i < r_newrefdef.num_particles; i++)
@@ -967,6 +990,7 @@ void R_DrawAllParticles (void)
 	}
 
 	R_FinishParticles (false);
+	Prof_End ();
 }
 
 
@@ -0,0 +1,114 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// r_sort.c -- key sorting for the blended lists
+//
+// Lists are sorted as (key, index) pairs, with the key made from
+// the quantized view depth and whatever state the list groups by.
+// Callers hand the keys over in last frame's order, so a list whose
+// order didn't change costs a single pass to check, and equal keys
+// keep their old order instead of flickering.
+
+#include "include/r_local.h"
+
+/*
+=================
+R_FloatSortKey
+
+Maps a float to a key that sorts in the same order
+=================
+*/
+uint32_t R_FloatSortKey (float f)
+{
+	uint32_t	u;
+
+	memcpy (&u, &f, sizeof(u));
+	return (u & 0x80000000) ? ~u : (u | 0x80000000);
+}
+
+/*
+=================
+R_KeysSorted
+=================
+*/
+qboolean R_KeysSorted (const sortkey_t *keys, int32_t count)
+{
+	int32_t		i;
+
+	for (i=1 ; i<count ; i++)
+	{
+		if (keys[i].key < keys[i-1].key)
+			return false;
+	}
+	return true;
+}
+
+/*
+=================
+R_SortKeys
+
+Stable ascending sort of count keys, a byte of the key per pass.
+temp must hold count keys as well, the return is whichever of the two
+ends up holding the result.  Passes over a byte every key shares are
+skipped, so keys that fit in 16 bits take two passes, and a list that
+is still in order takes none.
+=================
+*/
+sortkey_t *R_SortKeys (sortkey_t *keys, sortkey_t *temp, int32_t count)
+{
+	uint32_t	counts[4][256];
+	uint32_t	sum, n;
+	int32_t		i, pass, shift;
+	sortkey_t	*src, *dst, *swap;
+
+	if (count < 2 || R_KeysSorted (keys, count))
+		return keys;
+
+	memset (counts, 0, sizeof(counts));
+	for (i=0 ; i<count ; i++)
+	{
+		counts[0][keys[i].key & 255]++;
+		counts[1][(keys[i].key >> 8) & 255]++;
+		counts[2][(keys[i].key >> 16) & 255]++;
+		counts[3][keys[i].key >> 24]++;
+	}
+
+	src = keys;
+	dst = temp;
+	for (pass=0, shift=0 ; pass<4 ; pass++, shift+=8)
+	{
+		if (counts[pass][(keys[0].key >> shift) & 255] == (uint32_t)count)
+			continue;	// every key has this byte
+
+		for (i=0, sum=0 ; i<256 ; i++)
+		{
+			n = counts[pass][i];
+			counts[pass][i] = sum;
+			sum += n;
+		}
+		for (i=0 ; i<count ; i++)
+			dst[counts[pass][(src[i].key >> shift) & 255]++] = src[i];
+
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	return src;
+}
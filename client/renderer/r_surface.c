@@ -532,7 +532,9 @@ dynamic:
 			smax = (fa->extents[0]>>4)+1;
 			tmax = (fa->extents[1]>>4)+1;
 
+			CL_BenchBegin (BENCH_LIGHTMAPS);
 			R_BuildLightMap(fa, (byte *)temp, smax*4);
+			CL_BenchEnd (BENCH_LIGHTMAPS);
 			R_SetCacheState(fa);
 
 			GL_Bind(glState.lightmap_textures + fa->lightmaptexturenum);
@@ -645,6 +647,8 @@ void R_DrawAlphaSurfaces (void)
 	// the textures are prescaled up for a better lighting range,
 	// so scale it back down
 
+	Prof_Begin ("R_DrawAlphaSurfaces");
+
 	rb_vertex = rb_index = 0;
 	GL_PushMatrix(GL_MODELVIEW);
 	for (s = r_alpha_surfaces; s; s = s->texturechain)
@@ -698,10 +702,128 @@ void R_DrawAlphaSurfaces (void)
 	GL_DepthMask (true);
 
 	r_alpha_surfaces = NULL;
+
+	Prof_End ();
 }
 
 
 #ifdef BATCH_LM_UPDATES
+/*
+=============================================================
+
+	LIGHTMAP JOBS
+
+Dynamic lightmaps are queued as they're found and built together on
+the job workers just before the dirty rects are uploaded.  Each job
+writes only its own surface's block of lightmap_update, and every
+batch has its own blocklights scratch.
+
+=============================================================
+*/
+
+#define	MAX_LIGHTMAP_JOBS		4096
+#define	MAX_LIGHTMAP_BATCHES	16
+#define	LIGHTMAP_BATCH_JOBS		8		// fewer than this aren't worth waking a worker for
+
+typedef struct
+{
+	msurface_t	*surf;
+	entity_t	*entity;	// currententity when it was queued
+} lightmapjob_t;
+
+static lightmapjob_t	lm_jobs[MAX_LIGHTMAP_JOBS];
+static int32_t			lm_numjobs;
+static int32_t			lm_numbatches;
+static float			*lm_blocklights[MAX_LIGHTMAP_BATCHES];
+
+/*
+=============
+R_LightmapBatch
+
+Runs on any thread
+=============
+*/
+static void R_LightmapBatch (void *data, int32_t batch)
+{
+	int32_t			i;
+	lightmapjob_t	*job;
+	uint32_t		*base;
+
+	for (i=batch; i<lm_numjobs; i+=lm_numbatches)
+	{
+		job = &lm_jobs[i];
+		base = gl_lms.lightmap_update[job->surf->lightmaptexturenum];
+		base += (job->surf->light_t * LM_BLOCK_WIDTH) + job->surf->light_s;
+		R_BuildLightMapBlock (job->surf, job->entity, lm_blocklights[batch], (byte *)base, LM_BLOCK_WIDTH*LIGHTMAP_BYTES);
+	}
+}
+
+
+/*
+=============
+R_FlushLightmapJobs
+=============
+*/
+static void R_FlushLightmapJobs (void)
+{
+	int32_t		i;
+
+	if (!lm_numjobs)
+		return;
+
+	CL_BenchBegin (BENCH_LIGHTMAPS);
+
+	lm_numbatches = (lm_numjobs + LIGHTMAP_BATCH_JOBS - 1) / LIGHTMAP_BATCH_JOBS;
+	lm_numbatches = min(lm_numbatches, Job_NumWorkers() + 1);
+	lm_numbatches = min(lm_numbatches, MAX_LIGHTMAP_BATCHES);
+	for (i=0; i<lm_numbatches; i++)
+	{
+		if (!lm_blocklights[i])
+			lm_blocklights[i] = Z_TagMalloc (MAX_BLOCKLIGHTS * sizeof(float), TAG_RENDERER);
+	}
+	Job_ParallelFor (R_LightmapBatch, NULL, lm_numbatches);
+	lm_numjobs = 0;
+
+	CL_BenchEnd (BENCH_LIGHTMAPS);
+}
+
+
+/*
+=============
+R_SurfLightUnchanged
+
+A dlit world surface whose lightmap was built from the same styles
+and dlights it has now doesn't need building again, either later
+this frame for another eye or next frame if none of its lights moved.
+Brush model surfaces move under their lights, so they always rebuild.
+=============
+*/
+static qboolean R_SurfLightUnchanged (msurface_t *surf)
+{
+	int32_t		i;
+
+	if (currentmodel != r_worldmodel)
+		return false;
+	if (surf->dlightframe != r_framecount || !surf->cached_dlight)
+		return false;
+	if (surf->cached_dlightframe != r_framecount && surf->cached_dlightframe != r_framecount - 1)
+		return false;
+
+	for (i = 0; i < MAXLIGHTMAPS && surf->styles[i] != 255; i++) {
+		if (r_newrefdef.lightstyles[surf->styles[i]].white != surf->cached_light[i])
+			return false;
+	}
+	for (i = 0; i < (MAX_DLIGHTS+31)>>5; i++)
+	{
+		if (surf->dlightbits[i] != surf->cached_dlightbits[i])
+			return false;
+		if (surf->cached_dlightframe != r_framecount && (surf->dlightbits[i] & r_dlightchanged[i]))
+			return false;
+	}
+	return true;
+}
+
+
 /*
 =============
 R_UpdateSurfaceLightmap
@@ -715,11 +837,20 @@ void R_UpdateSurfaceLightmap (msurface_t *surf)
 
 	if (R_SurfIsDynamic (surf, &map))
 	{
-		uint32_t	*base = gl_lms.lightmap_update[surf->lightmaptexturenum];
 		rect_t		*rect = &gl_lms.lightrect[surf->lightmaptexturenum];
 
-		base += (surf->light_t * LM_BLOCK_WIDTH) + surf->light_s;
-		R_BuildLightMap (surf, (byte *)base, LM_BLOCK_WIDTH*LIGHTMAP_BYTES);
+		if (R_SurfLightUnchanged (surf))
+		{
+			surf->cached_dlightframe = r_framecount;
+			return;
+		}
+
+		if (lm_numjobs == MAX_LIGHTMAP_JOBS)
+			R_FlushLightmapJobs ();
+		lm_jobs[lm_numjobs].surf = surf;
+		lm_jobs[lm_numjobs].entity = currententity;
+		lm_numjobs++;
+
 		R_SetCacheState (surf);
 		gl_lms.modified[surf->lightmaptexturenum] = true;
 
@@ -747,6 +878,8 @@ void R_RebuildLightmaps (void)
 	int32_t			i;
 	qboolean	storeSet = false;
 
+	R_FlushLightmapJobs ();
+
 	for (i=1; i<gl_lms.current_lightmap_texture; i++)
 	{
 		if (!gl_lms.modified[i])
@@ -777,6 +910,314 @@ void R_RebuildLightmaps (void)
 #endif // BATCH_LM_UPDATES
 
 
+/*
+=============================================================
+
+	WORLD VERTEX BUFFER
+
+Plain lightmapped world surfaces are uploaded once into a static
+vertex buffer laid out like glpoly_t verts (xyz s1t1 s2t2).  Each
+frame only their indexes are written, one list per texture, lightmap
+and alpha test, and drawn straight from the buffer.  Surfaces that
+need per frame texcoords or extra passes keep the client array path.
+
+=============================================================
+*/
+
+typedef struct
+{
+	image_t		*image;
+	int32_t		lightmap;
+	qboolean	alphatest;
+	int32_t		firstindex;
+	int32_t		numindexes;
+} worlddraw_t;
+
+static vbo_t		world_vbo;
+static model_t		*world_vbo_model;
+static uint32_t		*world_vbo_indexes;		// room for every surface once
+static worlddraw_t	*world_vbo_draws;		// a draw has at least one surface
+static int32_t		world_vbo_maxindexes;
+static int32_t		world_vbo_numindexes, world_vbo_numdraws;
+static int32_t		world_vbo_buckets[MAX_LIGHTMAPS*2];
+
+
+/*
+================
+R_BuildWorldVBO
+================
+*/
+static void R_BuildWorldVBO (model_t *m)
+{
+	msurface_t	*surf;
+	glpoly_t	*p;
+	float		*verts;
+	int32_t		i, numverts, numindexes;
+
+	R_FreeWorldVBO (world_vbo_model);
+
+	numverts = numindexes = 0;
+	for (i=0, surf=m->surfaces; i<m->numsurfaces; i++, surf++)
+	{
+		surf->vbo_firstvert = -1;
+		surf->vbo_numindexes = 0;
+		if (surf->texinfo->flags & (SURF_SKY|SURF_WARP|SURF_TRANS33|SURF_TRANS66))
+			continue;
+		if (!surf->polys)
+			continue;
+
+		surf->vbo_firstvert = numverts;
+		for (p = surf->polys; p; p = p->chain)
+		{
+			numverts += p->numverts;
+			surf->vbo_numindexes += (p->numverts-2)*3;
+		}
+		numindexes += surf->vbo_numindexes;
+	}
+	if (!numverts)
+		return;
+
+	verts = (float *)Z_TagMalloc (numverts*VERTEXSIZE*sizeof(float), TAG_RENDERER);
+	for (i=0, surf=m->surfaces; i<m->numsurfaces; i++, surf++)
+	{
+		float	*v;
+
+		if (surf->vbo_firstvert < 0)
+			continue;
+		v = verts + surf->vbo_firstvert*VERTEXSIZE;
+		for (p = surf->polys; p; p = p->chain)
+		{
+			memcpy (v, p->verts, p->numverts*VERTEXSIZE*sizeof(float));
+			v += p->numverts*VERTEXSIZE;
+		}
+	}
+
+	R_CreateIVBO (&world_vbo, GL_STATIC_DRAW);
+	R_BindIVBO (&world_vbo, NULL, 0);
+	R_VertexData (&world_vbo, numverts*VERTEXSIZE*sizeof(float), verts);
+	world_vbo.usage = GL_STREAM_DRAW;	// the index lists change every frame
+	R_IndexData (&world_vbo, GL_TRIANGLES, GL_UNSIGNED_INT, 0, numindexes*sizeof(uint32_t), NULL);
+	R_ReleaseIVBO ();
+	Z_Free (verts);
+
+	world_vbo_indexes = (uint32_t *)Z_TagMalloc (numindexes*sizeof(uint32_t), TAG_RENDERER);
+	world_vbo_draws = (worlddraw_t *)Z_TagMalloc (m->numsurfaces*sizeof(worlddraw_t), TAG_RENDERER);
+	world_vbo_maxindexes = numindexes;
+	world_vbo_numindexes = world_vbo_numdraws = 0;
+	world_vbo_model = m;
+
+	VID_Printf (PRINT_DEVELOPER, "World vertex buffer: %i verts, %i KB\n",
+		numverts, (int32_t)(numverts*VERTEXSIZE*sizeof(float) / 1024));
+}
+
+
+/*
+================
+R_FreeWorldVBO
+
+Only frees the buffer if it was built from mod
+================
+*/
+void R_FreeWorldVBO (model_t *mod)
+{
+	if (!mod || mod != world_vbo_model)
+		return;
+
+	R_DelIVBO (&world_vbo);
+	Z_Free (world_vbo_indexes);
+	Z_Free (world_vbo_draws);
+	world_vbo_indexes = NULL;
+	world_vbo_draws = NULL;
+	world_vbo_maxindexes = world_vbo_numindexes = world_vbo_numdraws = 0;
+	world_vbo_model = NULL;
+}
+
+
+/*
+================
+R_WorldVBOActive
+================
+*/
+static qboolean R_WorldVBOActive (void)
+{
+	return r_worldvbo->value && world_vbo_model && (world_vbo_model == r_worldmodel) && !r_showtris->value;
+}
+
+
+/*
+================
+R_SurfInWorldVBO
+
+Glows, envmaps, caustics and flowing textures need the client arrays
+================
+*/
+static qboolean R_SurfInWorldVBO (msurface_t *surf)
+{
+	if (surf->vbo_firstvert < 0)
+		return false;
+	if (surf->texinfo->flags & (SURF_FLOWING|SURF_NOLIGHTENV))
+		return false;
+	if (r_glows->value && (R_TextureAnimationGlow(surf) != glMedia.notexture))
+		return false;
+	if (R_SurfHasEnvMap (surf))
+		return false;
+	if ((r_waterquality->value > 1) && (surf->flags & SURF_MASK_CAUSTIC))
+		return false;
+	return true;
+}
+
+
+/*
+================
+R_AddWorldVBOChain
+
+Takes the surfaces of an image's texture chain that can be drawn from
+the world vertex buffer out of the chain and writes their index lists.
+The rest stay in the chain, in order.
+================
+*/
+static void R_AddWorldVBOChain (image_t *image)
+{
+	msurface_t	*s, *next, *rest, **tail, *vbosurfs;
+	worlddraw_t	*d;
+	int32_t		i, b, numused, numindexes;
+	int32_t		used[MAX_LIGHTMAPS*2];
+
+	rest = vbosurfs = NULL;
+	tail = &rest;
+	numused = numindexes = 0;
+	for (s = image->texturechain; s; s = next)
+	{
+		next = s->texturechain;
+		if (!R_SurfInWorldVBO (s)
+			|| (world_vbo_numindexes + numindexes + s->vbo_numindexes > world_vbo_maxindexes))
+		{
+			*tail = s;
+			tail = &s->texturechain;
+			continue;
+		}
+
+		b = s->lightmaptexturenum*2 + ((s->texinfo->flags & SURF_ALPHATEST) != 0);
+		if (!world_vbo_buckets[b])
+			used[numused++] = b;
+		world_vbo_buckets[b] += s->vbo_numindexes;
+		numindexes += s->vbo_numindexes;
+
+		s->texturechain = vbosurfs;
+		vbosurfs = s;
+	}
+	*tail = NULL;
+	image->texturechain = rest;
+
+	if (!vbosurfs)
+		return;
+
+	// lay the lists out back to back, the bucket then holds its draw
+	for (i=0; i<numused; i++)
+	{
+		b = used[i];
+		d = &world_vbo_draws[world_vbo_numdraws];
+		d->image = image;
+		d->lightmap = b >> 1;
+		d->alphatest = b & 1;
+		d->firstindex = world_vbo_numindexes;
+		d->numindexes = 0;
+		world_vbo_numindexes += world_vbo_buckets[b];
+		world_vbo_buckets[b] = world_vbo_numdraws++;
+	}
+
+	for (s = vbosurfs; s; s = s->texturechain)
+	{
+		b = s->lightmaptexturenum*2 + ((s->texinfo->flags & SURF_ALPHATEST) != 0);
+		d = &world_vbo_draws[world_vbo_buckets[b]];
+		d->numindexes += R_WriteSurfaceIndexes (s, world_vbo_indexes + d->firstindex + d->numindexes);
+		c_brush_surfs++;
+		c_brush_polys += s->vbo_numindexes / 3;
+	}
+
+	for (i=0; i<numused; i++)
+		world_vbo_buckets[used[i]] = 0;
+}
+
+
+/*
+================
+R_UploadWorldVBO
+
+Uploads the index lists of the draws from firstdraw on
+================
+*/
+static void R_UploadWorldVBO (int32_t firstdraw)
+{
+	int32_t		first;
+
+	if (firstdraw >= world_vbo_numdraws)
+		return;
+
+	first = world_vbo_draws[firstdraw].firstindex;
+	R_BindIVBO (&world_vbo, NULL, 0);
+	glBufferSubData (GL_ELEMENT_ARRAY_BUFFER, first*sizeof(uint32_t),
+		(world_vbo_numindexes - first)*sizeof(uint32_t), world_vbo_indexes + first);
+	R_ReleaseIVBO ();
+}
+
+
+/*
+================
+R_DrawWorldVBO
+
+Draws the uploaded index lists from firstdraw on
+================
+*/
+static void R_DrawWorldVBO (int32_t firstdraw)
+{
+	worlddraw_t	*d;
+	int32_t		i;
+	float		alpha;
+
+	if (firstdraw >= world_vbo_numdraws)
+		return;
+
+	alpha = (currententity && (currententity->flags & RF_TRANSLUCENT)) ? currententity->alpha : 1.0;
+
+	R_BindIVBO (&world_vbo, NULL, 0);
+
+	glDisableClientState (GL_COLOR_ARRAY);
+	glColor4f (1.0, 1.0, 1.0, alpha);
+	GL_SelectTexture (1);
+	glTexCoordPointer (2, GL_FLOAT, VERTEXSIZE*sizeof(float), (void *)(sizeof(float) * 5));
+	GL_SelectTexture (0);
+	glTexCoordPointer (2, GL_FLOAT, VERTEXSIZE*sizeof(float), (void *)(sizeof(float) * 3));
+	glVertexPointer (3, GL_FLOAT, VERTEXSIZE*sizeof(float), NULL);
+
+	for (i=firstdraw, d=world_vbo_draws+firstdraw; i<world_vbo_numdraws; i++, d++)
+	{
+		if (d->alphatest)
+			GL_Enable (GL_ALPHA_TEST);
+
+		GL_MBind (0, d->image->texnum);
+		if (r_fullbright->value != 0)
+			GL_MBind (1, glMedia.whitetexture->texnum);
+		else
+			GL_MBind (1, glState.lightmap_textures + d->lightmap);
+
+		R_DrawRangeIVBO (&world_vbo, (void *)(d->firstindex * sizeof(uint32_t)), d->numindexes);
+		c_brush_calls++;
+
+		GL_Disable (GL_ALPHA_TEST);
+	}
+
+	R_ReleaseIVBO ();
+
+	GL_SelectTexture (1);
+	glTexCoordPointer (2, GL_FLOAT, sizeof(texCoordArray[1][0]), texCoordArray[1][0]);
+	GL_SelectTexture (0);
+	glTexCoordPointer (2, GL_FLOAT, sizeof(texCoordArray[0][0]), texCoordArray[0][0]);
+	glVertexPointer (3, GL_FLOAT, sizeof(vertexArray[0]), vertexArray[0]);
+	glEnableClientState (GL_COLOR_ARRAY);
+}
+
+
 /*
 ================
 R_DrawMultiTextureChains
@@ -786,7 +1227,7 @@ Draws solid warp surfaces im multitexture mode
 */
 void R_DrawMultiTextureChains (void)
 {
-	int32_t			i;
+	int32_t			i, firstdraw, firstindex;
 	msurface_t	*s;
 	image_t		*image;
 
@@ -800,6 +1241,28 @@ void R_DrawMultiTextureChains (void)
 	R_RebuildLightmaps ();
 #endif
 
+	if (currentmodel == r_worldmodel)
+		R_DrawWorldVBO (0);		// split off by R_BuildWorldLists
+	else
+	{	// brush models go after the world lists and are dropped once drawn
+		firstdraw = world_vbo_numdraws;
+		firstindex = world_vbo_numindexes;
+		if (R_WorldVBOActive ())
+		{
+			for (i=0, image=gltextures; i<numgltextures; i++, image++)
+			{
+				if (!image->registration_sequence)
+					continue;
+				if (image->texturechain)
+					R_AddWorldVBOChain (image);
+			}
+		}
+		R_UploadWorldVBO (firstdraw);
+		R_DrawWorldVBO (firstdraw);
+		world_vbo_numdraws = firstdraw;
+		world_vbo_numindexes = firstindex;
+	}
+
 	for (i=0, image=gltextures; i<numgltextures; i++, image++)
 	{
 		if (!image->registration_sequence)
@@ -1060,7 +1523,9 @@ static void RB_RenderLightmappedSurface (msurface_t *surf)
 		smax = (surf->extents[0]>>4)+1;
 		tmax = (surf->extents[1]>>4)+1;
 
+		CL_BenchBegin (BENCH_LIGHTMAPS);
 		R_BuildLightMap (surf, (void *)temp, smax*4);
+		CL_BenchEnd (BENCH_LIGHTMAPS);
 
 		if ((surf->styles[map] >= 32 || surf->styles[map] == 0) && (surf->dlightframe != r_framecount))
 		{
@@ -1582,6 +2047,8 @@ void R_DrawBrushModel (entity_t *e)
 R_RecursiveWorldNode
 ================
 */
+static float	worldnode_spread;	// views this far from modelorg see the world lists
+
 void R_RecursiveWorldNode (mnode_t *node)
 {
 	int32_t			c, side, sidebit;
@@ -1590,6 +2057,7 @@ void R_RecursiveWorldNode (mnode_t *node)
 	mleaf_t		*pleaf;
 	float		dot;
 	image_t		*image;
+	qboolean	bothsides;
 
 	if (node->contents == CONTENTS_SOLID)
 		return;		// solid
@@ -1658,6 +2126,9 @@ void R_RecursiveWorldNode (mnode_t *node)
 		sidebit = SURF_PLANEBACK;
 	}
 
+	// a plane running between the eyes has both sides seen
+	bothsides = (dot < worldnode_spread) && (dot > -worldnode_spread);
+
 	// recurse down the children, front side first
 	R_RecursiveWorldNode (node->children[side]);
 
@@ -1667,7 +2138,7 @@ void R_RecursiveWorldNode (mnode_t *node)
 		if (surf->visframe != r_framecount)
 			continue;
 
-		if ((surf->flags & SURF_PLANEBACK) != sidebit)
+		if ((surf->flags & SURF_PLANEBACK) != sidebit && !bothsides)
 			continue;		// wrong side
 
 		surf->entity = NULL;
@@ -1712,6 +2183,88 @@ void R_RecursiveWorldNode (mnode_t *node)
 }
 
 
+/*
+=============================================================
+
+	WORLD LISTS
+
+The first view of a frame walks the world and keeps what it found:
+the texture chains, the world vertex buffer index lists and the alpha
+surfaces.  Views sharing the lists, the second eye, only draw them.
+
+=============================================================
+*/
+
+typedef struct
+{
+	image_t		*image;
+	msurface_t	*texturechain;
+	msurface_t	*warp_texturechain;
+} worldchain_t;
+
+static worldchain_t	world_chains[MAX_GLTEXTURES];
+static int32_t		world_numchains;
+static msurface_t	*world_alpha_surfaces;
+
+
+/*
+=============
+R_BuildWorldLists
+
+Walks the world from r_listorigin, holding the surfaces of every view
+within r_listspread of it
+=============
+*/
+static void R_BuildWorldLists (void)
+{
+	int32_t			i;
+	image_t			*image;
+	worldchain_t	*c;
+
+	VectorCopy (r_listorigin, modelorg);
+	worldnode_spread = r_listspread;
+
+	R_ClearSkyBox ();
+	r_alpha_surfaces = NULL;
+	world_vbo_numdraws = world_vbo_numindexes = 0;
+
+#ifndef MULTITEXTURE_CHAINS
+	GL_EnableMultitexture (true);
+	R_SetLightingMode (0);
+#endif // MULTITEXTURE_CHAINS
+
+	CL_BenchBegin (BENCH_WORLDNODE);
+	R_RecursiveWorldNode (r_worldmodel->nodes);
+	CL_BenchEnd (BENCH_WORLDNODE);
+
+#ifndef MULTITEXTURE_CHAINS
+	GL_EnableMultitexture (false);
+#endif // MULTITEXTURE_CHAINS
+
+	world_numchains = 0;
+	for (i=0, image=gltextures; i<numgltextures; i++, image++)
+	{
+		if (!image->texturechain && !image->warp_texturechain)
+			continue;
+
+		if (image->texturechain && R_WorldVBOActive ())
+			R_AddWorldVBOChain (image);
+
+		c = &world_chains[world_numchains++];
+		c->image = image;
+		c->texturechain = image->texturechain;
+		c->warp_texturechain = image->warp_texturechain;
+		image->texturechain = image->warp_texturechain = NULL;
+	}
+	R_UploadWorldVBO (0);
+
+	world_alpha_surfaces = r_alpha_surfaces;
+
+	VectorCopy (r_newrefdef.vieworg, modelorg);
+	worldnode_spread = 0;
+}
+
+
 /*
 =============
 R_DrawWorld
@@ -1719,7 +2272,9 @@ R_DrawWorld
 */
 void R_DrawWorld (void)
 {
-	entity_t	ent;
+	entity_t		ent;
+	int32_t			i;
+	worldchain_t	*c;
 
 	if (!r_drawworld->value)
 		return;
@@ -1727,9 +2282,9 @@ void R_DrawWorld (void)
 	if ( r_newrefdef.rdflags & RDF_NOWORLDMODEL )
 		return;
 
-	currentmodel = r_worldmodel;
+	Prof_Begin ("R_DrawWorld");
 
-	VectorCopy (r_newrefdef.vieworg, modelorg);
+	currentmodel = r_worldmodel;
 
 	// auto cycle the world frame for texture animation
 	memset (&ent, 0, sizeof(ent));
@@ -1741,22 +2296,27 @@ void R_DrawWorld (void)
 
 	glColor3f (1,1,1);
 	memset (gl_lms.lightmap_surfaces, 0, sizeof(gl_lms.lightmap_surfaces));
-	R_ClearSkyBox ();
 
-#ifndef MULTITEXTURE_CHAINS
-	GL_EnableMultitexture (true);
-	R_SetLightingMode (0);
+#ifdef MULTITEXTURE_CHAINS
+	if (!r_sharedview)
 #endif // MULTITEXTURE_CHAINS
+		R_BuildWorldLists ();
 
-	R_RecursiveWorldNode (r_worldmodel->nodes);
+	VectorCopy (r_newrefdef.vieworg, modelorg);
 
-#ifndef MULTITEXTURE_CHAINS
-	GL_EnableMultitexture (false);
-#endif // MULTITEXTURE_CHAINS
+	// hand the lists to R_DrawMultiTextureChains, which uses them up
+	for (i=0, c=world_chains; i<world_numchains; i++, c++)
+	{
+		c->image->texturechain = c->texturechain;
+		c->image->warp_texturechain = c->warp_texturechain;
+	}
+	r_alpha_surfaces = world_alpha_surfaces;
 
 	R_DrawMultiTextureChains ();	// draw solid warp surfaces
 
 	R_DrawSkyBox ();
+
+	Prof_End ();
 }
 
 
@@ -1803,11 +2363,10 @@ void R_MarkLeaves (void)
 	// may have to combine two clusters because of solid water boundaries
 	if (r_viewcluster2 != r_viewcluster)
 	{
-		memcpy (fatvis, vis, (r_worldmodel->numleafs+7)/8);
+		c = (r_worldmodel->vis->numclusters+7)/8;
+		memcpy (fatvis, vis, c);
 		vis = Mod_ClusterPVS (r_viewcluster2, r_worldmodel);
-		c = (r_worldmodel->numleafs+31)/32;
-		for (i=0 ; i<c ; i++)
-			((int32_t *)fatvis)[i] |= ((int32_t *)vis)[i];
+		Bits_Or (fatvis, vis, c);
 		vis = fatvis;
 	}
 	
@@ -2279,6 +2838,13 @@ void R_BeginBuildingLightmaps (model_t *m)
 
 	r_framecount = 1;		// no dlightcache
 
+	// the world lists point into the old map
+	world_numchains = 0;
+	world_alpha_surfaces = NULL;
+#ifdef BATCH_LM_UPDATES
+	lm_numjobs = 0;
+#endif // BATCH_LM_UPDATES
+
 	GL_EnableMultitexture (true);
 //	GL_SelectTexture(1);
 
@@ -2337,9 +2903,10 @@ void R_BeginBuildingLightmaps (model_t *m)
 R_EndBuildingLightmaps
 =======================
 */
-void R_EndBuildingLightmaps (void)
+void R_EndBuildingLightmaps (model_t *m)
 {
 	LM_UploadBlock (false);
 	GL_EnableMultitexture (false);
+	R_BuildWorldVBO (m);
 }
 
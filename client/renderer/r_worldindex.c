@@ -0,0 +1,51 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// r_worldindex.c -- index lists for the world vertex buffer
+//
+// Kept apart from r_surface.c so building the lists needs nothing
+// but the surface data.
+
+#include "include/r_local.h"
+
+/*
+================
+R_WriteSurfaceIndexes
+
+Writes the triangle fans of a surface in the world vertex buffer to
+out and returns how many indexes that was.  Touches no GL state.
+================
+*/
+int32_t R_WriteSurfaceIndexes (msurface_t *surf, uint32_t *out)
+{
+	glpoly_t	*p;
+	uint32_t	first = surf->vbo_firstvert;
+	int32_t		i, n = 0;
+
+	for (p = surf->polys; p; p = p->chain)
+	{
+		for (i=0; i < p->numverts-2; i++) {
+			out[n++] = first;
+			out[n++] = first+i+1;
+			out[n++] = first+i+2;
+		}
+		first += p->numverts;
+	}
+	return n;
+}
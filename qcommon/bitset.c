@@ -0,0 +1,190 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// bitset.c -- bit vector kernels for pvs / phs rows
+//
+// Rows are plain byte arrays with bit n at [n>>3] & (1<<(n&7)), the
+// layout the vis lump uses.  Nothing here assumes any alignment or a
+// length rounded past the bytes given, so rows pointing straight into
+// a mapped bsp are fine.
+
+#include "qcommon.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define	BITS_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define	BITS_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define	BITS_NEON
+#endif
+
+/*
+=================
+Bits_Or
+
+dst |= src over bytes bytes
+=================
+*/
+void Bits_Or (byte *dst, const byte *src, int32_t bytes)
+{
+	int32_t		i = 0;
+
+#if defined(BITS_AVX2)
+	for ( ; i + 32 <= bytes ; i += 32)
+		_mm256_storeu_si256 ((__m256i *)(dst + i), _mm256_or_si256 (
+			_mm256_loadu_si256 ((const __m256i *)(dst + i)),
+			_mm256_loadu_si256 ((const __m256i *)(src + i))));
+#elif defined(BITS_SSE2)
+	for ( ; i + 16 <= bytes ; i += 16)
+		_mm_storeu_si128 ((__m128i *)(dst + i), _mm_or_si128 (
+			_mm_loadu_si128 ((const __m128i *)(dst + i)),
+			_mm_loadu_si128 ((const __m128i *)(src + i))));
+#elif defined(BITS_NEON)
+	for ( ; i + 16 <= bytes ; i += 16)
+		vst1q_u8 (dst + i, vorrq_u8 (vld1q_u8 (dst + i), vld1q_u8 (src + i)));
+#else
+	uint32_t	a, b;
+
+	for ( ; i + 4 <= bytes ; i += 4)
+	{
+		memcpy (&a, dst + i, 4);
+		memcpy (&b, src + i, 4);
+		a |= b;
+		memcpy (dst + i, &a, 4);
+	}
+#endif
+
+	for ( ; i < bytes ; i++)
+		dst[i] |= src[i];
+}
+
+/*
+=================
+Bits_Path
+=================
+*/
+const char *Bits_Path (void)
+{
+#if defined(BITS_AVX2)
+	return "avx2";
+#elif defined(BITS_SSE2)
+	return "sse2";
+#elif defined(BITS_NEON)
+	return "neon";
+#else
+	return "scalar";
+#endif
+}
+
+/*
+=============================================================================
+
+BENCHMARK
+
+=============================================================================
+*/
+
+#define	BITBENCH_ROWS	16
+#define	BITBENCH_INDICES	16	// MAX_ENT_CLUSTERS
+
+/*
+=================
+Bits_Bench_f
+
+bitbench [clusters] [passes]
+
+Times the kernels against the loops they replaced, over rows as wide as
+the loaded map's (or the given cluster count, or the largest a bsp allows)
+=================
+*/
+void Bits_Bench_f (void)
+{
+	static byte	rows[BITBENCH_ROWS][MAX_MAP_LEAFS/8];
+	static byte	dst[MAX_MAP_LEAFS/8];
+	int32_t		clusters, passes, bytes, longs;
+	int32_t		i, j, p, l, start;
+	int32_t		indices[BITBENCH_INDICES];
+	int32_t		times[2][2];
+	volatile int32_t	sink = 0;
+
+	clusters = CM_NumClusters ();
+	if (Cmd_Argc() > 1)
+		clusters = atoi (Cmd_Argv(1));
+	if (clusters <= 0 || clusters > MAX_MAP_LEAFS)
+		clusters = MAX_MAP_LEAFS;
+	passes = Cmd_Argc() > 2 ? atoi (Cmd_Argv(2)) : 2000;
+	if (passes < 1)
+		passes = 1;
+
+	bytes = (clusters + 7) >> 3;
+	longs = (clusters + 31) >> 5;
+
+	// sparse-ish rows, like a real pvs
+	for (i=0 ; i<BITBENCH_ROWS ; i++)
+		for (j=0 ; j<bytes ; j++)
+			rows[i][j] = (rand() & 3) ? 0 : rand();
+
+	// union, the SV_FatPVS / R_MarkLeaves loop
+	start = Sys_Milliseconds ();
+	for (p=0 ; p<passes ; p++)
+		for (i=0 ; i<BITBENCH_ROWS ; i++)
+			for (j=0 ; j<longs ; j++)
+				((int32_t *)dst)[j] |= ((int32_t *)rows[i])[j];
+	times[0][0] = Sys_Milliseconds () - start;
+	sink += dst[0];
+
+	start = Sys_Milliseconds ();
+	for (p=0 ; p<passes ; p++)
+		for (i=0 ; i<BITBENCH_ROWS ; i++)
+			Bits_Or (dst, rows[i], bytes);
+	times[1][0] = Sys_Milliseconds () - start;
+	sink += dst[0];
+
+	// entity cluster tests, as many scattered lookups as an entity can have
+	for (i=0 ; i<BITBENCH_INDICES ; i++)
+		indices[i] = rand() % clusters;
+
+	start = Sys_Milliseconds ();
+	for (p=0 ; p<passes*64 ; p++)
+		for (i=0 ; i<BITBENCH_ROWS ; i++)
+		{
+			for (j=0 ; j<BITBENCH_INDICES ; j++)
+			{
+				l = indices[j];
+				if (rows[i][l >> 3] & (1 << (l&7) ))
+					break;
+			}
+			sink += j;
+		}
+	times[0][1] = Sys_Milliseconds () - start;
+
+	start = Sys_Milliseconds ();
+	for (p=0 ; p<passes*64 ; p++)
+		for (i=0 ; i<BITBENCH_ROWS ; i++)
+			sink += Bits_TestAny (rows[i], indices, BITBENCH_INDICES);
+	times[1][1] = Sys_Milliseconds () - start;
+
+	Com_Printf ("bitbench: %i clusters, %i passes, %s kernels\n", clusters, passes, Bits_Path());
+	Com_Printf ("             loop   kernel\n");
+	Com_Printf ("union     %6i ms %6i ms\n", times[0][0], times[1][0]);
+	Com_Printf ("testany   %6i ms %6i ms\n", times[0][1], times[1][1]);
+}
@@ -21,6 +21,21 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "qcommon.h"
 
+// four planes to a group, most brushes are six sided boxes so groups of
+// eight would be largely padding and check the early out half as often.
+// Without vectors a group is a single plane.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define	CM_SSE2
+#define	PLANE_LANES	4
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define	CM_NEON
+#define	PLANE_LANES	4
+#else
+#define	PLANE_LANES	1
+#endif
+
 typedef struct
 {
 	cplane_t	*plane;
@@ -47,9 +62,18 @@ typedef struct
 	int32_t			contents;
 	int32_t			numsides;
 	int32_t			firstbrushside;
-	int32_t			checkcount;		// to avoid repeated testings
+	int32_t			firstgroup;		// in map_planegroups, -1 for the box hull
 } cbrush_t;
 
+// the planes of each brush copied out PLANE_LANES to a group, so the
+// clipping tests can take a whole group at once.  The lanes past the
+// last side hold a plane nothing is ever in front of.
+typedef struct
+{
+	float		normal[3][PLANE_LANES];
+	float		dist[PLANE_LANES];
+} cplanegroup_t;
+
 typedef struct
 {
 	int32_t		numareaportals;
@@ -58,8 +82,6 @@ typedef struct
 	int32_t		floodvalid;
 } carea_t;
 
-int32_t			checkcount;
-
 char		map_name[MAX_QPATH];
 
 int32_t			numbrushsides;
@@ -87,9 +109,11 @@ cmodel_t	map_cmodels[MAX_MAP_MODELS];
 int32_t			numbrushes;
 cbrush_t	map_brushes[MAX_MAP_BRUSHES];
 
+static cplanegroup_t	*map_planegroups;
+
 int32_t			numvisibility;
-byte		map_visibility[MAX_MAP_VISIBILITY];
-dvis_t		*map_vis = (dvis_t *)map_visibility;
+byte		map_visibility[MAX_MAP_VISIBILITY];	// swapped copy on big endian hosts
+dvis_t		*map_vis = (dvis_t *)map_visibility;	// usually points into map_file
 
 int32_t			numentitychars;
 char		map_entitystring[MAX_MAP_ENTSTRING];
@@ -113,6 +137,10 @@ cvar_t		*map_noareas;
 
 void	CM_InitBoxHull (void);
 void	FloodAreaConnections (void);
+static void	CM_FreeVisCache (void);
+static void	CM_BuildVisCache (void);
+static void	CM_FreeBrushPlanes (void);
+static void	CM_BuildBrushPlanes (void);
 
 
 int32_t		c_pointcontents;
@@ -128,6 +156,7 @@ int32_t		c_traces, c_brush_traces;
 */
 
 byte	*cmod_base;
+static const void	*map_file;		// mapped .bsp, kept for the lumps used in place
 
 /*
 =================
@@ -511,6 +540,14 @@ void CMod_LoadVisibility (lump_t *l)
 	if (l->filelen > MAX_MAP_VISIBILITY)
 		Com_Error (ERR_DROP, "Map has too large visibility lump");
 
+	// the lump is already in memory order, use it straight out of the file
+	if (!bigendien && l->filelen && !(l->fileofs & 3))
+	{
+		map_vis = (dvis_t *)(cmod_base + l->fileofs);
+		return;
+	}
+
+	map_vis = (dvis_t *)map_visibility;
 	memcpy (map_visibility, cmod_base + l->fileofs, l->filelen);
 
 	map_vis->numclusters = LittleLong (map_vis->numclusters);
@@ -586,7 +623,7 @@ Loads in the map and all submodels
 */
 cmodel_t *CM_LoadMap (char *name, qboolean clientload, uint32_t *checksum)
 {
-	uint32_t		*buf;
+	const uint32_t	*buf;
 	int32_t				i;
 	dheader_t		header;
 	int32_t				length;
@@ -606,6 +643,12 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, uint32_t *checksum)
 	}
 
 	// free old stuff
+	CM_FreeVisCache ();
+	CM_FreeBrushPlanes ();
+	if (map_file)
+		FS_UnmapFile (map_file);
+	map_file = NULL;
+	map_vis = (dvis_t *)map_visibility;
 	numplanes = 0;
 	numnodes = 0;
 	numleafs = 0;
@@ -627,11 +670,12 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, uint32_t *checksum)
 	//
 	// load the file
 	//
-	length = FS_LoadFile (name, (void **)&buf);
+	buf = (const uint32_t *)FS_MapFile (name, &length);
 	if (!buf)
 		Com_Error (ERR_DROP, "Couldn't load %s", name);
+	map_file = buf;
 
-	last_checksum = LittleLong (Com_BlockChecksum (buf, length));
+	last_checksum = LittleLong (Com_BlockChecksum ((void *)buf, length));
 	*checksum = last_checksum;
 
 	header = *(dheader_t *)buf;
@@ -686,9 +730,9 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, uint32_t *checksum)
 		//	Com_Printf ("External entities not found. Using bsp entities\n");
 	}
 */
-	FS_FreeFile (buf);
-
 	CM_InitBoxHull ();
+	CM_BuildBrushPlanes ();
+	CM_BuildVisCache ();
 
 	memset (portalopen, 0, sizeof(portalopen));
 	FloodAreaConnections ();
@@ -760,6 +804,8 @@ int32_t			box_headnode;
 cbrush_t	*box_brush;
 cleaf_t		*box_leaf;
 
+cmtrace_t	cm_tracectx;		// used by the non reentrant entry points
+
 /*
 ===================
 CM_InitBoxHull
@@ -788,6 +834,7 @@ void CM_InitBoxHull (void)
 	box_brush = &map_brushes[numbrushes];
 	box_brush->numsides = 6;
 	box_brush->firstbrushside = numbrushsides;
+	box_brush->firstgroup = -1;		// planes change with every box
 	box_brush->contents = CONTENTS_MONSTER;
 
 	box_leaf = &map_leafs[numleafs];
@@ -854,9 +901,49 @@ int32_t	CM_HeadnodeForBox (vec3_t mins, vec3_t maxs)
 	box_planes[10].dist = mins[2];
 	box_planes[11].dist = -mins[2];
 
+	memcpy (cm_tracectx.boxplanes, box_planes, sizeof(cm_tracectx.boxplanes));
+
 	return box_headnode;
 }
 
+/*
+===================
+CM_HeadnodeForBoxCtx
+
+Same as CM_HeadnodeForBox, but the box only exists for traces made
+with the given context
+===================
+*/
+int32_t	CM_HeadnodeForBoxCtx (cmtrace_t *ctx, vec3_t mins, vec3_t maxs)
+{
+	int32_t		i;
+
+	memcpy (ctx->boxplanes, box_planes, sizeof(ctx->boxplanes));
+	for (i=0 ; i<3 ; i++)
+	{
+		ctx->boxplanes[i*4+0].dist = maxs[i];
+		ctx->boxplanes[i*4+1].dist = -maxs[i];
+		ctx->boxplanes[i*4+2].dist = mins[i];
+		ctx->boxplanes[i*4+3].dist = -mins[i];
+	}
+
+	return box_headnode;
+}
+
+/*
+===================
+CM_TracePlane
+
+Box hull planes are looked up in the context, everything else is shared
+===================
+*/
+static cplane_t *CM_TracePlane (cmtrace_t *ctx, cplane_t *plane)
+{
+	if (ctx && plane >= box_planes && plane < box_planes + 12)
+		return &ctx->boxplanes[plane - box_planes];
+	return plane;
+}
+
 
 /*
 ==================
@@ -906,12 +993,16 @@ CM_BoxLeafnums
 Fills in a list of all the leafs touched
 =============
 */
-int32_t		leaf_count, leaf_maxcount;
-int32_t		*leaf_list;
-float	*leaf_mins, *leaf_maxs;
-int32_t		leaf_topnode;
-
-void CM_BoxLeafnums_r (int32_t nodenum)
+typedef struct
+{
+	int32_t		count, maxcount;
+	int32_t		*list;
+	float	*mins, *maxs;
+	int32_t		topnode;
+	cmtrace_t	*ctx;
+} boxleafs_t;
+
+void CM_BoxLeafnums_r (boxleafs_t *bl, int32_t nodenum)
 {
 	cplane_t	*plane;
 	cnode_t		*node;
@@ -921,50 +1012,57 @@ void CM_BoxLeafnums_r (int32_t nodenum)
 	{
 		if (nodenum < 0)
 		{
-			if (leaf_count >= leaf_maxcount)
+			if (bl->count >= bl->maxcount)
 			{
 //				Com_Printf ("CM_BoxLeafnums_r: overflow\n");
 				return;
 			}
-			leaf_list[leaf_count++] = -1 - nodenum;
+			bl->list[bl->count++] = -1 - nodenum;
 			return;
 		}
 	
 		node = &map_nodes[nodenum];
-		plane = node->plane;
-//		s = BoxOnPlaneSide (leaf_mins, leaf_maxs, plane);
-		s = BOX_ON_PLANE_SIDE(leaf_mins, leaf_maxs, plane);
+		plane = CM_TracePlane (bl->ctx, node->plane);
+//		s = BoxOnPlaneSide (bl->mins, bl->maxs, plane);
+		s = BOX_ON_PLANE_SIDE(bl->mins, bl->maxs, plane);
 		if (s == 1)
 			nodenum = node->children[0];
 		else if (s == 2)
 			nodenum = node->children[1];
 		else
 		{	// go down both
-			if (leaf_topnode == -1)
-				leaf_topnode = nodenum;
-			CM_BoxLeafnums_r (node->children[0]);
+			if (bl->topnode == -1)
+				bl->topnode = nodenum;
+			CM_BoxLeafnums_r (bl, node->children[0]);
 			nodenum = node->children[1];
 		}
 
 	}
 }
 
-int32_t	CM_BoxLeafnums_headnode (vec3_t mins, vec3_t maxs, int32_t *list, int32_t listsize, int32_t headnode, int32_t *topnode)
+int32_t	CM_BoxLeafnums_ctx (cmtrace_t *ctx, vec3_t mins, vec3_t maxs, int32_t *list, int32_t listsize, int32_t headnode, int32_t *topnode)
 {
-	leaf_list = list;
-	leaf_count = 0;
-	leaf_maxcount = listsize;
-	leaf_mins = mins;
-	leaf_maxs = maxs;
+	boxleafs_t	bl;
 
-	leaf_topnode = -1;
+	bl.list = list;
+	bl.count = 0;
+	bl.maxcount = listsize;
+	bl.mins = mins;
+	bl.maxs = maxs;
+	bl.topnode = -1;
+	bl.ctx = ctx;
 
-	CM_BoxLeafnums_r (headnode);
+	CM_BoxLeafnums_r (&bl, headnode);
 
 	if (topnode)
-		*topnode = leaf_topnode;
+		*topnode = bl.topnode;
 
-	return leaf_count;
+	return bl.count;
+}
+
+int32_t	CM_BoxLeafnums_headnode (vec3_t mins, vec3_t maxs, int32_t *list, int32_t listsize, int32_t headnode, int32_t *topnode)
+{
+	return CM_BoxLeafnums_ctx (NULL, mins, maxs, list, listsize, headnode, topnode);
 }
 
 int32_t	CM_BoxLeafnums (vec3_t mins, vec3_t maxs, int32_t *list, int32_t listsize, int32_t *topnode)
@@ -1029,6 +1127,197 @@ int32_t	CM_TransformedPointContents (vec3_t p, int32_t headnode, vec3_t origin,
 }
 
 
+/*
+===============================================================================
+
+BRUSH PLANE GROUPS
+
+===============================================================================
+*/
+
+/*
+===================
+CM_PackBrushPlanes
+
+Copies the planes of a brush into its groups, through the trace context
+so the box hull gets that trace's planes
+===================
+*/
+static void CM_PackBrushPlanes (cmtrace_t *ctx, cbrush_t *brush, cplanegroup_t *groups)
+{
+	int32_t		i, lane;
+	cplane_t	*plane;
+	cplanegroup_t	*g;
+
+	memset (groups, 0, sizeof(cplanegroup_t) * ((brush->numsides + PLANE_LANES-1) / PLANE_LANES));
+	for (i=0 ; i<brush->numsides ; i++)
+	{
+		plane = CM_TracePlane (ctx, map_brushsides[brush->firstbrushside+i].plane);
+		g = &groups[i / PLANE_LANES];
+		lane = i % PLANE_LANES;
+		g->normal[0][lane] = plane->normal[0];
+		g->normal[1][lane] = plane->normal[1];
+		g->normal[2][lane] = plane->normal[2];
+		g->dist[lane] = plane->dist;
+	}
+
+	// a zero normal with a positive dist puts every point behind it
+	for (lane = i % PLANE_LANES ; lane && lane < PLANE_LANES ; lane++)
+		groups[i / PLANE_LANES].dist[lane] = 1;
+}
+
+/*
+===================
+CM_FreeBrushPlanes
+===================
+*/
+static void CM_FreeBrushPlanes (void)
+{
+	if (map_planegroups)
+		Z_Free (map_planegroups);
+	map_planegroups = NULL;
+}
+
+/*
+===================
+CM_BuildBrushPlanes
+
+Called after CM_InitBoxHull, which leaves the box brush out
+===================
+*/
+static void CM_BuildBrushPlanes (void)
+{
+	int32_t		i, count;
+	cbrush_t	*b;
+
+	CM_FreeBrushPlanes ();
+
+	for (i=0, count=0, b=map_brushes ; i<numbrushes ; i++, b++)
+	{
+		b->firstgroup = count;
+		count += (b->numsides + PLANE_LANES-1) / PLANE_LANES;
+	}
+	if (!count)
+		return;
+
+	map_planegroups = Z_Malloc (count * sizeof(cplanegroup_t));
+	for (i=0, b=map_brushes ; i<numbrushes ; i++, b++)
+		CM_PackBrushPlanes (NULL, b, map_planegroups + b->firstgroup);
+}
+
+/*
+================
+CM_ClipPlaneGroup
+
+Distances of p1 and p2 in front of each plane of a group once pushed out
+for the box, with the same arithmetic as a plane at a time.  Stores them
+in d1 and d2 and sets bit n of out1 / out2 when lane n has p1 / p2 in
+front.  Returns the lanes where the whole move stays in front.
+================
+*/
+static FORCE_INLINE int32_t CM_ClipPlaneGroup (const cplanegroup_t *g, const vec3_t mins, const vec3_t maxs,
+	const vec3_t p1, const vec3_t p2, float *d1, float *d2, int32_t *out1, int32_t *out2)
+{
+#if defined(CM_SSE2)
+	__m128	zero = _mm_setzero_ps ();
+	__m128	n[3], neg, ofs, dist, a, b, in1, in2;
+	int32_t	j;
+
+	ofs = zero;
+	for (j=0 ; j<3 ; j++)
+	{
+		n[j] = _mm_loadu_ps (g->normal[j]);
+		neg = _mm_cmplt_ps (n[j], zero);
+		a = _mm_mul_ps (n[j], _mm_or_ps (_mm_and_ps (neg, _mm_set1_ps (maxs[j])),
+			_mm_andnot_ps (neg, _mm_set1_ps (mins[j]))));
+		ofs = j ? _mm_add_ps (ofs, a) : a;
+	}
+	dist = _mm_sub_ps (_mm_loadu_ps (g->dist), ofs);
+
+	a = _mm_add_ps (_mm_add_ps (_mm_mul_ps (n[0], _mm_set1_ps (p1[0])),
+		_mm_mul_ps (n[1], _mm_set1_ps (p1[1]))), _mm_mul_ps (n[2], _mm_set1_ps (p1[2])));
+	b = _mm_add_ps (_mm_add_ps (_mm_mul_ps (n[0], _mm_set1_ps (p2[0])),
+		_mm_mul_ps (n[1], _mm_set1_ps (p2[1]))), _mm_mul_ps (n[2], _mm_set1_ps (p2[2])));
+	a = _mm_sub_ps (a, dist);
+	b = _mm_sub_ps (b, dist);
+	_mm_storeu_ps (d1, a);
+	_mm_storeu_ps (d2, b);
+
+	in1 = _mm_cmpgt_ps (a, zero);
+	in2 = _mm_cmpgt_ps (b, zero);
+	*out1 = _mm_movemask_ps (in1);
+	*out2 = _mm_movemask_ps (in2);
+	return _mm_movemask_ps (_mm_and_ps (in1, _mm_cmpge_ps (b, a)));
+
+#elif defined(CM_NEON)
+	static const uint32_t	bits[4] = {1, 2, 4, 8};
+	float32x4_t	zero = vdupq_n_f32 (0);
+	float32x4_t	n[3], ofs, dist, a, b;
+	uint32x4_t	lanes = vld1q_u32 (bits);
+	uint32x4_t	in1, in2, front;
+	uint32x2_t	s;
+	int32_t		j;
+
+	ofs = zero;
+	for (j=0 ; j<3 ; j++)
+	{
+		n[j] = vld1q_f32 (g->normal[j]);
+		a = vmulq_f32 (n[j], vbslq_f32 (vcltq_f32 (n[j], zero), vdupq_n_f32 (maxs[j]), vdupq_n_f32 (mins[j])));
+		ofs = j ? vaddq_f32 (ofs, a) : a;
+	}
+	dist = vsubq_f32 (vld1q_f32 (g->dist), ofs);
+
+	a = vaddq_f32 (vaddq_f32 (vmulq_f32 (n[0], vdupq_n_f32 (p1[0])),
+		vmulq_f32 (n[1], vdupq_n_f32 (p1[1]))), vmulq_f32 (n[2], vdupq_n_f32 (p1[2])));
+	b = vaddq_f32 (vaddq_f32 (vmulq_f32 (n[0], vdupq_n_f32 (p2[0])),
+		vmulq_f32 (n[1], vdupq_n_f32 (p2[1]))), vmulq_f32 (n[2], vdupq_n_f32 (p2[2])));
+	a = vsubq_f32 (a, dist);
+	b = vsubq_f32 (b, dist);
+	vst1q_f32 (d1, a);
+	vst1q_f32 (d2, b);
+
+	// no movemask, sum the lane bits instead
+	in1 = vandq_u32 (vcgtq_f32 (a, zero), lanes);
+	in2 = vandq_u32 (vcgtq_f32 (b, zero), lanes);
+	front = vandq_u32 (in1, vcgeq_f32 (b, a));
+	s = vadd_u32 (vget_low_u32 (in1), vget_high_u32 (in1));
+	*out1 = vget_lane_u32 (vpadd_u32 (s, s), 0);
+	s = vadd_u32 (vget_low_u32 (in2), vget_high_u32 (in2));
+	*out2 = vget_lane_u32 (vpadd_u32 (s, s), 0);
+	s = vadd_u32 (vget_low_u32 (front), vget_high_u32 (front));
+	return vget_lane_u32 (vpadd_u32 (s, s), 0);
+
+#else
+	int32_t		i, j;
+	float		ofs[3], dist;
+	vec3_t		normal;
+
+	*out1 = *out2 = 0;
+	for (i=0 ; i<PLANE_LANES ; i++)
+	{
+		for (j=0 ; j<3 ; j++)
+		{
+			normal[j] = g->normal[j][i];
+			ofs[j] = (normal[j] < 0) ? maxs[j] : mins[j];
+		}
+		dist = g->dist[i] - DotProduct (ofs, normal);
+		d1[i] = DotProduct (p1, normal) - dist;
+		d2[i] = DotProduct (p2, normal) - dist;
+
+		if (d1[i] > 0)
+		{
+			if (d2[i] >= d1[i])
+				return 1<<i;	// the caller is done with this brush
+			*out1 |= 1<<i;
+		}
+		if (d2[i] > 0)
+			*out2 |= 1<<i;
+	}
+	return 0;
+#endif
+}
+
+
 /*
 ===============================================================================
 
@@ -1040,35 +1329,30 @@ BOX TRACING
 // 1/32 epsilon to keep floating point happy
 #define	DIST_EPSILON	(0.03125)
 
-vec3_t	trace_start, trace_end;
-vec3_t	trace_mins, trace_maxs;
-vec3_t	trace_extents;
-
-trace_t	trace_trace;
-int32_t		trace_contents;
-qboolean	trace_ispoint;		// optimized case
-
 /*
 ================
 CM_ClipBoxToBrush
+
+The point case is the box case with zero mins and maxs, which pushes
+every plane out by nothing
 ================
 */
-void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
+void CM_ClipBoxToBrush (cmtrace_t *ctx, vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 					  trace_t *trace, cbrush_t *brush)
 {
-	int32_t			i, j;
-	cplane_t	*plane, *clipplane;
-	float		dist;
+	int32_t			i, j, numgroups;
+	int32_t			out1, out2, cross;
+	int32_t			leadside;
+	float		d1[PLANE_LANES], d2[PLANE_LANES];
 	float		enterfrac, leavefrac;
-	vec3_t		ofs;
-	float		d1, d2;
 	qboolean	getout, startout;
 	float		f;
-	cbrushside_t	*side, *leadside;
+	cplanegroup_t	boxgroups[(6 + PLANE_LANES-1) / PLANE_LANES];
+	cplanegroup_t	*groups;
+	cbrushside_t	*side;
 
 	enterfrac = -1;
 	leavefrac = 1;
-	clipplane = NULL;
 
 	if (!brush->numsides)
 		return;
@@ -1077,67 +1361,50 @@ void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 
 	getout = false;
 	startout = false;
-	leadside = NULL;
+	leadside = -1;
 
-	for (i=0 ; i<brush->numsides ; i++)
+	if (brush->firstgroup < 0)
 	{
-		side = &map_brushsides[brush->firstbrushside+i];
-		plane = side->plane;
-
-		// FIXME: special case for axial
-
-		if (!trace_ispoint)
-		{	// general box case
-
-			// push the plane out apropriately for mins/maxs
-
-			// FIXME: use signbits into 8 way lookup for each mins/maxs
-			for (j=0 ; j<3 ; j++)
-			{
-				if (plane->normal[j] < 0)
-					ofs[j] = maxs[j];
-				else
-					ofs[j] = mins[j];
-			}
-			dist = DotProduct (ofs, plane->normal);
-			dist = plane->dist - dist;
-		}
-		else
-		{	// special point case
-			dist = plane->dist;
-		}
+		CM_PackBrushPlanes (ctx, brush, boxgroups);
+		groups = boxgroups;
+	}
+	else
+		groups = map_planegroups + brush->firstgroup;
+	numgroups = (brush->numsides + PLANE_LANES-1) / PLANE_LANES;
 
-		d1 = DotProduct (p1, plane->normal) - dist;
-		d2 = DotProduct (p2, plane->normal) - dist;
+	for (i=0 ; i<numgroups ; i++)
+	{
+		// if completely in front of any face, no intersection
+		if (CM_ClipPlaneGroup (&groups[i], mins, maxs, p1, p2, d1, d2, &out1, &out2))
+			return;
 
-		if (d2 > 0)
+		if (out2)
 			getout = true;	// endpoint is not in solid
-		if (d1 > 0)
+		if (out1)
 			startout = true;
 
-		// if completely in front of face, no intersection
-		if (d1 > 0 && d2 >= d1)
-			return;
-
-		if (d1 <= 0 && d2 <= 0)
-			continue;
-
-		// crosses face
-		if (d1 > d2)
-		{	// enter
-			f = (d1-DIST_EPSILON) / (d1-d2);
-			if (f > enterfrac)
-			{
-				enterfrac = f;
-				clipplane = plane;
-				leadside = side;
+		// the faces it crosses, in side order so ties go to the first
+		cross = out1 | out2;
+		for (j=0 ; cross ; j++, cross >>= 1)
+		{
+			if (!(cross & 1))
+				continue;
+
+			if (d1[j] > d2[j])
+			{	// enter
+				f = (d1[j]-DIST_EPSILON) / (d1[j]-d2[j]);
+				if (f > enterfrac)
+				{
+					enterfrac = f;
+					leadside = i*PLANE_LANES + j;
+				}
+			}
+			else
+			{	// leave
+				f = (d1[j]+DIST_EPSILON) / (d1[j]-d2[j]);
+				if (f < leavefrac)
+					leavefrac = f;
 			}
-		}
-		else
-		{	// leave
-			f = (d1+DIST_EPSILON) / (d1-d2);
-			if (f < leavefrac)
-				leavefrac = f;
 		}
 	}
 
@@ -1154,9 +1421,10 @@ void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 		{
 			if (enterfrac < 0)
 				enterfrac = 0;
+			side = &map_brushsides[brush->firstbrushside + leadside];
 			trace->fraction = enterfrac;
-			trace->plane = *clipplane;
-			trace->surface = &(leadside->surface->c);
+			trace->plane = *CM_TracePlane (ctx, side->plane);
+			trace->surface = &(side->surface->c);
 			trace->contents = brush->contents;
 		}
 	}
@@ -1167,47 +1435,32 @@ void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 CM_TestBoxInBrush
 ================
 */
-void CM_TestBoxInBrush (vec3_t mins, vec3_t maxs, vec3_t p1,
+void CM_TestBoxInBrush (cmtrace_t *ctx, vec3_t mins, vec3_t maxs, vec3_t p1,
 					  trace_t *trace, cbrush_t *brush)
 {
-	int32_t			i, j;
-	cplane_t	*plane;
-	float		dist;
-	vec3_t		ofs;
-	float		d1;
-	cbrushside_t	*side;
+	int32_t			i, numgroups;
+	int32_t			out1, out2;
+	float		d1[PLANE_LANES], d2[PLANE_LANES];
+	cplanegroup_t	boxgroups[(6 + PLANE_LANES-1) / PLANE_LANES];
+	cplanegroup_t	*groups;
 
 	if (!brush->numsides)
 		return;
 
-	for (i=0 ; i<brush->numsides ; i++)
+	if (brush->firstgroup < 0)
 	{
-		side = &map_brushsides[brush->firstbrushside+i];
-		plane = side->plane;
-
-		// FIXME: special case for axial
-
-		// general box case
-
-		// push the plane out apropriately for mins/maxs
-
-		// FIXME: use signbits into 8 way lookup for each mins/maxs
-		for (j=0 ; j<3 ; j++)
-		{
-			if (plane->normal[j] < 0)
-				ofs[j] = maxs[j];
-			else
-				ofs[j] = mins[j];
-		}
-		dist = DotProduct (ofs, plane->normal);
-		dist = plane->dist - dist;
-
-		d1 = DotProduct (p1, plane->normal) - dist;
+		CM_PackBrushPlanes (ctx, brush, boxgroups);
+		groups = boxgroups;
+	}
+	else
+		groups = map_planegroups + brush->firstgroup;
+	numgroups = (brush->numsides + PLANE_LANES-1) / PLANE_LANES;
 
+	for (i=0 ; i<numgroups ; i++)
+	{
 		// if completely in front of face, no intersection
-		if (d1 > 0)
+		if (CM_ClipPlaneGroup (&groups[i], mins, maxs, p1, p1, d1, d2, &out1, &out2))
 			return;
-
 	}
 
 	// inside this brush
@@ -1222,7 +1475,7 @@ void CM_TestBoxInBrush (vec3_t mins, vec3_t maxs, vec3_t p1,
 CM_TraceToLeaf
 ================
 */
-void CM_TraceToLeaf (int32_t leafnum)
+void CM_TraceToLeaf (cmtrace_t *ctx, int32_t leafnum)
 {
 	int32_t			k;
 	int32_t			brushnum;
@@ -1230,21 +1483,21 @@ void CM_TraceToLeaf (int32_t leafnum)
 	cbrush_t	*b;
 
 	leaf = &map_leafs[leafnum];
-	if ( !(leaf->contents & trace_contents))
+	if ( !(leaf->contents & ctx->contents))
 		return;
 	// trace line against all brushes in the leaf
 	for (k=0 ; k<leaf->numleafbrushes ; k++)
 	{
 		brushnum = map_leafbrushes[leaf->firstleafbrush+k];
 		b = &map_brushes[brushnum];
-		if (b->checkcount == checkcount)
+		if (ctx->brushchecks[brushnum] == ctx->checkcount)
 			continue;	// already checked this brush in another leaf
-		b->checkcount = checkcount;
+		ctx->brushchecks[brushnum] = ctx->checkcount;
 
-		if ( !(b->contents & trace_contents))
+		if ( !(b->contents & ctx->contents))
 			continue;
-		CM_ClipBoxToBrush (trace_mins, trace_maxs, trace_start, trace_end, &trace_trace, b);
-		if (!trace_trace.fraction)
+		CM_ClipBoxToBrush (ctx, ctx->mins, ctx->maxs, ctx->start, ctx->end, &ctx->trace, b);
+		if (!ctx->trace.fraction)
 			return;
 	}
 
@@ -1256,7 +1509,7 @@ void CM_TraceToLeaf (int32_t leafnum)
 CM_TestInLeaf
 ================
 */
-void CM_TestInLeaf (int32_t leafnum)
+void CM_TestInLeaf (cmtrace_t *ctx, int32_t leafnum)
 {
 	int32_t			k;
 	int32_t			brushnum;
@@ -1264,21 +1517,21 @@ void CM_TestInLeaf (int32_t leafnum)
 	cbrush_t	*b;
 
 	leaf = &map_leafs[leafnum];
-	if ( !(leaf->contents & trace_contents))
+	if ( !(leaf->contents & ctx->contents))
 		return;
 	// trace line against all brushes in the leaf
 	for (k=0 ; k<leaf->numleafbrushes ; k++)
 	{
 		brushnum = map_leafbrushes[leaf->firstleafbrush+k];
 		b = &map_brushes[brushnum];
-		if (b->checkcount == checkcount)
+		if (ctx->brushchecks[brushnum] == ctx->checkcount)
 			continue;	// already checked this brush in another leaf
-		b->checkcount = checkcount;
+		ctx->brushchecks[brushnum] = ctx->checkcount;
 
-		if ( !(b->contents & trace_contents))
+		if ( !(b->contents & ctx->contents))
 			continue;
-		CM_TestBoxInBrush (trace_mins, trace_maxs, trace_start, &trace_trace, b);
-		if (!trace_trace.fraction)
+		CM_TestBoxInBrush (ctx, ctx->mins, ctx->maxs, ctx->start, &ctx->trace, b);
+		if (!ctx->trace.fraction)
 			return;
 	}
 
@@ -1291,7 +1544,7 @@ CM_RecursiveHullCheck
 
 ==================
 */
-void CM_RecursiveHullCheck (const int32_t num, const float p1f, const float p2f, const vec3_t p1, const vec3_t p2)
+void CM_RecursiveHullCheck (cmtrace_t *ctx, const int32_t num, const float p1f, const float p2f, const vec3_t p1, const vec3_t p2)
 {
 	cnode_t		*node;
 	cplane_t	*plane;
@@ -1303,13 +1556,13 @@ void CM_RecursiveHullCheck (const int32_t num, const float p1f, const float p2f,
 	int32_t			side;
 	float		midf;
 
-	if (trace_trace.fraction <= p1f)
+	if (ctx->trace.fraction <= p1f)
 		return;		// already hit something nearer
 
 	// if < 0, we are in a leaf node
 	if (num < 0)
 	{
-		CM_TraceToLeaf (-1-num);
+		CM_TraceToLeaf (ctx, -1-num);
 		return;
 	}
 
@@ -1318,42 +1571,42 @@ void CM_RecursiveHullCheck (const int32_t num, const float p1f, const float p2f,
 	// and the offset for the size of the box
 	//
 	node = map_nodes + num;
-	plane = node->plane;
+	plane = CM_TracePlane (ctx, node->plane);
 
 	if (plane->type < 3)
 	{
 		t1 = p1[plane->type] - plane->dist;
 		t2 = p2[plane->type] - plane->dist;
-		offset = trace_extents[plane->type];
+		offset = ctx->extents[plane->type];
 	}
 	else
 	{
 		t1 = DotProduct (plane->normal, p1) - plane->dist;
 		t2 = DotProduct (plane->normal, p2) - plane->dist;
-		if (trace_ispoint)
+		if (ctx->ispoint)
 			offset = 0;
 		else
-			offset = fabs(trace_extents[0]*plane->normal[0]) +
-				fabs(trace_extents[1]*plane->normal[1]) +
-				fabs(trace_extents[2]*plane->normal[2]);
+			offset = fabs(ctx->extents[0]*plane->normal[0]) +
+				fabs(ctx->extents[1]*plane->normal[1]) +
+				fabs(ctx->extents[2]*plane->normal[2]);
 	}
 
 
 #if 0
-CM_RecursiveHullCheck (node->children[0], p1f, p2f, p1, p2);
-CM_RecursiveHullCheck (node->children[1], p1f, p2f, p1, p2);
+CM_RecursiveHullCheck (ctx, node->children[0], p1f, p2f, p1, p2);
+CM_RecursiveHullCheck (ctx, node->children[1], p1f, p2f, p1, p2);
 return;
 #endif
 
 	// see which sides we need to consider
 	if (t1 >= offset && t2 >= offset)
 	{
-		CM_RecursiveHullCheck (node->children[0], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck (ctx, node->children[0], p1f, p2f, p1, p2);
 		return;
 	}
 	if (t1 < -offset && t2 < -offset)
 	{
-		CM_RecursiveHullCheck (node->children[1], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck (ctx, node->children[1], p1f, p2f, p1, p2);
 		return;
 	}
 
@@ -1389,7 +1642,7 @@ return;
 	for (i=0 ; i<3 ; i++)
 		mid[i] = p1[i] + frac*(p2[i] - p1[i]);
 
-	CM_RecursiveHullCheck (node->children[side], p1f, midf, p1, mid);
+	CM_RecursiveHullCheck (ctx, node->children[side], p1f, midf, p1, mid);
 
 
 	// go past the node
@@ -1402,7 +1655,7 @@ return;
 	for (i=0 ; i<3 ; i++)
 		mid[i] = p1[i] + frac2*(p2[i] - p1[i]);
 
-	CM_RecursiveHullCheck (node->children[side^1], midf, p2f, mid, p2);
+	CM_RecursiveHullCheck (ctx, node->children[side^1], midf, p2f, mid, p2);
 }
 
 
@@ -1411,32 +1664,32 @@ return;
 
 /*
 ==================
-CM_BoxTrace
+CM_BoxTraceCtx
 ==================
 */
-trace_t		CM_BoxTrace (const vec3_t start, const vec3_t end,
+trace_t		CM_BoxTraceCtx (cmtrace_t *ctx, const vec3_t start, const vec3_t end,
 						  const vec3_t mins, const vec3_t maxs,
 						  const int32_t headnode, const int32_t brushmask)
 {
 	int32_t		i;
 
-	checkcount++;		// for multi-check avoidance
+	ctx->checkcount++;		// for multi-check avoidance
 
 	c_traces++;			// for statistics, may be zeroed
 
 	// fill in a default trace
-	memset (&trace_trace, 0, sizeof(trace_trace));
-	trace_trace.fraction = 1;
-	trace_trace.surface = &(nullsurface.c);
+	memset (&ctx->trace, 0, sizeof(ctx->trace));
+	ctx->trace.fraction = 1;
+	ctx->trace.surface = &(nullsurface.c);
 
 	if (!numnodes)	// map not loaded
-		return trace_trace;
+		return ctx->trace;
 
-	trace_contents = brushmask;
-	VectorCopy (start, trace_start);
-	VectorCopy (end, trace_end);
-	VectorCopy (mins, trace_mins); //crashes here
-	VectorCopy (maxs, trace_maxs);
+	ctx->contents = brushmask;
+	VectorCopy (start, ctx->start);
+	VectorCopy (end, ctx->end);
+	VectorCopy (mins, ctx->mins);
+	VectorCopy (maxs, ctx->maxs);
 
 	//
 	// check for position test special case
@@ -1456,15 +1709,15 @@ trace_t		CM_BoxTrace (const vec3_t start, const vec3_t end,
 			c2[i] += 1;
 		}
 
-		numleafs = CM_BoxLeafnums_headnode (c1, c2, leafs, 1024, headnode, &topnode);
+		numleafs = CM_BoxLeafnums_ctx (ctx, c1, c2, leafs, 1024, headnode, &topnode);
 		for (i=0 ; i<numleafs ; i++)
 		{
-			CM_TestInLeaf (leafs[i]);
-			if (trace_trace.allsolid)
+			CM_TestInLeaf (ctx, leafs[i]);
+			if (ctx->trace.allsolid)
 				break;
 		}
-		VectorCopy (start, trace_trace.endpos);
-		return trace_trace;
+		VectorCopy (start, ctx->trace.endpos);
+		return ctx->trace;
 	}
 
 	//
@@ -1473,32 +1726,45 @@ trace_t		CM_BoxTrace (const vec3_t start, const vec3_t end,
 	if (mins[0] == 0 && mins[1] == 0 && mins[2] == 0
 		&& maxs[0] == 0 && maxs[1] == 0 && maxs[2] == 0)
 	{
-		trace_ispoint = true;
-		VectorClear (trace_extents);
+		ctx->ispoint = true;
+		VectorClear (ctx->extents);
 	}
 	else
 	{
-		trace_ispoint = false;
-		trace_extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
-		trace_extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
-		trace_extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+		ctx->ispoint = false;
+		ctx->extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
+		ctx->extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
+		ctx->extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
 	}
 
 	//
 	// general sweeping through world
 	//
-	CM_RecursiveHullCheck (headnode, 0, 1, start, end);
+	CM_RecursiveHullCheck (ctx, headnode, 0, 1, start, end);
 
-	if (trace_trace.fraction == 1)
+	if (ctx->trace.fraction == 1)
 	{
-		VectorCopy (end, trace_trace.endpos);
+		VectorCopy (end, ctx->trace.endpos);
 	}
 	else
 	{
 		for (i=0 ; i<3 ; i++)
-			trace_trace.endpos[i] = start[i] + trace_trace.fraction * (end[i] - start[i]);
+			ctx->trace.endpos[i] = start[i] + ctx->trace.fraction * (end[i] - start[i]);
 	}
-	return trace_trace;
+	return ctx->trace;
+}
+
+
+/*
+==================
+CM_BoxTrace
+==================
+*/
+trace_t		CM_BoxTrace (const vec3_t start, const vec3_t end,
+						  const vec3_t mins, const vec3_t maxs,
+						  const int32_t headnode, const int32_t brushmask)
+{
+	return CM_BoxTraceCtx (&cm_tracectx, start, end, mins, maxs, headnode, brushmask);
 }
 
 
@@ -1515,7 +1781,7 @@ rotating entities
 #endif
 
 
-trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
+trace_t		CM_TransformedBoxTraceCtx (cmtrace_t *ctx, vec3_t start, vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  int32_t headnode, int32_t brushmask,
 						  vec3_t origin, vec3_t angles)
@@ -1554,7 +1820,7 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 	}
 
 	// sweep the box through the model
-	trace = CM_BoxTrace (start_l, end_l, mins, maxs, headnode, brushmask);
+	trace = CM_BoxTraceCtx (ctx, start_l, end_l, mins, maxs, headnode, brushmask);
 
 	if (rotated && trace.fraction != 1.0)
 	{
@@ -1575,6 +1841,15 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 	return trace;
 }
 
+trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int32_t headnode, int32_t brushmask,
+						  vec3_t origin, vec3_t angles)
+{
+	return CM_TransformedBoxTraceCtx (&cm_tracectx, start, end, mins, maxs,
+		headnode, brushmask, origin, angles);
+}
+
 #ifdef _WIN32
 #pragma optimize( "", on )
 #endif
@@ -1639,22 +1914,206 @@ void CM_DecompressVis (byte *in, byte *out)
 byte	pvsrow[MAX_MAP_LEAFS/8];
 byte	phsrow[MAX_MAP_LEAFS/8];
 
+/*
+Decompressed rows are kept around so the server's per-client loops don't
+keep running the same clusters through the rle decoder.  When the whole
+PVS and PHS fit in CM_VIS_EXPAND_BYTES they are expanded once at load,
+otherwise the most recently used rows of each are kept in a small cache.
+*/
+#define	CM_VIS_EXPAND_BYTES	(16*1024*1024)
+#define	CM_VIS_CACHE_ROWS	128
+
+typedef struct
+{
+	byte		*rows;						// CM_VIS_CACHE_ROWS rows
+	int32_t		cluster[CM_VIS_CACHE_ROWS];	// -1 if the row is empty
+	int32_t		used[CM_VIS_CACHE_ROWS];
+	int16_t		slot[MAX_MAP_LEAFS];		// row holding each cluster, or -1
+	int32_t		stamp;
+} visrowcache_t;
+
+static int32_t			visrowbytes;
+static byte				*visexpanded[2];	// DVIS_PVS / DVIS_PHS, numclusters rows each
+static visrowcache_t	visrowcache[2];
+
+/*
+===================
+CM_FreeVisCache
+===================
+*/
+static void CM_FreeVisCache (void)
+{
+	int32_t		i;
+
+	for (i=0 ; i<2 ; i++)
+	{
+		if (visexpanded[i])
+			Z_Free (visexpanded[i]);
+		visexpanded[i] = NULL;
+		if (visrowcache[i].rows)
+			Z_Free (visrowcache[i].rows);
+		visrowcache[i].rows = NULL;
+	}
+	visrowbytes = 0;
+}
+
+/*
+===================
+CM_BuildVisCache
+===================
+*/
+static void CM_BuildVisCache (void)
+{
+	int32_t		i, j;
+	visrowcache_t	*cache;
+
+	CM_FreeVisCache ();
+
+	if (!numvisibility)
+		return;		// everything is visible, nothing to decode
+
+	visrowbytes = (numclusters+7)>>3;
+
+	if (2 * numclusters * visrowbytes <= CM_VIS_EXPAND_BYTES)
+	{
+		for (i=0 ; i<2 ; i++)
+		{
+			// padded so callers can read whole longs off the last row
+			visexpanded[i] = Z_Malloc (numclusters * visrowbytes + 4);
+			memset (visexpanded[i] + numclusters * visrowbytes, 0, 4);
+			for (j=0 ; j<numclusters ; j++)
+				CM_DecompressVis ((byte *)map_vis + map_vis->bitofs[j][i], visexpanded[i] + j*visrowbytes);
+		}
+		return;
+	}
+
+	for (i=0 ; i<2 ; i++)
+	{
+		cache = &visrowcache[i];
+		cache->rows = Z_Malloc (CM_VIS_CACHE_ROWS * visrowbytes + 4);
+		for (j=0 ; j<CM_VIS_CACHE_ROWS ; j++)
+		{
+			cache->cluster[j] = -1;
+			cache->used[j] = 0;
+		}
+		memset (cache->slot, 0xff, sizeof(cache->slot));
+		cache->stamp = 0;
+	}
+}
+
+/*
+===================
+CM_CachedVisRow
+
+Main thread only, the rows returned from the lru can be
+replaced by the next lookup
+===================
+*/
+static byte *CM_CachedVisRow (int32_t cluster, int32_t type, byte *fallback)
+{
+	visrowcache_t	*cache;
+	int32_t			i, best;
+
+	if (visexpanded[type])
+		return visexpanded[type] + cluster*visrowbytes;
+
+	cache = &visrowcache[type];
+	if (!cache->rows)
+	{
+		CM_DecompressVis ((byte *)map_vis + map_vis->bitofs[cluster][type], fallback);
+		return fallback;
+	}
+
+	i = cache->slot[cluster];
+	if (i == -1)
+	{	// evict the least recently used row
+		best = 0;
+		for (i=1 ; i<CM_VIS_CACHE_ROWS ; i++)
+			if (cache->used[i] < cache->used[best])
+				best = i;
+		i = best;
+
+		if (cache->cluster[i] != -1)
+			cache->slot[cache->cluster[i]] = -1;
+		cache->cluster[i] = cluster;
+		cache->slot[cluster] = i;
+		CM_DecompressVis ((byte *)map_vis + map_vis->bitofs[cluster][type], cache->rows + i*visrowbytes);
+	}
+
+	cache->used[i] = ++cache->stamp;
+	return cache->rows + i*visrowbytes;
+}
+
+/*
+===================
+CM_ClusterPVSInto
+
+Returns a cluster's PVS or PHS, decompressing it into a caller
+supplied buffer unless the map's rows were expanded at load.
+Callers must use the returned pointer and not write through it.
+Safe to call from several threads at once.
+===================
+*/
+byte	*CM_ClusterPVSInto (int32_t cluster, byte *buffer)
+{
+	if (cluster == -1)
+		memset (buffer, 0, (numclusters+7)>>3);
+	else if (visexpanded[DVIS_PVS])
+		return visexpanded[DVIS_PVS] + cluster*visrowbytes;
+	else
+		CM_DecompressVis ((byte *)map_vis + map_vis->bitofs[cluster][DVIS_PVS], buffer);
+	return buffer;
+}
+
+byte	*CM_ClusterPHSInto (int32_t cluster, byte *buffer)
+{
+	if (cluster == -1)
+		memset (buffer, 0, (numclusters+7)>>3);
+	else if (visexpanded[DVIS_PHS])
+		return visexpanded[DVIS_PHS] + cluster*visrowbytes;
+	else
+		CM_DecompressVis ((byte *)map_vis + map_vis->bitofs[cluster][DVIS_PHS], buffer);
+	return buffer;
+}
+
 byte	*CM_ClusterPVS (int32_t cluster)
 {
 	if (cluster == -1)
+	{
 		memset (pvsrow, 0, (numclusters+7)>>3);
-	else
-		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PVS], pvsrow);
-	return pvsrow;
+		return pvsrow;
+	}
+	return CM_CachedVisRow (cluster, DVIS_PVS, pvsrow);
 }
 
 byte	*CM_ClusterPHS (int32_t cluster)
 {
 	if (cluster == -1)
+	{
 		memset (phsrow, 0, (numclusters+7)>>3);
-	else
-		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PHS], phsrow);
-	return phsrow;
+		return phsrow;
+	}
+	return CM_CachedVisRow (cluster, DVIS_PHS, phsrow);
+}
+
+/*
+===================
+CM_SharedClusterPVS
+
+Lets the renderer use these rows instead of decoding its own copy
+of the same visibility.  Returns NULL unless mapname is the loaded
+map and has the expected cluster count.  Same lifetime rules as
+CM_ClusterPVS.
+===================
+*/
+byte	*CM_SharedClusterPVS (const char *mapname, int32_t cluster, int32_t clusters)
+{
+	if (!visrowbytes || clusters != numclusters || cluster < 0 || cluster >= numclusters)
+		return NULL;
+	if (strcmp (map_name, mapname))
+		return NULL;
+
+	return CM_CachedVisRow (cluster, DVIS_PVS, pvsrow);
 }
 
 
@@ -20,8 +20,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // common.c -- misc functions used in client and server
 #include "qcommon.h"
 #include <setjmp.h>
-
-#include "../backends/sdl2/sdl2quake.h"
+#ifdef _WIN32
+#include <windows.h>	// OutputDebugString
+#endif
 
 #define	MAXPRINTMSG	8192 // was 4096, fix for nVidia 191.xx crash
 
@@ -75,14 +76,14 @@ static char	*rd_buffer;
 static int32_t	rd_buffersize;
 static void	(*rd_flush)(int32_t target, char *buffer);
 
-void Com_BeginRedirect (int32_t target, char *buffer, int32_t buffersize, void (*flush))
+void Com_BeginRedirect (int32_t target, char *buffer, int32_t buffersize, void (*flush)(int32_t target, char *buffer))
 {
 	if (!target || !buffer || !buffersize || !flush)
 		return;
 	rd_target = target;
 	rd_buffer = buffer;
 	rd_buffersize = buffersize;
-	rd_flush = (void(__cdecl *)(int32_t, char *))flush;
+	rd_flush = flush;
 
 	*rd_buffer = 0;
 }
@@ -217,6 +218,7 @@ void Com_Error (int32_t code, char *fmt, ...)
 		Com_Printf (S_COLOR_RED"********************\n"
 					S_COLOR_RED"ERROR: %s\n"
 					S_COLOR_RED"********************\n", msg);
+		CL_BenchAbort (msg);
 		SV_Shutdown (va("Server crashed: %s\n", msg), false);
 		CL_Drop ();
 		recursive = false;
@@ -1133,7 +1135,8 @@ void *SZ_GetSpace (sizebuf_t *buf, int32_t length)
 		if (length > buf->maxsize)
 			Com_Error (ERR_FATAL, "SZ_GetSpace: %i is > full buffer size", length);
 			
-		Com_Printf ("SZ_GetSpace: overflow\n");
+		if (!buf->quiet)
+			Com_Printf ("SZ_GetSpace: overflow\n");
 		SZ_Clear (buf); 
 		buf->overflowed = true;
 	}
@@ -1315,12 +1318,31 @@ void Info_Print (char *s)
 
 						ZONE MEMORY ALLOCATION
 
-just cleared malloc with counters now...
+Blocks up to ZONE_SLAB_MAX bytes, header included, are carved from
+size class pages and recycled through per-class free lists instead
+of going back to malloc.  Level lifetime tags get their own arenas:
+small blocks are bumped out of large chunks, and a whole level is
+dropped in one go by Z_FreeTags.  A small block freed before that
+only goes on the arena's free list for reuse.  Larger blocks are
+plain callocs, and every block other than an arena one is linked in
+its tag chain so Z_FreeTags can find it.
+
+All zone memory comes back zero filled.
 
 ==============================================================================
 */
 
 #define	Z_MAGIC		0x1d1d
+#define	Z_FREEMAGIC	0x1dfe		// on a pooled block sitting in a free list
+
+#define	ZONE_NUM_CLASSES	12
+#define	ZONE_SLAB_MAX		1024
+#define	ZONE_SLAB_PAGE		0x10000
+#define	ZONE_ARENA_CHUNK	0x100000
+
+static const int32_t	z_classSizes[ZONE_NUM_CLASSES] = {
+	32, 48, 64, 96, 128, 192, 256, 384, 512, 640, 768, 1024
+};
 
 
 typedef struct
@@ -1349,22 +1371,73 @@ typedef struct zhead_s
 	struct zhead_s	*prev, *next;
 	int16_t	magic;
 	int16_t	tag;			// for group free
-	int32_t	size;
+	int32_t	size;			// footprint, header included
 } zhead_t;
 
+typedef struct zchunk_s
+{
+	struct zchunk_s	*next;
+	int32_t	size;
+	int32_t	used;
+} zchunk_t;
+
+typedef struct
+{
+	zchunk_t	*chunks;
+	zhead_t		*free[ZONE_NUM_CLASSES];
+	int64_t		reserved;		// chunk bytes taken from the system
+	int64_t		peakReserved;
+} zarena_t;
+
+typedef struct
+{
+	zhead_t		*free;
+	int32_t		pages;
+	int32_t		freeCount;
+} zslab_t;
+
 typedef struct ztag_s {
     zhead_t chain;
     struct ztag_s *next;
     char *name;
     int64_t bytes;
+    int64_t peak;				// high-water mark of bytes
     int32_t count;
     int16_t tag;
+    zarena_t *arena;			// NULL unless the tag is level lifetime
 } ztag_t;
 
 #define ZONE_HASHMAP_WIDTH 0x10
 #define ZONE_HASHMAP_MASK 0x0F
 
 static ztag_t *z_tagchain[ZONE_HASHMAP_WIDTH];
+static zslab_t z_slabs[ZONE_NUM_CLASSES];
+
+/*
+========================
+Z_SizeClass
+
+Returns the smallest class holding size bytes
+========================
+*/
+static int32_t Z_SizeClass (int32_t size)
+{
+	int32_t	i;
+
+	for (i = 0; z_classSizes[i] < size; i++)
+		;
+	return i;
+}
+
+/*
+========================
+Z_IsArenaTag
+========================
+*/
+static qboolean Z_IsArenaTag (int16_t tag)
+{
+	return tag == (int16_t)TAG_LEVEL || tag == (int16_t)TAG_LEVEL_LEGACY;
+}
 
 ztag_t *Z_GetTagChain (int16_t tag) {
     int index = tag&ZONE_HASHMAP_MASK;
@@ -1394,6 +1467,9 @@ ztag_t *Z_GetTagChain (int16_t tag) {
     
     z->name = zonenames[i].name;
 
+    if (Z_IsArenaTag(tag))
+        z->arena = (zarena_t*)calloc(1, sizeof(zarena_t));
+
     if (prev) {
         z->next = prev->next;
         prev->next = z;
@@ -1405,6 +1481,189 @@ ztag_t *Z_GetTagChain (int16_t tag) {
     return z;
 }
 
+/*
+========================
+Z_FindTagChain
+========================
+*/
+static ztag_t *Z_FindTagChain (int16_t tag)
+{
+    ztag_t *chain = z_tagchain[tag&ZONE_HASHMAP_MASK];
+
+    // fast local search for the chain
+    while (chain && chain->tag != tag) {
+        chain = chain->next;
+    }
+    
+    if (!chain)
+        chain = Z_GetTagChain(tag);
+    return chain;
+}
+
+/*
+========================
+Z_SlabAlloc
+========================
+*/
+static zhead_t *Z_SlabAlloc (int32_t size)
+{
+	zslab_t	*slab;
+	zhead_t	*z;
+	byte	*page;
+	int32_t	i, classSize, count;
+
+	i = Z_SizeClass(size);
+	slab = &z_slabs[i];
+	classSize = z_classSizes[i];
+
+	if (!slab->free)
+	{
+		page = (byte*)malloc(ZONE_SLAB_PAGE);
+		if (!page)
+			Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", ZONE_SLAB_PAGE);
+
+		count = ZONE_SLAB_PAGE / classSize;
+		for (i = 0; i < count; i++)
+		{
+			z = (zhead_t *)(page + i * classSize);
+			z->magic = Z_FREEMAGIC;
+			z->next = slab->free;
+			slab->free = z;
+		}
+		slab->pages++;
+		slab->freeCount += count;
+	}
+
+	z = slab->free;
+	slab->free = z->next;
+	slab->freeCount--;
+
+	memset (z, 0, classSize);
+	z->size = classSize;
+	return z;
+}
+
+/*
+========================
+Z_SlabFree
+========================
+*/
+static void Z_SlabFree (zhead_t *z)
+{
+	zslab_t	*slab = &z_slabs[Z_SizeClass(z->size)];
+
+	z->magic = Z_FREEMAGIC;
+	z->next = slab->free;
+	slab->free = z;
+	slab->freeCount++;
+}
+
+/*
+========================
+Z_ArenaAlloc
+
+Reuses a freed block of the same class, or bumps a new one off the
+current chunk
+========================
+*/
+static zhead_t *Z_ArenaAlloc (zarena_t *arena, int32_t size)
+{
+	zchunk_t	*chunk;
+	zhead_t		*z;
+	int32_t		i, classSize;
+
+	i = Z_SizeClass(size);
+	classSize = z_classSizes[i];
+
+	if (arena->free[i])
+	{
+		z = arena->free[i];
+		arena->free[i] = z->next;
+	}
+	else
+	{
+		chunk = arena->chunks;
+		if (!chunk || chunk->used + classSize > chunk->size)
+		{
+			chunk = (zchunk_t*)malloc(sizeof(zchunk_t) + ZONE_ARENA_CHUNK);
+			if (!chunk)
+				Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", ZONE_ARENA_CHUNK);
+			chunk->size = ZONE_ARENA_CHUNK;
+			chunk->used = 0;
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+			arena->reserved += ZONE_ARENA_CHUNK;
+			if (arena->reserved > arena->peakReserved)
+				arena->peakReserved = arena->reserved;
+		}
+		z = (zhead_t *)((byte *)(chunk + 1) + chunk->used);
+		chunk->used += classSize;
+	}
+
+	memset (z, 0, classSize);
+	z->size = classSize;
+	return z;
+}
+
+/*
+========================
+Z_ArenaFree
+========================
+*/
+static void Z_ArenaFree (zarena_t *arena, zhead_t *z)
+{
+	int32_t	i = Z_SizeClass(z->size);
+
+	z->magic = Z_FREEMAGIC;
+	z->next = arena->free[i];
+	arena->free[i] = z;
+}
+
+/*
+========================
+Z_ArenaReset
+
+Hands every chunk back in one go
+========================
+*/
+static void Z_ArenaReset (zarena_t *arena)
+{
+	zchunk_t	*chunk, *next;
+
+	for (chunk = arena->chunks; chunk; chunk = next)
+	{
+		next = chunk->next;
+		free (chunk);
+	}
+	arena->chunks = NULL;
+	arena->reserved = 0;
+	memset (arena->free, 0, sizeof(arena->free));
+}
+
+/*
+========================
+Z_Release
+
+Returns a block that is already off the books to where it came from
+========================
+*/
+static void Z_Release (ztag_t *chain, zhead_t *z)
+{
+	if (z->size <= ZONE_SLAB_MAX && chain->arena)
+	{
+		Z_ArenaFree(chain->arena, z);
+		return;
+	}
+
+	z->prev->next = z->next;
+	z->next->prev = z->prev;
+
+	if (z->size <= ZONE_SLAB_MAX)
+		Z_SlabFree(z);
+	else
+		free (z);
+}
+
 /*
 ========================
 Z_Free
@@ -1419,20 +1678,10 @@ void Z_Free (void *ptr)
 	if (z->magic != Z_MAGIC)
 		Com_Error (ERR_FATAL, "Z_Free: bad magic");
 
-    tag = z_tagchain[z->tag&ZONE_HASHMAP_MASK];
-	z->prev->next = z->next;
-	z->next->prev = z->prev;
-
-    while (tag != NULL && tag->tag != z->tag)
-    {
-        tag = tag->next;
-    }
-
-    // if we've gotten here and tag is NULL (e.g., it couldn't find the proper tag chain)
-    // we are so past fucked up that it's not even worth checking for errors
+    tag = Z_FindTagChain(z->tag);
     tag->count--;
     tag->bytes -= z->size;
-    free (z);
+    Z_Release(tag, z);
 }
 
 /*
@@ -1443,15 +1692,37 @@ Z_Stats_f
 void Z_Stats_f (void)
 {
     ztag_t *z;
+    zslab_t *slab;
+    int64_t total, peak, slabBytes, slabFree;
     int i;
+
+    total = peak = 0;
     for (i = 0; i < ZONE_HASHMAP_WIDTH; i++) {
         for (z = z_tagchain[i]; z != NULL; z = z->next) {
             if (z->name)
-                Com_Printf ("C%02u: %8i bytes %4i blocks - %s\n", i, z->bytes, z->count, z->name);
+                Com_Printf ("C%02u: %8i bytes %4i blocks %8i peak - %s\n", i, (int32_t)z->bytes, z->count, (int32_t)z->peak, z->name);
             else
-                Com_Printf ("C%02u: %8i bytes %4i blocks - Tag %i\n", i, z->bytes, z->count, z->tag);
+                Com_Printf ("C%02u: %8i bytes %4i blocks %8i peak - Tag %i\n", i, (int32_t)z->bytes, z->count, (int32_t)z->peak, z->tag);
+            if (z->arena && z->arena->peakReserved)
+                Com_Printf ("     arena %8i reserved %8i peak\n", (int32_t)z->arena->reserved, (int32_t)z->arena->peakReserved);
+            total += z->bytes;
+            peak += z->peak;
         }
     }
+
+    slabBytes = slabFree = 0;
+    for (i = 0; i < ZONE_NUM_CLASSES; i++) {
+        slab = &z_slabs[i];
+        if (!slab->pages)
+            continue;
+        Com_Printf ("slab %4i: %3i pages %6i free blocks\n", z_classSizes[i], slab->pages, slab->freeCount);
+        slabBytes += (int64_t)slab->pages * ZONE_SLAB_PAGE;
+        slabFree += (int64_t)slab->freeCount * z_classSizes[i];
+    }
+
+    Com_Printf ("%i bytes in use, %i peak sum\n", (int32_t)total, (int32_t)peak);
+    if (slabBytes)
+        Com_Printf ("%i bytes in slabs, %i%% free\n", (int32_t)slabBytes, (int32_t)(slabFree * 100 / slabBytes));
 }
 
 /*
@@ -1464,6 +1735,7 @@ void Z_FreeTags (int16_t tag)
 	zhead_t	*z, *next;
     ztag_t *chain = Z_GetTagChain(tag);
     
+    // arena blocks aren't linked, the chain only holds large blocks
     for (z=chain->chain.next ; z != &(chain->chain) ; z=next)
     {
         next = z->next;
@@ -1471,11 +1743,16 @@ void Z_FreeTags (int16_t tag)
         if (z->magic != Z_MAGIC)
             Com_Error (ERR_FATAL, "Z_Free: bad magic");
         
-        z->prev->next = z->next;
-        z->next->prev = z->prev;
         chain->bytes -= z->size;
         chain->count--;
-        free (z);
+        Z_Release(chain, z);
+    }
+
+    if (chain->arena)
+    {
+        Z_ArenaReset(chain->arena);
+        chain->bytes = 0;
+        chain->count = 0;
     }
 }
 
@@ -1487,27 +1764,33 @@ Z_TagMalloc
 void *Z_TagMalloc (int32_t size, int16_t tag)
 {
 	zhead_t	*z;
-    ztag_t *chain = z_tagchain[tag&ZONE_HASHMAP_MASK];
-
-    // fast local search for the chain
-    while (chain && chain->tag != tag) {
-        chain = chain->next;
-    }
-    
-    if (!chain)
-        chain = Z_GetTagChain(tag);
+    ztag_t *chain = Z_FindTagChain(tag);
     
 	size = size + sizeof(zhead_t);
-	z = (zhead_t*)calloc(1, size);
-	if (!z)
-		Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes",size);
+	if (size <= ZONE_SLAB_MAX)
+	{
+		if (chain->arena)
+			z = Z_ArenaAlloc(chain->arena, size);
+		else
+			z = Z_SlabAlloc(size);
+	}
+	else
+	{
+		z = (zhead_t*)calloc(1, size);
+		if (!z)
+			Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes",size);
+		z->size = size;
+	}
 
-//	memset (z, 0, size);
 	chain->count++;
-	chain->bytes += size;
+	chain->bytes += z->size;
+	if (chain->bytes > chain->peak)
+		chain->peak = chain->bytes;
 	z->magic = Z_MAGIC;
 	z->tag = tag;
-	z->size = size;
+
+	if (z->size <= ZONE_SLAB_MAX && chain->arena)
+		return (void *)(z+1);
 
 	z->next = chain->chain.next;
 	z->prev = &(chain->chain);
@@ -1520,7 +1803,8 @@ void *Z_TagMalloc (int32_t size, int16_t tag)
 void *Z_Realloc(void* ptr, int32_t size) {
     zhead_t	*z = ((zhead_t *)ptr) - 1;
     zhead_t *newZ, *prev, *next;
-    ztag_t *chain = z_tagchain[z->tag&ZONE_HASHMAP_MASK];
+    ztag_t *chain;
+    void *newPtr;
     int64_t sizeDiff;
     int32_t newSize;
     int32_t oldSize;
@@ -1528,19 +1812,27 @@ void *Z_Realloc(void* ptr, int32_t size) {
     if (!ptr)
         return Z_Malloc(size);
     
-    prev = z->prev;
-    next = z->next;
+    if (z->magic != Z_MAGIC)
+        Com_Error (ERR_FATAL, "Z_Realloc: bad magic");
+
     oldSize = z->size;
-    // fast local search for the chain
-    while (chain && chain->tag != z->tag) {
-        chain = chain->next;
-    }
+    newSize = size + sizeof(zhead_t);
 
-    if (!chain)
-        chain = Z_GetTagChain(z->tag);
-    
+    // pooled blocks have room up to their class size
+    if (oldSize <= ZONE_SLAB_MAX && newSize <= oldSize)
+        return ptr;
 
-    newSize = size + sizeof(zhead_t);
+    if (oldSize <= ZONE_SLAB_MAX || newSize <= ZONE_SLAB_MAX)
+    {
+        newPtr = Z_TagMalloc(size, z->tag);
+        memcpy(newPtr, ptr, min(oldSize, newSize) - sizeof(zhead_t));
+        Z_Free(ptr);
+        return newPtr;
+    }
+
+    prev = z->prev;
+    next = z->next;
+    chain = Z_FindTagChain(z->tag);
     sizeDiff = newSize - oldSize;
     
     newZ = (zhead_t*)realloc(z, newSize);
@@ -1550,6 +1842,8 @@ void *Z_Realloc(void* ptr, int32_t size) {
         prev->next = newZ;
         next->prev = newZ;
         chain->bytes += sizeDiff;
+        if (chain->bytes > chain->peak)
+            chain->peak = chain->bytes;
         return (void *)(newZ+1);
     }
     return NULL;
@@ -1849,6 +2143,7 @@ void Qcommon_Init (int32_t argc, char **argv)
 	// init commands and vars
 	//
     Cmd_AddCommand ("meminfo", Z_Stats_f);
+    Cmd_AddCommand ("bitbench", Bits_Bench_f);
     Cmd_AddCommand ("error", Com_Error_f);
 
 	host_speeds = Cvar_Get ("host_speeds", "0", 0);
@@ -1880,6 +2175,8 @@ void Qcommon_Init (int32_t argc, char **argv)
 		Cmd_AddCommand ("quit", Com_Quit);
 
 	Sys_Init ();
+	Job_Init ();
+	Prof_Init ();
     
 	NET_Init ();
 	Netchan_Init ();
@@ -1916,7 +2213,10 @@ void Qcommon_Frame (int32_t msec)
 	int32_t		time_before, time_between, time_after;
 
 	if (setjmp (abortframe) )
+	{
+		Prof_EndAll ();
 		return;			// an ERR_DROP was thrown
+	}
 
 	if ( log_stats->modified )
 	{
@@ -1955,11 +2255,15 @@ void Qcommon_Frame (int32_t msec)
 	{
 		extern	int32_t c_traces, c_brush_traces;
 		extern	int32_t	c_pointcontents;
+		extern	int32_t	c_areaqueries, c_areacandidates;
 
-		Com_Printf ("%4i traces  %4i points\n", c_traces, c_pointcontents);
+		Com_Printf ("%4i traces  %4i points  %4i areas  %4i candidates\n",
+			c_traces, c_pointcontents, c_areaqueries, c_areacandidates);
 		c_traces = 0;
 		c_brush_traces = 0;
 		c_pointcontents = 0;
+		c_areaqueries = 0;
+		c_areacandidates = 0;
 	}
 
 	do
@@ -1971,15 +2275,21 @@ void Qcommon_Frame (int32_t msec)
 
 	Cbuf_Execute ();
 
+	Prof_Begin ("Qcommon_Frame");
+
 	if (host_speeds->value)
 		time_before = Sys_Milliseconds ();
 
+	Prof_Begin ("SV_Frame");
 	SV_Frame (msec);
+	Prof_End ();
 
 	if (host_speeds->value)
 		time_between = Sys_Milliseconds ();		
 
+	Prof_Begin ("CL_Frame");
 	CL_Frame (msec);
+	Prof_End ();
 
 	if (host_speeds->value)
 		time_after = Sys_Milliseconds ();		
@@ -1999,6 +2309,8 @@ void Qcommon_Frame (int32_t msec)
 		Com_Printf ("all:%3i sv:%3i gm:%3i cl:%3i rf:%3i\n",
 			all, sv, gm, cl, rf);
 	}	
+
+	Prof_End ();
 }
 
 /*
@@ -2008,7 +2320,9 @@ Qcommon_Shutdown
 */
 void Qcommon_Shutdown (void)
 {	
+	Job_Shutdown();
 	FS_Shutdown();
+	Prof_Shutdown();
 }
 
 
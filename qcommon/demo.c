@@ -0,0 +1,321 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// demo.c -- keyframe index for seekable demos
+//
+// File layout after the -1 that ends the message stream:
+//
+//	demokeyframe_t	keyframes[numkeyframes]
+//	byte			log[logsize]		// { long time; short index; string }
+//	long			numkeyframes
+//	long			logsize
+//	long			DEMO_INDEX_VERSION
+//	long			DEMO_INDEX_ID
+//
+// Everything is little endian.  Times are msec from the first keyframe,
+// the start value of a configstring is logged with a time of -1 the
+// first time it changes, so replaying the log up to a keyframe gives
+// every string that differs from the demo header at that point.
+
+#include "qcommon.h"
+
+#define	DEMO_INDEX_VERSION	1
+
+/*
+=================
+Demo_BeginIndex
+=================
+*/
+void Demo_BeginIndex (demoindex_t *index)
+{
+	memset (index, 0, sizeof(*index));
+}
+
+/*
+=================
+Demo_FreeIndex
+=================
+*/
+void Demo_FreeIndex (demoindex_t *index)
+{
+	if (index->keyframes)
+		Z_Free (index->keyframes);
+	if (index->log)
+		Z_Free (index->log);
+	memset (index, 0, sizeof(*index));
+}
+
+/*
+=================
+Demo_CloseIndex
+
+Times start over with a new level, so nothing after this is indexed
+=================
+*/
+void Demo_CloseIndex (demoindex_t *index)
+{
+	index->closed = true;
+}
+
+/*
+=================
+Demo_AddKeyframe
+
+Time is absolute, the first keyframe sets the base
+=================
+*/
+void Demo_AddKeyframe (demoindex_t *index, int32_t time, int32_t offset)
+{
+	demokeyframe_t	*key;
+
+	if (index->closed)
+		return;
+	if (!index->numkeyframes)
+		index->basetime = time;
+
+	if (index->numkeyframes == index->maxkeyframes)
+	{
+		index->maxkeyframes = index->maxkeyframes ? index->maxkeyframes*2 : 64;
+		index->keyframes = Z_Realloc (index->keyframes, sizeof(demokeyframe_t)*index->maxkeyframes);
+	}
+
+	key = &index->keyframes[index->numkeyframes++];
+	key->time = time - index->basetime;
+	key->offset = offset;
+}
+
+/*
+=================
+Demo_AppendLog
+=================
+*/
+static void Demo_AppendLog (demoindex_t *index, int32_t time, int32_t num, const char *value)
+{
+	int32_t		len;
+	byte		*p;
+
+	len = (int32_t)strlen(value) + 1;
+	if (index->logsize + 6 + len > index->maxlogsize)
+	{
+		index->maxlogsize = max(index->maxlogsize*2, index->logsize + 6 + len + 4096);
+		index->log = Z_Realloc (index->log, index->maxlogsize);
+	}
+
+	p = index->log + index->logsize;
+	p[0] = time & 255;
+	p[1] = (time>>8) & 255;
+	p[2] = (time>>16) & 255;
+	p[3] = (time>>24) & 255;
+	p[4] = num & 255;
+	p[5] = (num>>8) & 255;
+	memcpy (p+6, value, len);
+	index->logsize += 6 + len;
+}
+
+/*
+=================
+Demo_LogConfigstring
+
+Records a configstring change at an absolute time.  Changes before
+the first keyframe are already in the stream the seek resumes from.
+=================
+*/
+void Demo_LogConfigstring (demoindex_t *index, int32_t time, int32_t num, const char *oldvalue, const char *newvalue)
+{
+	if (index->closed || !index->numkeyframes || num < 0 || num >= MAX_CONFIGSTRINGS)
+		return;
+	if (!strcmp(oldvalue, newvalue))
+		return;
+
+	if (!(index->logged[num>>3] & (1<<(num&7))))
+	{
+		index->logged[num>>3] |= 1<<(num&7);
+		Demo_AppendLog (index, -1, num, oldvalue);
+	}
+	Demo_AppendLog (index, time - index->basetime, num, newvalue);
+}
+
+/*
+=================
+Demo_WriteIndex
+
+Called right after the -1 that ends the stream.  Frees the index.
+=================
+*/
+void Demo_WriteIndex (demoindex_t *index, FILE *f)
+{
+	int32_t		i;
+	int32_t		trailer[DEMO_TRAILER_SIZE/4];
+	demokeyframe_t	key;
+
+	for (i=0 ; i<index->numkeyframes ; i++)
+	{
+		key.time = LittleLong (index->keyframes[i].time);
+		key.offset = LittleLong (index->keyframes[i].offset);
+		fwrite (&key, sizeof(key), 1, f);
+	}
+	if (index->logsize)
+		fwrite (index->log, index->logsize, 1, f);
+
+	trailer[0] = LittleLong (index->numkeyframes);
+	trailer[1] = LittleLong (index->logsize);
+	trailer[2] = LittleLong (DEMO_INDEX_VERSION);
+	trailer[3] = LittleLong (DEMO_INDEX_ID);
+	fwrite (trailer, sizeof(trailer), 1, f);
+
+	Demo_FreeIndex (index);
+}
+
+/*
+=================
+Demo_ReadIndex
+
+Loads the index of an opened demo of the given length and rewinds it.
+Returns false for demos that were recorded without one.
+=================
+*/
+qboolean Demo_ReadIndex (demoindex_t *index, fileHandle_t f, int32_t length)
+{
+	int32_t		i;
+	int32_t		trailer[DEMO_TRAILER_SIZE/4];
+	int32_t		start;
+
+	Demo_BeginIndex (index);
+	if (length < DEMO_TRAILER_SIZE)
+		return false;
+
+	FS_Seek (f, length - DEMO_TRAILER_SIZE, FS_SEEK_SET);
+	if (FS_Read (trailer, sizeof(trailer), f) != sizeof(trailer))
+		goto fail;
+	for (i=0 ; i<DEMO_TRAILER_SIZE/4 ; i++)
+		trailer[i] = LittleLong (trailer[i]);
+	if (trailer[3] != DEMO_INDEX_ID || trailer[2] != DEMO_INDEX_VERSION)
+		goto fail;
+
+	index->numkeyframes = trailer[0];
+	index->logsize = trailer[1];
+	if (index->numkeyframes <= 0 || index->logsize < 0
+		|| index->numkeyframes > length / (int32_t)sizeof(demokeyframe_t))
+		goto fail;
+	start = length - DEMO_TRAILER_SIZE - index->logsize - index->numkeyframes*(int32_t)sizeof(demokeyframe_t);
+	if (start < 0)
+		goto fail;
+
+	index->maxkeyframes = index->numkeyframes;
+	index->keyframes = Z_Malloc (sizeof(demokeyframe_t)*index->numkeyframes);
+	FS_Seek (f, start, FS_SEEK_SET);
+	if (FS_Read (index->keyframes, sizeof(demokeyframe_t)*index->numkeyframes, f) != sizeof(demokeyframe_t)*index->numkeyframes)
+		goto fail;
+	for (i=0 ; i<index->numkeyframes ; i++)
+	{
+		index->keyframes[i].time = LittleLong (index->keyframes[i].time);
+		index->keyframes[i].offset = LittleLong (index->keyframes[i].offset);
+		if (index->keyframes[i].offset < 0 || index->keyframes[i].offset >= start)
+			goto fail;
+	}
+
+	if (index->logsize)
+	{
+		index->maxlogsize = index->logsize;
+		index->log = Z_Malloc (index->logsize);
+		if (FS_Read (index->log, index->logsize, f) != index->logsize)
+			goto fail;
+	}
+
+	FS_Seek (f, 0, FS_SEEK_SET);
+	return true;
+
+fail:
+	Demo_FreeIndex (index);
+	FS_Seek (f, 0, FS_SEEK_SET);
+	return false;
+}
+
+/*
+=================
+Demo_FindKeyframe
+
+Returns the last keyframe at or before time, or -1 without an index
+=================
+*/
+int32_t Demo_FindKeyframe (demoindex_t *index, int32_t time)
+{
+	int32_t		low, high, mid;
+
+	if (!index->numkeyframes)
+		return -1;
+
+	low = 0;
+	high = index->numkeyframes - 1;
+	while (low < high)
+	{
+		mid = (low + high + 1) / 2;
+		if (index->keyframes[mid].time <= time)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+	return low;
+}
+
+/*
+=================
+Demo_WriteConfigstrings
+
+Writes svc_configstrings for every logged string as it was at time,
+stopping short if msg fills up
+=================
+*/
+void Demo_WriteConfigstrings (demoindex_t *index, int32_t time, sizebuf_t *msg)
+{
+	static const char	*values[MAX_CONFIGSTRINGS];
+	byte		*p, *end;
+	int32_t		t, num, len;
+
+	memset ((void *)values, 0, sizeof(values));
+
+	p = index->log;
+	end = index->log + index->logsize;
+	while (p && end - p > 6)
+	{
+		t = p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32_t)p[3]<<24);
+		num = p[4] | (p[5]<<8);
+		len = (int32_t)strnlen ((char *)p+6, end - p - 6);
+		if (p + 6 + len >= end || num >= MAX_CONFIGSTRINGS)
+			break;		// truncated
+		if (t <= time)
+			values[num] = (const char *)p+6;
+		p += 6 + len + 1;
+	}
+
+	for (num=0 ; num<MAX_CONFIGSTRINGS ; num++)
+	{
+		if (!values[num])
+			continue;
+		len = (int32_t)strlen(values[num]);
+		if (msg->cursize + len + 4 > msg->maxsize)
+		{
+			Com_Printf ("Demo_WriteConfigstrings: too many changes, some strings were skipped\n");
+			break;
+		}
+		MSG_WriteByte (msg, svc_configstring);
+		MSG_WriteShort (msg, num);
+		MSG_WriteString (msg, values[num]);
+	}
+}
@@ -19,7 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon.h"
-#include "zip/unzip.h"
+#include "zip/zlib.h"
 #include <sys/stat.h>
 
 #ifndef _WIN32
@@ -76,11 +76,13 @@ instruct clients to write files over areas they shouldn't.
 // Berserk's pk3 file support
 //
 
+typedef struct fsPackReader_s fsPackReader_t;
+
 typedef struct {
 	char			name[MAX_QPATH];
 	fsMode_t		mode;
 	FILE			*file;				// Only one of file or
-	unzFile			*zip;				// zip will be used
+	fsPackReader_t	*reader;			// reader will be used
 } fsHandle_t;
 
 typedef struct fsLink_s {
@@ -94,20 +96,79 @@ typedef struct {
     const char      *name;
 	int32_t         hash;				// To speed up searching
 	int32_t			size;
-	int32_t			offset;				// This is ignored in PK3 files
+	int32_t			offset;				// Data in PAK files, local header in PK3 files
+	int32_t			compressedSize;
+	int32_t			method;				// 0 for stored, Z_DEFLATED
 	qboolean		ignore;				// Whether this file should be ignored
 } fsPackFile_t;
 
 typedef struct {
 	char			name[MAX_OSPATH];
     stable_t        fileNames;
-	FILE			*pak;
-	unzFile			*pk3;
+	FILE			*file;				// shared by everything opened from the pack, Sys_ReadFileAt only
+	qboolean		isPk3;
 	int32_t			numFiles;
 	uint32_t        contentFlags;
     fsPackFile_t	*files;
+	void			*index;				// mapped pack index holding fileNames, or NULL
+	int32_t			indexLength;
 } fsPack_t;
 
+//
+// Pack members are read with positioned reads on the pack's own file.
+// Every open member takes a reader from the pool, and the inflate state
+// of a reader is reset rather than freed between files.
+//
+#define PACKREADER_BUFSIZE		0x4000
+
+struct fsPackReader_s {
+	fsPack_t		*pack;
+	int32_t			dataOfs;			// start of the member in the pack
+	int32_t			compressedSize;
+	int32_t			size;
+	int32_t			method;
+	int32_t			position;			// uncompressed bytes handed out
+	int32_t			readOfs;			// compressed bytes fetched
+	qboolean		inUse;
+	qboolean		zInit;				// z has been through inflateInit2
+	z_stream		z;
+	byte			in[PACKREADER_BUFSIZE];
+};
+
+static fsPackReader_t	fs_packReaders[MAX_HANDLES];
+
+#define ZIP_LOCAL_SIG			0x04034b50
+#define ZIP_CENTRAL_SIG			0x02014b50
+#define ZIP_END_SIG				0x06054b50
+
+//
+// Directories are cached in a binary index per pack, so startup doesn't
+// have to walk every zip central directory again.  The index holds the
+// packed file name table, which is used straight out of the mapping.
+//
+#define PACKINDEX_IDENT			(('X'<<24)+('D'<<16)+('I'<<8)+'P')	// little-endian "PIDX"
+#define PACKINDEX_VERSION		2
+
+typedef struct {
+	int32_t			ident;
+	int32_t			version;
+	int32_t			packSize;
+	int32_t			numFiles;
+	int64_t			packTime;
+	uint32_t		contentFlags;
+	int32_t			namesSize;
+	char			packPath[MAX_OSPATH];
+} fsPackIndexHeader_t;
+
+typedef struct {
+	int32_t			hash;
+	int32_t			size;
+	int32_t			offset;
+	int32_t			compressedSize;
+	int32_t			method;
+	int32_t			ignore;
+} fsPackIndexFile_t;
+
 typedef struct fsSearchPath_s {
 	char			path[MAX_OSPATH];	// Only one of path or
 	fsPack_t		*pack;				// pack will be used
@@ -132,9 +193,33 @@ char	last_pk3_name[MAX_QPATH];	// This is set by FS_FOpenFile
 cvar_t	*fs_basedir;
 cvar_t	*fs_gamedirvar;
 cvar_t	*fs_debug;
+cvar_t	*fs_packindex;
+cvar_t	*fs_prefetch;
+
+
+/*
+=================
+Com_FileExtension
+
+Returns the extension, if any (does not include the .)
+=================
+*/
+void Com_FileExtension (const char *path, char *dst, int32_t dstSize)
+{
+	const char	*s, *last;
+
+	s = last = path + strlen(path);
+	while (*s != '/' && *s != '\\' && s != path){
+		if (*s == '.'){
+			last = s+1;
+			break;
+		}
 
+		s--;
+	}
 
-void Com_FileExtension (const char *path, char *dst, int32_t dstSize);
+	Q_strncpyz(dst, last, dstSize);
+}
 
 /*
 =================
@@ -262,6 +347,9 @@ void FS_CreatePath (char *path)
 
 	FS_DPrintf("FS_CreatePath( %s )\n", path);
 
+	// anything creating a path is about to add a file
+	FS_FlushLookupCache();
+
 	if (strstr(path, "..") || strstr(path, "::") || strstr(path, "\\\\") || strstr(path, "//"))
 	{
 		Com_Printf(S_COLOR_YELLOW"WARNING: refusing to create relative path '%s'\n", path);
@@ -369,8 +457,8 @@ FILE *FS_FileForHandle (fileHandle_t f)
 
 	handle = FS_GetFileByHandle(f);
 
-	if (handle->zip)
-		Com_Error(ERR_DROP, "FS_FileForHandle: can't get FILE on zip file");
+	if (handle->reader)
+		Com_Error(ERR_DROP, "FS_FileForHandle: can't get FILE on pack file");
 
 	if (!handle->file)
 		Com_Error(ERR_DROP, "FS_FileForHandle: NULL");
@@ -394,7 +482,7 @@ fsHandle_t *FS_HandleForFile (const char *path, fileHandle_t *f)
 	handle = fs_handles;
 	for (i = 0; i < MAX_HANDLES; i++, handle++)
 	{
-		if (!handle->file && !handle->zip)
+		if (!handle->file && !handle->reader)
 		{
 			strcpy(handle->name, path);
 			*f = i + 1;
@@ -425,55 +513,213 @@ fsHandle_t *FS_GetFileByHandle (fileHandle_t f)
 
 /*
 =================
-FS_FindPackItem
+File lookups
 
-Performs a binary search by hashed filename
-to find pack items in a sorted pack
+Every file opened for reading goes through one hash table keyed by
+its lowercase name.  Pack contents are entered when the search path
+changes, so the first pack holding a name wins without probing the
+others.  Loose directories ahead of that pack are only tried the first
+time a name is opened, and the result, including a miss, is kept until
+something writes to disk and calls FS_FlushLookupCache.
 =================
 */
-int32_t FS_FindPackItem (fsPack_t *pack, char *itemName)
+typedef struct {
+	const char		*name;			// lowercase, NULL for an empty slot
+	uint32_t		hash;
+	qboolean		ownName;		// name was allocated for this entry
+	fsSearchPath_t	*pack;			// first pack holding the name, or NULL
+	int32_t			packIndex;
+	fsSearchPath_t	*found;			// where it was last opened from, NULL if nowhere
+	int32_t			foundIndex;		// pack item, or -1 for a loose file
+	int32_t			generation;		// found only counts while this is fs_lookupGeneration
+} fsLookup_t;
+
+static fsLookup_t	*fs_lookups;
+static int32_t		fs_numLookups;
+static int32_t		fs_lookupSize;		// power of two
+static int32_t		fs_lookupGeneration = 1;
+static qboolean		fs_lookupDirty = true;
+
+static uint32_t FS_LookupHash (const char *name)
 {
-    char buffer[MAX_OSPATH];
-	int32_t		smax, smin, smidpt;	//, counter = 0;
-	int32_t		i;	//, matchStart, matchEnd;
-    int32_t     itemIndex = -1;
-    int32_t     numLookups = 0;
-    int32_t     overlap = 0;
-	// catch null pointers
-	if ( !pack || !itemName)
-        return -1;
-    
-    Q_strlcpy_lower(buffer, itemName, MAX_OSPATH);
+	return Hash32(name, strlen(name)).h;
+}
 
-    itemIndex = Q_STLookup(&pack->fileNames, buffer);
-    
-    if (itemIndex < 0)
-		return -1;
-    
-	smin = 0;	smax = pack->numFiles;
-	while ( (smax - smin) > 1 )	//&& counter < pack->numFiles )
+/*
+=================
+FS_LookupSlot
+
+Returns the slot holding name, or the empty slot it would go in
+=================
+*/
+static fsLookup_t *FS_LookupSlot (const char *name, uint32_t hash)
+{
+	int32_t		i;
+
+	i = hash & (fs_lookupSize - 1);
+	while (fs_lookups[i].name && (fs_lookups[i].hash != hash || strcmp(fs_lookups[i].name, name)))
+		i = (i + 1) & (fs_lookupSize - 1);
+
+	return &fs_lookups[i];
+}
+
+/*
+=================
+FS_ResizeLookups
+=================
+*/
+static void FS_ResizeLookups (int32_t size)
+{
+	fsLookup_t	*old;
+	int32_t		oldSize, i;
+
+	old = fs_lookups;
+	oldSize = fs_lookupSize;
+
+	fs_lookups = (fsLookup_t*)Z_TagMalloc(size * sizeof(fsLookup_t), TAG_SYSTEM);
+	memset(fs_lookups, 0, size * sizeof(fsLookup_t));
+	fs_lookupSize = size;
+
+	for (i = 0; i < oldSize; i++)
+	{
+		if (old[i].name)
+			*FS_LookupSlot(old[i].name, old[i].hash) = old[i];
+	}
+
+	if (old)
+		Z_Free(old);
+}
+
+/*
+=================
+FS_FreeLookups
+=================
+*/
+static void FS_FreeLookups (void)
+{
+	int32_t		i;
+
+	for (i = 0; i < fs_lookupSize; i++)
 	{
+		if (fs_lookups[i].ownName)
+			Z_Free((void *)fs_lookups[i].name);
+	}
 
-		smidpt = (int) ((smax + smin) / 2.0);
+	if (fs_lookups)
+		Z_Free(fs_lookups);
 
-		if (pack->files[smidpt].hash > itemIndex)	// before midpoint
-			smax = smidpt;
-		else if (pack->files[smidpt].hash < itemIndex)	// after midpoint
-			smin = smidpt;
-        else {
-            smin = smidpt;
-            smax = smidpt;
-        }
-		numLookups++;
+	fs_lookups = NULL;
+	fs_numLookups = 0;
+	fs_lookupSize = 0;
+	fs_lookupDirty = true;
+}
+
+/*
+=================
+FS_BuildLookups
+
+Enters the contents of every pack in search path order
+=================
+*/
+static void FS_BuildLookups (void)
+{
+	fsSearchPath_t	*search;
+	fsPack_t		*pack;
+	fsLookup_t		*lookup;
+	uint32_t		hash;
+	int32_t			i, count, size;
+
+	FS_FreeLookups();
+
+	count = 0;
+	for (search = fs_searchPaths; search; search = search->next)
+	{
+		if (search->pack)
+			count += search->pack->numFiles;
 	}
-	for (i=smin; i<=smax; i++)
-	{	// make sure this entry is not blacklisted & compare filenames
-		if ( (pack->files[i].hash == itemIndex) && !pack->files[i].ignore) {
-			return i;
-        }
-        overlap++;
+
+	// leave room for misses and loose files
+	for (size = 1024; size < count * 2; size <<= 1)
+		;
+	FS_ResizeLookups(size);
+
+	for (search = fs_searchPaths; search; search = search->next)
+	{
+		if (!search->pack)
+			continue;
+
+		pack = search->pack;
+		for (i = 0; i < pack->numFiles; i++)
+		{
+			if (pack->files[i].ignore)
+				continue;
+
+			hash = FS_LookupHash(pack->files[i].name);
+			lookup = FS_LookupSlot(pack->files[i].name, hash);
+			if (lookup->name)
+				continue;	// an earlier pack overrides this one
+
+			lookup->name = pack->files[i].name;
+			lookup->hash = hash;
+			lookup->pack = search;
+			lookup->packIndex = i;
+			fs_numLookups++;
+		}
 	}
-	return -1;
+
+	fs_lookupDirty = false;
+}
+
+/*
+=================
+FS_GetLookup
+
+Finds or adds the entry for a file name
+=================
+*/
+static fsLookup_t *FS_GetLookup (const char *name)
+{
+	char		lower[MAX_OSPATH];
+	uint32_t	hash;
+	fsLookup_t	*lookup;
+
+	if (fs_lookupDirty)
+		FS_BuildLookups();
+
+	Q_strlcpy_lower(lower, name, sizeof(lower));
+	hash = FS_LookupHash(lower);
+
+	lookup = FS_LookupSlot(lower, hash);
+	if (lookup->name)
+		return lookup;
+
+	if ((fs_numLookups + 1) * 4 > fs_lookupSize * 3)
+	{
+		FS_ResizeLookups(fs_lookupSize * 2);
+		lookup = FS_LookupSlot(lower, hash);
+	}
+
+	lookup->name = (const char *)Z_TagStrdup(lower, TAG_SYSTEM);
+	lookup->hash = hash;
+	lookup->ownName = true;
+	lookup->pack = NULL;
+	lookup->packIndex = -1;
+	fs_numLookups++;
+
+	return lookup;
+}
+
+/*
+=================
+FS_FlushLookupCache
+
+Forgets where loose files were found, and which names weren't
+found at all.  Call after creating, renaming or removing files.
+=================
+*/
+void FS_FlushLookupCache (void)
+{
+	fs_lookupGeneration++;
 }
 
 /*
@@ -539,209 +785,486 @@ int32_t FS_FOpenFileWrite (fsHandle_t *handle)
 
 /*
 =================
-FS_FOpenFileRead
+FS_ZipShort / FS_ZipLong
+=================
+*/
+static int32_t FS_ZipShort (const byte *p)
+{
+	return p[0] | (p[1] << 8);
+}
 
-Returns file size or -1 if not found.
-Can open separate files as well as files inside pack files (both PAK 
-and PK3).
+static int32_t FS_ZipLong (const byte *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+/*
+=================
+FS_PackDataOffset
+
+Returns where a member's data starts in the pack, or -1
 =================
 */
-int32_t FS_FOpenFileRead (fsHandle_t *handle)
+static int32_t FS_PackDataOffset (fsPack_t *pack, fsPackFile_t *file)
 {
-	fsSearchPath_t	*search;
-	fsPack_t		*pack;
-	char			path[MAX_OSPATH];
-	int32_t				i;
-	uint32_t	typeFlag;
+	byte			local[30];
 
-	// Knightmare- hack global vars for autodownloads
-	file_from_pak = 0;
-	file_from_pk3 = 0;
-	Com_sprintf(last_pk3_name, sizeof(last_pk3_name), "\0");
+	if (!pack->isPk3)
+		return file->offset;
 
-    typeFlag = FS_TypeFlagForPakItem(handle->name);
+	// the local header's extra field can differ from the central one
+	if (Sys_ReadFileAt(pack->file, file->offset, local, sizeof(local)) != sizeof(local)
+		|| FS_ZipLong(local) != ZIP_LOCAL_SIG)
+		return -1;
 
-	// Search through the path, one element at a time
-	for (search = fs_searchPaths; search; search = search->next)
-	{
-		if (search->pack)
-		{	// Search inside a pack file
-			pack = search->pack;
+	return file->offset + sizeof(local) + FS_ZipShort(local + 26) + FS_ZipShort(local + 28);
+}
 
-			// skip if pack doesn't contain this type of file
-			if ((typeFlag != 0)) {
-				if (!(pack->contentFlags & typeFlag))
-					continue;
-			}
+/*
+=================
+FS_InitPackReader
 
-            // find index of pack item
-			i = FS_FindPackItem (pack, handle->name);
-            // found it!
-            if ( i != -1 && i >= 0 && i < pack->numFiles )
-            {
-                
-                // Found it!
-                Com_FilePath(pack->name, fs_fileInPath, sizeof(fs_fileInPath));
-                fs_fileInPack = true;
-                
-                if (fs_debug->value)
-                    Com_Printf("FS_FOpenFileRead: %s (found in %s)\n", handle->name, pack->name);
-                
-                if (pack->pak)
-                {	// PAK
-                    file_from_pak = 1; // Knightmare added
-                    handle->file = fopen(pack->name, "rb");
-                    if (handle->file)
-                    {
-                        fseek(handle->file, pack->files[i].offset, SEEK_SET);
-                        
-                        return pack->files[i].size;
-                    }
-                }
-                else if (pack->pk3)
-                {	// PK3
-                    file_from_pk3 = 1; // Knightmare added
-                    Com_sprintf(last_pk3_name, sizeof(last_pk3_name), strrchr(pack->name, '/')+1); // Knightmare added
-                    handle->zip = (unzFile*)unzOpen(pack->name);
-                    if (handle->zip)
-                    {
-                        if (unzLocateFile(handle->zip, handle->name, 2) == UNZ_OK)
-                        {
-                            if (unzOpenCurrentFile(handle->zip) == UNZ_OK)
-                                return pack->files[i].size;
-                        }
-                        
-                        unzClose(handle->zip);
-                    }
-                }
-                
-                Com_Error(ERR_FATAL, "Couldn't reopen %s", pack->name);
-            }
-        }
-		else
-		{	// Search in a directory tree
-			Com_sprintf(path, sizeof(path), "%s/%s", search->path, handle->name);
+Points a reader at the start of a pack member.  Only touches the
+reader and the pack's file, so the prefetch thread can use it too.
+=================
+*/
+static qboolean FS_InitPackReader (fsPackReader_t *reader, fsPack_t *pack, fsPackFile_t *file)
+{
+	int32_t			dataOfs;
 
-			handle->file = fopen(path, "rb");
-			if (handle->file)
-			{	// Found it!
-				Q_strncpyz(fs_fileInPath, search->path, sizeof(fs_fileInPath));
-				fs_fileInPack = false;
+	dataOfs = FS_PackDataOffset(pack, file);
+	if (dataOfs == -1)
+		return false;
 
-				if (fs_debug->value)
-					Com_Printf("FS_FOpenFileRead: %s (found in %s)\n", handle->name, search->path);
+	reader->pack = pack;
+	reader->dataOfs = dataOfs;
+	reader->compressedSize = file->compressedSize;
+	reader->size = file->size;
+	reader->method = file->method;
+	reader->position = 0;
+	reader->readOfs = 0;
 
-				return FS_FileLength(handle->file);
-			}
+	if (reader->method == Z_DEFLATED)
+	{
+		if (!reader->zInit)
+		{
+			memset(&reader->z, 0, sizeof(reader->z));
+			if (inflateInit2(&reader->z, -MAX_WBITS) != Z_OK)
+				return false;
+			reader->zInit = true;
 		}
-	}
-
-	// Not found!
-	fs_fileInPath[0] = 0;
-	fs_fileInPack = false;
+		else
+			inflateReset(&reader->z);
 
-	if (fs_debug->value)
-		Com_Printf("FS_FOpenFileRead: couldn't find %s\n", handle->name);
+		reader->z.next_in = reader->in;
+		reader->z.avail_in = 0;
+	}
 
-	return -1;
+	return true;
 }
 
 /*
 =================
-FS_FOpenFile
+FS_OpenPackReader
 
-Opens a file for "mode".
-Returns file size or -1 if an error occurs/not found.
-Can open separate files as well as files inside pack files (both PAK 
-and PK3).
+Takes a free reader from the pool for a pack member
 =================
 */
-int32_t FS_FOpenFile (const char *name, fileHandle_t *f, fsMode_t mode)
+static fsPackReader_t *FS_OpenPackReader (fsPack_t *pack, fsPackFile_t *file)
 {
-	fsHandle_t	*handle;
-	int32_t			size;
-
-	handle = FS_HandleForFile(name, f);
-
-	Q_strncpyz(handle->name, name, sizeof(handle->name));
-	handle->mode = mode;
+	fsPackReader_t	*reader;
+	int32_t			i;
 
-	switch (mode)
+	for (i = 0, reader = fs_packReaders; i < MAX_HANDLES; i++, reader++)
 	{
-	case FS_READ:
-		size = FS_FOpenFileRead(handle);
-		break;
-	case FS_WRITE:
-		size = FS_FOpenFileWrite(handle);
-		break;
-	case FS_APPEND:
-		size = FS_FOpenFileAppend(handle);
-		break;
-	default:
-		Com_Error(ERR_FATAL, "FS_FOpenFile: bad mode (%i)", mode);
+		if (!reader->inUse)
+			break;
 	}
+	if (i == MAX_HANDLES)
+		return NULL;
 
-	if (size != -1)
-		return size;
-
-	// Couldn't open, so free the handle
-	memset(handle, 0, sizeof(*handle));
+	if (!FS_InitPackReader(reader, pack, file))
+		return NULL;
 
-	*f = 0;
-	return -1;
+	reader->inUse = true;
+	return reader;
 }
 
-
 /*
 =================
-FS_FCloseFile
+FS_ClosePackReader
 =================
 */
-void FS_FCloseFile (fileHandle_t f)
+static void FS_ClosePackReader (fsPackReader_t *reader)
 {
-	fsHandle_t *handle;
+	reader->inUse = false;
+}
 
-	handle = FS_GetFileByHandle(f);
+/*
+=================
+FS_FreePackReaders
+=================
+*/
+static void FS_FreePackReaders (void)
+{
+	int32_t		i;
 
-	if (handle->file)
-		fclose(handle->file);
-	else if (handle->zip) {
-		unzCloseCurrentFile(handle->zip);
-		unzClose(handle->zip);
+	for (i = 0; i < MAX_HANDLES; i++)
+	{
+		if (fs_packReaders[i].zInit)
+			inflateEnd(&fs_packReaders[i].z);
 	}
-
-	memset(handle, 0, sizeof(*handle));
+	memset(fs_packReaders, 0, sizeof(fs_packReaders));
 }
 
 /*
 =================
-FS_Read
+FS_PackReaderRead
 
-Properly handles partial reads
+Returns the number of bytes read, 0 at the end of the file
+or -1 on an error
 =================
 */
-int32_t FS_Read (void *buffer, int32_t size, fileHandle_t f)
+static int32_t FS_PackReaderRead (fsPackReader_t *reader, byte *buffer, int32_t length)
 {
-	fsHandle_t	*handle;
-	int32_t			remaining, r;
-	byte		*buf;
-
-	handle = FS_GetFileByHandle(f);
+	int32_t		r, err;
 
-	// Read
-	remaining = size;
-	buf = (byte *)buffer;
+	if (length > reader->size - reader->position)
+		length = reader->size - reader->position;
+	if (length <= 0)
+		return 0;
 
-	while (remaining)
+	if (reader->method != Z_DEFLATED)
 	{
-		if (handle->file)
-			r = fread(buf, 1, remaining, handle->file);
-		else if (handle->zip)
-			r = unzReadCurrentFile(handle->zip, buf, remaining);
-		else
-			return 0;
+		r = Sys_ReadFileAt(reader->pack->file, reader->dataOfs + reader->position, buffer, length);
+		if (r > 0)
+			reader->position += r;
+		return r;
+	}
 
-		if (r == 0)
+	reader->z.next_out = buffer;
+	reader->z.avail_out = length;
+
+	while (reader->z.avail_out)
+	{
+		if (!reader->z.avail_in)
+		{
+			r = min(PACKREADER_BUFSIZE, reader->compressedSize - reader->readOfs);
+			if (r <= 0)
+				break;
+			r = Sys_ReadFileAt(reader->pack->file, reader->dataOfs + reader->readOfs, reader->in, r);
+			if (r <= 0)
+				return -1;
+			reader->readOfs += r;
+			reader->z.next_in = reader->in;
+			reader->z.avail_in = r;
+		}
+
+		err = inflate(&reader->z, Z_SYNC_FLUSH);
+		if (err == Z_STREAM_END)
+			break;
+		if (err != Z_OK)
+			return -1;
+	}
+
+	r = length - reader->z.avail_out;
+	reader->position += r;
+	return r;
+}
+
+/*
+=================
+FS_PackReaderSeek
+=================
+*/
+static void FS_PackReaderSeek (fsPackReader_t *reader, int32_t offset)
+{
+	byte		dummy[0x8000];
+	int32_t		len;
+
+	offset = max(0, min(offset, reader->size));
+
+	if (reader->method != Z_DEFLATED)
+	{
+		reader->position = offset;
+		return;
+	}
+
+	if (offset < reader->position)
+	{	// start over
+		inflateReset(&reader->z);
+		reader->z.next_in = reader->in;
+		reader->z.avail_in = 0;
+		reader->position = 0;
+		reader->readOfs = 0;
+	}
+
+	// inflate until the desired offset is reached
+	while (reader->position < offset)
+	{
+		len = min(offset - reader->position, sizeof(dummy));
+		if (FS_PackReaderRead(reader, dummy, len) <= 0)
+			break;
+	}
+}
+
+/*
+=================
+FS_SetFileSource
+
+Records where the last file read came from
+=================
+*/
+static void FS_SetFileSource (const char *name, fsSearchPath_t *search)
+{
+	if (fs_debug->value)
+		Com_Printf("FS_FOpenFileRead: %s (found in %s)\n", name, search->pack ? search->pack->name : search->path);
+
+	if (!search->pack)
+	{
+		Q_strncpyz(fs_fileInPath, search->path, sizeof(fs_fileInPath));
+		fs_fileInPack = false;
+		return;
+	}
+
+	Com_FilePath(search->pack->name, fs_fileInPath, sizeof(fs_fileInPath));
+	fs_fileInPack = true;
+
+	if (search->pack->isPk3)
+	{
+		file_from_pk3 = 1; // Knightmare added
+		Com_sprintf(last_pk3_name, sizeof(last_pk3_name), strrchr(search->pack->name, '/')+1); // Knightmare added
+	}
+	else
+		file_from_pak = 1; // Knightmare added
+}
+
+/*
+=================
+FS_OpenLooseFile
+=================
+*/
+static FILE *FS_OpenLooseFile (const char *name, fsSearchPath_t *search)
+{
+	char	path[MAX_OSPATH];
+
+	Com_sprintf(path, sizeof(path), "%s/%s", search->path, name);
+
+	return fopen(path, "rb");
+}
+
+/*
+=================
+FS_LocateFile
+
+Finds the search path that provides name, and the pack item
+in it or -1 for a loose file.  If looseFile is given, a loose
+file is left open in it, otherwise a cached location is trusted.
+Returns NULL if the file is nowhere.
+=================
+*/
+static fsSearchPath_t *FS_LocateFile (const char *name, int32_t *index, FILE **looseFile)
+{
+	fsSearchPath_t	*search;
+	fsLookup_t		*lookup;
+	qboolean		cacheLoose;
+	FILE			*f;
+
+	lookup = FS_GetLookup(name);
+
+	// a miss for a mixed case name says nothing about a case
+	// sensitive directory, so only lowercase names cache loose results
+	cacheLoose = !strcmp(lookup->name, name);
+
+	if (cacheLoose && lookup->generation == fs_lookupGeneration)
+	{
+		if (!lookup->found)
+			return NULL;
+
+		*index = lookup->foundIndex;
+		if (lookup->found->pack || !looseFile)
+			return lookup->found;
+
+		*looseFile = FS_OpenLooseFile(name, lookup->found);
+		if (*looseFile)
+			return lookup->found;
+	}
+
+	// Search the directories ahead of the first pack that has it
+	for (search = fs_searchPaths; search && search != lookup->pack; search = search->next)
+	{
+		if (search->pack)
+			continue;
+
+		f = FS_OpenLooseFile(name, search);
+		if (!f)
+			continue;
+
+		if (looseFile)
+			*looseFile = f;
+		else
+			fclose(f);
+
+		if (cacheLoose)
+		{
+			lookup->found = search;
+			lookup->foundIndex = -1;
+			lookup->generation = fs_lookupGeneration;
+		}
+		*index = -1;
+		return search;
+	}
+
+	if (cacheLoose)
+	{
+		lookup->found = lookup->pack;
+		lookup->foundIndex = lookup->packIndex;
+		lookup->generation = fs_lookupGeneration;
+	}
+
+	*index = lookup->packIndex;
+	return lookup->pack;
+}
+
+/*
+=================
+FS_FOpenFileRead
+
+Returns file size or -1 if not found.
+Can open separate files as well as files inside pack files (both PAK 
+and PK3).
+=================
+*/
+int32_t FS_FOpenFileRead (fsHandle_t *handle)
+{
+	fsSearchPath_t	*search;
+	fsPack_t		*pack;
+	int32_t			index;
+
+	// Knightmare- hack global vars for autodownloads
+	file_from_pak = 0;
+	file_from_pk3 = 0;
+	Com_sprintf(last_pk3_name, sizeof(last_pk3_name), "\0");
+
+	search = FS_LocateFile(handle->name, &index, &handle->file);
+	if (!search)
+	{
+		fs_fileInPath[0] = 0;
+		fs_fileInPack = false;
+
+		if (fs_debug->value)
+			Com_Printf("FS_FOpenFileRead: couldn't find %s\n", handle->name);
+
+		return -1;
+	}
+
+	FS_SetFileSource(handle->name, search);
+
+	if (!search->pack)
+		return FS_FileLength(handle->file);
+
+	pack = search->pack;
+	handle->reader = FS_OpenPackReader(pack, &pack->files[index]);
+	if (!handle->reader)
+		Com_Error(ERR_FATAL, "Couldn't reopen %s", pack->name);
+
+	return pack->files[index].size;
+}
+
+/*
+=================
+FS_FOpenFile
+
+Opens a file for "mode".
+Returns file size or -1 if an error occurs/not found.
+Can open separate files as well as files inside pack files (both PAK 
+and PK3).
+=================
+*/
+int32_t FS_FOpenFile (const char *name, fileHandle_t *f, fsMode_t mode)
+{
+	fsHandle_t	*handle;
+	int32_t			size;
+
+	handle = FS_HandleForFile(name, f);
+
+	Q_strncpyz(handle->name, name, sizeof(handle->name));
+	handle->mode = mode;
+
+	switch (mode)
+	{
+	case FS_READ:
+		size = FS_FOpenFileRead(handle);
+		break;
+	case FS_WRITE:
+		size = FS_FOpenFileWrite(handle);
+		break;
+	case FS_APPEND:
+		size = FS_FOpenFileAppend(handle);
+		break;
+	default:
+		Com_Error(ERR_FATAL, "FS_FOpenFile: bad mode (%i)", mode);
+	}
+
+	if (size != -1)
+		return size;
+
+	// Couldn't open, so free the handle
+	memset(handle, 0, sizeof(*handle));
+
+	*f = 0;
+	return -1;
+}
+
+
+/*
+=================
+FS_FCloseFile
+=================
+*/
+void FS_FCloseFile (fileHandle_t f)
+{
+	fsHandle_t *handle;
+
+	handle = FS_GetFileByHandle(f);
+
+	if (handle->file)
+		fclose(handle->file);
+	else if (handle->reader)
+		FS_ClosePackReader(handle->reader);
+
+	memset(handle, 0, sizeof(*handle));
+}
+
+/*
+=================
+FS_Read
+
+Properly handles partial reads
+=================
+*/
+int32_t FS_Read (void *buffer, int32_t size, fileHandle_t f)
+{
+	fsHandle_t	*handle;
+	int32_t			remaining, r;
+	byte		*buf;
+
+	handle = FS_GetFileByHandle(f);
+
+	// Read
+	remaining = size;
+	buf = (byte *)buffer;
+
+	while (remaining)
+	{
+		if (handle->file)
+			r = fread(buf, 1, remaining, handle->file);
+		else if (handle->reader)
+			r = FS_PackReaderRead(handle->reader, buf, remaining);
+		else
+			return 0;
+
+		if (r == 0)
 		{
 			//Com_Error(ERR_FATAL, va("FS_Read: 0 bytes read from %s", handle->name));
 			Com_DPrintf(S_COLOR_YELLOW"FS_Read: 0 bytes read from %s\n", handle->name);
@@ -786,8 +1309,8 @@ int32_t FS_FRead (void *buffer, int32_t size, int32_t count, fileHandle_t f)
 		{
 			if (handle->file)
 				r = fread(buf, 1, remaining, handle->file);
-			else if (handle->zip)
-				r = unzReadCurrentFile(handle->zip, buf, remaining);
+			else if (handle->reader)
+				r = FS_PackReaderRead(handle->reader, buf, remaining);
 			else
 				return 0;
 
@@ -830,8 +1353,8 @@ int32_t FS_Write (const void *buffer, int32_t size, fileHandle_t f){
 	{
 		if (handle->file)
 			w = fwrite(buf, 1, remaining, handle->file);
-		else if (handle->zip)
-			Com_Error(ERR_FATAL, "FS_Write: can't write to zip file %s", handle->name);
+		else if (handle->reader)
+			Com_Error(ERR_FATAL, "FS_Write: can't write to pack file %s", handle->name);
 		else
 			return 0;
 
@@ -864,8 +1387,8 @@ int32_t FS_FTell (fileHandle_t f)
 
 	if (handle->file)
 		return ftell(handle->file);
-	else if (handle->zip)
-		return unztell(handle->zip);
+	else if (handle->reader)
+		return handle->reader->position;
 
 	return 0;
 }
@@ -976,9 +1499,6 @@ FS_Seek
 void FS_Seek (fileHandle_t f, int32_t offset, fsOrigin_t origin)
 {
 	fsHandle_t		*handle;
-	unz_file_info	info;
-	int32_t				remaining, r, len;
-	byte			dummy[0x8000];
 
 	handle = FS_GetFileByHandle(f);
 
@@ -999,163 +1519,762 @@ void FS_Seek (fileHandle_t f, int32_t offset, fsOrigin_t origin)
 			Com_Error(ERR_FATAL, "FS_Seek: bad origin (%i)", origin);
 		}
 	}
-	else if (handle->zip)
+	else if (handle->reader)
 	{
 		switch (origin)
 		{
 		case FS_SEEK_SET:
-			remaining = offset;
 			break;
 		case FS_SEEK_CUR:
-			remaining = offset + unztell(handle->zip);
+			offset += handle->reader->position;
 			break;
 		case FS_SEEK_END:
-			unzGetCurrentFileInfo(handle->zip, &info, NULL, 0, NULL, 0, NULL, 0);
-
-			remaining = offset + info.uncompressed_size;
+			offset += handle->reader->size;
 			break;
 		default:
 			Com_Error(ERR_FATAL, "FS_Seek: bad origin (%i)", origin);
 		}
 
-		// Reopen the file
-		unzCloseCurrentFile(handle->zip);
-		unzOpenCurrentFile(handle->zip);
+		FS_PackReaderSeek(handle->reader, offset);
+	}
+}
+
+/*
+=================
+FS_Tell
 
-		// Skip until the desired offset is reached
-		while (remaining)
+Returns -1 if an error occurs
+=================
+*/
+int32_t FS_Tell (fileHandle_t f)
+{
+	fsHandle_t *handle;
+
+	handle = FS_GetFileByHandle(f);
+
+	if (handle->file)
+		return ftell(handle->file);
+	else if (handle->reader)
+		return handle->reader->position;
+    return -1;
+}
+
+/*
+=================
+FS_FileExists
+================
+*/
+qboolean FS_FileExists (char *path)
+{
+	fileHandle_t f;
+
+	FS_FOpenFile(path, &f, FS_READ);
+	if (f)
+	{
+		FS_FCloseFile(f);
+		return true;
+	}
+	return false;
+}
+
+/*
+=================
+FS_RenameFile
+=================
+*/
+void FS_RenameFile (const char *oldPath, const char *newPath)
+{
+	FS_DPrintf("FS_RenameFile( %s, %s )\n", oldPath, newPath);
+
+	if (rename(oldPath, newPath))
+		FS_DPrintf("FS_RenameFile: failed to rename %s to %s\n", oldPath, newPath);
+
+	FS_FlushLookupCache();
+}
+
+/*
+=================
+FS_DeleteFile
+=================
+*/
+void FS_DeleteFile (const char *path)
+{
+	FS_DPrintf("FS_DeleteFile( %s )\n", path);
+
+	if (remove(path))
+		FS_DPrintf("FS_DeleteFile: failed to delete %s\n", path);
+
+	FS_FlushLookupCache();
+}
+
+/*
+=================
+FS_LoadFile
+
+"path" is relative to the Quake search path.
+Returns file size or -1 if the file is not found.
+A NULL buffer will just return the file size without loading.
+=================
+*/
+int32_t FS_LoadFile (const char *path, void **buffer)
+{
+	fileHandle_t	f;
+	byte			*buf;
+	int32_t				size;
+
+	buf = NULL;
+
+	size = FS_LoadPrefetched(path, buffer);
+	if (size != -1)
+		return size;
+
+	size = FS_FOpenFile(path, &f, FS_READ);
+	if (size == -1 || size == 0)
+	{
+		if (buffer)
+			*buffer = NULL;
+		return size;
+	}
+	if (!buffer)
+	{
+		FS_FCloseFile(f);
+		return size;
+	}
+	buf = (byte*)Z_TagMalloc(size, TAG_SYSTEM);
+	*buffer = buf;
+
+	FS_Read(buf, size, f);
+
+	FS_FCloseFile(f);
+
+	return size;
+}
+
+/*
+=================
+FS_MapFile
+
+Returns a read only view of a whole file.  Loose files and pack
+members stored without compression at a 4 byte aligned offset are
+mapped in place, so callers can read ints through the view, anything
+else is loaded.  The view stays valid until FS_UnmapFile, even if
+the search path changes.
+=================
+*/
+#define	MAX_FILE_MAPPINGS	16
+
+typedef struct {
+	const byte		*data;				// NULL for a free slot
+	void			*base;				// mapping, or loaded buffer if mapLength is 0
+	int32_t			mapLength;
+} fsMapping_t;
+
+static fsMapping_t	fs_mappings[MAX_FILE_MAPPINGS];
+
+const void *FS_MapFile (const char *path, int32_t *length)
+{
+	char			fullPath[MAX_OSPATH];
+	fsMapping_t		*mapping;
+	fsSearchPath_t	*search;
+	fsPackFile_t	*file;
+	void			*buf;
+	int32_t			i, index, dataOfs;
+
+	for (i = 0, mapping = fs_mappings; i < MAX_FILE_MAPPINGS; i++, mapping++)
+	{
+		if (!mapping->data)
+			break;
+	}
+	if (i == MAX_FILE_MAPPINGS)
+		Com_Error(ERR_FATAL, "FS_MapFile: too many mappings");
+
+	// already read by the prefetcher
+	*length = FS_LoadPrefetched(path, &buf);
+	if (*length > 0)
+		goto loaded;
+
+	file_from_pak = 0;
+	file_from_pk3 = 0;
+	last_pk3_name[0] = 0;
+
+	search = FS_LocateFile(path, &index, NULL);
+	if (!search)
+		return NULL;
+
+	mapping->base = NULL;
+	if (!search->pack)
+	{
+		Com_sprintf(fullPath, sizeof(fullPath), "%s/%s", search->path, path);
+		mapping->base = Sys_MapFile(fullPath, &mapping->mapLength);
+		mapping->data = (const byte *)mapping->base;
+		*length = mapping->mapLength;
+	}
+	else
+	{
+		file = &search->pack->files[index];
+		dataOfs = FS_PackDataOffset(search->pack, file);
+		if (file->method != Z_DEFLATED && dataOfs != -1 && file->size > 0)
+			mapping->base = Sys_MapFile(search->pack->name, &mapping->mapLength);
+		if (mapping->base && (dataOfs + file->size > mapping->mapLength
+			|| (((uintptr_t)mapping->base + dataOfs) & 3)))
 		{
-			len = remaining;
-			if (len > sizeof(dummy))
-				len = sizeof(dummy);
+			Sys_UnmapFile(mapping->base, mapping->mapLength);
+			mapping->base = NULL;
+		}
+		if (mapping->base)
+			mapping->data = (const byte *)mapping->base + dataOfs;
+		*length = file->size;
+	}
+
+	if (mapping->base)
+	{
+		FS_SetFileSource(path, search);
+		return mapping->data;
+	}
+
+	*length = FS_LoadFile(path, &buf);
+	if (!buf)
+	{
+		mapping->data = NULL;
+		return NULL;
+	}
+
+loaded:
+	mapping->base = buf;
+	mapping->mapLength = 0;
+	mapping->data = (const byte *)buf;
+	return buf;
+}
+
+/*
+=================
+FS_UnmapFile
+=================
+*/
+void FS_UnmapFile (const void *data)
+{
+	fsMapping_t		*mapping;
+	int32_t			i;
+
+	for (i = 0, mapping = fs_mappings; i < MAX_FILE_MAPPINGS; i++, mapping++)
+	{
+		if (mapping->data == data)
+			break;
+	}
+	if (!data || i == MAX_FILE_MAPPINGS)
+	{
+		FS_DPrintf("FS_UnmapFile: not a mapping\n");
+		return;
+	}
+
+	if (mapping->mapLength)
+		Sys_UnmapFile(mapping->base, mapping->mapLength);
+	else
+		FS_FreeFile(mapping->base);
+	memset(mapping, 0, sizeof(*mapping));
+}
+
+/*
+=================
+FS_FreeFile
+=================
+*/
+void FS_FreeFile (void *buffer)
+{
+	if (!buffer)
+	{
+		FS_DPrintf("FS_FreeFile: NULL buffer\n");
+		return;
+	}
+	Z_Free(buffer);
+}
+
+
+/*
+=================
+Prefetching
+
+Level assets are read on a loader thread while the client is still
+connecting, so registration finds the bytes already in memory.
+Names are located on the main thread when they are queued; the
+loader only reads the pack member or loose path it was handed, with
+its own pack reader, and allocates with malloc since the zone isn't
+thread safe.  A decoder can be installed to also turn the bytes into
+what the caller will want, like image pixels for the renderer.
+=================
+*/
+#define	MAX_PREFETCH			4096
+#define	PREFETCH_MAX_BYTES		(192<<20)
+
+typedef enum {
+	PREFETCH_QUEUED,
+	PREFETCH_LOADING,
+	PREFETCH_DONE,
+	PREFETCH_DROPPED			// failed, taken, cancelled or over budget
+} fsPrefetchState_t;
+
+typedef struct {
+	char			name[MAX_QPATH];
+	uint32_t		hash;				// of the lowercase name
+	fsSearchPath_t	*search;
+	int32_t			index;				// pack item, or -1 for a loose file
+	int32_t			generation;			// fs_lookupGeneration when located
+	fsPrefetchState_t	state;
+	byte			*data;				// malloc'd
+	int32_t			length;
+	void			*decoded;			// malloc'd by the decoder
+	int32_t			reserved;			// bytes counted against the budget
+} fsPrefetch_t;
+
+static fsPrefetch_t		fs_prefetchFiles[MAX_PREFETCH];
+static int32_t			fs_numPrefetch;
+static int32_t			fs_prefetchNext;		// next entry for the loader
+static volatile int32_t	fs_prefetchBytes;
+static fsPackReader_t	fs_prefetchReader;		// owned by the loader thread
+
+static void				*fs_prefetchThread;
+static void				*fs_prefetchLock;
+static void				*fs_prefetchWake;		// posted once per queued entry
+static void				*fs_prefetchDone;		// posted once per finished entry
+static qboolean			fs_prefetchQuit;
+
+static fsPrefetchDecoder_t	fs_prefetchDecoder;
+
+/*
+=================
+FS_ReservePrefetch
+=================
+*/
+static qboolean FS_ReservePrefetch (fsPrefetch_t *entry, int32_t length)
+{
+	if (Sys_AtomicAdd(&fs_prefetchBytes, length) + length > PREFETCH_MAX_BYTES)
+	{
+		Sys_AtomicAdd(&fs_prefetchBytes, -length);
+		return false;
+	}
+
+	entry->reserved += length;
+	return true;
+}
+
+/*
+=================
+FS_ReadPrefetch
+
+Runs on the loader thread, so it must not print, error out or
+use the zone
+=================
+*/
+static void FS_ReadPrefetch (fsPrefetch_t *entry)
+{
+	char			path[MAX_OSPATH+MAX_QPATH];
+	fsPack_t		*pack;
+	FILE			*f;
+	byte			*data;
+	int32_t			length, decodedLength;
+
+	if (entry->search->pack)
+	{
+		pack = entry->search->pack;
+		length = pack->files[entry->index].size;
+		if (!FS_ReservePrefetch(entry, length) || !(data = (byte*)malloc(length)))
+			return;
+
+		if (!FS_InitPackReader(&fs_prefetchReader, pack, &pack->files[entry->index])
+			|| FS_PackReaderRead(&fs_prefetchReader, data, length) != length)
+		{
+			free(data);
+			return;
+		}
+	}
+	else
+	{
+		Com_sprintf(path, sizeof(path), "%s/%s", entry->search->path, entry->name);
+		f = fopen(path, "rb");
+		if (!f)
+			return;
+
+		length = FS_FileLength(f);
+		if (!FS_ReservePrefetch(entry, length) || !(data = (byte*)malloc(length)))
+		{
+			fclose(f);
+			return;
+		}
+
+		if ((int32_t)fread(data, 1, length, f) != length)
+		{
+			fclose(f);
+			free(data);
+			return;
+		}
+		fclose(f);
+	}
+
+	entry->data = data;
+	entry->length = length;
+
+	if (!fs_prefetchDecoder)
+		return;
+
+	entry->decoded = fs_prefetchDecoder(entry->name, data, length, &decodedLength);
+	if (!entry->decoded)
+		return;
+
+	// callers that get the decoded form don't need the file
+	free(entry->data);
+	entry->data = NULL;
+	FS_ReservePrefetch(entry, decodedLength);
+}
+
+/*
+=================
+FS_PrefetchThread
+=================
+*/
+static int32_t FS_PrefetchThread (void *unused)
+{
+	fsPrefetch_t	*entry;
+
+	while (1)
+	{
+		Sys_SemaphoreWait(fs_prefetchWake);
+		if (fs_prefetchQuit)
+			break;
+
+		Sys_SemaphoreWait(fs_prefetchLock);
+		entry = NULL;
+		while (fs_prefetchNext < fs_numPrefetch && !entry)
+		{
+			entry = &fs_prefetchFiles[fs_prefetchNext++];
+			if (entry->state != PREFETCH_QUEUED)
+				entry = NULL;
+		}
+		if (entry)
+			entry->state = PREFETCH_LOADING;
+		Sys_SemaphorePost(fs_prefetchLock);
+
+		if (!entry)
+			continue;	// cancelled or taken before it was reached
+
+		FS_ReadPrefetch(entry);
+
+		Sys_SemaphoreWait(fs_prefetchLock);
+		entry->state = (entry->data || entry->decoded) ? PREFETCH_DONE : PREFETCH_DROPPED;
+		Sys_SemaphorePost(fs_prefetchLock);
+		Sys_SemaphorePost(fs_prefetchDone);
+	}
+
+	return 0;
+}
+
+/*
+=================
+FS_StartPrefetch
+=================
+*/
+static qboolean FS_StartPrefetch (void)
+{
+	if (fs_prefetchThread)
+		return true;
+
+	fs_prefetchLock = Sys_CreateSemaphore(1);
+	fs_prefetchWake = Sys_CreateSemaphore(0);
+	fs_prefetchDone = Sys_CreateSemaphore(0);
+	fs_prefetchQuit = false;
+	if (fs_prefetchLock && fs_prefetchWake && fs_prefetchDone)
+		fs_prefetchThread = Sys_CreateThread(FS_PrefetchThread, NULL, "prefetch");
+
+	if (fs_prefetchThread)
+		return true;
+
+	// no threads on this platform
+	Cvar_ForceSet("fs_prefetch", "0");
+	return false;
+}
+
+/*
+=================
+FS_StopPrefetch
+=================
+*/
+static void FS_StopPrefetch (void)
+{
+	FS_ClearPrefetch();
+
+	if (fs_prefetchThread)
+	{
+		fs_prefetchQuit = true;
+		Sys_SemaphorePost(fs_prefetchWake);
+		Sys_WaitThread(fs_prefetchThread);
+		fs_prefetchThread = NULL;
+	}
+
+	if (fs_prefetchLock)
+		Sys_DestroySemaphore(fs_prefetchLock);
+	if (fs_prefetchWake)
+		Sys_DestroySemaphore(fs_prefetchWake);
+	if (fs_prefetchDone)
+		Sys_DestroySemaphore(fs_prefetchDone);
+	fs_prefetchLock = fs_prefetchWake = fs_prefetchDone = NULL;
+
+	if (fs_prefetchReader.zInit)
+		inflateEnd(&fs_prefetchReader.z);
+	memset(&fs_prefetchReader, 0, sizeof(fs_prefetchReader));
+}
+
+/*
+=================
+FS_FindPrefetch
+=================
+*/
+static fsPrefetch_t *FS_FindPrefetch (const char *name)
+{
+	char			lower[MAX_QPATH];
+	uint32_t		hash;
+	int32_t			i;
+
+	Q_strlcpy_lower(lower, name, sizeof(lower));
+	hash = FS_LookupHash(lower);
+
+	for (i = 0; i < fs_numPrefetch; i++)
+	{
+		if (fs_prefetchFiles[i].hash == hash && !Q_strcasecmp(fs_prefetchFiles[i].name, name))
+			return &fs_prefetchFiles[i];
+	}
+
+	return NULL;
+}
 
-			r = unzReadCurrentFile(handle->zip, dummy, len);
-			if (r <= 0)
-				break;
+/*
+=================
+FS_ReleasePrefetch
 
-			remaining -= r;
-		}
-	}
+Frees whatever an entry still holds.  The loader must be done with it.
+=================
+*/
+static void FS_ReleasePrefetch (fsPrefetch_t *entry)
+{
+	if (entry->data)
+		free(entry->data);
+	if (entry->decoded)
+		free(entry->decoded);
+	entry->data = NULL;
+	entry->decoded = NULL;
+
+	Sys_AtomicAdd(&fs_prefetchBytes, -entry->reserved);
+	entry->reserved = 0;
+	entry->state = PREFETCH_DROPPED;
 }
 
 /*
 =================
-FS_Tell
+FS_WaitPrefetch
 
-Returns -1 if an error occurs
+Returns the entry for name once the loader is done with it, or NULL
+if it isn't worth waiting for.  An entry the loader hasn't reached
+is dropped, since the caller is about to read the file itself.
 =================
 */
-int32_t FS_Tell (fileHandle_t f)
+static fsPrefetch_t *FS_WaitPrefetch (const char *name)
 {
-	fsHandle_t *handle;
+	fsPrefetch_t	*entry;
 
-	handle = FS_GetFileByHandle(f);
+	if (!fs_numPrefetch)
+		return NULL;
 
-	if (handle->file)
-		return ftell(handle->file);
-	else if (handle->zip)
-		return unztell(handle->zip);
-    return -1;
+	entry = FS_FindPrefetch(name);
+	if (!entry)
+		return NULL;
+
+	Sys_SemaphoreWait(fs_prefetchLock);
+	if (entry->state == PREFETCH_QUEUED)
+		entry->state = PREFETCH_DROPPED;
+	while (entry->state == PREFETCH_LOADING)
+	{
+		Sys_SemaphorePost(fs_prefetchLock);
+		Sys_SemaphoreWait(fs_prefetchDone);
+		Sys_SemaphoreWait(fs_prefetchLock);
+	}
+	Sys_SemaphorePost(fs_prefetchLock);
+
+	if (entry->state != PREFETCH_DONE)
+		return NULL;
+
+	// the search path changed, or something was written
+	if (fs_lookupDirty || entry->generation != fs_lookupGeneration)
+	{
+		FS_ReleasePrefetch(entry);
+		return NULL;
+	}
+
+	return entry;
 }
 
 /*
 =================
-FS_FileExists
-================
+FS_PrefetchFile
+
+Queues a file to be read in the background.  Returns false if
+the file doesn't exist, so callers can try alternatives in order.
+=================
 */
-qboolean FS_FileExists (char *path)
+qboolean FS_PrefetchFile (const char *name)
 {
-	fileHandle_t f;
+	fsPrefetch_t	*entry;
+	fsSearchPath_t	*search;
+	char			lower[MAX_QPATH];
+	int32_t			index;
 
-	FS_FOpenFile(path, &f, FS_READ);
-	if (f)
-	{
-		FS_FCloseFile(f);
+	if (!name[0] || strlen(name) >= MAX_QPATH)
+		return false;
+
+	if (!fs_prefetch->integer || fs_numPrefetch == MAX_PREFETCH || !FS_StartPrefetch())
+		return FS_LocateFile(name, &index, NULL) != NULL;
+
+	if (FS_FindPrefetch(name))
 		return true;
-	}
-	return false;
+
+	// locating may rebuild the lookups, which drops stale entries
+	search = FS_LocateFile(name, &index, NULL);
+	if (!search)
+		return false;
+
+	Sys_SemaphoreWait(fs_prefetchLock);
+	entry = &fs_prefetchFiles[fs_numPrefetch];
+	memset(entry, 0, sizeof(*entry));
+	Q_strlcpy_lower(lower, name, sizeof(lower));
+	Q_strncpyz(entry->name, name, sizeof(entry->name));
+	entry->hash = FS_LookupHash(lower);
+	entry->search = search;
+	entry->index = index;
+	entry->generation = fs_lookupGeneration;
+	entry->state = PREFETCH_QUEUED;
+	fs_numPrefetch++;
+	Sys_SemaphorePost(fs_prefetchLock);
+
+	Sys_SemaphorePost(fs_prefetchWake);
+	return true;
 }
 
 /*
 =================
-FS_RenameFile
+FS_ClearPrefetch
+
+Cancels everything queued and frees everything staged.  Call once
+registration is over, and before packs go away.
 =================
 */
-void FS_RenameFile (const char *oldPath, const char *newPath)
+void FS_ClearPrefetch (void)
 {
-	FS_DPrintf("FS_RenameFile( %s, %s )\n", oldPath, newPath);
+	int32_t		i;
+	qboolean	loading;
 
-	if (rename(oldPath, newPath))
-		FS_DPrintf("FS_RenameFile: failed to rename %s to %s\n", oldPath, newPath);
+	if (!fs_numPrefetch)
+		return;
+
+	Sys_SemaphoreWait(fs_prefetchLock);
+	while (1)
+	{
+		loading = false;
+		for (i = 0; i < fs_numPrefetch; i++)
+		{
+			if (fs_prefetchFiles[i].state == PREFETCH_QUEUED)
+				fs_prefetchFiles[i].state = PREFETCH_DROPPED;
+			else if (fs_prefetchFiles[i].state == PREFETCH_LOADING)
+				loading = true;
+		}
+		if (!loading)
+			break;
+
+		Sys_SemaphorePost(fs_prefetchLock);
+		Sys_SemaphoreWait(fs_prefetchDone);
+		Sys_SemaphoreWait(fs_prefetchLock);
+	}
+
+	for (i = 0; i < fs_numPrefetch; i++)
+		FS_ReleasePrefetch(&fs_prefetchFiles[i]);
+	fs_numPrefetch = 0;
+	fs_prefetchNext = 0;
+	Sys_SemaphorePost(fs_prefetchLock);
 }
 
 /*
 =================
-FS_DeleteFile
+FS_SetPrefetchDecoder
+
+The decoder runs on the loader thread for every file read, and
+returns a malloc'd block, or NULL to keep the raw file instead.
 =================
 */
-void FS_DeleteFile (const char *path)
+void FS_SetPrefetchDecoder (fsPrefetchDecoder_t decoder)
 {
-	FS_DPrintf("FS_DeleteFile( %s )\n", path);
-
-	if (remove(path))
-		FS_DPrintf("FS_DeleteFile: failed to delete %s\n", path);
+	FS_ClearPrefetch();
+	fs_prefetchDecoder = decoder;
 }
 
 /*
 =================
-FS_LoadFile
+FS_LoadPrefetched
 
-"path" is relative to the Quake search path.
-Returns file size or -1 if the file is not found.
-A NULL buffer will just return the file size without loading.
+Hands over the raw bytes of a prefetched file the same way
+FS_LoadFile would.  Returns -1 if it wasn't prefetched.
 =================
 */
-int32_t FS_LoadFile (const char *path, void **buffer)
+int32_t FS_LoadPrefetched (const char *path, void **buffer)
 {
-	fileHandle_t	f;
-	byte			*buf;
-	int32_t				size;
+	fsPrefetch_t	*entry;
+	int32_t			length;
 
-	buf = NULL;
+	entry = FS_WaitPrefetch(path);
+	if (!entry || !entry->data)
+		return -1;
 
-	size = FS_FOpenFile(path, &f, FS_READ);
-	if (size == -1 || size == 0)
-	{
-		if (buffer)
-			*buffer = NULL;
-		return size;
-	}
+	// keep the autodownload globals the same as a real open
+	file_from_pak = 0;
+	file_from_pk3 = 0;
+	last_pk3_name[0] = 0;
+	FS_SetFileSource(entry->name, entry->search);
+
+	length = entry->length;
 	if (!buffer)
+		return length;
+
+	*buffer = NULL;
+	if (length)
 	{
-		FS_FCloseFile(f);
-		return size;
+		*buffer = Z_TagMalloc(length, TAG_SYSTEM);
+		memcpy(*buffer, entry->data, length);
 	}
-	buf = (byte*)Z_TagMalloc(size, TAG_SYSTEM);
-	*buffer = buf;
+	FS_ReleasePrefetch(entry);
 
-	FS_Read(buf, size, f);
-
-	FS_FCloseFile(f);
-
-	return size;
+	return length;
 }
 
 /*
 =================
-FS_FreeFile
+FS_TakeDecoded
+
+Returns what the decoder made of a prefetched file, or NULL.
+The caller frees it with free().
 =================
 */
-void FS_FreeFile (void *buffer)
+void *FS_TakeDecoded (const char *path)
 {
-	if (!buffer)
-	{
-		FS_DPrintf("FS_FreeFile: NULL buffer\n");
-		return;
-	}
-	Z_Free(buffer);
+	fsPrefetch_t	*entry;
+	void			*decoded;
+
+	entry = FS_WaitPrefetch(path);
+	if (!entry || !entry->decoded)
+		return NULL;
+
+	decoded = entry->decoded;
+	entry->decoded = NULL;
+	FS_ReleasePrefetch(entry);
+
+	return decoded;
 }
 
+
 // Some incompetently packaged mods have these files in their paks!
 char* pakfile_ignore_names[] =
 {
@@ -1202,6 +2321,203 @@ qboolean FS_FileInPakBlacklist (char *filename, qboolean isPk3)
 	return ignore;
 }
 
+/*
+=================
+FS_FreePack
+=================
+*/
+void FS_FreePack (fsPack_t *pack)
+{
+	FS_ClearPrefetch();
+
+	if (pack->file)
+		fclose(pack->file);
+
+	if (pack->index)
+		Sys_UnmapFile(pack->index, pack->indexLength);
+	else
+		Q_STFree(&pack->fileNames);
+
+	Z_Free(pack->files);
+	Z_Free(pack);
+}
+
+/*
+=================
+FS_PackIndexPath
+
+Pack indexes are kept with the user's config, named after the pack
+and a hash of its full path
+=================
+*/
+static void FS_PackIndexPath (const char *packPath, char *path, int32_t size)
+{
+	const char	*base;
+
+	base = strrchr(packPath, '/');
+	base = base ? base + 1 : packPath;
+	Com_sprintf(path, size, "%s/packindex/%s-%08x.idx", fs_gamedir, base,
+		Hash32(packPath, strlen(packPath)).h);
+}
+
+/*
+=================
+FS_PackStat
+
+Returns false if the pack doesn't exist
+=================
+*/
+static qboolean FS_PackStat (const char *packPath, int32_t *packSize, int64_t *packTime)
+{
+	struct stat	st;
+
+	if (stat(packPath, &st) == -1)
+		return false;
+
+	*packSize = (int32_t)st.st_size;
+	*packTime = (int64_t)st.st_mtime;
+	return true;
+}
+
+/*
+=================
+FS_LoadPackIndex
+
+Maps the cached index for a pack, or returns NULL if there isn't one
+or the pack has changed since it was written.  The caller still has to
+open the pack itself.
+=================
+*/
+fsPack_t *FS_LoadPackIndex (const char *packPath, int32_t packSize, int64_t packTime)
+{
+	char				path[MAX_OSPATH];
+	byte				*base;
+	int32_t				length, i;
+	fsPackIndexHeader_t	*header;
+	fsPackIndexFile_t	*in;
+	fsPackFile_t		*files;
+	fsPack_t			*pack;
+
+	if (!fs_packindex->value)
+		return NULL;
+
+	FS_PackIndexPath(packPath, path, sizeof(path));
+	base = (byte *)Sys_MapFile(path, &length);
+	if (!base)
+		return NULL;
+
+	header = (fsPackIndexHeader_t *)base;
+	if (length < sizeof(fsPackIndexHeader_t)
+		|| header->ident != PACKINDEX_IDENT || header->version != PACKINDEX_VERSION
+		|| header->packSize != packSize || header->packTime != packTime
+		|| header->packPath[sizeof(header->packPath)-1] || strcmp(header->packPath, packPath)
+		|| header->numFiles <= 0 || header->numFiles > MAX_FILES_IN_PACK || header->namesSize <= 0
+		|| length != sizeof(fsPackIndexHeader_t) + header->numFiles * sizeof(fsPackIndexFile_t) + header->namesSize)
+	{	// stale or damaged, it gets rewritten after the directory is read
+		Sys_UnmapFile(base, length);
+		return NULL;
+	}
+
+	// names are looked up straight out of the mapping, and the entries
+	// have to point inside the pack, or it is rebuilt from the directory
+	in = (fsPackIndexFile_t *)(header + 1);
+	if (((char *)(in + header->numFiles))[header->namesSize-1])
+	{
+		Sys_UnmapFile(base, length);
+		return NULL;
+	}
+	for (i = 0; i < header->numFiles; i++)
+	{
+		if (in[i].hash <= 0 || in[i].hash >= header->namesSize
+			|| in[i].size < 0 || in[i].compressedSize < 0
+			|| in[i].offset < 0 || in[i].offset > packSize
+			|| in[i].compressedSize > packSize - in[i].offset)
+		{
+			Sys_UnmapFile(base, length);
+			return NULL;
+		}
+	}
+
+	pack = (fsPack_t*)Z_TagMalloc(sizeof(fsPack_t), TAG_SYSTEM);
+	memset(pack, 0, sizeof(fsPack_t));
+	strcpy(pack->name, packPath);
+	pack->numFiles = header->numFiles;
+	pack->contentFlags = header->contentFlags;
+	pack->fileNames.st = in + header->numFiles;
+	pack->fileNames.size = header->namesSize;
+	pack->fileNames.tag = TAG_SYSTEM;
+	pack->index = base;
+	pack->indexLength = length;
+
+	files = (fsPackFile_t*)Z_TagMalloc(pack->numFiles * sizeof(fsPackFile_t), TAG_SYSTEM);
+	for (i = 0; i < pack->numFiles; i++)
+	{
+		files[i].hash = in[i].hash;
+		files[i].size = in[i].size;
+		files[i].offset = in[i].offset;
+		files[i].compressedSize = in[i].compressedSize;
+		files[i].method = in[i].method;
+		files[i].ignore = in[i].ignore;
+		files[i].name = Q_STGetString(&pack->fileNames, files[i].hash);
+	}
+	pack->files = files;
+
+	return pack;
+}
+
+/*
+=================
+FS_WritePackIndex
+=================
+*/
+void FS_WritePackIndex (fsPack_t *pack, int32_t packSize, int64_t packTime)
+{
+	char				path[MAX_OSPATH];
+	FILE				*f;
+	int32_t				i;
+	fsPackIndexHeader_t	*header;
+	fsPackIndexFile_t	*out;
+
+	if (!fs_packindex->value)
+		return;
+
+	FS_PackIndexPath(pack->name, path, sizeof(path));
+	FS_CreatePath(path);
+	f = fopen(path, "wb");
+	if (!f)
+		return;
+
+	header = (fsPackIndexHeader_t*)Z_TagMalloc(sizeof(fsPackIndexHeader_t) + pack->numFiles * sizeof(fsPackIndexFile_t), TAG_SYSTEM);
+	memset(header, 0, sizeof(fsPackIndexHeader_t));
+	header->ident = PACKINDEX_IDENT;
+	header->version = PACKINDEX_VERSION;
+	header->packSize = packSize;
+	header->numFiles = pack->numFiles;
+	header->packTime = packTime;
+	header->contentFlags = pack->contentFlags;
+	header->namesSize = pack->fileNames.size;
+	Q_strncpyz(header->packPath, pack->name, sizeof(header->packPath));
+
+	out = (fsPackIndexFile_t *)(header + 1);
+	for (i = 0; i < pack->numFiles; i++)
+	{
+		out[i].hash = pack->files[i].hash;
+		out[i].size = pack->files[i].size;
+		out[i].offset = pack->files[i].offset;
+		out[i].compressedSize = pack->files[i].compressedSize;
+		out[i].method = pack->files[i].method;
+		out[i].ignore = pack->files[i].ignore;
+	}
+
+	fwrite(header, 1, sizeof(fsPackIndexHeader_t) + pack->numFiles * sizeof(fsPackIndexFile_t), f);
+	fwrite(pack->fileNames.st, 1, pack->fileNames.size, f);
+	fclose(f);
+
+	Z_Free(header);
+
+	FS_DPrintf("FS_WritePackIndex: %s\n", path);
+}
+
 /*
 =================
 FS_LoadPAK
@@ -1222,11 +2538,24 @@ fsPack_t *FS_LoadPAK (const char *packPath)
 	dpackheader_t		header;
 	dpackfile_t		info[MAX_FILES_IN_PACK];
 	uint32_t		contentFlags = 0;
+	int32_t			packSize;
+	int64_t			packTime;
+
+	if (!FS_PackStat(packPath, &packSize, &packTime))
+		return NULL;
 
 	handle = fopen(packPath, "rb");
 	if (!handle)
 		return NULL;
 
+	pack = FS_LoadPackIndex(packPath, packSize, packTime);
+	if (pack)
+	{
+		pack->file = handle;
+		pack->isPk3 = false;
+		return pack;
+	}
+
 	fread(&header, 1, sizeof(dpackheader_t), handle);
 	
 	if (LittleLong(header.ident) != IDPAKHEADER)
@@ -1259,6 +2588,8 @@ fsPack_t *FS_LoadPAK (const char *packPath)
         files[i].hash = Q_STAutoRegister(&filenameTable, buffer);
         files[i].offset = LittleLong(cur.filepos);
         files[i].size = LittleLong(cur.filelen);
+        files[i].compressedSize = files[i].size;
+        files[i].method = 0;
         files[i].ignore = FS_FileInPakBlacklist(buffer, false);	// check against pak loading blacklist
         if (!files[i].ignore)	// add type flag for this file
             contentFlags |= FS_TypeFlagForPakItem(buffer);
@@ -1276,12 +2607,16 @@ fsPack_t *FS_LoadPAK (const char *packPath)
 
     pack = (fsPack_t*)Z_TagMalloc(sizeof(fsPack_t), TAG_SYSTEM);
 	strcpy(pack->name, packPath);
-	pack->pak = handle;
-	pack->pk3 = NULL;
+	pack->file = handle;
+	pack->isPk3 = false;
 	pack->numFiles = numFiles;
 	pack->files = files;
 	pack->contentFlags = contentFlags;
     pack->fileNames = filenameTable;
+	pack->index = NULL;
+	pack->indexLength = 0;
+
+	FS_WritePackIndex(pack, packSize, packTime);
 
 	return pack;
 }
@@ -1305,6 +2640,7 @@ void FS_AddPAKFile (const char *packPath)
     search->pack = pack;
     search->next = fs_searchPaths;
     fs_searchPaths = search;
+    fs_lookupDirty = true;
 }
 
 /*
@@ -1319,59 +2655,115 @@ the list so they override previous pack files.
 */
 fsPack_t *FS_LoadPK3 (const char *packPath)
 {
-	int32_t				numFiles, i = 0;
+	int32_t				numFiles, i;
 	fsPackFile_t	*files;
 	fsPack_t		*pack;
-	unzFile			*handle;
-	unz_global_info	global;
-	unz_file_info	info;
-	int32_t				status;
+	FILE			*handle;
+	byte			*buf, *dir, *p, *end;
+	int32_t			len, dirOfs, dirLen, nameLen;
 	uint32_t		contentFlags = 0;
 	char			fileName[MAX_QPATH];
     stable_t        filenameTable = {0, 0, 0};
+	int32_t			packSize;
+	int64_t			packTime;
+
+	if (!FS_PackStat(packPath, &packSize, &packTime))
+		return NULL;
 
-	handle = (unzFile*)unzOpen(packPath);
+	handle = fopen(packPath, "rb");
 	if (!handle)
 		return NULL;
 
-	if (unzGetGlobalInfo(handle, &global) != UNZ_OK)
+	pack = FS_LoadPackIndex(packPath, packSize, packTime);
+	if (pack)
+	{
+		pack->file = handle;
+		pack->isPk3 = true;
+		return pack;
+	}
+
+	// find the end of central directory record,
+	// it can be followed by a comment of up to 64k
+	len = min(packSize, 0xffff + 22);
+	buf = (byte*)Z_TagMalloc(max(len, 1), TAG_SYSTEM);
+	i = -1;
+	if (len >= 22 && Sys_ReadFileAt(handle, packSize - len, buf, len) == len)
 	{
-		unzClose(handle);
+		for (i = len - 22; i >= 0; i--)
+		{
+			if (FS_ZipLong(buf + i) == ZIP_END_SIG)
+				break;
+		}
+	}
+	if (i < 0)
+	{
+		Z_Free(buf);
+		fclose(handle);
 		Com_Error(ERR_FATAL, "FS_LoadPK3: %s is not a pack file", packPath);
 	}
-	numFiles = global.number_entry;
+	numFiles = FS_ZipShort(buf + i + 10);
+	dirLen = FS_ZipLong(buf + i + 12);
+	dirOfs = FS_ZipLong(buf + i + 16);
+	Z_Free(buf);
+
 	if (numFiles > MAX_FILES_IN_PACK || numFiles == 0)
 	{
-		unzClose(handle);
+		fclose(handle);
 		Com_Error(ERR_FATAL, "FS_LoadPK3: %s has %i files", packPath, numFiles);
 	}
+
+	// read the whole central directory at once
+	if (dirLen <= 0 || dirOfs < 0 || dirLen > packSize - dirOfs)
+	{
+		fclose(handle);
+		Com_Error(ERR_FATAL, "FS_LoadPK3: %s has a bad directory", packPath);
+	}
+	dir = (byte*)Z_TagMalloc(dirLen, TAG_SYSTEM);
+	if (Sys_ReadFileAt(handle, dirOfs, dir, dirLen) != dirLen)
+	{
+		Z_Free(dir);
+		fclose(handle);
+		Com_Error(ERR_FATAL, "FS_LoadPK3: couldn't read %s", packPath);
+	}
+
 	files = (fsPackFile_t*)Z_TagMalloc(numFiles * sizeof(fsPackFile_t), TAG_SYSTEM);
 
     Q_STInit(&filenameTable, numFiles * MAX_QPATH, MAX_QPATH, TAG_SYSTEM);
-    
-    
-	status = unzGoToFirstFile(handle);
-	while (status == UNZ_OK)
+
+	p = dir;
+	end = dir + dirLen;
+	for (i = 0; i < numFiles; i++)
 	{
         char buffer[MAX_OSPATH];
 
-		fileName[0] = 0;
-		unzGetCurrentFileInfo(handle, &info, fileName, MAX_QPATH, NULL, 0, NULL, 0);
+		if (p + 46 > end || FS_ZipLong(p) != ZIP_CENTRAL_SIG)
+			break;
+		nameLen = FS_ZipShort(p + 28);
+		if (p + 46 + nameLen > end)
+			break;
+
+		len = min(nameLen, MAX_QPATH - 1);
+		memcpy(fileName, p + 46, len);
+		fileName[len] = 0;
 
 		Q_strlcpy_lower(buffer, fileName, MAX_OSPATH);
 
         files[i].hash = Q_STAutoRegister(&filenameTable, buffer);
-		files[i].offset = -1;		// Not used in ZIP files
-		files[i].size = info.uncompressed_size;
+		files[i].offset = FS_ZipLong(p + 42);
+		files[i].size = FS_ZipLong(p + 24);
+		files[i].compressedSize = FS_ZipLong(p + 20);
+		files[i].method = FS_ZipShort(p + 10);
 		files[i].ignore = FS_FileInPakBlacklist(buffer, true);	// check against pak loading blacklist
+		if ((FS_ZipShort(p + 8) & 1) || (files[i].method != 0 && files[i].method != Z_DEFLATED))
+			files[i].ignore = true;	// encrypted, or a method we can't read
 		if (!files[i].ignore)	// add type flag for this file
 			contentFlags |= FS_TypeFlagForPakItem(buffer);
-		i++;
 
-		status = unzGoToNextFile(handle);
+		p += 46 + nameLen + FS_ZipShort(p + 30) + FS_ZipShort(p + 32);
 	}
 
 	numFiles = i;
+	Z_Free(dir);
 
 	Q_STAutoPack(&filenameTable);
 
@@ -1382,12 +2774,17 @@ fsPack_t *FS_LoadPK3 (const char *packPath)
 
 	pack = (fsPack_t*)Z_TagMalloc(sizeof(fsPack_t), TAG_SYSTEM);
 	strcpy(pack->name, packPath);
-	pack->pak = NULL;
-	pack->pk3 = handle;
+	pack->file = handle;
+	pack->isPk3 = true;
 	pack->numFiles = numFiles;
 	pack->files = files;
 	pack->contentFlags = contentFlags;
     pack->fileNames = filenameTable;
+	pack->index = NULL;
+	pack->indexLength = 0;
+
+	FS_WritePackIndex(pack, packSize, packTime);
+
 	return pack;
 }
 
@@ -1410,6 +2807,7 @@ void FS_AddPK3File (const char *packPath)
     search->pack = pack;
     search->next = fs_searchPaths;
     fs_searchPaths = search;
+    fs_lookupDirty = true;
 }
 
 /*
@@ -1528,6 +2926,8 @@ void FS_AddGameDirectory (const char *dir)
         }
         // VoiD -E- *.pack support
     } 
+
+	FS_BuildLookups();
 }
 
 /*
@@ -1647,7 +3047,7 @@ void FS_Path_f (void)
 
 	for (i = 0, handle = fs_handles; i < MAX_HANDLES; i++, handle++)
 	{
-		if (handle->file || handle->zip)
+		if (handle->file || handle->reader)
 			Com_Printf("Handle %i: %s\n", i + 1, handle->name);
 	}
 
@@ -1680,28 +3080,21 @@ void FS_Startup (void)
 	if (Q_strcasecmp(fs_gamedirvar->string, fs_currentGame))
 	{
 		fsSearchPath_t	*next;
-		fsPack_t		*pack;
+
+		// the loader may be reading from the paths about to go
+		FS_ClearPrefetch();
 
 		// Free up any current game dir info
 		while (fs_searchPaths != fs_baseSearchPaths)
 		{
 			if (fs_searchPaths->pack)
-			{
-				pack = fs_searchPaths->pack;
-
-				if (pack->pak)
-					fclose(pack->pak);
-				if (pack->pk3)
-					unzClose(pack->pk3);
-
-				Z_Free(pack->files);
-				Z_Free(pack);
-			}
+				FS_FreePack(fs_searchPaths->pack);
 
 			next = fs_searchPaths->next;
 			Z_Free(fs_searchPaths);
 			fs_searchPaths = next;
 		}
+		fs_lookupDirty = true;
 
 		if (!Q_strcasecmp(fs_gamedirvar->string, BASEDIRNAME))	// Don't add baseq2 again
             fs_gamedir = fs_basedir->string;
@@ -1740,6 +3133,14 @@ void FS_InitFilesystem (void)
 	// allows the game to run from outside the data tree
 	fs_basedir = Cvar_Get ("basedir", Sys_GetBaseDir(), CVAR_NOSET);
 
+	fs_debug = Cvar_Get("fs_debug", "0", 0);
+
+	// cache pack directories in packindex/
+	fs_packindex = Cvar_Get ("fs_packindex", "1", CVAR_ARCHIVE);
+
+	// read level assets on a background thread while connecting
+	fs_prefetch = Cvar_Get ("fs_prefetch", "1", CVAR_ARCHIVE);
+
 	// start up with baseq2 by default
 	FS_AddGameDirectory (va("%s/"BASEDIRNAME, fs_basedir->string) );
 
@@ -1749,7 +3150,6 @@ void FS_InitFilesystem (void)
 	strcpy(fs_currentGame, BASEDIRNAME);
 
 	// check for game override
-	fs_debug = Cvar_Get("fs_debug", "0", 0);
 	fs_gamedirvar = Cvar_Get ("game", "", CVAR_LATCH|CVAR_SERVERINFO);
 	if (fs_gamedirvar->string[0])
 		FS_SetGamedir (fs_gamedirvar->string);
@@ -1766,7 +3166,6 @@ void FS_Shutdown (void)
 {
 	fsHandle_t		*handle;
 	fsSearchPath_t	*next;
-	fsPack_t		*pack;
 	int32_t				i;
 
 	Cmd_RemoveCommand("dir");
@@ -1774,38 +3173,29 @@ void FS_Shutdown (void)
 	Cmd_RemoveCommand("link");
 	Cmd_RemoveCommand("path");
 
+	FS_StopPrefetch();
+
 	// Close all files
 	for (i = 0, handle = fs_handles; i < MAX_HANDLES; i++, handle++)
 	{
 		if (handle->file)
 			fclose(handle->file);
-		if (handle->zip)
-		{
-			unzCloseCurrentFile(handle->zip);
-			unzClose(handle->zip);
-		}
+		if (handle->reader)
+			FS_ClosePackReader(handle->reader);
 	}
 
 	// Free the search paths
 	while (fs_searchPaths)
 	{
 		if (fs_searchPaths->pack)
-		{
-            pack = fs_searchPaths->pack;
-            
-            if (pack->pak)
-                fclose(pack->pak);
-            if (pack->pk3)
-                unzClose(pack->pk3);
-            
-            Q_STFree(&pack->fileNames);
-            Z_Free(pack->files);
-            Z_Free(pack);
-        }
+			FS_FreePack(fs_searchPaths->pack);
         next = fs_searchPaths->next;
 		Z_Free(fs_searchPaths);
 		fs_searchPaths = next;
 	}
+
+	FS_FreeLookups();
+	FS_FreePackReaders();
 }
 
 
@@ -1827,24 +3217,21 @@ void FS_SetGamedir (const char *dir)
 		return;
 	}
 
+	// the loader may be reading from the paths about to go
+	FS_ClearPrefetch ();
+
 	//
 	// free up any current game dir info
 	//
 	while (fs_searchPaths != fs_baseSearchPaths)
 	{
 		if (fs_searchPaths->pack)
-		{
-			if (fs_searchPaths->pack->pak)
-				fclose(fs_searchPaths->pack->pak);
-			if (fs_searchPaths->pack->pk3)
-				unzClose(fs_searchPaths->pack->pk3);
-			Z_Free (fs_searchPaths->pack->files);
-			Z_Free (fs_searchPaths->pack);
-		}
+			FS_FreePack (fs_searchPaths->pack);
 		next = fs_searchPaths->next;
 		Z_Free (fs_searchPaths);
 		fs_searchPaths = next;
 	}
+	fs_lookupDirty = true;
 
 	//
 	// flush all data, so it will be forced to reload
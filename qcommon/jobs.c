@@ -0,0 +1,197 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// jobs.c -- small worker pool for splitting per-frame work across cpus
+
+#include "qcommon.h"
+
+#define	MAX_JOB_WORKERS	16
+
+typedef struct
+{
+	void		*threads[MAX_JOB_WORKERS];
+	int32_t			numworkers;
+
+	void		*start;			// posted once per worker for each batch
+	void		*done;			// posted by each worker when a batch runs dry
+	qboolean	quit;
+
+	// current batch
+	void		(*func)(void *data, int32_t index);
+	void		*data;
+	int32_t			count;
+	volatile int32_t	next;	// next index to hand out
+} jobpool_t;
+
+static jobpool_t	jobs;
+
+cvar_t	*sys_workers;
+
+/*
+=================
+Job_RunBatch
+
+Pulls indices until the current batch is exhausted
+=================
+*/
+static void Job_RunBatch (void)
+{
+	int32_t		index;
+
+	Prof_Begin ("Job_RunBatch");
+	while (1)
+	{
+		index = Sys_AtomicAdd (&jobs.next, 1);
+		if (index >= jobs.count)
+			break;
+		jobs.func (jobs.data, index);
+	}
+	Prof_End ();
+}
+
+/*
+=================
+Job_Worker
+=================
+*/
+static int32_t Job_Worker (void *unused)
+{
+	while (1)
+	{
+		Sys_SemaphoreWait (jobs.start);
+		if (jobs.quit)
+			break;
+		Job_RunBatch ();
+		Sys_SemaphorePost (jobs.done);
+	}
+	return 0;
+}
+
+/*
+=================
+Job_Init
+
+sys_workers -1 picks one worker less than the cpu count,
+0 runs every batch on the calling thread
+=================
+*/
+void Job_Init (void)
+{
+	int32_t		i, count;
+
+	sys_workers = Cvar_Get ("sys_workers", "-1", CVAR_ARCHIVE|CVAR_LATCH);
+
+	count = (int32_t)sys_workers->value;
+	if (count < 0)
+		count = Sys_CPUCount() - 1;
+	if (count > MAX_JOB_WORKERS)
+		count = MAX_JOB_WORKERS;
+	if (count <= 0)
+		return;
+
+	jobs.start = Sys_CreateSemaphore (0);
+	jobs.done = Sys_CreateSemaphore (0);
+	if (!jobs.start || !jobs.done)
+	{
+		Job_Shutdown ();
+		return;
+	}
+
+	for (i=0 ; i<count ; i++)
+	{
+		jobs.threads[i] = Sys_CreateThread (Job_Worker, NULL, va("worker%i", i));
+		if (!jobs.threads[i])
+			break;
+		jobs.numworkers++;
+	}
+
+	Com_Printf ("%i job workers\n", jobs.numworkers);
+}
+
+/*
+=================
+Job_Shutdown
+=================
+*/
+void Job_Shutdown (void)
+{
+	int32_t		i;
+
+	jobs.quit = true;
+	for (i=0 ; i<jobs.numworkers ; i++)
+		Sys_SemaphorePost (jobs.start);
+	for (i=0 ; i<jobs.numworkers ; i++)
+		Sys_WaitThread (jobs.threads[i]);
+
+	if (jobs.start)
+		Sys_DestroySemaphore (jobs.start);
+	if (jobs.done)
+		Sys_DestroySemaphore (jobs.done);
+	memset (&jobs, 0, sizeof(jobs));
+}
+
+/*
+=================
+Job_NumWorkers
+=================
+*/
+int32_t Job_NumWorkers (void)
+{
+	return jobs.numworkers;
+}
+
+/*
+=================
+Job_ParallelFor
+
+Calls func once for every index in [0, count), spread over the workers
+and the calling thread, and returns when all of them are done.
+The order the indices run in is not defined, and func must not print,
+error out or start another batch.
+=================
+*/
+void Job_ParallelFor (void (*func)(void *data, int32_t index), void *data, int32_t count)
+{
+	int32_t		i, wake;
+
+	if (count <= 0)
+		return;
+
+	if (!jobs.numworkers || count == 1)
+	{
+		for (i=0 ; i<count ; i++)
+			func (data, i);
+		return;
+	}
+
+	jobs.func = func;
+	jobs.data = data;
+	jobs.count = count;
+	jobs.next = 0;
+
+	// no point waking more workers than there are indices left
+	wake = min(jobs.numworkers, count - 1);
+	for (i=0 ; i<wake ; i++)
+		Sys_SemaphorePost (jobs.start);
+
+	Job_RunBatch ();
+
+	for (i=0 ; i<wake ; i++)
+		Sys_SemaphoreWait (jobs.done);
+}
@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon.h"
+#include "zip/zlib.h"
 
 /*
 
@@ -72,15 +73,47 @@ If there is no information that needs to be transfered on a given frame,
 such as during the connection stage while waiting for the client to load,
 then a packet only needs to be delivered if there is something in the
 unacknowledged reliable
+
+
+When both sides offer NETCHAN_ZLIB in the connect handshake, the reliable
+payload is preceded by a long holding its stored length in the low 16 bits
+and its unpacked length in the high 16 bits.  If the two differ the
+payload is a raw deflate stream.  Netchan_Process unpacks it in place, so
+the rest of the engine never sees the difference.
+
+When both sides offer NETCHAN_FRAG, messages can grow to MAX_NETCHAN_MSGLEN.
+Anything past NET_FRAGMENT_SIZE after the header goes out as a run of
+datagrams sharing one sequence number with FRAGMENT_BIT set.  Each one
+carries a long with the fragment's offset in the low 16 bits and its length
+in the high 16 bits, and a fragment shorter than NET_FRAGMENT_SIZE ends the
+message.  If a fragment goes missing, the whole message is dropped, like any
+other lost packet, and the reliable part is retransmitted.
 */
 
+#define	NET_COMPRESS_MIN	128		// smaller reliables aren't worth deflating
+#define	NET_FRAGMENT_SIZE	1200	// fragment payload, safe for any sane mtu
+#define	FRAGMENT_BIT		(1u<<30)
+
+// where the buffers are in large_bufs
+#define	LARGE_RELIABLE		(MAX_NETCHAN_MSGLEN-16)
+#define	LARGE_FRAGMENT		(2*(MAX_NETCHAN_MSGLEN-16))
+#define	LARGE_SIZE			(2*(MAX_NETCHAN_MSGLEN-16) + MAX_NETCHAN_MSGLEN)
+
 cvar_t		*showpackets;
 cvar_t		*showdrop;
 cvar_t		*qport;
+cvar_t		*net_compress;
+cvar_t		*net_fragment;
 
 netadr_t	net_from;
 sizebuf_t	net_message;
-byte		net_message_buffer[MAX_MSGLEN];
+byte		net_message_buffer[MAX_NETCHAN_MSGLEN];
+
+static z_stream	net_deflate;
+static z_stream	net_inflate;
+static qboolean	net_deflateInit;
+static qboolean	net_inflateInit;
+static byte		net_zscratch[MAX_NETCHAN_MSGLEN];
 
 /*
 ===============
@@ -98,6 +131,8 @@ void Netchan_Init (void)
 	showpackets = Cvar_Get ("showpackets", "0", 0);
 	showdrop = Cvar_Get ("showdrop", "0", 0);
 	qport = Cvar_Get ("qport", va("%i", port), CVAR_NOSET);
+	net_compress = Cvar_Get ("net_compress", "1", CVAR_ARCHIVE);
+	net_fragment = Cvar_Get ("net_fragment", "1", CVAR_ARCHIVE);
 }
 
 /*
@@ -152,6 +187,7 @@ called to open a channel to a remote system
 */
 void Netchan_Setup (netsrc_t sock, netchan_t *chan, netadr_t adr, int32_t qport)
 {
+	Netchan_Free (chan);
 	memset (chan, 0, sizeof(*chan));
 	
 	chan->sock = sock;
@@ -161,10 +197,79 @@ void Netchan_Setup (netsrc_t sock, netchan_t *chan, netadr_t adr, int32_t qport)
 	chan->incoming_sequence = 0;
 	chan->outgoing_sequence = 1;
 
-	SZ_Init (&chan->message, chan->message_buf, sizeof(chan->message_buf));
+	SZ_Init (&chan->message, chan->message_buf, MAX_MSGLEN-16);
 	chan->message.allowoverflow = true;
 }
 
+/*
+==============
+Netchan_EnableFragments
+
+Lets the channel build messages past one packet, once both
+sides agreed on NETCHAN_FRAG
+==============
+*/
+void Netchan_EnableFragments (netchan_t *chan)
+{
+	if (!chan->large_bufs)
+		chan->large_bufs = Z_Malloc (LARGE_SIZE);
+	memcpy (chan->large_bufs, chan->message.data, chan->message.cursize);
+	memcpy (chan->large_bufs + LARGE_RELIABLE, chan->reliable_buf, chan->reliable_length);
+
+	chan->fragment = true;
+	chan->message.data = chan->large_bufs;
+	chan->message.maxsize = MAX_NETCHAN_MSGLEN-16;
+}
+
+/*
+==============
+Netchan_Free
+
+Frees what Netchan_EnableFragments allocated.  The channel can't be
+used again until Netchan_Setup.
+==============
+*/
+void Netchan_Free (netchan_t *chan)
+{
+	if (!chan->large_bufs)
+		return;
+
+	Z_Free (chan->large_bufs);
+	chan->large_bufs = NULL;
+	chan->fragment = false;
+	SZ_Init (&chan->message, chan->message_buf, MAX_MSGLEN-16);
+	chan->message.allowoverflow = true;
+	chan->reliable_length = 0;
+}
+
+/*
+==============
+Netchan_ReliableBuf
+==============
+*/
+static byte *Netchan_ReliableBuf (netchan_t *chan)
+{
+	return chan->large_bufs ? chan->large_bufs + LARGE_RELIABLE : chan->reliable_buf;
+}
+
+/*
+==============
+Netchan_HasExtension
+
+Returns true if name is one of the command arguments from firstarg on,
+which is where connect and client_connect list the extensions
+==============
+*/
+qboolean Netchan_HasExtension (const char *name, int32_t firstarg)
+{
+	int32_t		i;
+
+	for (i=firstarg ; i<Cmd_Argc() ; i++)
+		if (!strcmp (Cmd_Argv(i), name))
+			return true;
+	return false;
+}
+
 
 /*
 ===============
@@ -201,6 +306,206 @@ qboolean Netchan_NeedReliable (netchan_t *chan)
 	return send_reliable;
 }
 
+/*
+===============
+Netchan_StoreReliable
+
+Moves the pending message into the reliable buffer, deflating it on
+channels that agreed to compression
+===============
+*/
+static void Netchan_StoreReliable (netchan_t *chan)
+{
+	int32_t		length;
+
+	length = chan->message.cursize;
+	chan->reliable_length = length;
+	chan->reliable_rawlength = length;
+
+	if (chan->compress && length >= NET_COMPRESS_MIN)
+	{
+		if (net_deflateInit)
+			deflateReset (&net_deflate);
+		else if (deflateInit2 (&net_deflate, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+			-MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+			net_deflateInit = true;
+
+		if (net_deflateInit)
+		{
+			// only keep the result if it actually came out smaller
+			net_deflate.next_in = chan->message.data;
+			net_deflate.avail_in = length;
+			net_deflate.next_out = Netchan_ReliableBuf (chan);
+			net_deflate.avail_out = length - 1;
+			if (deflate (&net_deflate, Z_FINISH) == Z_STREAM_END)
+			{
+				chan->reliable_length = net_deflate.total_out;
+				return;
+			}
+		}
+	}
+
+	memcpy (Netchan_ReliableBuf (chan), chan->message.data, length);
+}
+
+/*
+===============
+Netchan_UnpackReliable
+
+Replaces a compressed channel's reliable payload in msg with its
+unpacked contents, keeping the unreliable tail after it
+===============
+*/
+static qboolean Netchan_UnpackReliable (netchan_t *chan, sizebuf_t *msg)
+{
+	uint32_t	lengths;
+	int32_t		start, stored, raw, tail;
+
+	start = msg->readcount;
+	lengths = MSG_ReadLong (msg);
+	stored = lengths & 0xffff;
+	raw = lengths >> 16;
+	tail = msg->cursize - msg->readcount - stored;
+
+	if (msg->readcount > msg->cursize || tail < 0 || stored > raw
+		|| start + raw + tail > msg->maxsize)
+	{
+		Com_Printf ("%s:Bad reliable header\n", NET_AdrToString (chan->remote_address));
+		return false;
+	}
+
+	memcpy (net_zscratch, msg->data + msg->readcount, stored + tail);
+
+	if (stored == raw)
+		memcpy (msg->data + start, net_zscratch, stored);
+	else
+	{
+		if (net_inflateInit)
+			inflateReset (&net_inflate);
+		else if (inflateInit2 (&net_inflate, -MAX_WBITS) == Z_OK)
+			net_inflateInit = true;
+		else
+			return false;
+
+		net_inflate.next_in = net_zscratch;
+		net_inflate.avail_in = stored;
+		net_inflate.next_out = msg->data + start;
+		net_inflate.avail_out = raw;
+		if (inflate (&net_inflate, Z_FINISH) != Z_STREAM_END || net_inflate.total_out != raw)
+		{
+			Com_Printf ("%s:Corrupt compressed reliable\n", NET_AdrToString (chan->remote_address));
+			return false;
+		}
+	}
+
+	memcpy (msg->data + start + raw, net_zscratch + stored, tail);
+	msg->cursize = start + raw + tail;
+	msg->readcount = start;
+	return true;
+}
+
+/*
+===============
+Netchan_SendFragments
+
+Sends everything after the header of send as a run of fragments
+===============
+*/
+static void Netchan_SendFragments (netchan_t *chan, sizebuf_t *send, int32_t header, uint32_t w1)
+{
+	sizebuf_t	frag;
+	byte		frag_buf[PACKET_HEADER + 4 + NET_FRAGMENT_SIZE];
+	int32_t		offset, length, total;
+
+	total = send->cursize - header;
+	offset = 0;
+
+	do
+	{
+		length = min(total - offset, NET_FRAGMENT_SIZE);
+
+		SZ_Init (&frag, frag_buf, sizeof(frag_buf));
+		MSG_WriteLong (&frag, w1 | FRAGMENT_BIT);
+		SZ_Write (&frag, send->data + 4, header - 4);
+		MSG_WriteLong (&frag, offset | ((uint32_t)length << 16));
+		SZ_Write (&frag, send->data + header + offset, length);
+
+		NET_SendPacket (chan->sock, frag.cursize, frag.data, chan->remote_address);
+		offset += length;
+	} while (length == NET_FRAGMENT_SIZE);	// a short one ends the message
+}
+
+/*
+===============
+Netchan_AddFragment
+
+Gathers a fragment into the channel.  Returns true once the message is
+complete, with msg rebuilt to hold all of it after the header.
+===============
+*/
+static qboolean Netchan_AddFragment (netchan_t *chan, sizebuf_t *msg, int32_t sequence)
+{
+	uint32_t	info;
+	int32_t		header, offset, length;
+
+	header = msg->readcount;
+	info = MSG_ReadLong (msg);
+	offset = info & 0xffff;
+	length = info >> 16;
+
+	if (msg->readcount + length > msg->cursize || length > NET_FRAGMENT_SIZE)
+	{
+		Com_Printf ("%s:Bad fragment\n", NET_AdrToString (chan->remote_address));
+		return false;
+	}
+
+	// a stray piece of an older message doesn't break the one being
+	// gathered, a new message throws away whatever was left of the last
+	if (sequence < chan->fragment_sequence)
+	{
+		if (showdrop->value)
+			Com_Printf ("%s:Stale fragment of %i at %i\n"
+				, NET_AdrToString (chan->remote_address)
+				, sequence
+				, chan->fragment_sequence);
+		return false;
+	}
+	if (sequence != chan->fragment_sequence)
+	{
+		chan->fragment_sequence = sequence;
+		chan->fragment_length = 0;
+	}
+
+	// out of order or lost fragments kill the whole message
+	if (offset != chan->fragment_length)
+	{
+		if (showdrop->value)
+			Com_Printf ("%s:Dropped fragment(s) of %i\n"
+				, NET_AdrToString (chan->remote_address)
+				, sequence);
+		return false;
+	}
+
+	if (header + chan->fragment_length + length > msg->maxsize)
+	{
+		Com_Printf ("%s:Oversize fragmented message\n", NET_AdrToString (chan->remote_address));
+		chan->fragment_length = 0;
+		return false;
+	}
+
+	memcpy (chan->large_bufs + LARGE_FRAGMENT + chan->fragment_length, msg->data + msg->readcount, length);
+	chan->fragment_length += length;
+
+	if (length == NET_FRAGMENT_SIZE)
+		return false;		// more to come
+
+	memcpy (msg->data + header, chan->large_bufs + LARGE_FRAGMENT, chan->fragment_length);
+	msg->cursize = header + chan->fragment_length;
+	msg->readcount = header;
+	chan->fragment_length = 0;
+	return true;
+}
+
 /*
 ===============
 Netchan_Transmit
@@ -214,9 +519,11 @@ A 0 length will still generate a packet and deal with the reliable messages.
 void Netchan_Transmit (netchan_t *chan, int32_t length, byte *data)
 {
 	sizebuf_t	send;
-	byte		send_buf[MAX_MSGLEN];
+	byte		send_buf[MAX_NETCHAN_MSGLEN];
 	qboolean	send_reliable;
 	uint32_t	w1, w2;
+	int32_t		unpacked;
+	int32_t		header;
 
 // check for message overflow
 	if (chan->message.overflowed)
@@ -231,17 +538,16 @@ void Netchan_Transmit (netchan_t *chan, int32_t length, byte *data)
 
 	if (!chan->reliable_length && chan->message.cursize)
 	{
-		memcpy (chan->reliable_buf, chan->message_buf, chan->message.cursize);
-		chan->reliable_length = chan->message.cursize;
+		Netchan_StoreReliable (chan);
 		chan->message.cursize = 0;
 		chan->reliable_sequence ^= 1;
 	}
 
 
 // write the packet header
-	SZ_Init (&send, send_buf, sizeof(send_buf));
+	SZ_Init (&send, send_buf, chan->fragment ? sizeof(send_buf) : MAX_MSGLEN);
 
-	w1 = ( chan->outgoing_sequence & ~(1<<31) ) | (send_reliable<<31);
+	w1 = ( chan->outgoing_sequence & ~(chan->fragment ? (3u<<30) : (1u<<31)) ) | (send_reliable<<31);
 	w2 = ( chan->incoming_sequence & ~(1<<31) ) | (chan->incoming_reliable_sequence<<31);
 
 	chan->outgoing_sequence++;
@@ -253,22 +559,34 @@ void Netchan_Transmit (netchan_t *chan, int32_t length, byte *data)
 	// send the qport if we are a client
 	if (chan->sock == NS_CLIENT)
 		MSG_WriteShort (&send, qport->value);
+	header = send.cursize;
 
 // copy the reliable message to the packet first
+	unpacked = send.cursize;
 	if (send_reliable)
 	{
-		SZ_Write (&send, chan->reliable_buf, chan->reliable_length);
+		if (chan->compress)
+		{
+			MSG_WriteLong (&send, chan->reliable_length | ((uint32_t)chan->reliable_rawlength << 16));
+			unpacked += chan->reliable_rawlength;
+		}
+		SZ_Write (&send, Netchan_ReliableBuf (chan), chan->reliable_length);
 		chan->last_reliable_sequence = chan->outgoing_sequence;
 	}
-	
-// add the unreliable part if space is available
-	if (send.maxsize - send.cursize >= length)
+	unpacked = max(unpacked, send.cursize);
+
+// add the unreliable part if space is available, counting
+// the reliable at the size the remote side will unpack it to
+	if (send.maxsize - unpacked >= length)
 		SZ_Write (&send, data, length);
 	else
 		Com_Printf ("Netchan_Transmit: dumped unreliable\n");
 
 // send the datagram
-	NET_SendPacket (chan->sock, send.cursize, send.data, chan->remote_address);
+	if (chan->fragment && send.cursize - header > NET_FRAGMENT_SIZE)
+		Netchan_SendFragments (chan, &send, header, w1);
+	else
+		NET_SendPacket (chan->sock, send.cursize, send.data, chan->remote_address);
 
 	if (showpackets->value)
 	{
@@ -301,6 +619,7 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 	uint32_t	sequence, sequence_ack;
 	uint32_t	reliable_ack, reliable_message;
 	int32_t			qport;
+	qboolean	fragmented;
 
 // get sequence numbers		
 	MSG_BeginReading (msg);
@@ -313,8 +632,9 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 
 	reliable_message = sequence >> 31;
 	reliable_ack = sequence_ack >> 31;
+	fragmented = chan->fragment && (sequence & FRAGMENT_BIT);
 
-	sequence &= ~(1<<31);
+	sequence &= ~(chan->fragment ? (3u<<30) : (1u<<31));
 	sequence_ack &= ~(1<<31);	
 
 	if (showpackets->value)
@@ -347,6 +667,19 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 		return false;
 	}
 
+//
+// gather fragments until the message is whole
+//
+	if (fragmented && !Netchan_AddFragment (chan, msg, sequence))
+		return false;
+
+//
+// unpack a compressed reliable before any of the state changes,
+// so a bad one is dropped like any other bad packet
+//
+	if (reliable_message && chan->compress && !Netchan_UnpackReliable (chan, msg))
+		return false;
+
 //
 // dropped packets don't keep the message from being used
 //
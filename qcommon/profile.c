@@ -0,0 +1,295 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// profile.c -- named zone profiler
+//
+// While prof_enable is set, Prof_Begin / Prof_End record nanosecond
+// timestamps into a ring owned by the calling thread, so only the last
+// PROF_RING_EVENTS events of each thread are kept.  "profile_dump" writes
+// them out in the Chrome trace event format, which chrome://tracing and
+// ui.perfetto.dev load directly.
+
+#include "qcommon.h"
+
+#define	MAX_PROF_THREADS	32
+#define	PROF_RING_EVENTS	65536		// must be a power of two
+
+#if defined(_MSC_VER)
+#define	PROF_THREADLOCAL	__declspec(thread)
+#else
+#define	PROF_THREADLOCAL	__thread
+#endif
+
+typedef struct
+{
+	uint64_t	time;
+	const char	*name;		// NULL ends the innermost zone
+} profevent_t;
+
+typedef struct
+{
+	qboolean			mainthread;
+	int32_t				depth;		// open zones
+	volatile uint32_t	head;		// events written, only the owner writes
+	profevent_t			*events;
+} profthread_t;
+
+static profthread_t		prof_threads[MAX_PROF_THREADS];
+static profthread_t		prof_nothread;		// for threads past MAX_PROF_THREADS
+static volatile int32_t	prof_numthreads;
+
+// set once per thread, so no thread ever looks at another's ring
+static PROF_THREADLOCAL profthread_t	*prof_thread;
+static PROF_THREADLOCAL qboolean		prof_ismain;
+
+cvar_t	*prof_enable;
+
+/*
+=================
+Prof_Thread
+
+Finds the ring of the calling thread, creating it on the first event.
+This can run on any thread, so the ring comes from malloc instead of
+the zone.
+=================
+*/
+static profthread_t *Prof_Thread (void)
+{
+	int32_t			i;
+	profthread_t	*t;
+
+	t = prof_thread;
+	if (!t)
+	{
+		i = Sys_AtomicAdd (&prof_numthreads, 1);
+		if (i < MAX_PROF_THREADS)
+		{
+			t = &prof_threads[i];
+			t->mainthread = prof_ismain;
+			t->events = malloc (sizeof(profevent_t) * PROF_RING_EVENTS);
+		}
+		else
+			t = &prof_nothread;
+		prof_thread = t;
+	}
+
+	return t->events ? t : NULL;
+}
+
+/*
+=================
+Prof_Record
+=================
+*/
+static void Prof_Record (profthread_t *t, const char *name)
+{
+	profevent_t	*ev;
+
+	ev = &t->events[t->head & (PROF_RING_EVENTS-1)];
+	ev->time = Sys_Nanoseconds ();
+	ev->name = name;
+	t->head++;
+}
+
+/*
+=================
+Prof_Begin
+=================
+*/
+void Prof_Begin (const char *name)
+{
+	profthread_t	*t;
+
+	if (!prof_enable || !prof_enable->value)
+		return;
+	if ( (t = Prof_Thread ()) == NULL )
+		return;
+
+	t->depth++;
+	Prof_Record (t, name);
+}
+
+/*
+=================
+Prof_End
+
+Ends without a matching begin, like those from before prof_enable
+was set, are dropped
+=================
+*/
+void Prof_End (void)
+{
+	profthread_t	*t;
+
+	if (!prof_enable || !prof_enable->value)
+		return;
+	if ( (t = Prof_Thread ()) == NULL || !t->depth )
+		return;
+
+	t->depth--;
+	Prof_Record (t, NULL);
+}
+
+/*
+=================
+Prof_EndAll
+
+Closes every zone of the calling thread, for when a Com_Error
+longjmps out of them
+=================
+*/
+void Prof_EndAll (void)
+{
+	profthread_t	*t;
+
+	if (!prof_enable || !prof_enable->value)
+		return;
+	if ( (t = Prof_Thread ()) == NULL )
+		return;
+
+	while (t->depth)
+	{
+		t->depth--;
+		Prof_Record (t, NULL);
+	}
+}
+
+/*
+=================
+Prof_Dump_f
+
+profile_dump [file]
+
+Timestamps are written relative to the oldest event still held so the
+trace starts at zero.  The other threads keep recording while this runs,
+events they write past the head read here are simply not included.
+=================
+*/
+static void Prof_Dump_f (void)
+{
+	char			name[MAX_OSPATH];
+	FILE			*f;
+	int32_t			i, count, depth, threads, written;
+	uint32_t		j, first, head[MAX_PROF_THREADS];
+	uint64_t		base;
+	profthread_t	*t;
+	profevent_t		*ev;
+
+	if (Cmd_Argc() > 2)
+	{
+		Com_Printf ("usage: profile_dump [file]\n");
+		return;
+	}
+
+	count = min(prof_numthreads, MAX_PROF_THREADS);
+	base = (uint64_t)-1;
+	for (i=0, t=prof_threads ; i<count ; i++, t++)
+	{
+		head[i] = t->events ? t->head : 0;
+		first = head[i] > PROF_RING_EVENTS ? head[i] - PROF_RING_EVENTS : 0;
+		if (first != head[i] && t->events[first & (PROF_RING_EVENTS-1)].time < base)
+			base = t->events[first & (PROF_RING_EVENTS-1)].time;
+	}
+	if (base == (uint64_t)-1)
+	{
+		Com_Printf ("Nothing recorded, set prof_enable 1 first.\n");
+		return;
+	}
+
+	Com_sprintf (name, sizeof(name), "%s/%s", FS_Gamedir(), (Cmd_Argc() == 2) ? Cmd_Argv(1) : "profile.json");
+	FS_CreatePath (name);
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Com_Printf ("Couldn't open %s\n", name);
+		return;
+	}
+
+	fprintf (f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	threads = written = 0;
+	for (i=0, t=prof_threads ; i<count ; i++, t++)
+	{
+		if (!head[i])
+			continue;
+
+		fprintf (f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%i,\"args\":{\"name\":\"%s\"}}",
+			threads++ ? ",\n" : "", i, t->mainthread ? "main" : va("thread %i", i));
+
+		// the ring may have wrapped in the middle of a zone
+		depth = 0;
+		first = head[i] > PROF_RING_EVENTS ? head[i] - PROF_RING_EVENTS : 0;
+		for (j=first ; j != head[i] ; j++)
+		{
+			ev = &t->events[j & (PROF_RING_EVENTS-1)];
+			if (ev->name)
+			{
+				depth++;
+				fprintf (f, ",\n{\"name\":\"%s\",\"ph\":\"B\",\"pid\":0,\"tid\":%i,\"ts\":%.3f}",
+					ev->name, i, (ev->time - base) / 1000.0);
+				written++;
+			}
+			else if (depth)
+			{
+				depth--;
+				fprintf (f, ",\n{\"ph\":\"E\",\"pid\":0,\"tid\":%i,\"ts\":%.3f}",
+					i, (ev->time - base) / 1000.0);
+				written++;
+			}
+		}
+	}
+	fprintf (f, "\n]}\n");
+	fclose (f);
+
+	Com_Printf ("Wrote %i events to %s\n", written, name);
+}
+
+/*
+=================
+Prof_Init
+=================
+*/
+void Prof_Init (void)
+{
+	prof_enable = Cvar_Get ("prof_enable", "0", 0);
+	prof_ismain = true;
+	Sys_Nanoseconds ();		// set the time base on this thread
+
+	Cmd_AddCommand ("profile_dump", Prof_Dump_f);
+}
+
+/*
+=================
+Prof_Shutdown
+
+Every other thread must have exited
+=================
+*/
+void Prof_Shutdown (void)
+{
+	int32_t		i;
+
+	for (i=0 ; i<MAX_PROF_THREADS ; i++)
+	{
+		if (prof_threads[i].events)
+			free (prof_threads[i].events);
+	}
+	memset (prof_threads, 0, sizeof(prof_threads));
+	prof_numthreads = 0;
+	prof_thread = NULL;
+}
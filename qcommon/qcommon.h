@@ -58,6 +58,7 @@ typedef struct sizebuf_s
 {
 	qboolean	allowoverflow;	// if false, do a Com_Error
 	qboolean	overflowed;		// set to true if the buffer size failed
+	qboolean	quiet;			// overflow without printing, the owner reports it
 	byte	*data;
 	int32_t		maxsize;
 	int32_t		cursize;
@@ -589,6 +590,10 @@ NET
 
 #define	PACKET_HEADER	10			// two ints and a int16_t
 
+// channels that agreed on NETCHAN_FRAG carry messages up to this size,
+// split into mtu sized fragments on the wire
+#define	MAX_NETCHAN_MSGLEN	0x10000
+
 typedef enum {NA_LOOPBACK, NA_BROADCAST, NA_IP, NA_IPX, NA_BROADCAST_IPX} netadrtype_t;
 
 typedef enum {NS_CLIENT, NS_SERVER} netsrc_t;
@@ -610,6 +615,8 @@ void		NET_Config (qboolean multiplayer);
 
 qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message);
 void		NET_SendPacket (netsrc_t sock, int32_t length, void *data, netadr_t to);
+void		NET_BeginBatch (netsrc_t sock);		// queue sends until NET_FlushPackets
+void		NET_FlushPackets (netsrc_t sock);
 
 qboolean	NET_CompareAdr (netadr_t a, netadr_t b);
 qboolean	NET_CompareBaseAdr (netadr_t a, netadr_t b);
@@ -637,6 +644,8 @@ typedef struct
 
 	netadr_t	remote_address;
 	int32_t			qport;				// qport value to write when transmitting
+	qboolean	compress;			// reliables go out deflated, agreed on at connect
+	qboolean	fragment;			// messages may be split, agreed on at connect
 
 // sequencing variables
 	int32_t			incoming_sequence;
@@ -655,12 +664,29 @@ typedef struct
 
 // message is copied to this buffer when it is first transfered
 	int32_t			reliable_length;
+	int32_t			reliable_rawlength;		// reliable_length before compression
 	byte		reliable_buf[MAX_MSGLEN-16];	// unacked reliable message
+
+// fragments of the incoming message are gathered here
+	int32_t			fragment_sequence;
+	int32_t			fragment_length;
+
+// only fragmenting channels have room for messages past MAX_MSGLEN,
+// allocated by Netchan_EnableFragments and freed by Netchan_Free:
+// the message, the reliable and the fragments, in that order
+	byte		*large_bufs;
 } netchan_t;
 
+// connect / client_connect arguments that offer and accept extensions
+#define	NETCHAN_ZLIB	"zlib"		// deflated reliables
+#define	NETCHAN_FRAG	"frag"		// messages larger than one packet
+
+extern	cvar_t		*net_compress;
+extern	cvar_t		*net_fragment;
+
 extern	netadr_t	net_from;
 extern	sizebuf_t	net_message;
-extern	byte		net_message_buffer[MAX_MSGLEN];
+extern	byte		net_message_buffer[MAX_NETCHAN_MSGLEN];
 
 
 void Netchan_Init (void);
@@ -673,6 +699,9 @@ void Netchan_OutOfBandPrint (int32_t net_socket, netadr_t adr, char *format, ...
 qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg);
 
 qboolean Netchan_CanReliable (netchan_t *chan);
+qboolean Netchan_HasExtension (const char *name, int32_t firstarg);
+void Netchan_EnableFragments (netchan_t *chan);
+void Netchan_Free (netchan_t *chan);
 
 
 /*
@@ -709,8 +738,37 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 						  int32_t headnode, int32_t brushmask,
 						  vec3_t origin, vec3_t angles);
 
+// all the state of a trace in progress, so traces on different contexts
+// can run at the same time.  A zero filled context is ready to use, and
+// the plain CM_ functions above share a single internal one.
+typedef struct
+{
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		extents;
+	trace_t		trace;
+	int32_t			contents;
+	qboolean	ispoint;		// optimized case
+
+	cplane_t	boxplanes[12];	// private copy of the box hull
+	int32_t			checkcount;
+	int32_t			brushchecks[MAX_MAP_BRUSHES];	// to avoid repeated testings
+} cmtrace_t;
+
+int32_t			CM_HeadnodeForBoxCtx (cmtrace_t *ctx, vec3_t mins, vec3_t maxs);
+trace_t		CM_BoxTraceCtx (cmtrace_t *ctx, const vec3_t start, const vec3_t end,
+						  const vec3_t mins, const vec3_t maxs,
+						  const int32_t headnode, const int32_t brushmask);
+trace_t		CM_TransformedBoxTraceCtx (cmtrace_t *ctx, vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int32_t headnode, int32_t brushmask,
+						  vec3_t origin, vec3_t angles);
+
 byte		*CM_ClusterPVS (int32_t cluster);
 byte		*CM_ClusterPHS (int32_t cluster);
+byte		*CM_ClusterPVSInto (int32_t cluster, byte *buffer);
+byte		*CM_ClusterPHSInto (int32_t cluster, byte *buffer);
+byte		*CM_SharedClusterPVS (const char *mapname, int32_t cluster, int32_t clusters);
 
 int32_t			CM_PointLeafnum (vec3_t p);
 
@@ -732,6 +790,36 @@ qboolean	CM_HeadnodeVisible (int32_t headnode, byte *visbits);
 void		CM_WritePortalState (FILE *f);
 
 
+/*
+==============================================================
+
+BIT VECTORS
+
+Kernels for pvs / phs sized rows, vectorized where the build allows
+
+==============================================================
+*/
+
+void		Bits_Or (byte *dst, const byte *src, int32_t bytes);
+const char	*Bits_Path (void);
+void		Bits_Bench_f (void);
+
+// true if any of the count bit numbers in indices is set; this is a
+// handful of scattered lookups, so it stays scalar and inline
+static FORCE_INLINE qboolean Bits_TestAny (const byte *bits, const int32_t *indices, int32_t count)
+{
+	int32_t		i, n;
+
+	for (i=0 ; i<count ; i++)
+	{
+		n = indices[i];
+		if (bits[n >> 3] & (1 << (n & 7)))
+			return true;
+	}
+	return false;
+}
+
+
 /*
 ==============================================================
 
@@ -804,6 +892,7 @@ void		FS_CopyFile (const char *srcPath, const char *dstPath);
 void		FS_RenameFile (const char *oldPath, const char *newPath);
 void		FS_DeleteFile (const char *path);
 void		FS_CreatePath (char *path);
+void		FS_FlushLookupCache (void);
 void		FS_DeletePath (char *path);
 const char	*FS_NextPath (const char *prevPath);
 const char  *FS_NextGamePath (const char *prevPath);
@@ -818,6 +907,7 @@ int32_t     FS_CountFiles (char *findname, uint32_t musthave, uint32_t canthave)
 int32_t     FS_CountFilesWithPaks(char *findname, uint32_t musthave, uint32_t canthave);
 void		FS_FreeFileList (char **list, int32_t n);
 qboolean	FS_ItemInList (char *check, int32_t num, char **list);
+void		Com_FileExtension (const char *path, char *dst, int32_t dstSize);
 void		FS_InsertInList (char **list, char *insert, int32_t len, int32_t start);
 void		FS_Dir_f (void);
 
@@ -829,10 +919,70 @@ void		FS_AddPK3File (const char *packPath); // add pk3 file function
 void		FS_SetGamedir (const char *dir);
 const char	*FS_Gamedir (void);
 void		FS_FreeFile (void *buffer);
+const void	*FS_MapFile (const char *path, int32_t *length);
+void		FS_UnmapFile (const void *data);
+
+// background reading of level assets
+typedef void	*(*fsPrefetchDecoder_t)(const char *name, const byte *data, int32_t length, int32_t *decodedLength);
+
+qboolean	FS_PrefetchFile (const char *name);
+void		FS_ClearPrefetch (void);
+void		FS_SetPrefetchDecoder (fsPrefetchDecoder_t decoder);
+int32_t			FS_LoadPrefetched (const char *path, void **buffer);
+void		*FS_TakeDecoded (const char *path);
 
 void FS_GetGameDirs(sset_t *output, qboolean requireGameLibrary);
 
 
+/*
+==============================================================
+
+DEMO INDEX
+
+A demo is the usual stream of length prefixed messages ended by -1.
+Seekable demos carry an index after that, which older players never
+read: keyframe offsets into the stream, then a log of configstring
+changes, then a fixed size trailer at the very end of the file.
+A keyframe is a stream message holding a full, non-delta frame.
+
+==============================================================
+*/
+
+#define	DEMO_INDEX_ID		(('X'<<24)+('D'<<16)+('M'<<8)+'D')	// "DMDX"
+#define	DEMO_TRAILER_SIZE	16
+
+typedef struct
+{
+	int32_t		time;			// msec, relative to the first keyframe
+	int32_t		offset;			// file offset of the keyframe message
+} demokeyframe_t;
+
+typedef struct
+{
+	int32_t		basetime;		// absolute time of the first keyframe
+	int32_t		numkeyframes;
+	int32_t		maxkeyframes;
+	demokeyframe_t	*keyframes;
+
+	// configstring changes: time, index, string, in the order they happened
+	byte		*log;
+	int32_t		logsize;
+	int32_t		maxlogsize;
+	byte		logged[(MAX_CONFIGSTRINGS+7)/8];	// start value already logged
+	qboolean	closed;			// the level it indexes has ended
+} demoindex_t;
+
+void		Demo_BeginIndex (demoindex_t *index);
+void		Demo_FreeIndex (demoindex_t *index);
+void		Demo_CloseIndex (demoindex_t *index);
+void		Demo_AddKeyframe (demoindex_t *index, int32_t time, int32_t offset);
+void		Demo_LogConfigstring (demoindex_t *index, int32_t time, int32_t num, const char *oldvalue, const char *newvalue);
+void		Demo_WriteIndex (demoindex_t *index, FILE *f);
+qboolean	Demo_ReadIndex (demoindex_t *index, fileHandle_t f, int32_t length);
+int32_t		Demo_FindKeyframe (demoindex_t *index, int32_t time);
+void		Demo_WriteConfigstrings (demoindex_t *index, int32_t time, sizebuf_t *msg);
+
+
 /*
 ==============================================================
 
@@ -853,7 +1003,7 @@ MISC
 #define	PRINT_ALL		0
 #define PRINT_DEVELOPER	1	// only print when "developer 1"
 
-void		Com_BeginRedirect (int32_t target, char *buffer, int32_t buffersize, void (*flush));
+void		Com_BeginRedirect (int32_t target, char *buffer, int32_t buffersize, void (*flush)(int32_t target, char *buffer));
 void		Com_EndRedirect (void);
 void 		Com_Printf (char *fmt, ...);
 void 		Com_DPrintf (char *fmt, ...);
@@ -988,6 +1138,34 @@ void Q_SSetReverseSort(sset_t *ss, qboolean caseSensitive);
 /*
 ==============================================================
 
+JOBS
+
+==============================================================
+*/
+
+void	Job_Init (void);
+void	Job_Shutdown (void);
+int32_t	Job_NumWorkers (void);
+void	Job_ParallelFor (void (*func)(void *data, int32_t index), void *data, int32_t count);
+
+/*
+==============================================================
+
+PROFILER
+
+==============================================================
+*/
+
+// zone names must outlive the profile, only the pointer is kept
+void	Prof_Init (void);
+void	Prof_Shutdown (void);
+void	Prof_Begin (const char *name);
+void	Prof_End (void);
+void	Prof_EndAll (void);
+
+/*
+==============================================================
+
 NON-PORTABLE SYSTEM SERVICES
 
 ==============================================================
@@ -1011,6 +1189,16 @@ char	*Sys_GetClipboardData( void );
 void    Sys_FreeClipboardData( char *cliptext );
 void	Sys_CopyProtect (void);
 
+// threads, only used through the job system
+int32_t	Sys_CPUCount (void);
+void	*Sys_CreateThread (int32_t (*func)(void *), void *data, const char *name);
+void	Sys_WaitThread (void *thread);
+void	*Sys_CreateSemaphore (int32_t value);
+void	Sys_DestroySemaphore (void *sem);
+void	Sys_SemaphoreWait (void *sem);
+void	Sys_SemaphorePost (void *sem);
+int32_t	Sys_AtomicAdd (volatile int32_t *value, int32_t add);
+
 /*
  ==============================================================
  
@@ -1031,6 +1219,7 @@ CLIENT / SERVER SYSTEMS
 
 void CL_Init (void);
 void CL_Drop (void);
+void CL_BenchAbort (const char *error);
 void CL_Shutdown (void);
 void CL_Frame (int32_t msec);
 void Con_Print (char *text);
@@ -1669,7 +1669,17 @@ size_t Q_strlcpy(char *dest, const char* src, size_t size)
 #ifdef _WIN32
 	return strcpy_s(dest, size, src);
 #else
-	return strlcpy(dest,src,size);
+	// glibc only has strlcpy from 2.38 on
+	size_t	len = strlen(src);
+
+	if (size)
+	{
+		size_t	n = (len >= size) ? size - 1 : len;
+
+		memcpy(dest, src, n);
+		dest[n] = 0;
+	}
+	return len;
 #endif
 }
 
@@ -1677,7 +1687,7 @@ size_t Q_strlcpy_lower(char *dest, const char* src, size_t size) {
 #ifdef _WIN32
     size_t s = strcpy_s(dest, size, src);
 #else
-	size_t s = strlcpy(dest, src, size);
+	size_t s = Q_strlcpy(dest, src, size);
 #endif
     Q_strlwr(dest);
     return s;
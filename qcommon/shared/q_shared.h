@@ -36,6 +36,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include <assert.h>
+#include <ctype.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -463,6 +464,7 @@ float	BigFloat (float l);
 float	LittleFloat (float l);
 
 void	Swap_Init (void);
+extern	qboolean	bigendien;	// set by Swap_Init
 char	*va(char *format, ...);
 
 //=============================================
@@ -490,6 +492,8 @@ SYSTEM SPECIFIC
 extern	int32_t	curtime;		// time returned by last Sys_Milliseconds
 
 int32_t		Sys_Milliseconds (void);
+uint64_t	Sys_Microseconds (void);
+uint64_t	Sys_Nanoseconds (void);
 void	Sys_Mkdir (char *path);
 void	Sys_Rmdir (char *path);
 
@@ -499,6 +503,16 @@ void	*Hunk_Alloc (int32_t size);
 void	Hunk_Free (void *buf);
 int32_t		Hunk_End (void);
 
+// read only mapping of a whole file, NULL if it can't be mapped
+void	*Sys_MapFile (const char *path, int32_t *length);
+void	Sys_UnmapFile (void *base, int32_t length);
+
+// positioned read that doesn't go through the stdio position or buffer,
+// so several readers can share one open file.  The os file position is
+// left undefined (windows moves it), so once a file is read this way
+// it must not be used with stdio any more
+int32_t	Sys_ReadFileAt (FILE *f, int32_t offset, void *buffer, int32_t length);
+
 // directory searching
 #define SFF_ARCH    0x01
 #define SFF_HIDDEN  0x02
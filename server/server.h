@@ -66,6 +66,10 @@ typedef struct
 	// demo server information
 	fileHandle_t demofile;
 	qboolean	timedemo;		// don't time sync
+	demoindex_t	demoindex;		// keyframes, if the demo has an index
+	int32_t		demokey;		// last keyframe played past, -1 before the first
+	int32_t		demotime;		// msec from the first keyframe, for demoseek
+	qboolean	demoseeking;	// keyframe waits for the seek's configstrings to arrive
 } server_t;
 
 #define EDICT_NUM(n) ((edict_t *)((byte *)ge->edicts + ge->edict_size*(n)))
@@ -114,6 +118,9 @@ typedef struct client_s
 	int32_t				surpressCount;		// number of messages rate supressed
 
 	edict_t			*edict;				// EDICT_NUM(clientnum+1)
+	int32_t				leafnum;			// leaf of edict->s.origin as of the
+	int32_t				cluster;			// last SV_LinkEdict, for multicasts
+	int32_t				area;
 	char			name[32];			// extracted from userinfo, high bits masked
     hash32_t        nameHash;
 	int32_t				messagelevel;		// for filtering printed messages
@@ -158,6 +165,24 @@ typedef struct
 } challenge_t;
 
 
+#define	MAX_DELTA_BYTES		96		// largest possible MSG_WriteDeltaEntity output
+
+// the last state of an edict the delta pass saw, with the bytes
+// MSG_WriteDeltaEntity gives for it against its previous state and
+// against itself, so clients whose delta base is one of those two
+// can copy them instead of encoding the entity again
+typedef struct
+{
+	entity_state_t	state;
+	uint32_t	version;				// stamp of state, 0 if not cached
+	uint32_t	prev_version;			// stamp of the state before it
+
+	int32_t		changed_length;			// prev_version -> version, -1 if none
+	int32_t		same_length;			// version -> version, -1 if none
+	byte		changed[MAX_DELTA_BYTES];
+	byte		same[MAX_DELTA_BYTES];
+} entitydelta_t;
+
 typedef struct
 {
 	qboolean	initialized;				// sv_init has completed
@@ -172,6 +197,15 @@ typedef struct
 	int32_t			num_client_entities;		// maxclients->value*UPDATE_BACKUP*MAX_PACKET_ENTITIES
 	int32_t			next_client_entities;		// next client_entity to use
 	entity_state_t	*client_entities;		// [num_client_entities]
+	uint32_t	*client_entity_versions;	// [num_client_entities], 0 if not cached
+
+	// encoded deltas shared by every client, see SV_UpdateEntityDeltas
+	entitydelta_t	*entity_deltas;			// [MAX_EDICTS]
+	uint32_t	entity_version;				// last stamp handed out
+
+	// scratch space for building client frames on the job workers
+	int16_t		*frame_entities;		// [maxclients->value*MAX_EDICTS]
+	byte		*frame_msgbufs;			// [maxclients->value*MAX_MSGLEN]
 
 	int32_t			last_heartbeat;
 
@@ -179,6 +213,8 @@ typedef struct
 
 	// serverrecord values
 	FILE		*demofile;
+	demoindex_t	demoindex;
+	int32_t		demonextkey;				// sv.time of the next keyframe, -1 for none
 	sizebuf_t	demo_multicast;
 	byte		demo_multicast_buf[MAX_MSGLEN];
 } server_static_t;
@@ -199,6 +235,9 @@ extern	cvar_t		*sv_noreload;			// don't reload level state when reentering
 extern	cvar_t		*sv_airaccelerate;		// don't reload level state when reentering
 											// development tool
 extern	cvar_t		*sv_enforcetime;
+extern	cvar_t		*sv_parallelframes;		// build client frames on the job workers
+extern	cvar_t		*sv_deltacache;			// share encoded entity deltas between clients
+extern	cvar_t		*sv_demokeyframes;		// seconds between serverrecord keyframes, 0 for none
 
 extern	client_t	*sv_client;
 extern	edict_t		*sv_player;
@@ -290,6 +329,10 @@ void SV_Status_f (void);
 void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg);
 void SV_RecordDemoMessage (void);
 void SV_BuildClientFrame (client_t *client);
+int32_t SV_ClientVisibleEntities (client_t *client, int16_t *list);
+void SV_CheckEntityNumbers (int16_t *list, int32_t count);
+void SV_CopyClientEntities (client_t *client, int16_t *list, int32_t count, int32_t first);
+void SV_UpdateEntityDeltas (void);
 
 
 void SV_Error (char *error, ...);
@@ -1050,6 +1050,9 @@ void SV_ServerRecord_f (void)
 	// setup a buffer to catch all multicasts
 	SZ_Init (&svs.demo_multicast, svs.demo_multicast_buf, sizeof(svs.demo_multicast_buf));
 
+	Demo_BeginIndex (&svs.demoindex);
+	svs.demonextkey = 0;
+
 	//
 	// write a single giant fake message with all the startup info
 	//
@@ -1097,17 +1100,88 @@ Ends server demo recording
 */
 void SV_ServerStop_f (void)
 {
+	int32_t		len;
+
 	if (!svs.demofile)
 	{
 		Com_Printf ("Not doing a serverrecord.\n");
 		return;
 	}
+	len = -1;
+	fwrite (&len, 4, 1, svs.demofile);
+	Demo_WriteIndex (&svs.demoindex, svs.demofile);
 	fclose (svs.demofile);
 	svs.demofile = NULL;
 	Com_Printf ("Recording completed.\n");
 }
 
 
+/*
+==============
+SV_DemoSeek_f
+
+demoseek <seconds>, or +/-<seconds> from the current point.
+Jumps to the nearest keyframe at or before that time, after sending
+the configstrings as they were there.
+==============
+*/
+void SV_DemoSeek_f (void)
+{
+	char		*s;
+	int32_t		i, key, time;
+	client_t	*cl;
+	sizebuf_t	buf;
+	byte		buf_data[MAX_MSGLEN-16];
+
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf ("demoseek <seconds> : seek from the start, or +/- from the current point\n");
+		return;
+	}
+
+	if (sv.state != ss_demo || !sv.demofile)
+	{
+		Com_Printf ("Not playing a demo.\n");
+		return;
+	}
+
+	if (!sv.demoindex.numkeyframes)
+	{
+		Com_Printf ("%s was recorded without keyframes.\n", sv.name);
+		return;
+	}
+
+	s = Cmd_Argv(1);
+	time = atof(s)*1000;
+	if (s[0] == '+' || s[0] == '-')
+		time += sv.demotime;
+
+	key = Demo_FindKeyframe (&sv.demoindex, time);
+
+	SZ_Init (&buf, buf_data, sizeof(buf_data));
+	Demo_WriteConfigstrings (&sv.demoindex, sv.demoindex.keyframes[key].time, &buf);
+	for (i=0, cl = svs.clients ; i<maxclients->value ; i++, cl++)
+	{
+		if (cl->state < cs_connected)
+			continue;
+		if (cl->netchan.message.cursize + buf.cursize > cl->netchan.message.maxsize)
+		{
+			Com_Printf ("%s: configstrings didn't fit\n", cl->name);
+			continue;
+		}
+		SZ_Write (&cl->netchan.message, buf.data, buf.cursize);
+	}
+
+	// the next message read is the keyframe
+	FS_Seek (sv.demofile, sv.demoindex.keyframes[key].offset, FS_SEEK_SET);
+	sv.demokey = key - 1;
+	sv.demoseeking = true;
+
+	time = sv.demoindex.keyframes[key].time / 1000;
+	Com_Printf ("demo at %i:%02i\n", time / 60, time % 60);
+}
+
+
 /*
 ===============
 SV_KillServer_f
@@ -1170,6 +1244,7 @@ void SV_InitOperatorCommands (void)
 
 	Cmd_AddCommand ("serverrecord", SV_ServerRecord_f);
 	Cmd_AddCommand ("serverstop", SV_ServerStop_f);
+	Cmd_AddCommand ("demoseek", SV_DemoSeek_f);
 
 	Cmd_AddCommand ("save", SV_Savegame_f);
 	Cmd_AddCommand ("load", SV_Loadgame_f);
@@ -115,6 +115,121 @@ void SV_EmitProjectileUpdate (sizebuf_t *msg)
 }
 #endif
 
+/*
+=============
+SV_EncodeDelta
+
+Returns the length MSG_WriteDeltaEntity gives for the pair,
+or -1 if it did not fit.  Works on copies, as the alpha clamp
+writes to the destination state.
+=============
+*/
+static int32_t SV_EncodeDelta (entity_state_t *from, entity_state_t *to, byte *out)
+{
+	entity_state_t	oldstate, newstate;
+	sizebuf_t	buf;
+
+	oldstate = *from;
+	newstate = *to;
+
+	SZ_Init (&buf, out, MAX_DELTA_BYTES);
+	buf.allowoverflow = true;
+	MSG_WriteDeltaEntity (&oldstate, &newstate, &buf, false, newstate.number <= maxclients->value);
+	if (buf.overflowed)
+		return -1;
+	return buf.cursize;
+}
+
+/*
+=============
+SV_UpdateEntityDeltas
+
+Runs once per server frame before any client frame is built.
+Every edict that changed since the last pass gets a new version
+stamp and its deltas against the old state and against itself are
+encoded once here, instead of once per client in SV_EmitPacketEntities.
+=============
+*/
+void SV_UpdateEntityDeltas (void)
+{
+	int32_t		e;
+	edict_t		*ent;
+	entitydelta_t	*delta;
+	entity_state_t	state;
+
+	if (!svs.entity_deltas || !sv_deltacache->value)
+		return;
+
+	for (e=1 ; e<ge->num_edicts ; e++)
+	{
+		ent = EDICT_NUM(e);
+		delta = &svs.entity_deltas[e];
+
+		// cache the state as MSG_WriteDeltaEntity would leave it, an
+		// alpha out of range would otherwise differ from itself
+		state = ent->s;
+#ifdef NEW_ENTITY_STATE_MEMBERS
+		if (state.alpha < 0.0)
+			state.alpha = 0.0;
+		if (state.alpha > 1.0)
+			state.alpha = 1.0;
+#endif
+
+		if (delta->version && !memcmp(&state, &delta->state, sizeof(entity_state_t)))
+			continue;
+
+		// only cache what could end up in a frame
+		if ((ent->svflags & SVF_NOCLIENT) || ent->s.number != e
+			|| (!ent->s.modelindex && !ent->s.effects && !ent->s.sound && !ent->s.event))
+		{
+			delta->version = 0;
+			continue;
+		}
+
+		if (delta->version)
+			delta->changed_length = SV_EncodeDelta (&delta->state, &state, delta->changed);
+		else
+			delta->changed_length = -1;
+
+		delta->prev_version = delta->version;
+		delta->state = state;
+		if (!++svs.entity_version)
+			svs.entity_version = 1;		// 0 means not cached
+		delta->version = svs.entity_version;
+
+		delta->same_length = SV_EncodeDelta (&delta->state, &delta->state, delta->same);
+	}
+}
+
+/*
+=============
+SV_WriteCachedDelta
+
+Copies the bytes the delta pass encoded for this pair of
+client_entities versions, if it has them
+=============
+*/
+static qboolean SV_WriteCachedDelta (uint32_t oldversion, uint32_t newversion, int32_t number, sizebuf_t *msg)
+{
+	entitydelta_t	*delta;
+
+	if (!newversion)
+		return false;
+
+	delta = &svs.entity_deltas[number];
+	if (newversion != delta->version)
+		return false;
+
+	if (oldversion == newversion && delta->same_length >= 0)
+		SZ_Write (msg, delta->same, delta->same_length);
+	else if (oldversion && oldversion == delta->prev_version && delta->changed_length >= 0)
+		SZ_Write (msg, delta->changed, delta->changed_length);
+	else
+		return false;
+
+	return true;
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -127,6 +242,7 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 	entity_state_t	*oldent, *newent;
 	int32_t		oldindex, newindex;
 	int32_t		oldnum, newnum;
+	int32_t		oldslot, newslot;
 	int32_t		from_num_entities;
 	int32_t		bits;
 
@@ -144,13 +260,16 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 
 	newindex = 0;
 	oldindex = 0;
+	newslot = 0;
+	oldslot = 0;
 	while (newindex < to->num_entities || oldindex < from_num_entities)
 	{
 		if (newindex >= to->num_entities)
 			newnum = 9999;
 		else
 		{
-			newent = &svs.client_entities[(to->first_entity+newindex)%svs.num_client_entities];
+			newslot = (to->first_entity+newindex)%svs.num_client_entities;
+			newent = &svs.client_entities[newslot];
 			newnum = newent->number;
 		}
 
@@ -158,7 +277,8 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 			oldnum = 9999;
 		else
 		{
-			oldent = &svs.client_entities[(from->first_entity+oldindex)%svs.num_client_entities];
+			oldslot = (from->first_entity+oldindex)%svs.num_client_entities;
+			oldent = &svs.client_entities[oldslot];
 			oldnum = oldent->number;
 		}
 
@@ -168,7 +288,9 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 			// in any bytes being emited if the entity has not changed at all
 			// note that players are always 'newentities', this updates their oldorigin always
 			// and prevents warping
-			MSG_WriteDeltaEntity (oldent, newent, msg, false, newent->number <= maxclients->value);
+			if (!SV_WriteCachedDelta (svs.client_entity_versions[oldslot],
+				svs.client_entity_versions[newslot], newnum, msg))
+				MSG_WriteDeltaEntity (oldent, newent, msg, false, newent->number <= maxclients->value);
 			oldindex++;
 			newindex++;
 			continue;
@@ -501,6 +623,13 @@ void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg)
 		oldframe = NULL;
 		lastframe = -1;
 	}
+	else if (svs.next_client_entities - client->frames[client->lastframe & UPDATE_MASK].first_entity
+		> svs.num_client_entities)
+	{	// the ring wrapped over its entities, maybe while another
+		// client's frame is being copied in by SV_SendClientDatagrams
+		oldframe = NULL;
+		lastframe = -1;
+	}
 	else
 	{	// we have a valid message to delta from
 		oldframe = &client->frames[client->lastframe & UPDATE_MASK];
@@ -533,8 +662,6 @@ Build a client frame structure
 =============================================================================
 */
 
-byte		fatpvs[65536/8];	// 32767 is MAX_MAP_LEAFS
-
 /*
 ============
 SV_FatPVS
@@ -543,12 +670,13 @@ The client will interpolate the view position,
 so we can't use a single PVS point
 ===========
 */
-void SV_FatPVS (vec3_t org)
+void SV_FatPVS (vec3_t org, byte *fatpvs)
 {
 	int32_t		leafs[64];
 	int32_t		i, j, count;
 	int32_t		longs;
-	byte	*src;
+	byte	src[MAX_MAP_LEAFS/8];
+	byte	*row;
 	vec3_t	mins, maxs;
 
 	for (i=0 ; i<3 ; i++)
@@ -566,7 +694,9 @@ void SV_FatPVS (vec3_t org)
 	for (i=0 ; i<count ; i++)
 		leafs[i] = CM_LeafCluster(leafs[i]);
 
-	memcpy (fatpvs, CM_ClusterPVS(leafs[0]), longs<<2);
+	row = CM_ClusterPVSInto (leafs[0], fatpvs);
+	if (row != fatpvs)
+		memcpy (fatpvs, row, longs<<2);
 	// or in all the other leaf bits
 	for (i=1 ; i<count ; i++)
 	{
@@ -575,39 +705,42 @@ void SV_FatPVS (vec3_t org)
 				break;
 		if (j != i)
 			continue;		// already have the cluster we want
-		src = CM_ClusterPVS(leafs[i]);
-		for (j=0 ; j<longs ; j++)
-			((int32_t *)fatpvs)[j] |= ((int32_t *)src)[j];
+		row = CM_ClusterPVSInto (leafs[i], src);
+		Bits_Or (fatpvs, row, longs<<2);
 	}
 }
 
 
 /*
 =============
-SV_BuildClientFrame
+SV_ClientVisibleEntities
 
 Decides which entities are going to be visible to the client, and
-copies off the playerstat and areabits.
+copies off the playerstat and areabits.  The numbers of the visible
+edicts are returned in list, or -1 if the client isn't in the game yet.
+
+Only the client's own frame is written to, so this can run for
+several clients at once.
 =============
 */
-void SV_BuildClientFrame (client_t *client)
+int32_t SV_ClientVisibleEntities (client_t *client, int16_t *list)
 {
 	int32_t		e, i;
 	vec3_t	org;
 	edict_t	*ent;
 	edict_t	*clent;
 	client_frame_t	*frame;
-	entity_state_t	*state;
-	int32_t		l;
 	int32_t		clientarea, clientcluster;
 	int32_t		leafnum;
-	int32_t		c_fullsend;
+	int32_t		count;
+	byte	fatpvs[MAX_MAP_LEAFS/8];
+	byte	clientphsbuf[MAX_MAP_LEAFS/8];
 	byte	*clientphs;
 	byte	*bitvector;
 
 	clent = client->edict;
 	if (!clent->client)
-		return;		// not in game yet
+		return -1;		// not in game yet
 
 #if 0
 	numprojs = 0; // no projectiles yet
@@ -633,14 +766,11 @@ void SV_BuildClientFrame (client_t *client)
 	frame->ps = clent->client->ps;
 
 
-	SV_FatPVS (org);
-	clientphs = CM_ClusterPHS (clientcluster);
+	SV_FatPVS (org, fatpvs);
+	clientphs = CM_ClusterPHSInto (clientcluster, clientphsbuf);
 
 	// build up the list of visible entities
-	frame->num_entities = 0;
-	frame->first_entity = svs.next_client_entities;
-
-	c_fullsend = 0;
+	count = 0;
 
 	for (e=1 ; e<ge->num_edicts ; e++)
 	{
@@ -670,8 +800,7 @@ void SV_BuildClientFrame (client_t *client)
 			// beams just check one point for PHS
 			if (ent->s.renderfx & RF_BEAM)
 			{
-				l = ent->clusternums[0];
-				if ( !(clientphs[l >> 3] & (1 << (l&7) )) )
+				if (!Bits_TestAny (clientphs, ent->clusternums, 1))
 					continue;
 			}
 			else
@@ -689,17 +818,10 @@ void SV_BuildClientFrame (client_t *client)
 				{	// too many leafs for individual check, go by headnode
 					if (!CM_HeadnodeVisible (ent->headnode, bitvector))
 						continue;
-					c_fullsend++;
 				}
 				else
 				{	// check individual leafs
-					for (i=0 ; i < ent->num_clusters ; i++)
-					{
-						l = ent->clusternums[i];
-						if (bitvector[l >> 3] & (1 << (l&7) ))
-							break;
-					}
-					if (i == ent->num_clusters)
+					if (!Bits_TestAny (bitvector, ent->clusternums, ent->num_clusters))
 						continue;		// not visible
 				}
 
@@ -728,25 +850,111 @@ void SV_BuildClientFrame (client_t *client)
 			continue; // added as a special projectile
 #endif
 
-		// add it to the circular client_entities array
-		state = &svs.client_entities[svs.next_client_entities%svs.num_client_entities];
-		if (ent->s.number != e)
+		list[count++] = e;
+	}
+
+	return count;
+}
+
+
+/*
+=============
+SV_CheckEntityNumbers
+
+Not thread safe, must run before the states are copied
+=============
+*/
+void SV_CheckEntityNumbers (int16_t *list, int32_t count)
+{
+	int32_t		i;
+	edict_t	*ent;
+
+	for (i=0 ; i<count ; i++)
+	{
+		ent = EDICT_NUM(list[i]);
+		if (ent->s.number != list[i])
 		{
 			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
-			ent->s.number = e;
+			ent->s.number = list[i];
 		}
+	}
+}
+
+
+/*
+=============
+SV_CopyClientEntities
+
+Copies the states of the visible edicts into the client's slice
+of the circular client_entities array, starting at first
+=============
+*/
+void SV_CopyClientEntities (client_t *client, int16_t *list, int32_t count, int32_t first)
+{
+	int32_t		i;
+	edict_t	*ent;
+	client_frame_t	*frame;
+	entity_state_t	*state;
+	entitydelta_t	*delta;
+	int32_t		slot;
+	uint32_t	version;
+
+	frame = &client->frames[sv.framenum & UPDATE_MASK];
+	frame->first_entity = first;
+	frame->num_entities = count;
+
+	for (i=0 ; i<count ; i++)
+	{
+		ent = EDICT_NUM(list[i]);
+
+		// add it to the circular client_entities array
+		slot = (first+i)%svs.num_client_entities;
+		state = &svs.client_entities[slot];
 		*state = ent->s;
 
+		// stamp the copy with the delta pass version if it is still
+		// the state that pass saw, the game may have changed it since
+		version = 0;
+		delta = &svs.entity_deltas[list[i]];
+		if (delta->version && sv_deltacache->value
+			&& !memcmp(state, &delta->state, sizeof(entity_state_t)))
+			version = delta->version;
+
 		// don't mark players missiles as solid
 		if (ent->owner == client->edict)
+		{
 			state->solid = 0;
+			version = 0;
+		}
 
-		svs.next_client_entities++;
-		frame->num_entities++;
+		svs.client_entity_versions[slot] = version;
 	}
 }
 
 
+/*
+=============
+SV_BuildClientFrame
+
+Decides which entities are going to be visible to the client, and
+copies off the playerstat and areabits.
+=============
+*/
+void SV_BuildClientFrame (client_t *client)
+{
+	static int16_t	list[MAX_EDICTS];
+	int32_t		count;
+
+	count = SV_ClientVisibleEntities (client, list);
+	if (count < 0)
+		return;		// not in game yet
+
+	SV_CheckEntityNumbers (list, count);
+	SV_CopyClientEntities (client, list, count, svs.next_client_entities);
+	svs.next_client_entities += count;
+}
+
+
 /*
 ==================
 SV_RecordDemoMessage
@@ -797,6 +1005,13 @@ void SV_RecordDemoMessage (void)
 	SZ_Write (&buf, svs.demo_multicast.data, svs.demo_multicast.cursize);
 	SZ_Clear (&svs.demo_multicast);
 
+	// every message is a full frame, so keyframes only need indexing
+	if (sv_demokeyframes->value > 0 && svs.demonextkey >= 0 && sv.time >= svs.demonextkey)
+	{
+		Demo_AddKeyframe (&svs.demoindex, sv.time, ftell(svs.demofile));
+		svs.demonextkey = sv.time + sv_demokeyframes->value*1000;
+	}
+
 	// now write the entire message to the file, prefixed by the length
 	len = LittleLong (buf.cursize);
 	fwrite (&len, 4, 1, svs.demofile);
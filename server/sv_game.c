@@ -201,6 +201,9 @@ void PF_Configstring (int32_t index, const char *val)
 	if (!val)
 		val = "";
 
+	if (svs.demofile && sv.state != ss_loading)
+		Demo_LogConfigstring (&svs.demoindex, sv.time, index, sv.configstrings[index], val);
+
 	// change the string in sv
 	strcpy (sv.configstrings[index], val);
     sv.confighashes[index] = Hash32(val, strlen(val));
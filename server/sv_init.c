@@ -195,6 +195,14 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 	Com_DPrintf ("SpawnServer: %s\n",server);
 	if (sv.demofile)
 		FS_FCloseFile (sv.demofile);
+	Demo_FreeIndex (&sv.demoindex);
+
+	// server times start over, so a serverrecord index stays with its level
+	if (svs.demofile)
+	{
+		svs.demonextkey = -1;
+		Demo_CloseIndex (&svs.demoindex);
+	}
 
 	svs.spawncount++;		// any partially connected client will be
 							// restarted
@@ -235,6 +243,8 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 		if (svs.clients[i].state > cs_connected)
 			svs.clients[i].state = cs_connected;
 		svs.clients[i].lastframe = -1;
+		svs.clients[i].cluster = -1;	// the old map's, not linked on this one yet
+		svs.clients[i].area = -1;
 	}
 
 	sv.time = 1000;
@@ -375,6 +385,15 @@ void SV_InitGame (void)
 	svs.clients = (client_t*)Z_TagMalloc (sizeof(client_t)*maxclients->value, TAG_SERVER);
 	svs.num_client_entities = maxclients->value*UPDATE_BACKUP*64;
 	svs.client_entities = (entity_state_t*)Z_TagMalloc (sizeof(entity_state_t)*svs.num_client_entities, TAG_SERVER);
+	svs.client_entity_versions = (uint32_t*)Z_TagMalloc (sizeof(uint32_t)*svs.num_client_entities, TAG_SERVER);
+	memset (svs.client_entity_versions, 0, sizeof(uint32_t)*svs.num_client_entities);
+	svs.entity_deltas = (entitydelta_t*)Z_TagMalloc (sizeof(entitydelta_t)*MAX_EDICTS, TAG_SERVER);
+	memset (svs.entity_deltas, 0, sizeof(entitydelta_t)*MAX_EDICTS);
+	if (Job_NumWorkers() && maxclients->value > 1)
+	{
+		svs.frame_entities = (int16_t*)Z_TagMalloc (sizeof(int16_t)*MAX_EDICTS*maxclients->value, TAG_SERVER);
+		svs.frame_msgbufs = (byte*)Z_TagMalloc (MAX_MSGLEN*maxclients->value, TAG_SERVER);
+	}
 
 	// init network stuff
 	NET_Config ( (maxclients->value > 1) );
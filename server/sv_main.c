@@ -28,6 +28,9 @@ cvar_t	*sv_paused;
 cvar_t	*sv_timedemo;
 
 cvar_t	*sv_enforcetime;
+cvar_t	*sv_parallelframes;
+cvar_t	*sv_deltacache;
+cvar_t	*sv_demokeyframes;
 
 cvar_t	*timeout;				// seconds without any message
 cvar_t	*zombietime;			// seconds to sink messages after disconnect
@@ -376,6 +379,7 @@ void SVC_DirectConnect (void)
 	int32_t			qport;
 	int32_t			challenge;
 	int32_t			previousclients;	// rich: connection limit per IP
+	qboolean	compress, fragment;
 
 	adr = net_from;
 
@@ -393,6 +397,12 @@ void SVC_DirectConnect (void)
 
 	challenge = atoi(Cmd_Argv(3));
 
+	// newer clients offer netchan extensions after the userinfo
+	compress = net_compress->value && adr.type != NA_LOOPBACK
+		&& Netchan_HasExtension (NETCHAN_ZLIB, 5);
+	fragment = net_fragment->value && adr.type != NA_LOOPBACK
+		&& Netchan_HasExtension (NETCHAN_FRAG, 5);
+
 	// r1ch: limit connections from a single IP
 	previousclients = 0;
 	for (i=0,cl=svs.clients; i<(int32_t)maxclients->value; i++,cl++)
@@ -512,11 +522,13 @@ gotnewcl:
 	// build a new connection
 	// accept the new client
 	// this is the only place a client_t is ever initialized
+	Netchan_Free (&newcl->netchan);
 	*newcl = temp;
 	sv_client = newcl;
 	edictnum = (newcl-svs.clients)+1;
 	ent = EDICT_NUM(edictnum);
 	newcl->edict = ent;
+	newcl->cluster = -1;	// not linked yet
 	newcl->challenge = challenge; // save challenge for checksumming
 
 	// get the game a chance to reject this connection or modify the userinfo
@@ -536,9 +548,13 @@ gotnewcl:
 	SV_UserinfoChanged (newcl);
 
 	// send the connect packet to the client
-	Netchan_OutOfBandPrint (NS_SERVER, adr, "client_connect");
+	Netchan_OutOfBandPrint (NS_SERVER, adr, "client_connect%s%s",
+		compress ? " " NETCHAN_ZLIB : "", fragment ? " " NETCHAN_FRAG : "");
 
 	Netchan_Setup (NS_SERVER, &newcl->netchan , adr, qport);
+	newcl->netchan.compress = compress;
+	if (fragment)
+		Netchan_EnableFragments (&newcl->netchan);
 
 	newcl->state = cs_connected;
 	
@@ -935,7 +951,9 @@ void SV_Frame (int32_t msec)
 	SV_CheckTimeouts ();
 
 	// get packets from clients
+	Prof_Begin ("SV_ReadPackets");
 	SV_ReadPackets ();
+	Prof_End ();
 
 	// move autonomous things around if enough time has passed
 	if (!sv_timedemo->value && svs.realtime < sv.time)
@@ -958,13 +976,19 @@ void SV_Frame (int32_t msec)
 	SV_GiveMsec ();
 
 	// let everything in the world think and move
+	Prof_Begin ("SV_RunGameFrame");
 	SV_RunGameFrame ();
+	Prof_End ();
 
 	// send messages back to the clients that had packets read this frame
+	Prof_Begin ("SV_SendClientMessages");
 	SV_SendClientMessages ();
+	Prof_End ();
 
 	// save the entire world state if recording a serverdemo
+	Prof_Begin ("SV_RecordDemoMessage");
 	SV_RecordDemoMessage ();
+	Prof_End ();
 
 	// send a heartbeat to the master if needed
 	Master_Heartbeat ();
@@ -1137,6 +1161,9 @@ void SV_Init (void)
 	sv_paused = Cvar_Get ("paused", "0", 0);
 	sv_timedemo = Cvar_Get ("timedemo", "0", 0);
 	sv_enforcetime = Cvar_Get ("sv_enforcetime", "0", 0);
+	sv_parallelframes = Cvar_Get ("sv_parallelframes", "1", 0);
+	sv_deltacache = Cvar_Get ("sv_deltacache", "1", 0);
+	sv_demokeyframes = Cvar_Get ("sv_demokeyframes", "10", 0);
 	allow_download = Cvar_Get ("allow_download", "1", CVAR_ARCHIVE);
 	allow_download_players  = Cvar_Get ("allow_download_players", "0", CVAR_ARCHIVE);
 	allow_download_models = Cvar_Get ("allow_download_models", "1", CVAR_ARCHIVE);
@@ -1217,6 +1244,8 @@ before Sys_Quit or Sys_Error
 */
 void SV_Shutdown (char *finalmsg, qboolean reconnect)
 {
+	int32_t		i;
+
 	if (svs.clients)
 		SV_FinalMessage (finalmsg, reconnect);
 
@@ -1226,16 +1255,30 @@ void SV_Shutdown (char *finalmsg, qboolean reconnect)
 	// free current level
 	if (sv.demofile)
 		FS_FCloseFile (sv.demofile);
+	Demo_FreeIndex (&sv.demoindex);
 	memset (&sv, 0, sizeof(sv));
 	Com_SetServerState (sv.state);
 
 	// free server static data
 	if (svs.clients)
+	{
+		for (i=0 ; i<maxclients->value ; i++)
+			Netchan_Free (&svs.clients[i].netchan);
 		Z_Free (svs.clients);
+	}
 	if (svs.client_entities)
 		Z_Free (svs.client_entities);
+	if (svs.client_entity_versions)
+		Z_Free (svs.client_entity_versions);
+	if (svs.entity_deltas)
+		Z_Free (svs.entity_deltas);
+	if (svs.frame_entities)
+		Z_Free (svs.frame_entities);
+	if (svs.frame_msgbufs)
+		Z_Free (svs.frame_msgbufs);
 	if (svs.demofile)
 		fclose (svs.demofile);
+	Demo_FreeIndex (&svs.demoindex);
 	memset (&svs, 0, sizeof(svs));
 }
 
@@ -226,13 +226,14 @@ void SV_Multicast (vec3_t origin, multicast_t to)
 			continue;
 
 		if (mask)
-		{
-			leafnum = CM_PointLeafnum (client->edict->s.origin);
-			cluster = CM_LeafCluster (leafnum);
-			area2 = CM_LeafArea (leafnum);
+		{	// leaf values are cached by SV_LinkEdict
+			cluster = client->cluster;
+			area2 = client->area;
+			if (cluster == -1)
+				continue;
 			if (!CM_AreasConnected (area1, area2))
 				continue;
-			if ( mask && (!(mask[cluster>>3] & (1<<(cluster&7)) ) ) )
+			if (!(mask[cluster>>3] & (1<<(cluster&7)) ) )
 				continue;
 		}
 
@@ -392,6 +393,41 @@ FRAME UPDATES
 
 
 
+/*
+=======================
+SV_TransmitClientDatagram
+
+Appends the accumulated multicast datagram to a message
+holding the client's frame and sends it
+=======================
+*/
+qboolean SV_TransmitClientDatagram (client_t *client, sizebuf_t *msg)
+{
+	// copy the accumulated multicast datagram
+	// for this client out to the message
+	// it is necessary for this to be after the WriteEntities
+	// so that entity references will be current
+	if (client->datagram.overflowed)
+		Com_Printf (S_COLOR_YELLOW"WARNING: datagram overflowed for %s\n", client->name);
+	else
+		SZ_Write (msg, client->datagram.data, client->datagram.cursize);
+	SZ_Clear (&client->datagram);
+
+	if (msg->overflowed)
+	{	// must have room left for the packet header
+		Com_Printf (S_COLOR_YELLOW"WARNING: msg overflowed for %s\n", client->name);
+		SZ_Clear (msg);
+	}
+
+	// send the datagram
+	Netchan_Transmit (&client->netchan, msg->cursize, msg->data);
+
+	// record the size for rate estimation
+	client->message_size[sv.framenum % RATE_MESSAGES] = msg->cursize;
+
+	return true;
+}
+
 /*
 =======================
 SV_SendClientDatagram
@@ -411,29 +447,89 @@ qboolean SV_SendClientDatagram (client_t *client)
 	// and the player_state_t
 	SV_WriteFrameToClient (client, &msg);
 
-	// copy the accumulated multicast datagram
-	// for this client out to the message
-	// it is necessary for this to be after the WriteEntities
-	// so that entity references will be current
-	if (client->datagram.overflowed)
-		Com_Printf (S_COLOR_YELLOW"WARNING: datagram overflowed for %s\n", client->name);
-	else
-		SZ_Write (&msg, client->datagram.data, client->datagram.cursize);
-	SZ_Clear (&client->datagram);
+	return SV_TransmitClientDatagram (client, &msg);
+}
 
-	if (msg.overflowed)
-	{	// must have room left for the packet header
-		Com_Printf (S_COLOR_YELLOW"WARNING: msg overflowed for %s\n", client->name);
-		SZ_Clear (&msg);
+
+/*
+===============================================================================
+
+PARALLEL CLIENT FRAMES
+
+Finding the visible entities and delta compressing the frame only read
+the world and write to the client being built, so that work is spread
+over the job workers.  The frames are laid out in the client_entities
+ring and the packets are sent in client order, the same as the serial
+path, so the wire output does not change.
+
+===============================================================================
+*/
+
+typedef struct
+{
+	client_t	*client;
+	int16_t		*entities;			// visible edict numbers
+	int32_t		num_entities;		// -1 if not in game yet
+	int32_t		first_entity;
+	sizebuf_t	msg;
+} framejob_t;
+
+static framejob_t	sv_framejobs[MAX_CLIENTS];
+
+static void SV_VisibleEntitiesJob (void *data, int32_t index)
+{
+	framejob_t	*job = (framejob_t *)data + index;
+
+	job->num_entities = SV_ClientVisibleEntities (job->client, job->entities);
+}
+
+static void SV_WriteFrameJob (void *data, int32_t index)
+{
+	framejob_t	*job = (framejob_t *)data + index;
+
+	if (job->num_entities >= 0)
+		SV_CopyClientEntities (job->client, job->entities, job->num_entities, job->first_entity);
+	SV_WriteFrameToClient (job->client, &job->msg);
+}
+
+/*
+=======================
+SV_SendClientDatagrams
+
+Same as calling SV_SendClientDatagram for each of the clients in turn
+=======================
+*/
+void SV_SendClientDatagrams (client_t **clients, int32_t count)
+{
+	framejob_t	*job;
+	int32_t			i, n;
+
+	for (i=0, job=sv_framejobs ; i<count ; i++, job++)
+	{
+		n = clients[i] - svs.clients;
+		job->client = clients[i];
+		job->entities = svs.frame_entities + n*MAX_EDICTS;
+		SZ_Init (&job->msg, svs.frame_msgbufs + n*MAX_MSGLEN, MAX_MSGLEN);
+		job->msg.allowoverflow = true;
+		job->msg.quiet = true;	// jobs can't print, SV_TransmitClientDatagram reports it
 	}
 
-	// send the datagram
-	Netchan_Transmit (&client->netchan, msg.cursize, msg.data);
+	Job_ParallelFor (SV_VisibleEntitiesJob, sv_framejobs, count);
 
-	// record the size for rate estimation
-	client->message_size[sv.framenum % RATE_MESSAGES] = msg.cursize;
+	// hand out the slices of the ring in client order
+	for (i=0, job=sv_framejobs ; i<count ; i++, job++)
+	{
+		if (job->num_entities < 0)
+			continue;
+		SV_CheckEntityNumbers (job->entities, job->num_entities);
+		job->first_entity = svs.next_client_entities;
+		svs.next_client_entities += job->num_entities;
+	}
 
-	return true;
+	Job_ParallelFor (SV_WriteFrameJob, sv_framejobs, count);
+
+	for (i=0, job=sv_framejobs ; i<count ; i++, job++)
+		SV_TransmitClientDatagram (job->client, &job->msg);
 }
 
 
@@ -449,6 +545,7 @@ void SV_DemoCompleted (void)
 		FS_FCloseFile (sv.demofile);
 		sv.demofile = 0; // clear the file handle
 	}
+	Demo_FreeIndex (&sv.demoindex);
 	SV_Nextserver ();
 }
 
@@ -487,6 +584,31 @@ qboolean SV_RateDrop (client_t *c)
 	return false;
 }
 
+/*
+=======================
+SV_DemoSeekPending
+
+The configstrings demoseek sends are reliable, and a packet that has
+to carry them leaves no room for the keyframe, which Netchan_Transmit
+would then drop as unreliable.  So the keyframe waits until every
+client has them.
+=======================
+*/
+static qboolean SV_DemoSeekPending (void)
+{
+	int32_t		i;
+	client_t	*c;
+
+	for (i=0, c = svs.clients ; i<maxclients->value; i++, c++)
+	{
+		if (c->state < cs_connected)
+			continue;
+		if (c->netchan.message.cursize || c->netchan.reliable_length)
+			return true;
+	}
+	return false;
+}
+
 /*
 =======================
 SV_SendClientMessages
@@ -497,18 +619,36 @@ void SV_SendClientMessages (void)
 	int32_t			i;
 	client_t	*c;
 	int32_t			msglen;
-	byte		msgbuf[MAX_MSGLEN];
+	byte		msgbuf[MAX_NETCHAN_MSGLEN];
 	int32_t			r;
+	client_t	*datagrams[MAX_CLIENTS];
+	int32_t			numdatagrams;
+	qboolean	parallel;
 
 	msglen = 0;
+	numdatagrams = 0;
+	parallel = sv_parallelframes->value && svs.frame_entities;
 
 	// read the next demo message if needed
 	if (sv.state == ss_demo && sv.demofile)
 	{
-		if (sv_paused->value)
+		if (sv.demoseeking)
+			sv.demoseeking = SV_DemoSeekPending ();
+
+		if (sv_paused->value || sv.demoseeking)
 			msglen = 0;
 		else
 		{
+			// keep the play position current for demoseek
+			if (sv.demokey+1 < sv.demoindex.numkeyframes
+				&& FS_Tell (sv.demofile) >= sv.demoindex.keyframes[sv.demokey+1].offset)
+			{
+				sv.demokey++;
+				sv.demotime = sv.demoindex.keyframes[sv.demokey].time;
+			}
+			else
+				sv.demotime += 100;
+
 			// get the next message
 			r = FS_FRead (&msglen, 4, 1, sv.demofile);
 			if (r != 4)
@@ -522,8 +662,9 @@ void SV_SendClientMessages (void)
 				SV_DemoCompleted ();
 				return;
 			}
-			if (msglen > MAX_MSGLEN)
-				Com_Error (ERR_DROP, "SV_SendClientMessages: msglen > MAX_MSGLEN");
+			// demos recorded over fragmenting channels can run past MAX_MSGLEN
+			if (msglen > MAX_NETCHAN_MSGLEN)
+				Com_Error (ERR_DROP, "SV_SendClientMessages: msglen > MAX_NETCHAN_MSGLEN");
 			r = FS_FRead (msgbuf, msglen, 1, sv.demofile);
 			if (r != msglen)
 			{
@@ -533,6 +674,13 @@ void SV_SendClientMessages (void)
 		}
 	}
 
+	// encode the entity changes every client frame shares
+	if (sv.state == ss_game)
+		SV_UpdateEntityDeltas ();
+
+	// hold the datagrams back so they go out in one batch
+	NET_BeginBatch (NS_SERVER);
+
 	// send a message to each connected client
 	for (i=0, c = svs.clients ; i<maxclients->value; i++, c++)
 	{
@@ -542,6 +690,13 @@ void SV_SendClientMessages (void)
 		// drop the client
 		if (c->netchan.message.overflowed)
 		{
+			// the game may change the world when the client leaves,
+			// so send everyone before it their frames first
+			if (numdatagrams)
+			{
+				SV_SendClientDatagrams (datagrams, numdatagrams);
+				numdatagrams = 0;
+			}
 			SZ_Clear (&c->netchan.message);
 			SZ_Clear (&c->datagram);
 			SV_BroadcastPrintf (PRINT_HIGH, "%s overflowed\n", c->name);
@@ -559,7 +714,10 @@ void SV_SendClientMessages (void)
 			if (SV_RateDrop (c))
 				continue;
 
-			SV_SendClientDatagram (c);
+			if (parallel)
+				datagrams[numdatagrams++] = c;
+			else
+				SV_SendClientDatagram (c);
 		}
 		else
 		{
@@ -568,5 +726,10 @@ void SV_SendClientMessages (void)
 				Netchan_Transmit (&c->netchan, 0, NULL);
 		}
 	}
+
+	if (numdatagrams)
+		SV_SendClientDatagrams (datagrams, numdatagrams);
+
+	NET_FlushPackets (NS_SERVER);
 }
 
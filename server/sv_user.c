@@ -40,11 +40,19 @@ SV_BeginDemoServer
 void SV_BeginDemoserver (void)
 {
 	char		name[MAX_OSPATH];
+	int32_t		length;
 
 	Com_sprintf (name, sizeof(name), "demos/%s", sv.name);
-	FS_FOpenFile (name, &sv.demofile, FS_READ);
+	length = FS_FOpenFile (name, &sv.demofile, FS_READ);
 	if (!sv.demofile)
 		Com_Error (ERR_DROP, "Couldn't open %s\n", name);
+
+	// demos recorded with keyframes can be seeked through
+	Demo_FreeIndex (&sv.demoindex);
+	if (Demo_ReadIndex (&sv.demoindex, sv.demofile, length))
+		Com_DPrintf ("%s: %i keyframes\n", name, sv.demoindex.numkeyframes);
+	sv.demokey = -1;
+	sv.demotime = 0;
 }
 
 /*
@@ -116,6 +124,69 @@ void SV_New_f (void)
 
 }
 
+/*
+==================
+SV_GamestateFits
+
+Everyone gets half buffer chunks of gamestate; compressing and
+fragmenting clients get them packed as tight as the reliable buffer
+allows, leaving some room for reliable multicasts
+==================
+*/
+static qboolean SV_GamestateFits (int32_t size)
+{
+	sizebuf_t	*msg = &sv_client->netchan.message;
+
+	if (msg->cursize < MAX_MSGLEN/2)
+		return true;
+
+	return (sv_client->netchan.compress || sv_client->netchan.fragment)
+		&& msg->cursize + size + msg->maxsize/8 <= msg->maxsize;
+}
+
+/*
+==================
+SV_WriteBaselines
+
+Writes baselines from start on, then asks for the next chunk or,
+once they are all out, moves the client on to precaching
+==================
+*/
+static void SV_WriteBaselines (int32_t start)
+{
+	entity_state_t	nullstate;
+	entity_state_t	*base;
+
+	memset (&nullstate, 0, sizeof(nullstate));
+
+	// write a packet full of data
+
+	while ( SV_GamestateFits (64)
+		&& start < MAX_EDICTS)
+	{
+		base = &sv.baselines[start];
+		if (base->modelindex || base->sound || base->effects)
+		{
+			MSG_WriteByte (&sv_client->netchan.message, svc_spawnbaseline);
+			MSG_WriteDeltaEntity (&nullstate, base, &sv_client->netchan.message, true, true);
+		}
+		start++;
+	}
+
+	// send next command
+
+	if (start == MAX_EDICTS)
+	{
+		MSG_WriteByte (&sv_client->netchan.message, svc_stufftext);
+		MSG_WriteString (&sv_client->netchan.message, va("precache %i\n", svs.spawncount) );
+	}
+	else
+	{
+		MSG_WriteByte (&sv_client->netchan.message, svc_stufftext);
+		MSG_WriteString (&sv_client->netchan.message, va("cmd baselines %i %i\n",svs.spawncount, start) );
+	}
+}
+
 /*
 ==================
 SV_Configstrings_f
@@ -153,8 +224,8 @@ void SV_Configstrings_f (void)
 
 	// write a packet full of data
 
-	while ( sv_client->netchan.message.cursize < MAX_MSGLEN/2 
-		&& start < MAX_CONFIGSTRINGS)
+	while ( start < MAX_CONFIGSTRINGS
+		&& SV_GamestateFits (strlen(sv.configstrings[start]) + 4))
 	{
 		if (sv.configstrings[start][0])
 		{
@@ -169,6 +240,12 @@ void SV_Configstrings_f (void)
 
 	if (start == MAX_CONFIGSTRINGS)
 	{
+		// these clients get the baselines in the same burst
+		if (sv_client->netchan.compress || sv_client->netchan.fragment)
+		{
+			SV_WriteBaselines (0);
+			return;
+		}
 		MSG_WriteByte (&sv_client->netchan.message, svc_stufftext);
 		MSG_WriteString (&sv_client->netchan.message, va("cmd baselines %i 0\n",svs.spawncount) );
 	}
@@ -186,9 +263,7 @@ SV_Baselines_f
 */
 void SV_Baselines_f (void)
 {
-	int32_t				startPos, start;
-	entity_state_t	nullstate;
-	entity_state_t	*base;
+	int32_t				startPos;
 
 	Com_DPrintf ("Baselines() from %s\n", sv_client->name);
 
@@ -214,36 +289,8 @@ void SV_Baselines_f (void)
 		SV_DropClient (sv_client);
 		return;
 	}
-	start = startPos;
-
-	memset (&nullstate, 0, sizeof(nullstate));
 
-	// write a packet full of data
-
-	while ( sv_client->netchan.message.cursize <  MAX_MSGLEN/2
-		&& start < MAX_EDICTS)
-	{
-		base = &sv.baselines[start];
-		if (base->modelindex || base->sound || base->effects)
-		{
-			MSG_WriteByte (&sv_client->netchan.message, svc_spawnbaseline);
-			MSG_WriteDeltaEntity (&nullstate, base, &sv_client->netchan.message, true, true);
-		}
-		start++;
-	}
-
-	// send next command
-
-	if (start == MAX_EDICTS)
-	{
-		MSG_WriteByte (&sv_client->netchan.message, svc_stufftext);
-		MSG_WriteString (&sv_client->netchan.message, va("precache %i\n", svs.spawncount) );
-	}
-	else
-	{
-		MSG_WriteByte (&sv_client->netchan.message, svc_stufftext);
-		MSG_WriteString (&sv_client->netchan.message, va("cmd baselines %i %i\n",svs.spawncount, start) );
-	}
+	SV_WriteBaselines (startPos);
 }
 
 /*
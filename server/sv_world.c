@@ -37,25 +37,41 @@ FIXME: this use of "area" is different from the bsp file use
 
 #define	EDICT_FROM_AREA(l) STRUCT_FROM_LINK(l,edict_t,area)
 
-typedef struct areanode_s
+// The world is covered by a stack of "loose" grids over x/y.  Level 0 is a
+// single cell spanning the whole world, and every deeper level roughly halves
+// the cell size until AREA_MIN_CELLSIZE is reached.  An edict is linked into
+// exactly one cell: the one containing its center, on the deepest level whose
+// cells are at least as large as the edict.  Since an edict can then only
+// stick out of its cell by half a cell, a query only has to look at the cells
+// overlapping its box expanded by half a cell on each level.
+typedef struct
 {
-	int32_t		axis;		// -1 = leaf node
-	float	dist;
-	struct areanode_s	*children[2];
 	link_t	trigger_edicts;
 	link_t	solid_edicts;
-} areanode_t;
+} areacell_t;
+
+typedef struct
+{
+	int32_t		cells[2];		// cell count along x and y
+	float		cellsize[2];
+	int32_t		firstcell;		// into sv_areacells
+	int32_t		numedicts;		// empty levels are skipped by queries
+} arealevel_t;
+
+#define	AREA_MIN_CELLSIZE	128
+#define	AREA_MAX_LEVELS		8
+#define	AREA_MAX_AXISCELLS	64
+#define	AREA_MAX_CELLS		8192
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	32
+areacell_t	sv_areacells[AREA_MAX_CELLS];
+arealevel_t	sv_arealevels[AREA_MAX_LEVELS];
+int32_t			sv_numarealevels;
+vec3_t		sv_areamins;
 
-areanode_t	sv_areanodes[AREA_NODES];
-int32_t			sv_numareanodes;
+int32_t			sv_edictcell[MAX_EDICTS];	// cell each linked edict is in
 
-float	*area_mins, *area_maxs;
-edict_t	**area_list;
-int32_t		area_count, area_maxcount;
-int32_t		area_type;
+// for showtrace
+int32_t		c_areaqueries, c_areacandidates;
 
 int32_t SV_HullForEntity (edict_t *ent);
 
@@ -82,48 +98,60 @@ void InsertLinkBefore (link_t *l, link_t *before)
 
 /*
 ===============
-SV_CreateAreaNode
+SV_CreateAreaLevels
 
-Builds a uniformly subdivided tree for the given world size
+Builds the grid levels for the given world size, as deep as the
+cell budget and AREA_MIN_CELLSIZE allow
 ===============
 */
-areanode_t *SV_CreateAreaNode (int32_t depth, vec3_t mins, vec3_t maxs)
+void SV_CreateAreaLevels (vec3_t mins, vec3_t maxs)
 {
-	areanode_t	*anode;
+	arealevel_t	*level;
 	vec3_t		size;
-	vec3_t		mins1, maxs1, mins2, maxs2;
+	float		largest, target;
+	int32_t			i, l, numcells;
 
-	anode = &sv_areanodes[sv_numareanodes];
-	sv_numareanodes++;
+	VectorSubtract (maxs, mins, size);
+	for (i=0 ; i<2 ; i++)
+		if (size[i] < AREA_MIN_CELLSIZE)
+			size[i] = AREA_MIN_CELLSIZE;
+	largest = max(size[0], size[1]);
 
-	ClearLink (&anode->trigger_edicts);
-	ClearLink (&anode->solid_edicts);
-	
-	if (depth == AREA_DEPTH)
+	VectorCopy (mins, sv_areamins);
+	sv_numarealevels = 0;
+	numcells = 0;
+
+	for (l=0 ; l<AREA_MAX_LEVELS ; l++)
 	{
-		anode->axis = -1;
-		anode->children[0] = anode->children[1] = NULL;
-		return anode;
+		target = largest / (1<<l);
+		if (l && target < AREA_MIN_CELLSIZE)
+			break;
+
+		level = &sv_arealevels[l];
+		for (i=0 ; i<2 ; i++)
+		{
+			level->cells[i] = (int32_t)ceil(size[i] / target);
+			if (level->cells[i] < 1)
+				level->cells[i] = 1;
+			if (level->cells[i] > AREA_MAX_AXISCELLS)
+				level->cells[i] = AREA_MAX_AXISCELLS;
+			level->cellsize[i] = size[i] / level->cells[i];
+		}
+
+		if (numcells + level->cells[0]*level->cells[1] > AREA_MAX_CELLS)
+			break;
+
+		level->firstcell = numcells;
+		level->numedicts = 0;
+		numcells += level->cells[0]*level->cells[1];
+		sv_numarealevels++;
 	}
-	
-	VectorSubtract (maxs, mins, size);
-	if (size[0] > size[1])
-		anode->axis = 0;
-	else
-		anode->axis = 1;
-	
-	anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
-	VectorCopy (mins, mins1);	
-	VectorCopy (mins, mins2);	
-	VectorCopy (maxs, maxs1);	
-	VectorCopy (maxs, maxs2);	
-	
-	maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
-	
-	anode->children[0] = SV_CreateAreaNode (depth+1, mins2, maxs2);
-	anode->children[1] = SV_CreateAreaNode (depth+1, mins1, maxs1);
 
-	return anode;
+	for (i=0 ; i<numcells ; i++)
+	{
+		ClearLink (&sv_areacells[i].trigger_edicts);
+		ClearLink (&sv_areacells[i].solid_edicts);
+	}
 }
 
 /*
@@ -134,9 +162,48 @@ SV_ClearWorld
 */
 void SV_ClearWorld (void)
 {
-	memset (sv_areanodes, 0, sizeof(sv_areanodes));
-	sv_numareanodes = 0;
-	SV_CreateAreaNode (0, sv.models[1]->mins, sv.models[1]->maxs);
+	memset (sv_areacells, 0, sizeof(sv_areacells));
+	memset (sv_arealevels, 0, sizeof(sv_arealevels));
+	memset (sv_edictcell, 0, sizeof(sv_edictcell));
+	SV_CreateAreaLevels (sv.models[1]->mins, sv.models[1]->maxs);
+}
+
+/*
+===============
+SV_AreaLevelForCell
+===============
+*/
+static arealevel_t *SV_AreaLevelForCell (int32_t cell)
+{
+	int32_t		l;
+
+	for (l=sv_numarealevels-1 ; l>0 ; l--)
+		if (cell >= sv_arealevels[l].firstcell)
+			break;
+	return &sv_arealevels[l];
+}
+
+/*
+===============
+SV_AreaCellRange
+
+Returns the range of cells on a level that can hold edicts touching
+the given box, taking the loose bounds into account
+===============
+*/
+static void SV_AreaCellRange (arealevel_t *level, vec3_t mins, vec3_t maxs, int32_t *lo, int32_t *hi)
+{
+	int32_t		i;
+	float	half;
+
+	for (i=0 ; i<2 ; i++)
+	{
+		half = 0.5 * level->cellsize[i];
+		lo[i] = (int32_t)floor((mins[i] - half - sv_areamins[i]) / level->cellsize[i]);
+		hi[i] = (int32_t)floor((maxs[i] + half - sv_areamins[i]) / level->cellsize[i]);
+		lo[i] = max(0, min(lo[i], level->cells[i]-1));
+		hi[i] = max(0, min(hi[i], level->cells[i]-1));
+	}
 }
 
 
@@ -152,6 +219,7 @@ void SV_UnlinkEdict (edict_t *ent)
 		return;		// not linked in anywhere
 	RemoveLink (&ent->area);
 	ent->area.prev = ent->area.next = NULL;
+	SV_AreaLevelForCell (sv_edictcell[NUM_FOR_EDICT(ent)])->numedicts--;
 }
 
 
@@ -164,7 +232,8 @@ SV_LinkEdict
 #define MAX_TOTAL_ENT_LEAFS		128
 void SV_LinkEdict (edict_t *ent)
 {
-	areanode_t	*node;
+	arealevel_t	*level;
+	int32_t			cell[2], l;
 	int32_t			leafs[MAX_TOTAL_ENT_LEAFS];
 	int32_t			clusters[MAX_TOTAL_ENT_LEAFS];
 	int32_t			num_leafs;
@@ -319,105 +388,114 @@ void SV_LinkEdict (edict_t *ent)
 	}
 	ent->linkcount++;
 
+	// remember where clients are so multicasts don't have to find out
+	i = NUM_FOR_EDICT(ent);
+	if (i <= maxclients->value)
+	{
+		client_t	*cl = svs.clients + i - 1;
+
+		cl->leafnum = CM_PointLeafnum (ent->s.origin);
+		cl->cluster = CM_LeafCluster (cl->leafnum);
+		cl->area = CM_LeafArea (cl->leafnum);
+	}
+
 	if (ent->solid == SOLID_NOT)
 		return;
 
-// find the first node that the ent's box crosses
-	node = sv_areanodes;
-	while (1)
+// find the deepest level the ent's box fits in
+	for (l=sv_numarealevels-1 ; l>0 ; l--)
 	{
-		if (node->axis == -1)
+		level = &sv_arealevels[l];
+		if (ent->absmax[0] - ent->absmin[0] <= level->cellsize[0]
+		&& ent->absmax[1] - ent->absmin[1] <= level->cellsize[1])
 			break;
-		if (ent->absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if (ent->absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
 	}
-	
-	// link it in	
+	level = &sv_arealevels[l];
+
+// and the cell its center is in
+	for (i=0 ; i<2 ; i++)
+	{
+		cell[i] = (int32_t)floor((0.5 * (ent->absmin[i] + ent->absmax[i]) - sv_areamins[i]) / level->cellsize[i]);
+		cell[i] = max(0, min(cell[i], level->cells[i]-1));
+	}
+	i = level->firstcell + cell[1]*level->cells[0] + cell[0];
+	sv_edictcell[NUM_FOR_EDICT(ent)] = i;
+	level->numedicts++;
+
+	// link it in
 	if (ent->solid == SOLID_TRIGGER)
-		InsertLinkBefore (&ent->area, &node->trigger_edicts);
+		InsertLinkBefore (&ent->area, &sv_areacells[i].trigger_edicts);
 	else
-		InsertLinkBefore (&ent->area, &node->solid_edicts);
+		InsertLinkBefore (&ent->area, &sv_areacells[i].solid_edicts);
 
 }
 
 
 /*
-====================
-SV_AreaEdicts_r
-
-====================
+================
+SV_AreaEdicts
+================
 */
-void SV_AreaEdicts_r (areanode_t *node)
+int32_t SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list,
+	int32_t maxcount, int32_t areatype)
 {
+	arealevel_t	*level;
 	link_t		*l, *next, *start;
 	edict_t		*check;
+	int32_t			lo[2], hi[2];
+	int32_t			i, x, y;
 	int32_t			count;
 
+	c_areaqueries++;
 	count = 0;
 
-	// touch linked edicts
-	if (area_type == AREA_SOLID)
-		start = &node->solid_edicts;
-	else
-		start = &node->trigger_edicts;
-
-	for (l=start->next  ; l != start ; l = next)
+	for (i=0 ; i<sv_numarealevels ; i++)
 	{
-		next = l->next;
-		check = EDICT_FROM_AREA(l);
-
-		if (check->solid == SOLID_NOT)
-			continue;		// deactivated
-		if (check->absmin[0] > area_maxs[0]
-		|| check->absmin[1] > area_maxs[1]
-		|| check->absmin[2] > area_maxs[2]
-		|| check->absmax[0] < area_mins[0]
-		|| check->absmax[1] < area_mins[1]
-		|| check->absmax[2] < area_mins[2])
-			continue;		// not touching
-
-		if (area_count == area_maxcount)
+		level = &sv_arealevels[i];
+		if (!level->numedicts)
+			continue;
+
+		SV_AreaCellRange (level, mins, maxs, lo, hi);
+		for (y=lo[1] ; y<=hi[1] ; y++)
 		{
-			Com_Printf ("SV_AreaEdicts: MAXCOUNT\n");
-			return;
+			for (x=lo[0] ; x<=hi[0] ; x++)
+			{
+				// touch linked edicts
+				if (areatype == AREA_SOLID)
+					start = &sv_areacells[level->firstcell + y*level->cells[0] + x].solid_edicts;
+				else
+					start = &sv_areacells[level->firstcell + y*level->cells[0] + x].trigger_edicts;
+
+				for (l=start->next  ; l != start ; l = next)
+				{
+					next = l->next;
+					check = EDICT_FROM_AREA(l);
+					c_areacandidates++;
+
+					if (check->solid == SOLID_NOT)
+						continue;		// deactivated
+					if (check->absmin[0] > maxs[0]
+					|| check->absmin[1] > maxs[1]
+					|| check->absmin[2] > maxs[2]
+					|| check->absmax[0] < mins[0]
+					|| check->absmax[1] < mins[1]
+					|| check->absmax[2] < mins[2])
+						continue;		// not touching
+
+					if (count == maxcount)
+					{
+						Com_Printf ("SV_AreaEdicts: MAXCOUNT\n");
+						return count;
+					}
+
+					list[count] = check;
+					count++;
+				}
+			}
 		}
-
-		area_list[area_count] = check;
-		area_count++;
 	}
-	
-	if (node->axis == -1)
-		return;		// terminal node
-
-	// recurse down both sides
-	if ( area_maxs[node->axis] > node->dist )
-		SV_AreaEdicts_r ( node->children[0] );
-	if ( area_mins[node->axis] < node->dist )
-		SV_AreaEdicts_r ( node->children[1] );
-}
-
-/*
-================
-SV_AreaEdicts
-================
-*/
-int32_t SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list,
-	int32_t maxcount, int32_t areatype)
-{
-	area_mins = mins;
-	area_maxs = maxs;
-	area_list = list;
-	area_count = 0;
-	area_maxcount = maxcount;
-	area_type = areatype;
-
-	SV_AreaEdicts_r (sv_areanodes);
 
-	return area_count;
+	return count;
 }
 
 